@@ -37,10 +37,10 @@ class TArrayList
 public:
 
     TArrayList( u32 Grow=ARRAYLIST_DEFAULT_ARRAY_GROWSIZE )
-        : m_GrowSize( Grow )
-        , m_DataCount( 0 )
+        : m_pData( 0 )
+        , m_GrowSize( Grow )
         , m_AllocatedMem( 0 )
-        , m_pData( 0 )
+        , m_DataCount( 0 )
     {
     }
 
@@ -27,6 +27,7 @@
 #include "Defines.h"
 #include "DataTypes.h"
 #include "Debug.h"
+#include "Profiler.h"
 #include "Errors.h"
 #include "Assert.h"
 #include "Math.h"
@@ -14,16 +14,52 @@
 
 #include "BaseTypes.h"
 #include "Debug.h"
+#include "LogFormat.h"
 
 #ifdef DEBUG_BUILD
 
-#include <direct.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #if defined ( WIN32 ) || defined ( WIN64 )
 #define _WIN32_WINNT 0x0400 
+#include <direct.h>
 #include <windows.h>  // For LPCRITICAL_SECTION
+
+#define LOG_FOLDER_FORMAT   "..\\Logs\\%.2d%.2d%.2d%.2d\\"
+
+// Gathered writes fall back to one fwrite per segment
+struct iovec
+{
+    void* iov_base;
+    size_t iov_len;
+};
+#define IOV_MAX             64
+#else
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define LOG_FOLDER_FORMAT   "../Logs/%.2d%.2d%.2d%.2d/"
+
+#define _mkdir( Path )                      mkdir( (Path), 0777 )
+#define localtime_s( pDate, pTime )         localtime_r( (pTime), (pDate) )
+#define sprintf_s                           snprintf
+#define vsprintf_s                          vsnprintf
+
+static int fopen_s( FILE** ppFile, const char* FileName, const char* Mode )
+{
+    *ppFile = fopen( FileName, Mode );
+    return (*ppFile != NULL) ? 0 : errno;
+}
 #endif
 
 #define MAX_STRING_LENGTH 2048
@@ -48,21 +84,230 @@ COMPILE_ASSERT( sizeof( s_LogFiles ) / sizeof( s_LogFiles[ 0 ] ) == LogType::e_L
 
 static Debug::Debugger* s_Debugger = NULL;
 
+// Levels used while there is no debugger, everything off
+static std::atomic<u8> s_aLogLevelsOff[ LogType::e_LogTypeCount ];
+
+std::atomic<u8>* Debug::g_pLogLevels = s_aLogLevelsOff;
+
+// Source of the serial numbers that tie thread local buffers to their debugger
+static std::atomic<u32> s_DebuggerSerial( 0 );
+
+
+namespace Debug
+{
+    namespace RecordKind = LogFormat::RecordKind;
+    namespace ArgKind = LogFormat::ArgKind;
+    using LogFormat::RecordHeader;
+    using LogFormat::MessageHeader;
+
+
+    ///////////////////////////////////////////////////////////////////////////
+    // LogBuffer - Single producer / single consumer ring of log records.  Only
+    // the owning thread writes records and only the writer thread reads them.
+    class LogBuffer
+    {
+    public:
+
+        LogBuffer( u32 Capacity, u32 Serial, u32 Index )
+            : m_Head( 0 )
+            , m_Tail( 0 )
+            , m_Dropped( 0 )
+            , m_Serial( Serial )
+            , m_Index( Index )
+            , m_pNext( NULL )
+        {
+            // Records are RecordHeader aligned, so the end of the buffer always has room for a
+            // padding record, and the capacity must be a power of 2.  The minimum leaves room for
+            // the largest record even when it has to wrap around.
+            m_Capacity = 16 * 1024;
+            while ( m_Capacity < Capacity )
+            {
+                m_Capacity <<= 1;
+            }
+            m_pData = new u8[ m_Capacity ];
+        }
+
+        ~LogBuffer( void )
+        {
+            delete [] m_pData;
+        }
+
+        // Producer: reserves Size bytes of contiguous space for a record, returns NULL when full
+        u8* Reserve( u32 Size )
+        {
+            u32 Head = m_Head.load( std::memory_order_relaxed );
+            u32 Offset = Head & (m_Capacity - 1);
+            u32 Padding = (Offset + Size > m_Capacity) ? m_Capacity - Offset : 0;
+
+            if ( Head + Padding + Size - m_Tail.load( std::memory_order_acquire ) > m_Capacity )
+            {
+                return NULL;
+            }
+
+            if ( Padding != 0 )
+            {
+                RecordHeader* pHeader = reinterpret_cast<RecordHeader*>(m_pData + Offset);
+                pHeader->Size = Padding;
+                pHeader->Kind = RecordKind::e_Padding;
+                m_Head.store( Head + Padding, std::memory_order_release );
+                Offset = 0;
+            }
+
+            return m_pData + Offset;
+        }
+
+        // Producer: publishes a record written into reserved space, returns the bytes pending
+        u32 Commit( u32 Size )
+        {
+            u32 Head = m_Head.load( std::memory_order_relaxed ) + Size;
+            m_Head.store( Head, std::memory_order_release );
+            return Head - m_Tail.load( std::memory_order_relaxed );
+        }
+
+        // Consumer: the pending records lie between the tail and the head
+        u32 GetHead( void ) const   { return m_Head.load( std::memory_order_acquire ); }
+        u32 GetTail( void ) const   { return m_Tail.load( std::memory_order_relaxed ); }
+        void Release( u32 Tail )    { m_Tail.store( Tail, std::memory_order_release ); }
+
+        const RecordHeader* GetRecord( u32 Position ) const
+        {
+            return reinterpret_cast<const RecordHeader*>(m_pData + (Position & (m_Capacity - 1)));
+        }
+
+        std::atomic<u32> m_Head;
+        std::atomic<u32> m_Tail;
+        std::atomic<u32> m_Dropped;
+
+        u8* m_pData;
+        u32 m_Capacity;
+        u32 m_Serial;
+        u32 m_Index;
+
+        LogBuffer* m_pNext;
+    };
+
+
+    ///////////////////////////////////////////////////////////////////////////
+    // FormatEntry - A format string registered for binary logging
+    struct FormatEntry
+    {
+        std::atomic<const char*> Format;    // Published last; the key of the entry
+        const char* pDefinition;            // The format, set before the writer sees the entry
+        u32 Id;                             // 0 if the format cannot be deferred
+        u32 ArgCount;
+        u32 FixedSize;                      // Size of the arguments other than the characters of strings
+        u8* pArgs;                          // ArgKind in the low bits, '*' count in the high bits
+    };
+
+
+    ///////////////////////////////////////////////////////////////////////////
+    // LogWriter - Owns the writer thread and the list of thread buffers
+    class LogWriter
+    {
+    public:
+
+        LogWriter( Debugger* pDebugger );
+        ~LogWriter( void );
+
+        LogBuffer* AddBuffer( void );
+
+        u32 GetSerial( void ) const { return m_Serial; }
+
+        const FormatEntry* GetFormat( const char* Format )
+        {
+            // Lock free lookup of the format by address; formats are string literals
+            for( size_t Slot = HashFormat( Format ); ; Slot = (Slot + 1) & (sm_kFormatTableSize - 1) )
+            {
+                const char* Key = m_aFormats[ Slot ].Format.load( std::memory_order_acquire );
+                if( Key == Format )
+                {
+                    return &m_aFormats[ Slot ];
+                }
+                else if( Key == NULL )
+                {
+                    return AddFormat( Format );
+                }
+            }
+        }
+
+        // Wakes the writer ahead of the flush interval
+        void Wake( void )
+        {
+            if ( !m_bWakePending.exchange( true, std::memory_order_relaxed ) )
+            {
+                m_WakeCondition.notify_one();
+            }
+        }
+
+        void Flush( void );
+
+    protected:
+
+        static const u32 sm_kFormatTableSize = 4096;
+
+        static size_t HashFormat( const char* Format )
+        {
+            return ((reinterpret_cast<size_t>(Format) >> 2) * 2654435761u) & (sm_kFormatTableSize - 1);
+        }
+
+        const FormatEntry* AddFormat( const char* Format );
+
+        void Run( void );
+        void Drain( void );
+        void WriteDefinitions( void );
+        void Write( FILE* pFile, std::vector<iovec>& Segments );
+
+        Debugger* m_pDebugger;
+        u32 m_Serial;
+
+        std::atomic<LogBuffer*> m_pBuffers;
+
+        std::mutex m_Mutex;
+        std::condition_variable m_WakeCondition;
+        std::condition_variable m_DoneCondition;
+        std::atomic<bool> m_bWakePending;
+        Bool m_bQuit;
+        u64 m_FlushRequested;
+        u64 m_FlushCompleted;
+
+        // Scratch for a drain; entries point straight into the buffers
+        std::vector<iovec> m_aSegments[ LogType::e_LogTypeCount ];
+        std::vector<iovec> m_BinarySegments;
+        char m_aszPrefixes[ LogType::e_LogTypeCount ][ 32 ];
+        char m_szDropped[ 64 ];
+
+        // Formats registered for binary logging, in the order they must be written
+        std::mutex m_FormatMutex;
+        FormatEntry m_aFormats[ sm_kFormatTableSize ];
+        const FormatEntry* m_apDefinitions[ sm_kFormatTableSize ];
+        std::atomic<u32> m_DefinitionCount;
+        u32 m_DefinitionsWritten;
+        u32 m_FormatCount;
+        std::vector<u8> m_DefinitionData;
+        std::atomic<u32> m_BufferCount;
+
+        std::thread m_Thread;
+    };
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // Init - Initialize Debug functionality (call once for each dll)
 void Debug::Init( Debug::Debugger* p_Debugger )
 {
 	// Store the pointed to the debugging interface
 	s_Debugger = p_Debugger;
+    g_pLogLevels = (s_Debugger != NULL) ? s_Debugger->GetLogLevels() : s_aLogLevelsOff;
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////
 // Startup - Startup Debug functionality (called once by the application)
-void Debug::Startup( Bool bLogging )
+void Debug::Startup( Bool bLogging, const LogConfig& Config )
 {
 	// Create instance of debugger interface
-	s_Debugger = new Debugger(bLogging);
+	s_Debugger = new Debugger( bLogging, Config );
+    g_pLogLevels = s_Debugger->GetLogLevels();
 }
 
 
@@ -73,6 +318,7 @@ void Debug::Shutdown( void )
 	// Release s_Debugger resources
 	if( s_Debugger )
 	{
+        g_pLogLevels = s_aLogLevelsOff;
 		delete s_Debugger;
 		s_Debugger = NULL;
 	}
@@ -87,6 +333,26 @@ Debug::Debugger* Debug::GetDebugger( void )
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+// SetLogLevel - Sets the level of a log type; takes effect immediately
+void Debug::SetLogLevel( LogType::LogType Type, LogLevel::LogLevel Level )
+{
+    if( s_Debugger )
+    {
+        s_Debugger->SetLogLevel( Type, Level );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetLogTypeName - Returns the system name of a log type
+const char* Debug::GetLogTypeName( LogType::LogType Type )
+{
+    ASSERT( Type < LogType::e_LogTypeCount );
+    return (Type == LogType::e_Debug) ? "Debug" : s_LogFiles[ Type ].SystemName;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // Print - Print a debug string to the output window
 void Debug::Print( const char* Format, ... )
@@ -102,16 +368,24 @@ void Debug::Print( const char* Format, ... )
 
 ///////////////////////////////////////////////////////////////////////////////
 // Debugger - Constructor for debugger class
-Debug::Debugger::Debugger(Bool bLogging)
+Debug::Debugger::Debugger( Bool bLogging, const LogConfig& Config )
+    : m_Config( Config )
+    , m_pWriter( NULL )
+    , m_pBinaryFile( NULL )
 {
     m_bLogging = bLogging;
 
+    // Log everything but verbose messages by default
+    for( u32 Type = 0; Type < LogType::e_LogTypeCount; Type++ )
+    {
+        m_aLogLevels[ Type ].store( static_cast<u8>(m_bLogging ? LogLevel::e_Info : LogLevel::e_None),
+                                    std::memory_order_relaxed );
+    }
+
 #if defined ( WIN32 ) || defined ( WIN64 )
     // Create critical section
     m_CsFileWrite = new CRITICAL_SECTION;
     InitializeCriticalSection( m_CsFileWrite );
-#else
-    ASSERT( False );  // Only Windows critical sections are supported
 #endif
 
     if(m_bLogging)
@@ -128,7 +402,7 @@ Debug::Debugger::Debugger(Bool bLogging)
 	    localtime_s( &Date, &Time );
 
 	    char FolderName[ MAX_STRING_LENGTH ];
-	    sprintf_s( FolderName, MAX_STRING_LENGTH, "..\\Logs\\%.2d%.2d%.2d%.2d\\", (Date.tm_mon + 1), Date.tm_mday, Date.tm_hour, Date.tm_min );
+	    sprintf_s( FolderName, MAX_STRING_LENGTH, LOG_FOLDER_FORMAT, (Date.tm_mon + 1), Date.tm_mday, Date.tm_hour, Date.tm_min );
 
 	    int Result = _mkdir( FolderName );
         
@@ -139,12 +413,22 @@ Debug::Debugger::Debugger(Bool bLogging)
 	        for( u8 Index = 0; Index < LogType::e_LogTypeCount; Index++ )
 	        {
 		        char FileName[ MAX_STRING_LENGTH ];
-		        strncpy_s( FileName, MAX_STRING_LENGTH, FolderName, MAX_STRING_LENGTH - strlen( m_LogFiles[ Index ].FileName ) );
-		        strcat_s( FileName, MAX_STRING_LENGTH, m_LogFiles[ Index ].FileName );
+		        sprintf_s( FileName, MAX_STRING_LENGTH, "%s%s", FolderName, m_LogFiles[ Index ].FileName );
 
 		        fopen_s( &m_LogFiles[ Index ].FileHandle, FileName, "w" );
 	        }
+
+            // Binary messages from all the log types share one file
+            if( m_Config.BinaryTypes != 0 )
+            {
+		        char FileName[ MAX_STRING_LENGTH + 16 ];
+		        sprintf_s( FileName, sizeof( FileName ), "%sDebug.bin", FolderName );
+
+		        fopen_s( &m_pBinaryFile, FileName, "wb" );
+            }
         }
+
+        m_pWriter = new LogWriter( this );
     }
 }
 
@@ -153,6 +437,9 @@ Debug::Debugger::Debugger(Bool bLogging)
 // Debugger - Destructor for debugger class
 Debug::Debugger::~Debugger()
 {
+    // Stopping the writer writes out everything still buffered
+    SAFE_DELETE( m_pWriter );
+
 #if defined ( WIN32 ) || defined ( WIN64 )
     // Release critical sections
     DeleteCriticalSection( m_CsFileWrite );
@@ -164,8 +451,16 @@ Debug::Debugger::~Debugger()
 	    // Close all the log files
 	    for( u8 Index = 0; Index < LogType::e_LogTypeCount; Index++ )
 	    {
-		    fclose( m_LogFiles[ Index ].FileHandle );
+            if( m_LogFiles[ Index ].FileHandle )
+            {
+		        fclose( m_LogFiles[ Index ].FileHandle );
+            }
 	    }
+
+        if( m_pBinaryFile )
+        {
+            fclose( m_pBinaryFile );
+        }
     }
 }
 
@@ -187,7 +482,7 @@ void Debug::Debugger::Print( const char* Format, va_list ArgList )
 	// Leave the critical section
 	LeaveCriticalSection( m_CsFileWrite );
 #else
-	vsprintf( _Format, Args );
+	vfprintf( stderr, Format, ArgList );
 #endif
 }
 
@@ -201,46 +496,594 @@ void Debug::Debugger::Log( LogType::LogType Type, const char* Format, va_list Ar
 
 	ASSERT( m_LogFiles[ Type ].FileHandle );
 
-	// Write to the appropriate log file
-	vfprintf( m_LogFiles[ Type ].FileHandle, Format, ArgList );
-	fflush( m_LogFiles[ Type ].FileHandle );
+    // Leave the formatting to the log decoder if the type is logged in binary
+    if( (m_Config.BinaryTypes & (1 << Type)) && LogBinary( Type, Format, ArgList ) )
+    {
+        return;
+    }
 
-	// Format the string
+	// Format the string once; the writer thread does the file and window output
 	char Buffer[ MAX_STRING_LENGTH ];
-	vsprintf_s( Buffer, MAX_STRING_LENGTH, Format, ArgList );
-	OutputDebugStringA( Buffer );
+	int Length = vsprintf_s( Buffer, MAX_STRING_LENGTH, Format, ArgList );
+    if( Length < 0 )
+    {
+        return;
+    }
+    else if( Length >= MAX_STRING_LENGTH )
+    {
+        Length = MAX_STRING_LENGTH - 1;
+    }
+
+    Push( Type, RecordKind::e_Text, Buffer, Length + 1 );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// LogBinary - Logs the format id and the raw arguments, returns False if the
+// format has to be formatted as text
+Bool Debug::Debugger::LogBinary( LogType::LogType Type, const char* Format, va_list ArgList )
+{
+    if( m_pWriter == NULL || m_pBinaryFile == NULL )
+    {
+        return False;
+    }
+
+    const FormatEntry* pFormat = m_pWriter->GetFormat( Format );
+    if( pFormat == NULL || pFormat->Id == 0 )
+    {
+        return False;
+    }
+
+    u8 Buffer[ MAX_STRING_LENGTH ];
+
+    // The writer thread fills in the thread index
+    u64 Time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch() ).count();
+    MessageHeader Header = { pFormat->Id, 0, 0, static_cast<u32>(Time), static_cast<u32>(Time >> 32) };
+    memcpy( Buffer, &Header, sizeof( Header ) );
+
+    u8* pArg = Buffer + sizeof( Header );
+    u32 StringSpace = sizeof( Buffer ) - sizeof( Header ) - pFormat->FixedSize;
+
+    for( u32 Index = 0; Index < pFormat->ArgCount; Index++ )
+    {
+        for( u32 Star = pFormat->pArgs[ Index ] >> 4; Star > 0; Star-- )
+        {
+            i32 Value = va_arg( ArgList, int );
+            memcpy( pArg, &Value, sizeof( Value ) );
+            pArg += sizeof( Value );
+        }
+
+        switch( pFormat->pArgs[ Index ] & 0xF )
+        {
+        case ArgKind::e_Int32:
+        {
+            i32 Value = va_arg( ArgList, int );
+            memcpy( pArg, &Value, sizeof( Value ) );
+            pArg += sizeof( Value );
+            break;
+        }
+
+        case ArgKind::e_Int64:
+        {
+            i64 Value = va_arg( ArgList, long long );
+            memcpy( pArg, &Value, sizeof( Value ) );
+            pArg += sizeof( Value );
+            break;
+        }
+
+        case ArgKind::e_Double:
+        {
+            f64 Value = va_arg( ArgList, double );
+            memcpy( pArg, &Value, sizeof( Value ) );
+            pArg += sizeof( Value );
+            break;
+        }
+
+        case ArgKind::e_Pointer:
+        {
+            u64 Value = reinterpret_cast<size_t>(va_arg( ArgList, void* ));
+            memcpy( pArg, &Value, sizeof( Value ) );
+            pArg += sizeof( Value );
+            break;
+        }
+
+        case ArgKind::e_String:
+        {
+            const char* pszValue = va_arg( ArgList, const char* );
+            if( pszValue == NULL )
+            {
+                pszValue = "(null)";
+            }
+
+            // Strings share whatever the fixed size arguments leave and are truncated to fit
+            size_t Length = strlen( pszValue );
+            u16 Stored = static_cast<u16>((Length < StringSpace) ? Length : StringSpace);
+            StringSpace -= Stored;
+
+            memcpy( pArg, &Stored, sizeof( Stored ) );
+            memcpy( pArg + sizeof( Stored ), pszValue, Stored );
+            pArg += sizeof( Stored ) + Stored;
+            break;
+        }
+        }
+    }
+
+    Push( Type, RecordKind::e_Binary, Buffer, static_cast<u32>(pArg - Buffer) );
+    return True;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SetLogLevel - Sets the level of a log type
+void Debug::Debugger::SetLogLevel( LogType::LogType Type, LogLevel::LogLevel Level )
+{
+    ASSERT( Type < LogType::e_LogTypeCount && Level < LogLevel::e_LevelCount );
+
+    // Without log files there is nowhere to log to
+    if( m_bLogging )
+    {
+        m_aLogLevels[ Type ].store( static_cast<u8>(Level), std::memory_order_relaxed );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Flush - Blocks until everything logged so far is written
+void Debug::Debugger::Flush( void )
+{
+    if( m_pWriter )
+    {
+        m_pWriter->Flush();
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetThreadBuffer - Returns the calling thread's log buffer, creating it on first use
+Debug::LogBuffer* Debug::Debugger::GetThreadBuffer( void )
+{
+    static thread_local LogBuffer* t_pBuffer = NULL;
+    static thread_local u32 t_Serial = 0;
+
+    // Buffers belong to a debugger and are freed with it, so a new debugger must not touch a
+    // stale one
+    if( t_pBuffer == NULL || t_Serial != m_pWriter->GetSerial() )
+    {
+        t_pBuffer = m_pWriter->AddBuffer();
+        t_Serial = m_pWriter->GetSerial();
+    }
+
+    return t_pBuffer;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Push - Copies a record into the calling thread's log buffer
+void Debug::Debugger::Push( LogType::LogType Type, u8 Kind, const void* pData, u32 Size )
+{
+    if( m_pWriter == NULL )
+    {
+        return;
+    }
+
+    LogBuffer* pBuffer = GetThreadBuffer();
+    u32 RecordSize = (sizeof( RecordHeader ) + Size + sizeof( RecordHeader ) - 1) &
+                     ~(sizeof( RecordHeader ) - 1);
+    ASSERT( RecordSize <= pBuffer->m_Capacity / 2 );
+
+    u8* pRecord = pBuffer->Reserve( RecordSize );
+    while( pRecord == NULL )
+    {
+        m_pWriter->Wake();
+
+        if( m_Config.WhenFull == FullPolicy::e_Drop )
+        {
+            pBuffer->m_Dropped.fetch_add( 1, std::memory_order_relaxed );
+            return;
+        }
+
+        std::this_thread::yield();
+        pRecord = pBuffer->Reserve( RecordSize );
+    }
+
+    RecordHeader* pHeader = reinterpret_cast<RecordHeader*>(pRecord);
+    pHeader->Size = RecordSize;
+    pHeader->Type = static_cast<u8>(Type);
+    pHeader->Kind = Kind;
+    pHeader->Length = static_cast<u16>(Size);
+    memcpy( pHeader + 1, pData, Size );
+    memset( reinterpret_cast<u8*>(pHeader + 1) + Size, 0, RecordSize - sizeof( RecordHeader ) - Size );
+
+    if( pBuffer->Commit( RecordSize ) >= m_Config.FlushThreshold )
+    {
+        m_pWriter->Wake();
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// LogWriter - Starts the writer thread
+Debug::LogWriter::LogWriter( Debugger* pDebugger )
+    : m_pDebugger( pDebugger )
+    , m_Serial( ++s_DebuggerSerial )
+    , m_pBuffers( NULL )
+    , m_bWakePending( false )
+    , m_bQuit( False )
+    , m_FlushRequested( 0 )
+    , m_FlushCompleted( 0 )
+    , m_DefinitionCount( 0 )
+    , m_DefinitionsWritten( 0 )
+    , m_FormatCount( 0 )
+    , m_BufferCount( 0 )
+{
+    // The general log prefixes system messages with the system name
+    for( u32 Type = 0; Type < LogType::e_LogTypeCount; Type++ )
+    {
+        sprintf_s( m_aszPrefixes[ Type ], sizeof( m_aszPrefixes[ Type ] ), "[%s] ", s_LogFiles[ Type ].SystemName );
+    }
+
+    for( u32 Slot = 0; Slot < sm_kFormatTableSize; Slot++ )
+    {
+        m_aFormats[ Slot ].Format.store( NULL, std::memory_order_relaxed );
+        m_aFormats[ Slot ].pArgs = NULL;
+    }
+
+    // The binary log starts with the names of the log types
+    FILE* pBinaryFile = m_pDebugger->m_pBinaryFile;
+    if( pBinaryFile != NULL )
+    {
+        LogFormat::FileHeader Header = { LogFormat::Magic, LogFormat::Version };
+        fwrite( &Header, sizeof( Header ), 1, pBinaryFile );
+
+        for( u32 Type = 0; Type < LogType::e_LogTypeCount; Type++ )
+        {
+            u32 Length = static_cast<u32>(strlen( s_LogFiles[ Type ].SystemName )) + 1;
+            RecordHeader Record = { static_cast<u32>(sizeof( RecordHeader ) + Length + 3) & ~3, static_cast<u8>(Type),
+                                    RecordKind::e_TypeName, static_cast<u16>(Length) };
+            u32 Padding = 0;
+
+            fwrite( &Record, sizeof( Record ), 1, pBinaryFile );
+            fwrite( s_LogFiles[ Type ].SystemName, Length, 1, pBinaryFile );
+            fwrite( &Padding, Record.Size - sizeof( Record ) - Length, 1, pBinaryFile );
+        }
+        fflush( pBinaryFile );
+    }
+
+    m_Thread = std::thread( &LogWriter::Run, this );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ~LogWriter - Stops the writer thread after a final drain
+Debug::LogWriter::~LogWriter( void )
+{
+    {
+        std::lock_guard<std::mutex> Lock( m_Mutex );
+        m_bQuit = True;
+    }
+    m_WakeCondition.notify_one();
+    m_Thread.join();
+
+    LogBuffer* pBuffer = m_pBuffers.load();
+    while( pBuffer != NULL )
+    {
+        LogBuffer* pNext = pBuffer->m_pNext;
+        delete pBuffer;
+        pBuffer = pNext;
+    }
+
+    for( u32 Slot = 0; Slot < sm_kFormatTableSize; Slot++ )
+    {
+        delete [] m_aFormats[ Slot ].pArgs;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// AddBuffer - Creates a buffer and publishes it to the writer thread
+Debug::LogBuffer* Debug::LogWriter::AddBuffer( void )
+{
+    LogBuffer* pBuffer = new LogBuffer( m_pDebugger->m_Config.BufferSize, m_Serial, m_BufferCount++ );
+
+    pBuffer->m_pNext = m_pBuffers.load( std::memory_order_relaxed );
+    while( !m_pBuffers.compare_exchange_weak( pBuffer->m_pNext, pBuffer, std::memory_order_release,
+                                              std::memory_order_relaxed ) )
+    {
+    }
+
+    return pBuffer;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// AddFormat - Registers a format string for binary logging
+const Debug::FormatEntry* Debug::LogWriter::AddFormat( const char* Format )
+{
+    std::lock_guard<std::mutex> Lock( m_FormatMutex );
+
+    size_t Slot = HashFormat( Format );
+    for( ; ; Slot = (Slot + 1) & (sm_kFormatTableSize - 1) )
+    {
+        const char* Key = m_aFormats[ Slot ].Format.load( std::memory_order_relaxed );
+        if( Key == Format )
+        {
+            // Another thread added it first
+            return &m_aFormats[ Slot ];
+        }
+        else if( Key == NULL )
+        {
+            break;
+        }
+    }
+
+    // Keep the table at most half full so lookups stay short; extra formats are logged as text
+    if( m_FormatCount >= sm_kFormatTableSize / 2 )
+    {
+        return NULL;
+    }
+
+    FormatEntry& Entry = m_aFormats[ Slot ];
+    Entry.Id = 0;
+    Entry.ArgCount = 0;
+    Entry.FixedSize = 0;
+
+    LogFormat::Conversion Spec;
+    const char* pCursor = Format;
+    Bool bValid = True;
+    std::vector<u8> Args;
+
+    while( LogFormat::NextConversion( pCursor, Spec ) )
+    {
+        if( Spec.Arg == ArgKind::e_None )
+        {
+            continue;
+        }
+        else if( Spec.Arg == ArgKind::e_Invalid )
+        {
+            bValid = False;
+            break;
+        }
+
+        static const u32 s_aArgSizes[] = { 0, 4, 8, 8, 8, sizeof( u16 ) };
+        Entry.FixedSize += Spec.StarCount * sizeof( i32 ) + s_aArgSizes[ Spec.Arg ];
+        Args.push_back( static_cast<u8>(Spec.Arg | (Spec.StarCount << 4)) );
+    }
+
+    if( bValid && Entry.FixedSize <= MAX_STRING_LENGTH / 2 )
+    {
+        u32 Count = m_DefinitionCount.load( std::memory_order_relaxed );
+
+        Entry.Id = Count + 1;
+        Entry.pDefinition = Format;
+        Entry.ArgCount = static_cast<u32>(Args.size());
+        Entry.pArgs = new u8[ Args.size() + 1 ];
+        if( !Args.empty() )
+        {
+            memcpy( Entry.pArgs, &Args[ 0 ], Args.size() );
+        }
+
+        // The writer thread picks up the definition before any message can use it
+        m_apDefinitions[ Count ] = &Entry;
+        m_DefinitionCount.store( Count + 1, std::memory_order_release );
+    }
+    m_FormatCount++;
+
+    Entry.Format.store( Format, std::memory_order_release );
+    return &Entry;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Flush - Has the writer thread drain all the buffers and waits for it
+void Debug::LogWriter::Flush( void )
+{
+    std::unique_lock<std::mutex> Lock( m_Mutex );
+
+    u64 Request = ++m_FlushRequested;
+    m_WakeCondition.notify_one();
+    m_DoneCondition.wait( Lock, [&]{ return m_FlushCompleted >= Request; } );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Run - Writer thread; drains the buffers every flush interval or when woken
+void Debug::LogWriter::Run( void )
+{
+    std::chrono::milliseconds Interval( m_pDebugger->m_Config.FlushInterval );
+    std::unique_lock<std::mutex> Lock( m_Mutex );
+
+    for( ;; )
+    {
+        m_WakeCondition.wait_for( Lock, Interval, [&]{
+            return m_bQuit || m_FlushRequested != m_FlushCompleted ||
+                   m_bWakePending.load( std::memory_order_relaxed );
+        } );
+        m_bWakePending.store( false, std::memory_order_relaxed );
+
+        Bool bQuit = m_bQuit;
+        u64 Request = m_FlushRequested;
+
+        Lock.unlock();
+        Drain();
+        Lock.lock();
+
+        m_FlushCompleted = Request;
+        m_DoneCondition.notify_all();
+
+        if( bQuit )
+        {
+            break;
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Drain - Writes out the records pending in every buffer
+void Debug::LogWriter::Drain( void )
+{
+    LogBuffer* pBuffer = m_pBuffers.load( std::memory_order_acquire );
+
+    for( ; pBuffer != NULL; pBuffer = pBuffer->m_pNext )
+    {
+        u32 Head = pBuffer->GetHead();
+        u32 Tail = pBuffer->GetTail();
+
+        u32 Dropped = pBuffer->m_Dropped.exchange( 0, std::memory_order_relaxed );
+        if( Dropped != 0 )
+        {
+            int Length = sprintf_s( m_szDropped, sizeof( m_szDropped ), "[Log] %u messages dropped\n", Dropped );
+            iovec Segment = { m_szDropped, static_cast<size_t>(Length) };
+            m_aSegments[ LogType::e_Debug ].push_back( Segment );
+            Write( m_pDebugger->m_LogFiles[ LogType::e_Debug ].FileHandle, m_aSegments[ LogType::e_Debug ] );
+        }
+
+        if( Head == Tail )
+        {
+            continue;
+        }
+
+        // Formats registered before the records were committed have to be written first
+        WriteDefinitions();
+
+        // Gather the records without copying them
+        for( u32 Position = Tail; Position != Head; )
+        {
+            RecordHeader* pHeader = const_cast<RecordHeader*>(pBuffer->GetRecord( Position ));
+            Position += pHeader->Size;
+
+            if( pHeader->Kind == RecordKind::e_Binary )
+            {
+                u16 ThreadIndex = static_cast<u16>(pBuffer->m_Index);
+                memcpy( reinterpret_cast<u8*>(pHeader + 1) + offsetof( MessageHeader, ThreadIndex ),
+                        &ThreadIndex, sizeof( ThreadIndex ) );
+
+                iovec Record = { pHeader, pHeader->Size };
+                m_BinarySegments.push_back( Record );
+                continue;
+            }
+            else if( pHeader->Kind != RecordKind::e_Text )
+            {
+                continue;
+            }
+
+            iovec Text = { pHeader + 1, static_cast<size_t>(pHeader->Length - 1) };
+            m_aSegments[ pHeader->Type ].push_back( Text );
 
-	// If this is a system specific log file, also log it to the general log
-	if( Type != LogType::e_Debug )
-	{
-		ASSERT( m_LogFiles[ LogType::e_Debug ].FileHandle );
-		
 #if defined ( WIN32 ) || defined ( WIN64 )
-		// Try to enter the critical section
-		u32 Index;
-		for( Index = 0; Index < 1000; Index++ )
-		{
-			if( TryEnterCriticalSection( m_CsFileWrite ) )
-			{
-				break;
-			}
-			Sleep(1);
-		}
-
-		// If we failed to enter, call the full EnterCriticalSection and wait
-		if( Index == 1000 )
-		{
-			EnterCriticalSection( m_CsFileWrite );
-		}
-		
-		// Print the string
-		fprintf_s( m_LogFiles[ LogType::e_Debug ].FileHandle, "[%s] %s", m_LogFiles[ Type ].SystemName, Buffer );
-		fflush( m_LogFiles[ LogType::e_Debug ].FileHandle );
-
-		// Leave the critical section
-		LeaveCriticalSection( m_CsFileWrite );
+            OutputDebugStringA( reinterpret_cast<const char*>(pHeader + 1) );
 #endif
-	}
+
+            // If this is a system specific message, also log it to the general log
+            if( pHeader->Type != LogType::e_Debug )
+            {
+                iovec Prefix = { m_aszPrefixes[ pHeader->Type ], strlen( m_aszPrefixes[ pHeader->Type ] ) };
+                m_aSegments[ LogType::e_Debug ].push_back( Prefix );
+                m_aSegments[ LogType::e_Debug ].push_back( Text );
+            }
+        }
+
+        for( u32 Type = 0; Type < LogType::e_LogTypeCount; Type++ )
+        {
+            Write( m_pDebugger->m_LogFiles[ Type ].FileHandle, m_aSegments[ Type ] );
+        }
+        Write( m_pDebugger->m_pBinaryFile, m_BinarySegments );
+
+        // The segments point into the buffer so it can only be reused once they are written
+        pBuffer->Release( Head );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// WriteDefinitions - Writes the formats registered since the last call to the
+// binary log
+void Debug::LogWriter::WriteDefinitions( void )
+{
+    u32 Count = m_DefinitionCount.load( std::memory_order_acquire );
+    if( m_DefinitionsWritten == Count )
+    {
+        return;
+    }
+
+    m_DefinitionData.clear();
+    for( ; m_DefinitionsWritten < Count; m_DefinitionsWritten++ )
+    {
+        const FormatEntry* pEntry = m_apDefinitions[ m_DefinitionsWritten ];
+        const char* Format = pEntry->pDefinition;
+
+        // Formats longer than a record can describe are cut short; they still decode
+        size_t Length = strlen( Format ) + 1;
+        if( Length > MAX_STRING_LENGTH )
+        {
+            Length = MAX_STRING_LENGTH;
+        }
+
+        u32 Size = static_cast<u32>(sizeof( RecordHeader ) + sizeof( LogFormat::FormatHeader ) + Length + 3) & ~3;
+        RecordHeader Record = { Size, LogType::e_Debug, RecordKind::e_Format,
+                                static_cast<u16>(sizeof( LogFormat::FormatHeader ) + Length) };
+        LogFormat::FormatHeader Header = { pEntry->Id };
+
+        size_t Offset = m_DefinitionData.size();
+        m_DefinitionData.resize( Offset + Size, 0 );
+        memcpy( &m_DefinitionData[ Offset ], &Record, sizeof( Record ) );
+        memcpy( &m_DefinitionData[ Offset + sizeof( Record ) ], &Header, sizeof( Header ) );
+        memcpy( &m_DefinitionData[ Offset + sizeof( Record ) + sizeof( Header ) ], Format, Length - 1 );
+    }
+
+    iovec Segment = { &m_DefinitionData[ 0 ], m_DefinitionData.size() };
+    m_BinarySegments.push_back( Segment );
+    Write( m_pDebugger->m_pBinaryFile, m_BinarySegments );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Write - Writes and clears the segments gathered for a log file
+void Debug::LogWriter::Write( FILE* pFile, std::vector<iovec>& Segments )
+{
+    if( pFile != NULL && !Segments.empty() )
+    {
+#if defined ( WIN32 ) || defined ( WIN64 )
+        for( size_t Index = 0; Index < Segments.size(); Index++ )
+        {
+            fwrite( Segments[ Index ].iov_base, 1, Segments[ Index ].iov_len, pFile );
+        }
+        fflush( pFile );
+#else
+        int Descriptor = fileno( pFile );
+        iovec* pSegments = &Segments[ 0 ];
+        size_t Count = Segments.size();
+
+        while( Count > 0 )
+        {
+            ssize_t Written = writev( Descriptor, pSegments, static_cast<int>(Count < IOV_MAX ? Count : IOV_MAX) );
+            if( Written < 0 )
+            {
+                if( errno == EINTR )
+                {
+                    continue;
+                }
+                break;
+            }
+
+            // Skip what was written, which may end part way through a segment
+            while( Count > 0 && static_cast<size_t>(Written) >= pSegments->iov_len )
+            {
+                Written -= pSegments->iov_len;
+                pSegments++;
+                Count--;
+            }
+            if( Count > 0 )
+            {
+                pSegments->iov_base = static_cast<char*>(pSegments->iov_base) + Written;
+                pSegments->iov_len -= Written;
+            }
+        }
+#endif
+    }
+
+    Segments.clear();
 }
 
-#endif
+#endif
\ No newline at end of file
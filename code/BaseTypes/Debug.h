@@ -15,6 +15,7 @@
 #pragma once
 
 #include <stdarg.h>
+#include <atomic>
 
 //#ifdef _DEBUG
 #define DEBUG_BUILD
@@ -25,6 +26,16 @@
 						Debug::GetDebugger()->Log( (x), Format, ArgList ); \
 						va_end( ArgList );
 
+#define LOG_INFO( x )   if( Debug::IsLogEnabled( (x), LogLevel::e_Info ) ) { LOG_ACTUAL( x ) }
+
+// Logs at a level, skipping the evaluation of the arguments when the level is filtered out
+#ifdef DEBUG_BUILD
+#define DEBUG_LOG( Type, Level, ... )   do { if( Debug::IsLogEnabled( (Type), (Level) ) )    \
+                                             { Debug::LogTo( (Type), __VA_ARGS__ ); } } while( 0 )
+#else
+#define DEBUG_LOG( Type, Level, ... )   do { } while( 0 )
+#endif
+
 // Forward declares
 struct _RTL_CRITICAL_SECTION;
 typedef _RTL_CRITICAL_SECTION* PRTL_CRITICAL_SECTION;
@@ -34,8 +45,8 @@ typedef PRTL_CRITICAL_SECTION LPCRITICAL_SECTION;
 struct LogFile
 {
     FILE* FileHandle;
-    char* FileName;
-    char* SystemName;
+    const char* FileName;
+    const char* SystemName;
 };
 
 
@@ -62,58 +73,181 @@ namespace LogType {
     };
 }
 
+// Severity of log messages; a type logs the messages at or below its level
+namespace LogLevel {
+    enum LogLevel
+    {
+        e_None,         // Only valid as a level for a type, turns it off
+
+        e_Error,
+        e_Warning,
+        e_Info,         // Level of the Log functions without one
+        e_Verbose,
+
+        e_LevelCount
+    };
+}
+
 // Debugging Functionality
 namespace Debug
 {
+    // What Log does when the calling thread's log buffer is full
+    namespace FullPolicy {
+        enum FullPolicy
+        {
+            e_Drop,         // Discard the message and report the count in the general log
+            e_Block         // Wait for the writer thread to make room
+        };
+    }
+
+    // Settings for the asynchronous log writer
+    struct LogConfig
+    {
+        LogConfig( void )
+            : BufferSize( 64 * 1024 )
+            , FlushInterval( 100 )
+            , FlushThreshold( 16 * 1024 )
+            , WhenFull( FullPolicy::e_Drop )
+            , BinaryTypes( 0 )
+        {
+        }
+
+        u32 BufferSize;                     // Bytes per logging thread, rounded up to a power of 2
+        u32 FlushInterval;                  // Milliseconds between writes
+        u32 FlushThreshold;                 // Bytes pending in a buffer that wake the writer early
+        FullPolicy::FullPolicy WhenFull;
+        u32 BinaryTypes;                    // Bit (1 << LogType) defers formatting that type to the
+                                            //  log decoder by logging it in binary to Debug.bin
+    };
+
+    class LogBuffer;
+    class LogWriter;
+
+    // Log messages are formatted on the calling thread into a per thread single producer /
+    // single consumer ring buffer.  A dedicated writer thread drains the buffers and writes
+    // each log file with one gathered write, so logging never waits on file I/O.
 	class Debugger
 	{
+        friend class LogWriter;
+
 	private:
         Bool m_bLogging;
         LogFile m_LogFiles[ LogType::e_LogTypeCount ];
+        LogConfig m_Config;
+        LogWriter* m_pWriter;
+        FILE* m_pBinaryFile;
 
 		#if defined ( WIN32 ) || defined ( WIN64 )
-		LPCRITICAL_SECTION m_CsFileWrite;  // Critical section for writing to logs
+		LPCRITICAL_SECTION m_CsFileWrite;  // Critical section for writing to the output window
 		#endif
 
+        // Read without locks by IsLogEnabled
+        std::atomic<u8> m_aLogLevels[ LogType::e_LogTypeCount ];
+
+        LogBuffer* GetThreadBuffer( void );
+        void Push( LogType::LogType Type, u8 Kind, const void* pData, u32 Size );
+        Bool LogBinary( LogType::LogType Type, const char* Format, va_list ArgList );
+
 	public:
-		Debugger(Bool bLogging);
+		Debugger( Bool bLogging, const LogConfig& Config = LogConfig() );
 		~Debugger();
 		void Print( const char* Format, va_list ArgList );
         void Log( LogType::LogType Type, const char* Format, va_list ArgList );
+        void Flush( void );                 // Blocks until everything logged so far is written
+
+        void SetLogLevel( LogType::LogType Type, LogLevel::LogLevel Level );
+        std::atomic<u8>* GetLogLevels( void ) { return m_aLogLevels; }
 	};
 
+    // Parses a level name (None, Error, Warning, Info or Verbose) or number
+    inline Bool ParseLogLevel( const char* pszLevel, LogLevel::LogLevel& Level )
+    {
+        static const char* const s_apszLevels[ LogLevel::e_LevelCount ] =
+        {
+            "None", "Error", "Warning", "Info", "Verbose"
+        };
+
+        if( pszLevel == NULL || *pszLevel == '\0' )
+        {
+            return False;
+        }
+        else if( pszLevel[ 0 ] >= '0' && pszLevel[ 0 ] < '0' + LogLevel::e_LevelCount && pszLevel[ 1 ] == '\0' )
+        {
+            Level = static_cast<LogLevel::LogLevel>(pszLevel[ 0 ] - '0');
+            return True;
+        }
+
+        for( u32 Index = 0; Index < LogLevel::e_LevelCount; Index++ )
+        {
+            const char* a = pszLevel;
+            const char* b = s_apszLevels[ Index ];
+            while( *a != '\0' && (*a | 0x20) == (*b | 0x20) )
+            {
+                a++;
+                b++;
+            }
+            if( *a == '\0' && *b == '\0' )
+            {
+                Level = static_cast<LogLevel::LogLevel>(Index);
+                return True;
+            }
+        }
+        return False;
+    }
+
 #ifdef DEBUG_BUILD
 	
 	void Init( Debug::Debugger* p_Debugger );
-	void Startup( Bool bLogging = False );
+	void Startup( Bool bLogging = False, const LogConfig& Config = LogConfig() );
 	void Shutdown( void );
 
 	Debug::Debugger* GetDebugger( void );
 
+    // Levels of the debugger this module logs to, or all e_None before there is one
+    extern std::atomic<u8>* g_pLogLevels;
+
+    // Checks if a message would be logged.  A relaxed load and a compare, so it is cheap enough
+    // to guard the evaluation of the arguments (see DEBUG_LOG).
+    inline Bool IsLogEnabled( LogType::LogType Type, LogLevel::LogLevel Level )
+    {
+        return Level <= g_pLogLevels[ Type ].load( std::memory_order_relaxed );
+    }
+
+    void SetLogLevel( LogType::LogType Type, LogLevel::LogLevel Level );
+    const char* GetLogTypeName( LogType::LogType Type );
+
 	void Print( const char* Format, ... );
 
-	inline void Log( const char* Format, ... )          { LOG_ACTUAL( LogType::e_Debug );     }
-	inline void LogAI( const char* Format, ... )        { LOG_ACTUAL( LogType::e_AI );        }
-	inline void LogAnimation( const char* Format, ... ) { LOG_ACTUAL( LogType::e_Animation ); }
-	inline void LogAudio( const char* Format, ... )     { LOG_ACTUAL( LogType::e_Audio );     }
-	inline void LogFire( const char* Format, ... )      { LOG_ACTUAL( LogType::e_Fire );      }
-	inline void LogGeometry( const char* Format, ... )  { LOG_ACTUAL( LogType::e_Geometry );  }
-	inline void LogGraphics( const char* Format, ... )  { LOG_ACTUAL( LogType::e_Graphics );  }
-	inline void LogInput( const char* Format, ... )     { LOG_ACTUAL( LogType::e_Input );     }
-	inline void LogPhysics( const char* Format, ... )   { LOG_ACTUAL( LogType::e_Physics );   }
-	inline void LogSmoke( const char* Format, ... )     { LOG_ACTUAL( LogType::e_Smoke );     }
-	inline void LogTrees( const char* Format, ... )     { LOG_ACTUAL( LogType::e_Trees );     } 
+	inline void LogTo( LogType::LogType Type, const char* Format, ... ) { LOG_ACTUAL( Type ); }
+
+	inline void Log( const char* Format, ... )          { LOG_INFO( LogType::e_Debug );       }
+	inline void LogAI( const char* Format, ... )        { LOG_INFO( LogType::e_AI );          }
+	inline void LogAnimation( const char* Format, ... ) { LOG_INFO( LogType::e_Animation );   }
+	inline void LogAudio( const char* Format, ... )     { LOG_INFO( LogType::e_Audio );       }
+	inline void LogFire( const char* Format, ... )      { LOG_INFO( LogType::e_Fire );        }
+	inline void LogGeometry( const char* Format, ... )  { LOG_INFO( LogType::e_Geometry );    }
+	inline void LogGraphics( const char* Format, ... )  { LOG_INFO( LogType::e_Graphics );    }
+	inline void LogInput( const char* Format, ... )     { LOG_INFO( LogType::e_Input );       }
+	inline void LogPhysics( const char* Format, ... )   { LOG_INFO( LogType::e_Physics );     }
+	inline void LogSmoke( const char* Format, ... )     { LOG_INFO( LogType::e_Smoke );       }
+	inline void LogTrees( const char* Format, ... )     { LOG_INFO( LogType::e_Trees );       } 
 
 #else  // Debugging disable, all functions will in inline and empty (aka removed)
 	
 	inline void Init( Debug::Debugger* p_Debugger ){};
-	inline void Startup( Bool bLogging = False ){};
+	inline void Startup( Bool bLogging = False, const LogConfig& Config = LogConfig() ){};
 	inline void Shutdown( void ){};
 
 	inline Debug::Debugger* GetDebugger( void ){ return NULL; };
 
+    inline Bool IsLogEnabled( LogType::LogType Type, LogLevel::LogLevel Level ){ return False; };
+    inline void SetLogLevel( LogType::LogType Type, LogLevel::LogLevel Level ){};
+    inline const char* GetLogTypeName( LogType::LogType Type ){ return ""; };
+
 	inline void Print( const char* Format, ... ){};
 
+	inline void LogTo( LogType::LogType Type, const char* Format, ... ){};
+
 	inline void Log( const char* Format, ... ){};
 	inline void LogAI( const char* Format, ... ){};
 	inline void LogAnimation( const char* Format, ... ){};
@@ -31,9 +31,9 @@
 #define SAFE_DELETE_ARRAY( p )		        if ((p)!=NULL){delete [] (p); (p)=NULL;}
 
 
-#define UNREFERENCED_PARAM(P)               (P)
-#define DBG_UNREFERENCED_PARAM(P)           (P)
-#define DBG_UNREFERENCED_LOCAL_VAR(V)       (V)
+#define UNREFERENCED_PARAM(P)               ((void)(P))
+#define DBG_UNREFERENCED_PARAM(P)           ((void)(P))
+#define DBG_UNREFERENCED_LOCAL_VAR(V)       ((void)(V))
 
 
 #if defined( _MSC_VER )
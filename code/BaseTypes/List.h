@@ -232,16 +232,16 @@ public:
         return bFound;
     }
 
-    Bool RemoveIf( fnBinaryCompare pfnBinaryCompare /*, const T& arg1*/ )
+    Bool RemoveIf( fnBinaryCompare pfnBinaryCompare, const T& Operand )
     {
         Bool bFound = False;
 
         TListNode* pNode = m_pFirstNode;
         TListNode* pPrevNode = m_pFirstNode;
 
-        while ( pNode != NULL && !found )
+        while ( pNode != NULL && !bFound )
         {
-            if ( pfnBinaryCompare( pNode->m_Element, operand ) )
+            if ( pfnBinaryCompare( pNode->m_Element, Operand ) )
             {
                 if ( pNode == m_pFirstNode )
                 {
@@ -284,6 +284,9 @@ public:
             m_Allocator.Deallocate( reinterpret_cast<u8*>(pNode) );
             pNode = pNextNode;
         }
+
+        m_pFirstNode = NULL;
+        m_pLastNode = NULL;
     }
 
 
@@ -0,0 +1,250 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#pragma once
+
+#include <stddef.h>
+
+//
+// Layout of the log buffer records and of the binary log file, shared by the debugger and the
+// offline log decoder.
+//
+// Binary log file (Debug.bin):
+//   FileHeader
+//   Records, each a RecordHeader followed by its payload and padded to a multiple of 4 bytes:
+//     e_TypeName   Payload is the NULL terminated system name of RecordHeader::Type
+//     e_Format     Payload is a FormatHeader followed by the NULL terminated format string
+//     e_Binary     Payload is a MessageHeader followed by the raw arguments
+//
+// A format is always written before the first message that uses it.  Arguments are stored in
+// the order the format consumes them, '*' widths and precisions included:
+//   e_Int32      4 bytes
+//   e_Int64      8 bytes
+//   e_Double     8 bytes
+//   e_Pointer    8 bytes
+//   e_String     u16 length followed by the characters, not NULL terminated
+// All multi byte values are in the byte order of the machine that wrote the log.
+//
+
+namespace Debug
+{
+namespace LogFormat
+{
+    static const u32 Magic                  = 0x474C4253;   // "SBLG"
+    static const u32 Version                = 1;
+
+    // Kinds of records in a log buffer or binary log file
+    namespace RecordKind {
+        enum RecordKind
+        {
+            e_Padding,      // Skips the unused end of a ring buffer
+            e_Text,         // A formatted, NULL terminated message
+            e_Binary,       // A message with its arguments left unformatted
+            e_Format,       // Defines the format string for an id
+            e_TypeName      // Names a log type
+        };
+    }
+
+    struct FileHeader
+    {
+        u32 Magic;
+        u32 Version;
+    };
+
+    // Header preceding every record
+    struct RecordHeader
+    {
+        u32 Size;           // Size of the record including the header, a multiple of 4
+        u8 Type;            // LogType::LogType
+        u8 Kind;            // RecordKind::RecordKind
+        u16 Length;         // Size of the payload
+    };
+
+    struct FormatHeader
+    {
+        u32 FormatId;
+    };
+
+    struct MessageHeader
+    {
+        u32 FormatId;
+        u16 ThreadIndex;    // Order in which the logging thread first logged
+        u16 Reserved;
+        u32 TimeLow;        // Nanoseconds from an arbitrary start
+        u32 TimeHigh;
+    };
+
+    // Kinds of arguments consumed by a conversion
+    namespace ArgKind {
+        enum ArgKind
+        {
+            e_None,         // %%
+            e_Int32,
+            e_Int64,
+            e_Double,
+            e_Pointer,
+            e_String,
+            e_Invalid       // A conversion that cannot be deferred, e.g. wide strings
+        };
+    }
+
+    // One conversion in a printf format string
+    struct Conversion
+    {
+        const char* pStart;         // The '%'
+        const char* pModifier;      // First character of the length modifier
+        const char* pType;          // The conversion character
+        u32 StarCount;              // Number of '*' int arguments preceding the value
+        ArgKind::ArgKind Arg;
+    };
+
+
+    ///////////////////////////////////////////////////////////////////////////
+    // NextConversion - Finds the next conversion in a format string
+    //
+    // Advances pCursor past the conversion and returns False once there are no
+    // more.  Both the encoder and the decoder walk formats with this so they
+    // agree on the arguments.
+    inline Bool NextConversion( const char*& pCursor, Conversion& Spec )
+    {
+        const char* p = pCursor;
+        while( *p != '%' )
+        {
+            if( *p == '\0' )
+            {
+                pCursor = p;
+                return False;
+            }
+            p++;
+        }
+
+        Spec.pStart = p++;
+        Spec.StarCount = 0;
+
+        // Flags, width and precision
+        while( *p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' || *p == '\'' )
+        {
+            p++;
+        }
+        for( u32 Part = 0; Part < 2; Part++ )
+        {
+            if( *p == '*' )
+            {
+                Spec.StarCount++;
+                p++;
+            }
+            while( *p >= '0' && *p <= '9' )
+            {
+                p++;
+            }
+            if( Part == 0 && *p == '.' )
+            {
+                p++;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        // Length modifier
+        Spec.pModifier = p;
+        u32 Size = sizeof( int );
+        Bool bWide = False;
+        switch( *p )
+        {
+        case 'h':
+            p += (p[ 1 ] == 'h') ? 2 : 1;
+            break;
+
+        case 'l':
+            if( p[ 1 ] == 'l' )
+            {
+                Size = sizeof( long long );
+                p += 2;
+            }
+            else
+            {
+                Size = sizeof( long );
+                bWide = True;
+                p++;
+            }
+            break;
+
+        case 'j':
+            Size = sizeof( long long );
+            p++;
+            break;
+
+        case 'z':
+            Size = sizeof( size_t );
+            p++;
+            break;
+
+        case 't':
+            Size = sizeof( ptrdiff_t );
+            p++;
+            break;
+
+        case 'L':
+            p++;
+            break;
+
+        case 'I':
+            if( p[ 1 ] == '6' && p[ 2 ] == '4' )
+            {
+                Size = sizeof( long long );
+                p += 3;
+            }
+            break;
+        }
+
+        Spec.pType = p;
+        switch( *p )
+        {
+        case '%':
+            Spec.Arg = ArgKind::e_None;
+            break;
+
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+            Spec.Arg = (Size > 4) ? ArgKind::e_Int64 : ArgKind::e_Int32;
+            break;
+
+        case 'c':
+            Spec.Arg = bWide ? ArgKind::e_Invalid : ArgKind::e_Int32;
+            break;
+
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            Spec.Arg = (*Spec.pModifier == 'L') ? ArgKind::e_Invalid : ArgKind::e_Double;
+            break;
+
+        case 's':
+            Spec.Arg = bWide ? ArgKind::e_Invalid : ArgKind::e_String;
+            break;
+
+        case 'p':
+            Spec.Arg = ArgKind::e_Pointer;
+            break;
+
+        default:
+            // %n and anything unknown
+            Spec.Arg = ArgKind::e_Invalid;
+            break;
+        }
+
+        pCursor = (*p != '\0') ? p + 1 : p;
+        return True;
+    }
+}
+}
@@ -13,6 +13,7 @@
 // responsibility to update it.
 
 #include "BaseTypes.h"
+#include "MathX.h"
 using namespace Math;
 
 _MM_ALIGN16 static const u32 kaTranslationMask[ 4 ] = { 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0 };
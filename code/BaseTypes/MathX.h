@@ -16,6 +16,10 @@
 
 #include <xmmintrin.h>
 
+#ifndef _MM_ALIGN16
+#define _MM_ALIGN16 __attribute__((aligned(16)))
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // <summary>
 //   Miscellaneous SSE functionality.
@@ -91,9 +95,12 @@ namespace Math
         /// <returns>A pointer to the allocated memory.</returns>
         void* operator new( size_t Size )
         {
-		void** ptr;	
-            posix_memalign( ptr, sizeof (__m128), Size);
-		return ptr;
+            void* ptr = NULL;
+            if ( posix_memalign( &ptr, sizeof (__m128), Size ) != 0 )
+            {
+                ptr = NULL;
+            }
+            return ptr;
         }
 
         /// <summary>
@@ -897,6 +904,7 @@ namespace Math
         const XMatrix4x4& operator*=( const XMatrix4x4& a )
         {
             *this = *this * a;
+            return *this;
         }
 
         /// <summary>
@@ -0,0 +1,591 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#include "BaseTypes.h"
+#include "Profiler.h"
+
+#ifdef PROFILE_BUILD
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+std::atomic<u32> Profiler::g_bEnabled( 0 );
+
+
+namespace Profiler
+{
+    ///////////////////////////////////////////////////////////////////////////
+    // EventBuffer - Single producer / single consumer ring of zones.  Only the
+    // owning thread records zones and only the frame thread drains them.
+    class EventBuffer
+    {
+    public:
+
+        EventBuffer( u32 Capacity, u32 Index )
+            : m_Head( 0 )
+            , m_Tail( 0 )
+            , m_Dropped( 0 )
+            , m_Index( Index )
+            , m_pNext( NULL )
+        {
+            m_Capacity = 64;
+            while( m_Capacity < Capacity )
+            {
+                m_Capacity <<= 1;
+            }
+            m_pEvents = new Event[ m_Capacity ];
+        }
+
+        ~EventBuffer( void )
+        {
+            delete [] m_pEvents;
+        }
+
+        // Producer: copies a zone into the ring, counting it as dropped when the ring is full
+        void Push( const Event& Zone )
+        {
+            u32 Head = m_Head.load( std::memory_order_relaxed );
+            if( Head - m_Tail.load( std::memory_order_acquire ) == m_Capacity )
+            {
+                m_Dropped.fetch_add( 1, std::memory_order_relaxed );
+                return;
+            }
+
+            m_pEvents[ Head & (m_Capacity - 1) ] = Zone;
+            m_Head.store( Head + 1, std::memory_order_release );
+        }
+
+        // Consumer: appends the recorded zones to Events and frees their space
+        void Drain( std::vector<Event>& Events )
+        {
+            u32 Head = m_Head.load( std::memory_order_acquire );
+            u32 Tail = m_Tail.load( std::memory_order_relaxed );
+            for( ; Tail != Head; Tail++ )
+            {
+                Events.push_back( m_pEvents[ Tail & (m_Capacity - 1) ] );
+            }
+            m_Tail.store( Tail, std::memory_order_release );
+        }
+
+        std::atomic<u32> m_Head;
+        std::atomic<u32> m_Tail;
+        std::atomic<u32> m_Dropped;
+        u32 m_Capacity;
+        Event* m_pEvents;
+
+        u32 m_Index;                        // Order in which the thread first recorded a zone
+        std::string m_Name;
+        std::vector<Event> m_Captured;      // Consumer only
+        EventBuffer* m_pNext;
+    };
+
+
+    // Orders zone names by their text, as the same name can have several addresses
+    struct NameLess
+    {
+        bool operator()( pcstr a, pcstr b ) const
+        {
+            return strcmp( a, b ) < 0;
+        }
+    };
+
+    struct ZoneTotals
+    {
+        u32 Count;
+        u64 Total;
+        u64 Max;
+    };
+
+    struct CapturedFrame
+    {
+        u64 Start;
+        u64 End;
+        u32 Index;
+    };
+
+
+    ///////////////////////////////////////////////////////////////////////////
+    // State - Everything owned by a started profiler
+    class State
+    {
+    public:
+
+        State( const Config& Settings, u32 Serial );
+        ~State( void );
+
+        EventBuffer* GetThreadBuffer( void );
+        void Calibrate( u64 Now );
+        f64 ToMs( u64 Ticks ) const
+        {
+            return static_cast<f64>(Ticks) / m_TicksPerMs;
+        }
+
+        Config m_Config;
+        u32 m_Serial;
+
+        // Buffers are only ever added, newest first, so the consumer can walk them without a lock
+        std::mutex m_BufferMutex;
+        std::atomic<EventBuffer*> m_pBuffers;
+        u32 m_BufferCount;
+
+        u64 m_CalibrationTicks;
+        std::chrono::steady_clock::time_point m_CalibrationTime;
+        f64 m_TicksPerMs;
+
+        std::mutex m_FrameMutex;
+        u32 m_FrameIndex;
+        u64 m_FrameStart;
+        std::vector<Event> m_Drained;
+        std::map<pcstr, ZoneTotals, NameLess> m_Totals;
+        FrameStats m_LastFrame;
+        Bool m_bHaveFrame;
+
+        Bool m_bCapturing;
+        std::vector<CapturedFrame> m_Frames;
+    };
+
+    static std::atomic<State*> s_pState( NULL );
+
+    // Source of the serial numbers that tie thread local buffers to their profiler
+    static std::atomic<u32> s_Serial( 0 );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// State - Calibrates the timer against the steady clock
+Profiler::State::State( const Config& Settings, u32 Serial )
+    : m_Config( Settings )
+    , m_Serial( Serial )
+    , m_pBuffers( NULL )
+    , m_BufferCount( 0 )
+    , m_FrameIndex( 0 )
+    , m_bHaveFrame( False )
+    , m_bCapturing( False )
+{
+    u16 Cpu;
+    m_CalibrationTime = std::chrono::steady_clock::now();
+    m_CalibrationTicks = ReadTimer( Cpu );
+
+#ifdef PROFILER_TSC
+    // A first estimate, refined by later frames
+    u64 Now;
+    while( std::chrono::steady_clock::now() - m_CalibrationTime < std::chrono::milliseconds( 5 ) )
+    {
+    }
+    Now = ReadTimer( Cpu );
+    Calibrate( Now );
+#else
+    m_TicksPerMs = 1000000.0;
+#endif
+
+    m_FrameStart = ReadTimer( Cpu );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ~State - Frees the thread buffers
+Profiler::State::~State( void )
+{
+    EventBuffer* pBuffer = m_pBuffers.load( std::memory_order_acquire );
+    while( pBuffer != NULL )
+    {
+        EventBuffer* pNext = pBuffer->m_pNext;
+        delete pBuffer;
+        pBuffer = pNext;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetThreadBuffer - Returns the calling thread's buffer, creating it on first use
+Profiler::EventBuffer* Profiler::State::GetThreadBuffer( void )
+{
+    static thread_local EventBuffer* t_pBuffer = NULL;
+    static thread_local u32 t_Serial = 0;
+
+    // Buffers belong to a profiler, so a new profiler must not reuse a stale one
+    if( t_pBuffer == NULL || t_Serial != m_Serial )
+    {
+        std::lock_guard<std::mutex> Lock( m_BufferMutex );
+
+        t_pBuffer = new EventBuffer( m_Config.EventsPerThread, m_BufferCount++ );
+        t_pBuffer->m_pNext = m_pBuffers.load( std::memory_order_relaxed );
+        m_pBuffers.store( t_pBuffer, std::memory_order_release );
+        t_Serial = m_Serial;
+    }
+
+    return t_pBuffer;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Calibrate - Measures the timer frequency over the time since startup
+void Profiler::State::Calibrate( u64 Now )
+{
+#ifdef PROFILER_TSC
+    f64 Elapsed = std::chrono::duration<f64, std::milli>(
+        std::chrono::steady_clock::now() - m_CalibrationTime ).count();
+    if( Elapsed > 0.0 && Now > m_CalibrationTicks )
+    {
+        m_TicksPerMs = static_cast<f64>(Now - m_CalibrationTicks) / Elapsed;
+    }
+#else
+    UNREFERENCED_PARAM( Now );
+#endif
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Startup - Creates the profiler and turns the zones on
+void Profiler::Startup( const Config& Settings )
+{
+    ASSERT( s_pState.load() == NULL );
+
+    State* pState = new State( Settings, s_Serial.fetch_add( 1 ) + 1 );
+    s_pState.store( pState, std::memory_order_release );
+    g_bEnabled.store( True, std::memory_order_release );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Shutdown - Turns the zones off and frees the profiler
+void Profiler::Shutdown( void )
+{
+    g_bEnabled.store( False, std::memory_order_release );
+
+    State* pState = s_pState.exchange( NULL );
+    SAFE_DELETE( pState );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// RecordZone - Copies a completed zone into the calling thread's buffer
+void Profiler::RecordZone( const Event& Zone )
+{
+    State* pState = s_pState.load( std::memory_order_acquire );
+    if( pState != NULL )
+    {
+        pState->GetThreadBuffer()->Push( Zone );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SetThreadName - Names the calling thread's track in captures
+void Profiler::SetThreadName( pcstr pszName )
+{
+    State* pState = s_pState.load( std::memory_order_acquire );
+    if( pState != NULL )
+    {
+        EventBuffer* pBuffer = pState->GetThreadBuffer();
+
+        std::lock_guard<std::mutex> Lock( pState->m_BufferMutex );
+        pBuffer->m_Name = pszName;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// BeginFrame - Starts timing a frame
+void Profiler::BeginFrame( void )
+{
+    State* pState = s_pState.load( std::memory_order_acquire );
+    if( pState != NULL )
+    {
+        std::lock_guard<std::mutex> Lock( pState->m_FrameMutex );
+
+        u16 Cpu;
+        pState->m_FrameStart = ReadTimer( Cpu );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// EndFrame - Drains the thread buffers and totals the zones that ended during
+// the frame.  Without a BeginFrame a frame starts where the last one ended.
+void Profiler::EndFrame( void )
+{
+    State* pState = s_pState.load( std::memory_order_acquire );
+    if( pState == NULL )
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> Lock( pState->m_FrameMutex );
+
+    u16 Cpu;
+    u64 Now = ReadTimer( Cpu );
+    pState->Calibrate( Now );
+
+    u32 Dropped = 0;
+    pState->m_Totals.clear();
+
+    for( EventBuffer* pBuffer = pState->m_pBuffers.load( std::memory_order_acquire );
+         pBuffer != NULL; pBuffer = pBuffer->m_pNext )
+    {
+        pState->m_Drained.clear();
+        pBuffer->Drain( pState->m_Drained );
+        Dropped += pBuffer->m_Dropped.exchange( 0, std::memory_order_relaxed );
+
+        for( std::vector<Event>::const_iterator it = pState->m_Drained.begin();
+             it != pState->m_Drained.end(); it++ )
+        {
+            u64 Duration = it->End - it->Start;
+
+            std::map<pcstr, ZoneTotals, NameLess>::iterator itTotals = pState->m_Totals.find( it->pszName );
+            if( itTotals == pState->m_Totals.end() )
+            {
+                ZoneTotals Totals = { 0, 0, 0 };
+                itTotals = pState->m_Totals.insert( std::make_pair( it->pszName, Totals ) ).first;
+            }
+            itTotals->second.Count++;
+            itTotals->second.Total += Duration;
+            itTotals->second.Max = std::max( itTotals->second.Max, Duration );
+        }
+
+        if( pState->m_bCapturing )
+        {
+            pBuffer->m_Captured.insert( pBuffer->m_Captured.end(),
+                                        pState->m_Drained.begin(), pState->m_Drained.end() );
+        }
+    }
+
+    FrameStats& Stats = pState->m_LastFrame;
+    Stats.FrameIndex = pState->m_FrameIndex;
+    Stats.FrameMs = static_cast<f32>(pState->ToMs( Now - pState->m_FrameStart ));
+    Stats.Dropped = Dropped;
+    Stats.Zones.clear();
+
+    for( std::map<pcstr, ZoneTotals, NameLess>::const_iterator it = pState->m_Totals.begin();
+         it != pState->m_Totals.end(); it++ )
+    {
+        ZoneStats Zone;
+        Zone.pszName = it->first;
+        Zone.Count = it->second.Count;
+        Zone.TotalMs = static_cast<f32>(pState->ToMs( it->second.Total ));
+        Zone.MaxMs = static_cast<f32>(pState->ToMs( it->second.Max ));
+        Stats.Zones.push_back( Zone );
+    }
+
+    struct ByTotal
+    {
+        bool operator()( const ZoneStats& a, const ZoneStats& b ) const
+        {
+            return a.TotalMs > b.TotalMs;
+        }
+    };
+    std::sort( Stats.Zones.begin(), Stats.Zones.end(), ByTotal() );
+
+    if( pState->m_bCapturing )
+    {
+        CapturedFrame Frame = { pState->m_FrameStart, Now, pState->m_FrameIndex };
+        pState->m_Frames.push_back( Frame );
+    }
+
+    pState->m_bHaveFrame = True;
+    pState->m_FrameIndex++;
+    pState->m_FrameStart = Now;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetFrameStats - Returns the totals of the last ended frame
+Bool Profiler::GetFrameStats( FrameStats& Stats )
+{
+    State* pState = s_pState.load( std::memory_order_acquire );
+    if( pState == NULL )
+    {
+        return False;
+    }
+
+    std::lock_guard<std::mutex> Lock( pState->m_FrameMutex );
+
+    if( !pState->m_bHaveFrame )
+    {
+        return False;
+    }
+    Stats = pState->m_LastFrame;
+    return True;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// BeginCapture - Keeps the zones of the frames ended from now on
+void Profiler::BeginCapture( void )
+{
+    State* pState = s_pState.load( std::memory_order_acquire );
+    if( pState != NULL )
+    {
+        std::lock_guard<std::mutex> Lock( pState->m_FrameMutex );
+
+        pState->m_bCapturing = True;
+    }
+}
+
+
+namespace Profiler
+{
+    ///////////////////////////////////////////////////////////////////////////
+    // WriteString - Writes a JSON string
+    static void WriteString( FILE* pFile, pcstr pszText )
+    {
+        fputc( '"', pFile );
+        for( const u8* p = reinterpret_cast<const u8*>(pszText); *p != '\0'; p++ )
+        {
+            if( *p == '"' || *p == '\\' )
+            {
+                fputc( '\\', pFile );
+                fputc( *p, pFile );
+            }
+            else if( *p < 0x20 )
+            {
+                fprintf( pFile, "\\u%04x", *p );
+            }
+            else
+            {
+                fputc( *p, pFile );
+            }
+        }
+        fputc( '"', pFile );
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // WriteTrackName - Writes the metadata event naming a track
+    static void WriteTrackName( FILE* pFile, u32 Track, pcstr pszName )
+    {
+        fprintf( pFile, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", Track );
+        WriteString( pFile, pszName );
+        fprintf( pFile, "}},\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"sort_index\":%u}}",
+                 Track, Track );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// EndCapture - Writes the captured frames as Chrome trace_event JSON.  Track 0
+// holds the frames, the others a thread or a core each.
+Bool Profiler::EndCapture( pcstr pszFileName, Bool bByCore )
+{
+    State* pState = s_pState.load( std::memory_order_acquire );
+    if( pState == NULL )
+    {
+        return False;
+    }
+
+    std::lock_guard<std::mutex> FrameLock( pState->m_FrameMutex );
+
+    if( !pState->m_bCapturing )
+    {
+        return False;
+    }
+    pState->m_bCapturing = False;
+
+    Bool bWritten = False;
+    FILE* pFile = fopen( pszFileName, "w" );
+    if( pFile != NULL )
+    {
+        EventBuffer* pBuffers = pState->m_pBuffers.load( std::memory_order_acquire );
+
+        // Times are in microseconds from the earliest zone or frame
+        u64 Origin = pState->m_Frames.empty() ? ~0ULL : pState->m_Frames.front().Start;
+        for( EventBuffer* pBuffer = pBuffers; pBuffer != NULL; pBuffer = pBuffer->m_pNext )
+        {
+            for( std::vector<Event>::const_iterator it = pBuffer->m_Captured.begin();
+                 it != pBuffer->m_Captured.end(); it++ )
+            {
+                Origin = std::min( Origin, it->Start );
+            }
+        }
+        f64 TicksPerUs = pState->m_TicksPerMs / 1000.0;
+
+        fprintf( pFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+        fprintf( pFile, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Smoke\"}}" );
+        WriteTrackName( pFile, 0, "Frames" );
+
+        for( std::vector<CapturedFrame>::const_iterator it = pState->m_Frames.begin();
+             it != pState->m_Frames.end(); it++ )
+        {
+            fprintf( pFile, ",\n{\"name\":\"Frame %u\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":0,"
+                     "\"ts\":%.3f,\"dur\":%.3f}",
+                     it->Index, (it->Start - Origin) / TicksPerUs, (it->End - it->Start) / TicksPerUs );
+        }
+
+        std::set<u32> Cores;
+        for( EventBuffer* pBuffer = pBuffers; pBuffer != NULL; pBuffer = pBuffer->m_pNext )
+        {
+            if( !bByCore )
+            {
+                std::lock_guard<std::mutex> BufferLock( pState->m_BufferMutex );
+
+                char szName[ 32 ];
+                snprintf( szName, sizeof( szName ), "Thread %u", pBuffer->m_Index );
+                WriteTrackName( pFile, pBuffer->m_Index + 1,
+                                pBuffer->m_Name.empty() ? szName : pBuffer->m_Name.c_str() );
+            }
+
+            for( std::vector<Event>::const_iterator it = pBuffer->m_Captured.begin();
+                 it != pBuffer->m_Captured.end(); it++ )
+            {
+                u32 Track = bByCore ? it->Cpu + 1 : pBuffer->m_Index + 1;
+                Cores.insert( it->Cpu );
+
+                fprintf( pFile, ",\n{\"name\":" );
+                WriteString( pFile, it->pszName );
+                fprintf( pFile, ",\"cat\":\"zone\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+                         "\"args\":{\"thread\":%u,\"cpu\":%u,\"depth\":%u",
+                         Track, (it->Start - Origin) / TicksPerUs, (it->End - it->Start) / TicksPerUs,
+                         pBuffer->m_Index, it->Cpu, it->Depth );
+                if( it->bRange )
+                {
+                    fprintf( pFile, ",\"begin\":%u,\"end\":%u", it->RangeBegin, it->RangeEnd );
+                }
+                fprintf( pFile, "}}" );
+            }
+
+            pBuffer->m_Captured.clear();
+        }
+
+        if( bByCore )
+        {
+            for( std::set<u32>::const_iterator it = Cores.begin(); it != Cores.end(); it++ )
+            {
+                char szName[ 32 ];
+                snprintf( szName, sizeof( szName ), "CPU %u", *it );
+                WriteTrackName( pFile, *it + 1, szName );
+            }
+        }
+
+        fprintf( pFile, "\n]}\n" );
+        bWritten = (ferror( pFile ) == 0);
+        bWritten &= (fclose( pFile ) == 0);
+    }
+
+    // The capture is over either way
+    for( EventBuffer* pBuffer = pState->m_pBuffers.load( std::memory_order_acquire );
+         pBuffer != NULL; pBuffer = pBuffer->m_pNext )
+    {
+        pBuffer->m_Captured.clear();
+    }
+    pState->m_Frames.clear();
+
+    return bWritten;
+}
+
+#endif
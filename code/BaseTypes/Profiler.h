@@ -0,0 +1,232 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#if defined( __i386__ ) || defined( __x86_64__ ) || defined( _M_IX86 ) || defined( _M_X64 )
+#if defined( _MSC_VER )
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define PROFILER_TSC
+#else
+#include <chrono>
+#endif
+
+#ifndef NO_PROFILER
+#define PROFILE_BUILD
+#endif
+
+#define PROFILE_CONCAT2( a, b )     a##b
+#define PROFILE_CONCAT( a, b )      PROFILE_CONCAT2( a, b )
+
+// Times the rest of the enclosing scope.  Names are not copied, so they must outlive the capture;
+// string literals and system names are fine.
+#ifdef PROFILE_BUILD
+#define PROFILE_ZONE( Name )                    Profiler::Zone PROFILE_CONCAT( ProfileZone, __LINE__ )( (Name) )
+#define PROFILE_ZONE_RANGE( Name, Begin, End )  Profiler::Zone PROFILE_CONCAT( ProfileZone, __LINE__ )( (Name), (Begin), (End) )
+#else
+#define PROFILE_ZONE( Name )                    do { } while( 0 )
+#define PROFILE_ZONE_RANGE( Name, Begin, End )  do { } while( 0 )
+#endif
+
+
+// Frame based CPU profiler
+//
+// Zones are timed with the time stamp counter and recorded, when they end, into a single
+// producer / single consumer ring owned by the calling thread, so timing a zone never takes a
+// lock.  Once a frame EndFrame drains every ring, aggregates the zones that ended during the
+// frame and, while capturing, keeps them for EndCapture to write as Chrome trace_event JSON
+// (chrome://tracing or ui.perfetto.dev).
+//
+// The task manager times each ISystemTask::Update with a zone named after the system and each
+// ParallelFor chunk with a range zone, so a capture shows which work ran on which thread and core.
+namespace Profiler
+{
+    // Settings for the profiler
+    struct Config
+    {
+        Config( void )
+            : EventsPerThread( 8 * 1024 )
+        {
+        }
+
+        u32 EventsPerThread;                // Zones a thread can record per frame, rounded up to a
+                                            //  power of 2.  Zones past that are counted as dropped.
+    };
+
+    // A completed zone
+    struct Event
+    {
+        u64 Start;                          // Ticks
+        u64 End;
+        pcstr pszName;
+        u32 RangeBegin;                     // Work range of a PROFILE_ZONE_RANGE
+        u32 RangeEnd;
+        u8 Depth;                           // Number of enclosing zones on the thread
+        u8 bRange;
+        u16 Cpu;                            // Core the zone started on
+    };
+
+    // Totals of the zones sharing a name over one frame
+    struct ZoneStats
+    {
+        pcstr pszName;
+        u32 Count;
+        f32 TotalMs;                        // Summed over all threads, so it can exceed the frame
+        f32 MaxMs;
+    };
+
+    struct FrameStats
+    {
+        u32 FrameIndex;
+        f32 FrameMs;
+        u32 Dropped;                        // Zones lost to full thread rings
+        std::vector<ZoneStats> Zones;       // Sorted by descending total time
+    };
+
+
+    ///////////////////////////////////////////////////////////////////////////
+    // ReadTimer - Reads the time stamp counter and the core it was read on
+    inline u64 ReadTimer( u16& Cpu )
+    {
+#ifdef PROFILER_TSC
+        // The OS keeps the core number in the low 12 bits of TSC_AUX
+        unsigned int Aux;
+        u64 Ticks = __rdtscp( &Aux );
+        Cpu = static_cast<u16>(Aux & 0xFFF);
+        return Ticks;
+#else
+        Cpu = 0;
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch() ).count();
+#endif
+    }
+
+    // Nesting depth of the calling thread's zones
+    inline u32& ZoneDepth( void )
+    {
+        static thread_local u32 t_Depth = 0;
+        return t_Depth;
+    }
+
+#ifdef PROFILE_BUILD
+
+    // Set between Startup and Shutdown, read without locks by the zones
+    extern std::atomic<u32> g_bEnabled;
+
+    inline Bool IsEnabled( void )
+    {
+        return g_bEnabled.load( std::memory_order_relaxed );
+    }
+
+    void Startup( const Config& Settings = Config() );
+    void Shutdown( void );              // Only once no other thread is timing zones
+
+    void RecordZone( const Event& Zone );
+
+    // Names the calling thread in captures
+    void SetThreadName( pcstr pszName );
+
+    // Frame boundaries, called by the thread that runs the frame loop
+    void BeginFrame( void );
+    void EndFrame( void );
+
+    // Returns the totals of the last ended frame
+    Bool GetFrameStats( FrameStats& Stats );
+
+    // Keeps the zones of the frames ended from now on for EndCapture
+    void BeginCapture( void );
+
+    // Writes the captured frames as Chrome trace_event JSON.  With bByCore the tracks are the
+    // cores rather than the threads.
+    Bool EndCapture( pcstr pszFileName, Bool bByCore = False );
+
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Zone - Times its own lifetime
+    class Zone
+    {
+    public:
+
+        Zone( pcstr pszName )
+        {
+            m_Event.pszName = pszName;
+            m_Event.RangeBegin = 0;
+            m_Event.RangeEnd = 0;
+            m_Event.bRange = False;
+            Begin();
+        }
+
+        Zone( pcstr pszName, u32 RangeBegin, u32 RangeEnd )
+        {
+            m_Event.pszName = pszName;
+            m_Event.RangeBegin = RangeBegin;
+            m_Event.RangeEnd = RangeEnd;
+            m_Event.bRange = True;
+            Begin();
+        }
+
+        ~Zone( void )
+        {
+            if( m_bActive )
+            {
+                u16 Cpu;
+                m_Event.End = ReadTimer( Cpu );
+                ZoneDepth()--;
+                RecordZone( m_Event );
+            }
+        }
+
+    private:
+
+        void Begin( void )
+        {
+            m_bActive = IsEnabled();
+            if( m_bActive )
+            {
+                u32& Depth = ZoneDepth();
+                m_Event.Depth = static_cast<u8>(Depth < 0xFF ? Depth : 0xFF);
+                Depth++;
+                m_Event.Start = ReadTimer( m_Event.Cpu );
+            }
+        }
+
+        Event m_Event;
+        Bool m_bActive;
+    };
+
+#else  // Profiling disabled, all functions are inline and empty
+
+    inline Bool IsEnabled( void ){ return False; };
+
+    inline void Startup( const Config& Settings = Config() ){};
+    inline void Shutdown( void ){};
+
+    inline void SetThreadName( pcstr pszName ){};
+
+    inline void BeginFrame( void ){};
+    inline void EndFrame( void ){};
+
+    inline Bool GetFrameStats( FrameStats& Stats ){ return False; };
+
+    inline void BeginCapture( void ){};
+    inline Bool EndCapture( pcstr pszFileName, Bool bByCore = False ){ return False; };
+
+#endif
+}
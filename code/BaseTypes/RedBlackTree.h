@@ -51,7 +51,7 @@ protected:
 #ifdef _DEBUGTREE
         u32 cnt;
         u8 Address[8];
-#endif _DEBUGTREE
+#endif // _DEBUGTREE
     };
 
     RBNode * m_Root;
@@ -118,7 +118,7 @@ public:
 //	iterator end() const   { return iterator(0)};
     
     //not const as UnitAllocator does not return a const;
-    u32  size() { return m_Allocator.NumAllocatedUnits()};
+    u32  size() { return m_Allocator.NumAllocatedUnits(); }
     Bool empty() const
     {
         Bool isEmpty = True; 
@@ -12,6 +12,8 @@
 // assume any responsibility for any errors which may appear in this software nor any
 // responsibility to update it.
 
+#include <algorithm>
+
 #include "../BaseTypes/BaseTypes.h"
 #include "../Interfaces/Interface.h"
 
@@ -130,11 +132,15 @@ Error CSubject::UpdateInterestBits( IObserver* pObserver, u32 uInIntrestBits )
         it->m_interestBits |= inInterest;
 #else
         // No lock is used, but updates can happen concurrently. So use interlocked operation
+#if defined( _MSC_VER )
         long prevBits;
         long newBits = long(it->m_interestBits | uInIntrestBits);
         do {
             prevBits = it->m_interestBits;
         } while ( _InterlockedCompareExchange((long*)&it->m_interestBits, newBits, prevBits) != prevBits );
+#else
+        __sync_fetch_and_or( &it->m_interestBits, uInIntrestBits );
+#endif
 #endif
         curError = Errors::Success;
     }
@@ -124,3 +124,40 @@ public:
     /// <returns>A reference to the runtime class.</returns>
     virtual IRuntime& Runtime( void ) = 0;
 };
+
+
+/// <summary>
+///   Applies the log level variables to the debugger.  <c>Debug::LogLevel</c> sets every log
+///    type and <c>Debug::LogLevel::System</c> (e.g. <c>Debug::LogLevel::Physics</c>) overrides
+///    a single type.  Levels are None, Error, Warning, Info, Verbose or their numbers.
+/// </summary>
+/// <remarks>
+///   IVariables has no change notification, so whoever loads the environment or sets any of
+///    these variables has to call this for the levels to take effect.  Nothing in this tree
+///    loads an environment yet, so nothing calls it; until then levels are set directly with
+///    Debug::SetLogLevel.
+/// </remarks>
+/// <param name="Variables">The environment variables to read the levels from.</param>
+inline void ApplyLogLevels( IEnvironment::IVariables& Variables )
+{
+    LogLevel::LogLevel DefaultLevel = LogLevel::e_Info;
+    Bool bDefault = Debug::ParseLogLevel( Variables.GetAsString( "Debug::LogLevel" ), DefaultLevel );
+
+    for ( u32 i=0; i < LogType::e_LogTypeCount; i++ )
+    {
+        LogType::LogType Type = static_cast<LogType::LogType>(i);
+
+        std::string sName = "Debug::LogLevel::";
+        sName += Debug::GetLogTypeName( Type );
+
+        LogLevel::LogLevel Level;
+        if ( Debug::ParseLogLevel( Variables.GetAsString( sName.c_str() ), Level ) )
+        {
+            Debug::SetLogLevel( Type, Level );
+        }
+        else if ( bDefault )
+        {
+            Debug::SetLogLevel( Type, DefaultLevel );
+        }
+    }
+}
@@ -190,6 +190,25 @@ class IGraphicsObject
 {
 public:
 
+    /// <summary>
+    ///   A read-only view of an index or vertex stream, pointing into the buffer the object keeps
+    ///    it in.  The data stays valid and unchanged until the view is passed to UnmapStream.
+    /// </summary>
+    struct StreamView
+    {
+        const void*                     pData;
+        u32                             Stride;
+        u32                             Count;
+
+        // Incremented by the object each time the stream changes, so that consumers can skip
+        //  streams they already have
+        u32                             Version;
+
+        // Identifies the buffer for UnmapStream
+        Handle                          Token;
+    };
+
+
     /// <summary>
     ///   Returns the number of submeshes.
     /// </summary>
@@ -258,6 +277,49 @@ public:
                               In  u32 nVertexDeclCount = 0,
                               In  VertexDecl::Element* pVertexDecl = NULL ) = 0;
 
+    /// <summary>
+    ///   Maps the index buffer for reading without copying it.
+    /// </summary>
+    /// <remarks>
+    ///   Objects not keeping their indices in a buffer they can hand out return False; callers
+    ///    then copy them with GetIndices.
+    /// </remarks>
+    /// <param name="View">The returned view, with a stride of the index size.</param>
+    /// <param name="nSubMeshIndex">The index of the SubMesh being referenced (default = 0).</param>
+    /// <returns>True if the view was mapped and must be passed to UnmapStream.</returns>
+    virtual Bool MapIndices( Out StreamView& View,
+                             In  u16 nSubMeshIndex = 0 )
+    {
+        return False;
+    }
+
+    /// <summary>
+    ///   Maps a vertex stream for reading without copying it.
+    /// </summary>
+    /// <remarks>
+    ///   The view's vertices have the elements of GetVertexDeclaration with the stream's index.
+    ///    Objects not keeping their vertices in a buffer they can hand out return False; callers
+    ///    then copy them with GetVertices.
+    /// </remarks>
+    /// <param name="View">The returned view.</param>
+    /// <param name="nSubMeshIndex">The index of the SubMesh being referenced (default = 0).</param>
+    /// <param name="nStreamIndex">Index of the Vertex Stream to map.</param>
+    /// <returns>True if the view was mapped and must be passed to UnmapStream.</returns>
+    virtual Bool MapVertices( Out StreamView& View,
+                              In  u16 nSubMeshIndex = 0,
+                              In  u16 nStreamIndex = 0 )
+    {
+        return False;
+    }
+
+    /// <summary>
+    ///   Releases a view returned by MapIndices or MapVertices.  Safe to call from any thread.
+    /// </summary>
+    /// <param name="View">The view.</param>
+    virtual void UnmapStream( In StreamView& View )
+    {
+    }
+
     /// <summary>
     ///   Queries a system for the indices of changed vertex streams.
     /// </summary>
@@ -294,6 +356,29 @@ public:
         u32                 Color;
     };
 
+    /// <summary>
+    ///   The particles of a group as one array per member of ParticleData.
+    /// </summary>
+    struct ParticleColumns
+    {
+        const f32*          pPositionX;
+        const f32*          pPositionY;
+        const f32*          pPositionZ;
+        const f32*          pVelocityX;
+        const f32*          pVelocityY;
+        const f32*          pVelocityZ;
+        const f32*          pSize;
+        const f32*          pTime;
+        const f32*          pLifeTime;
+        const f32*          pMass;
+        const u32*          pColor;
+        u32                 Count;
+
+        // The particles to draw, such as those left by culling, or NULL to draw them all
+        const u32*          pVisible;
+        u32                 VisibleCount;
+    };
+
 
 public:
 
@@ -305,6 +390,22 @@ public:
 
 	virtual void GetParticles( u32 iParticleGroup, Out ParticleData* pParticles ) {};
 
+    /// <summary>
+    ///   Gets the particles of a group without copying them, valid until the object's next
+    ///    update.
+    /// </summary>
+    /// <remarks>
+    ///   Objects not keeping their particles in columns return False; callers then copy them with
+    ///    GetParticles.
+    /// </remarks>
+    /// <param name="iParticleGroup">The group.</param>
+    /// <param name="Columns">The returned columns.</param>
+    /// <returns>True if the columns were returned.</returns>
+    virtual Bool GetParticleColumns( u32 iParticleGroup, Out ParticleColumns& Columns )
+    {
+        return False;
+    }
+
 	virtual std::string GetParticleGroupTechnique(void) {return "turkey breath";};
 
 	virtual f32 GetParticleSystemAge() {return 0.0f;};
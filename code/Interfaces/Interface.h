@@ -18,6 +18,7 @@ namespace Interface
 {
     #include "SystemTypes.h"
     #include "Property.h"
+    #include "PropertyBinary.h"
     #include "Platform.h"
     #include "ChangeControl.h"
     #include "TaskManager.h"
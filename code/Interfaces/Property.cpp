@@ -12,9 +12,15 @@
 // assume any responsibility for any errors which may appear in this software nor any
 // responsibility to update it.
 
-#include <StdArg.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unordered_map>
+#include <algorithm>
+#include <new>
 
 #include "../BaseTypes/BaseTypes.h"
+#include "../BaseTypes/TbbSpinMutex.h"
 #include "Interface.h"
 
 
@@ -27,6 +33,426 @@ namespace Properties
     pcstr Property::sm_kpszValue3Name = "Value3";
     pcstr Property::sm_kpszValue4Name = "Value4";
 
+    const u32 StringStore::MaxSize;
+
+
+    //
+    // Interned names.  Interning only happens while loading definitions so a single lock is
+    //  sufficient.
+    //
+    typedef std::unordered_map<Id, std::string> NameTable;
+
+    static NameTable& GetNameTable( void )
+    {
+        static NameTable s_Names;
+        return s_Names;
+    }
+
+    DECLARE_STATIC_SPIN_MUTEX( s_NamesMutex );
+
+
+    Id
+    Names::Intern(
+        pcstr pszName
+        )
+    {
+        ASSERT( pszName != NULL );
+
+        Id PropertyId = MakeId( pszName );
+
+        SCOPED_SPIN_LOCK( s_NamesMutex );
+
+        std::pair<NameTable::iterator, bool> Result =
+            GetNameTable().insert( NameTable::value_type( PropertyId, std::string() ) );
+        if ( Result.second )
+        {
+            Result.first->second = pszName;
+        }
+        else
+        {
+            ASSERTMSG1( Result.first->second == pszName,
+                        "Property name %s collides with an interned name.", pszName );
+        }
+
+        return PropertyId;
+    }
+
+
+    pcstr
+    Names::GetName(
+        Id PropertyId
+        )
+    {
+        SCOPED_SPIN_LOCK( s_NamesMutex );
+
+        NameTable::const_iterator it = GetNameTable().find( PropertyId );
+        return (it != GetNameTable().end()) ? it->second.c_str() : NULL;
+    }
+
+
+    void
+    Map::Build(
+        const Array& Properties
+        )
+    {
+        Clear();
+
+        for ( u32 i=0; i < Properties.size(); i++ )
+        {
+            Insert( Properties[ i ].GetId(), i );
+        }
+    }
+
+
+    void
+    Map::Insert(
+        Id PropertyId,
+        u32 Index
+        )
+    {
+        ASSERT( PropertyId != InvalidId );
+
+        //
+        // Keep the load factor at or below one half so probe sequences stay short.
+        //
+        if ( (m_Count + 1) * 2 > m_aEntries.size() )
+        {
+            Grow();
+        }
+
+        u32 Slot = PropertyId & m_Mask;
+        while ( m_aEntries[ Slot ].Key != InvalidId && m_aEntries[ Slot ].Key != PropertyId )
+        {
+            Slot = (Slot + 1) & m_Mask;
+        }
+
+        if ( m_aEntries[ Slot ].Key == InvalidId )
+        {
+            m_aEntries[ Slot ].Key = PropertyId;
+            m_Count++;
+        }
+        m_aEntries[ Slot ].Index = Index;
+    }
+
+
+    void
+    Map::Clear(
+        void
+        )
+    {
+        Entry Empty = { InvalidId, InvalidIndex };
+        std::fill( m_aEntries.begin(), m_aEntries.end(), Empty );
+        m_Count = 0;
+    }
+
+
+    void
+    Map::Grow(
+        void
+        )
+    {
+        std::vector<Entry> aOld;
+        aOld.swap( m_aEntries );
+
+        u32 Size = aOld.empty() ? 16 : static_cast<u32>(aOld.size()) * 2;
+        Entry Empty = { InvalidId, InvalidIndex };
+        m_aEntries.assign( Size, Empty );
+        m_Mask = Size - 1;
+        m_Count = 0;
+
+        for ( std::vector<Entry>::const_iterator it=aOld.begin(); it != aOld.end(); it++ )
+        {
+            if ( it->Key != InvalidId )
+            {
+                Insert( it->Key, it->Index );
+            }
+        }
+    }
+
+
+    Property&
+    ChangeSet::Add(
+        Id PropertyId,
+        u32 PropertyType,
+        System::Changes::BitMask Changes
+        )
+    {
+        ASSERT( PropertyId != InvalidId );
+
+        m_Changes |= Changes;
+
+        u32 Index = m_Index.Find( PropertyId );
+        if ( Index == Map::InvalidIndex )
+        {
+            pcstr pszName = Names::GetName( PropertyId );
+            ASSERTMSG( pszName != NULL, "Change set properties must have interned names." );
+
+            Index = static_cast<u32>(m_Properties.size());
+            m_Index.Insert( PropertyId, Index );
+            m_Properties.push_back( Property( pszName, PropertyId, PropertyType, Flags::Valid ) );
+        }
+        else
+        {
+            ASSERTMSG( m_Properties[ Index ].GetType() == PropertyType,
+                       "A property cannot change type within a change set." );
+        }
+
+        return m_Properties[ Index ];
+    }
+
+
+    void
+    ChangeSet::Add(
+        const Property& Source,
+        System::Changes::BitMask Changes
+        )
+    {
+        ASSERT( Source.GetId() != InvalidId );
+
+        m_Changes |= Changes;
+
+        u32 Index = m_Index.Find( Source.GetId() );
+        if ( Index == Map::InvalidIndex )
+        {
+            m_Index.Insert( Source.GetId(), static_cast<u32>(m_Properties.size()) );
+            m_Properties.push_back( Source );
+        }
+        else
+        {
+            m_Properties[ Index ] = Source;
+        }
+    }
+
+
+    void
+    ChangeSet::Clear(
+        void
+        )
+    {
+        if ( !m_Properties.empty() )
+        {
+            m_Properties.clear();
+            m_Index.Clear();
+        }
+        m_Changes = System::Changes::None;
+    }
+
+
+    StringStore::StringStore(
+        const StringStore& Store
+        )
+        : m_Size( 0 )
+        , m_Capacity( InlineCapacity )
+    {
+        *this = Store;
+    }
+
+
+    StringStore::StringStore(
+        StringStore&& Store
+        )
+        : m_Size( 0 )
+        , m_Capacity( InlineCapacity )
+    {
+        Swap( Store );
+    }
+
+
+    StringStore::~StringStore(
+        void
+        )
+    {
+        if ( IsHeap() )
+        {
+            free( m_pHeap );
+        }
+    }
+
+
+    StringStore&
+    StringStore::operator=(
+        const StringStore& Store
+        )
+    {
+        if ( this != &Store )
+        {
+            //
+            // Only the used characters are copied so a copy of a property whose strings were
+            //  compacted back under the inline capacity doesn't allocate.
+            //
+            m_Size = 0;
+            Reserve( Store.m_Size );
+            memcpy( GetData(), Store.GetData(), Store.m_Size );
+            m_Size = Store.m_Size;
+        }
+
+        return *this;
+    }
+
+
+    StringStore&
+    StringStore::operator=(
+        StringStore&& Store
+        )
+    {
+        if ( this != &Store )
+        {
+            Swap( Store );
+            Store.Clear();
+        }
+
+        return *this;
+    }
+
+
+    void
+    StringStore::Swap(
+        StringStore& Store
+        )
+    {
+        //
+        // The union holds either the inline characters or the heap pointer, so exchanging its
+        //  raw bytes moves either representation.
+        //
+        char aTemp[ InlineCapacity ];
+        memcpy( aTemp, m_aInline, InlineCapacity );
+        memcpy( m_aInline, Store.m_aInline, InlineCapacity );
+        memcpy( Store.m_aInline, aTemp, InlineCapacity );
+
+        u32 Size = m_Size;
+        m_Size = Store.m_Size;
+        Store.m_Size = Size;
+
+        u32 Capacity = m_Capacity;
+        m_Capacity = Store.m_Capacity;
+        Store.m_Capacity = Capacity;
+    }
+
+
+    void
+    StringStore::Reserve(
+        u32 Capacity
+        )
+    {
+        ASSERT( Capacity <= MaxSize );
+
+        if ( Capacity > m_Capacity )
+        {
+            u32 NewCapacity = std::min( m_Capacity * 2, MaxSize );
+            if ( NewCapacity < Capacity )
+            {
+                NewCapacity = Capacity;
+            }
+
+            //
+            // Fail as the std::string the values used to be held in would have.
+            //
+            char* pNew = static_cast<char*>(malloc( NewCapacity ));
+            if ( pNew == NULL )
+            {
+                throw std::bad_alloc();
+            }
+            memcpy( pNew, GetData(), m_Size );
+
+            if ( IsHeap() )
+            {
+                free( m_pHeap );
+            }
+
+            m_pHeap = pNew;
+            m_Capacity = NewCapacity;
+        }
+    }
+
+
+    u32
+    StringStore::Append(
+        pcstr pszValue,
+        u32 Length
+        )
+    {
+        //
+        // Truncate rather than let the size wrap.  A full store hands out its last terminator
+        //  as an empty string.
+        //
+        if ( m_Size == MaxSize )
+        {
+            return m_Size - 1;
+        }
+        if ( Length > MaxSize - m_Size - 1 )
+        {
+            Length = MaxSize - m_Size - 1;
+        }
+
+        Reserve( m_Size + Length + 1 );
+
+        u32 Offset = m_Size;
+        char* pData = GetData() + Offset;
+        memcpy( pData, pszValue, Length );
+        pData[ Length ] = '\0';
+        m_Size += Length + 1;
+
+        return Offset;
+    }
+
+
+    void
+    Property::SetValue(
+        i32 Index,
+        pcstr pszValue
+        )
+    {
+        size_t Length = std::min<size_t>( strlen( pszValue ), StringStore::MaxSize );
+        SetString( Index, pszValue, static_cast<u32>(Length) );
+    }
+
+
+    void
+    Property::SetString(
+        i32 Index,
+        pcstr pszValue,
+        u32 Length
+        )
+    {
+        ASSERT( Index >= 0 && Index < Values::Count );
+        ASSERT( pszValue != NULL );
+
+        //
+        // The store may be repacked or grown below, so a value that points into it has to be
+        //  copied out first.
+        //
+        if ( m_Strings.Contains( pszValue ) )
+        {
+            std::string sValue( pszValue, Length );
+            SetString( Index, sValue.c_str(), Length );
+            return;
+        }
+
+        m_StringMask &= ~(1 << Index);
+
+        //
+        // Replaced strings are left behind in the store.  Before the store has to grow, repack
+        //  the strings that are still referenced so that repeatedly setting a value doesn't
+        //  creep onto the heap.
+        //
+        if ( m_Strings.GetSize() + Length + 1 > m_Strings.GetCapacity() )
+        {
+            StringStore Packed;
+            for ( u32 i=0; i < Values::Count; i++ )
+            {
+                if ( m_StringMask & (1 << i) )
+                {
+                    pcstr pszLive = m_Strings.Get( m_aValues[ i ].String );
+                    m_aValues[ i ].String = Packed.Append( pszLive, static_cast<u32>(strlen( pszLive )) );
+                }
+            }
+            m_Strings.Swap( Packed );
+        }
+
+        m_aValues[ Index ].String = m_Strings.Append( pszValue, Length );
+        m_StringMask |= (1 << Index);
+    }
+
     Property::Property(
         pcstr pszName,
         u32 Type,
@@ -38,8 +464,10 @@ namespace Properties
         ...
         )
         : m_pszName( pszName )
+        , m_Id( (pszName != NULL) ? Names::Intern( pszName ) : InvalidId )
         , m_Type( Type )
         , m_Flags( Flags )
+        , m_StringMask( 0 )
         , m_apszEnumOptions( NULL )
     {
         //
@@ -100,7 +528,7 @@ namespace Properties
         va_list pArg;
         va_start( pArg, pszValue4Name );
 
-        for ( i32 i=0; i < Values::Count; i++ )
+        for ( u32 i=0; i < Values::Count; i++ )
         {
             switch ( Type & Values::Mask )
             {
@@ -119,16 +547,16 @@ namespace Properties
 
             case Values::Float32:
             case Values::Angle:
-                m_aValues[ i ].Float32 = va_arg( pArg, f32 );
+                m_aValues[ i ].Float32 = static_cast<f32>(va_arg( pArg, f64 ));
                 break;
 
             case Values::Vector3 & Values::Mask:
             case Values::Color3 & Values::Mask:
             {
                 ASSERTMSG( i == 0, "Vector3 or Color3 can be the only value on a property." );
-                m_aValues[ 0 ].Float32 = va_arg( pArg, f32 );
-                m_aValues[ 1 ].Float32 = va_arg( pArg, f32 );
-                m_aValues[ 2 ].Float32 = va_arg( pArg, f32 );
+                m_aValues[ 0 ].Float32 = static_cast<f32>(va_arg( pArg, f64 ));
+                m_aValues[ 1 ].Float32 = static_cast<f32>(va_arg( pArg, f64 ));
+                m_aValues[ 2 ].Float32 = static_cast<f32>(va_arg( pArg, f64 ));
                 i = Values::Count;
                 break;
             }
@@ -138,17 +566,17 @@ namespace Properties
             case Values::Color4 & Values::Mask:
             {
                 ASSERTMSG( i == 0, "Vector4, Quaternion, or Color4 can be the only value on a property." );
-                m_aValues[ 0 ].Float32 = va_arg( pArg, f32 );
-                m_aValues[ 1 ].Float32 = va_arg( pArg, f32 );
-                m_aValues[ 2 ].Float32 = va_arg( pArg, f32 );
-                m_aValues[ 3 ].Float32 = va_arg( pArg, f32 );
+                m_aValues[ 0 ].Float32 = static_cast<f32>(va_arg( pArg, f64 ));
+                m_aValues[ 1 ].Float32 = static_cast<f32>(va_arg( pArg, f64 ));
+                m_aValues[ 2 ].Float32 = static_cast<f32>(va_arg( pArg, f64 ));
+                m_aValues[ 3 ].Float32 = static_cast<f32>(va_arg( pArg, f64 ));
                 i = Values::Count;
                 break;
             }
 
             case Values::String:
             case Values::Path:
-                m_asValues[ i ] = va_arg( pArg, pcstr );
+                SetValue( i, va_arg( pArg, pcstr ) );
                 break;
 
             default:
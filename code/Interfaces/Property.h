@@ -63,9 +63,196 @@ namespace Properties
         static const u32 WriteOnly                  = 0x00000008;
     }
 
+    /// <summary>
+    ///   Stable identifier for a property name.  Ids are the FNV-1a hash of the name so they can
+    ///    be computed at compile time for names a system knows statically, e.g.
+    ///    <c>static const Properties::Id Position = Properties::MakeId( "Position" );</c>
+    /// </summary>
+    typedef u32 Id;
+
+    static const Id InvalidId                       = 0;
+
+    /// <summary>
+    ///   Computes the id of a property name.
+    /// </summary>
+    /// <remarks>
+    ///   Evaluated at compile time when given a string literal in a constant expression.
+    ///    InvalidId is never returned for a valid name.
+    /// </remarks>
+    /// <param name="pszName">The property name.</param>
+    /// <param name="Hash">The running hash (leave as the default).</param>
+    /// <returns>The id of the name.</returns>
+    constexpr Id MakeId( pcstr pszName, u32 Hash = 2166136261u )
+    {
+        return (*pszName != '\0') ?
+            MakeId( pszName + 1, (Hash ^ static_cast<u8>(*pszName)) * 16777619u ) :
+            ((Hash != InvalidId) ? Hash : 1);
+    }
+
+
+    /// <summary>
+    ///   Global interning table for property names.  Registering a name records it for reverse
+    ///    lookup and checks that it does not collide with a different name already in use.
+    /// </summary>
+    class Names
+    {
+    public:
+
+        /// <summary>
+        ///   Registers a property name.
+        /// </summary>
+        /// <remarks>
+        ///   The name is copied so the caller's string does not have to stay alive.
+        /// </remarks>
+        /// <param name="pszName">The property name.</param>
+        /// <returns>The id of the name.</returns>
+        static Id Intern( pcstr pszName );
+
+        /// <summary>
+        ///   Returns the interned name for an id.
+        /// </summary>
+        /// <param name="PropertyId">The property id.</param>
+        /// <returns>The name or NULL if the id was never interned.</returns>
+        static pcstr GetName( Id PropertyId );
+    };
+
+    /// <summary>
+    ///   Packed storage for the string values of a property.  All the strings of a property share
+    ///    one NULL terminated character buffer that lives inside the property while it fits
+    ///    (small string optimization) and is moved to the heap only when it outgrows it.
+    /// </summary>
+    /// <remarks>
+    ///   The store holds up to MaxSize characters; Append truncates a string that would not fit.
+    /// </remarks>
+    class StringStore
+    {
+    public:
+
+        /// <summary>
+        ///   Number of characters (including terminators) that can be stored without allocating.
+        /// </summary>
+        static const u32 InlineCapacity             = 24;
+
+        /// <summary>
+        ///   Number of characters (including terminators) the store can hold.
+        /// </summary>
+        static const u32 MaxSize                    = 0x7FFFFFFF;
+
+        StringStore( void )
+            : m_Size( 0 )
+            , m_Capacity( InlineCapacity )
+        {
+        }
+
+        StringStore( const StringStore& Store );
+
+        StringStore( StringStore&& Store );
+
+        ~StringStore( void );
+
+        StringStore& operator=( const StringStore& Store );
+
+        StringStore& operator=( StringStore&& Store );
+
+        /// <summary>
+        ///   Exchanges the contents of two stores without copying any heap memory.
+        /// </summary>
+        /// <param name="Store">The store to swap with.</param>
+        void Swap( StringStore& Store );
+
+        /// <summary>
+        ///   Returns the string starting at the given offset.
+        /// </summary>
+        /// <param name="Offset">The offset returned by Append.</param>
+        /// <returns>A pointer to the NULL terminated string.</returns>
+        pcstr Get( u32 Offset ) const
+        {
+            ASSERT( Offset < m_Size );
+            return GetData() + Offset;
+        }
+
+        /// <summary>
+        ///   Appends a string to the store.
+        /// </summary>
+        /// <param name="pszValue">The string to append.</param>
+        /// <param name="Length">The length of the string excluding the terminator.  Characters
+        ///  past MaxSize are dropped.</param>
+        /// <returns>The offset of the stored string.</returns>
+        u32 Append( pcstr pszValue, u32 Length );
+
+        /// <summary>
+        ///   Returns True if the string points into this store.
+        /// </summary>
+        Bool Contains( pcstr pszValue ) const
+        {
+            return pszValue >= GetData() && pszValue < GetData() + m_Size;
+        }
+
+        /// <summary>
+        ///   Returns the number of characters used, including the terminators.
+        /// </summary>
+        u32 GetSize( void ) const
+        {
+            return m_Size;
+        }
+
+        /// <summary>
+        ///   Returns the number of characters that can be stored before growing.
+        /// </summary>
+        u32 GetCapacity( void ) const
+        {
+            return m_Capacity;
+        }
+
+        /// <summary>
+        ///   Removes all the strings without releasing any memory.
+        /// </summary>
+        void Clear( void )
+        {
+            m_Size = 0;
+        }
+
+        /// <summary>
+        ///   Returns True if the strings have been moved to the heap.
+        /// </summary>
+        Bool IsHeap( void ) const
+        {
+            return m_Capacity > InlineCapacity;
+        }
+
+
+    protected:
+
+        void Reserve( u32 Capacity );
+
+        const char* GetData( void ) const
+        {
+            return IsHeap() ? m_pHeap : m_aInline;
+        }
+
+        char* GetData( void )
+        {
+            return IsHeap() ? m_pHeap : m_aInline;
+        }
+
+        union
+        {
+            char                m_aInline[ InlineCapacity ];
+            char*               m_pHeap;
+        };
+        u32                     m_Size;
+        u32                     m_Capacity;
+    };
+
+
     /// <summary>
     ///   Class for providing a method to transfer paramters between a system and the framework.
     /// </summary>
+    /// <remarks>
+    ///   Numeric values are stored inline.  String values are packed into a single buffer that
+    ///    only allocates once the strings no longer fit within the property, so a property
+    ///    holding a Float32 or a Vector3 never touches the heap.
+    /// </remarks>
     class Property
     {
     public:
@@ -73,7 +260,15 @@ namespace Properties
         /// <summary>
         ///   Empty constructor.
         /// </summary>
-        Property( void ) {}
+        Property( void )
+            : m_pszName( NULL )
+            , m_Id( InvalidId )
+            , m_Type( Values::None )
+            , m_Flags( 0 )
+            , m_StringMask( 0 )
+            , m_apszEnumOptions( NULL )
+        {
+        }
 
         /// <summary>
         ///   Constructor for creating a well formed property.  Useful for creating an array of
@@ -89,6 +284,7 @@ namespace Properties
         ///    statically defined properties.  Gives the extra added bonus of naming the values
         ///    within an xDF instead of just Value1, Value2, etc.
         /// </summary>
+        /// <remarks>The name is interned so that Names::GetName finds it by id.</remarks>
         /// <param name="pszPropertyName">The name of this property.</param>
         /// <param name="PropertyType">The type of property from Proerties::Values.</param>
         /// <param name="PropertyFlags">Flags for qualifying the use of the property.</param>
@@ -100,6 +296,33 @@ namespace Properties
                   pcstr pszValue1Name, pcstr pszValue2Name, pcstr pszValue3Name, pcstr pszValue4Name,
                   ... );
 
+        /// <summary>
+        ///   Constructor for a property whose values are filled in afterwards with SetValue.  Used
+        ///    when the name and id are already known, e.g. when reading a serialized property.
+        /// </summary>
+        /// <param name="pszPropertyName">The name of this property.</param>
+        /// <param name="PropertyId">The id of the name.</param>
+        /// <param name="PropertyType">The type of property from Proerties::Values.</param>
+        /// <param name="PropertyFlags">Flags for qualifying the use of the property.</param>
+        Property( pcstr pszPropertyName, Id PropertyId, u32 PropertyType, u32 PropertyFlags )
+            : m_pszName( pszPropertyName )
+            , m_Id( PropertyId )
+            , m_Type( PropertyType )
+            , m_Flags( PropertyFlags )
+            , m_StringMask( 0 )
+            , m_apszEnumOptions( NULL )
+        {
+            m_apszValueNames[ 0 ] = sm_kpszValue1Name;
+            m_apszValueNames[ 1 ] = sm_kpszValue2Name;
+            m_apszValueNames[ 2 ] = sm_kpszValue3Name;
+            m_apszValueNames[ 3 ] = sm_kpszValue4Name;
+
+            for ( u32 i=0; i < Values::Count; i++ )
+            {
+                m_aValues[ i ].Int32 = 0;
+            }
+        }
+
         /// <summary>
         ///   Returns the property name.
         /// </summary>
@@ -109,6 +332,24 @@ namespace Properties
             return m_pszName;
         }
 
+        /// <summary>
+        ///   Returns the id of the property name.
+        /// </summary>
+        /// <returns>The property's id.</returns>
+        Id GetId( void ) const
+        {
+            return m_Id;
+        }
+
+        /// <summary>
+        ///   Returns the packed type of all the values (see VALUE1..VALUE4).
+        /// </summary>
+        /// <returns>The property's type.</returns>
+        u32 GetType( void ) const
+        {
+            return m_Type;
+        }
+
         u32 GetValueType( i32 Index ) const
         {
             ASSERT( Index >= 0 && Index < Values::Count );
@@ -150,14 +391,13 @@ namespace Properties
 
         const std::string GetString( i32 Index ) const
         {
-            ASSERT( Index >= 0 && Index < Values::Count );
-            return m_asValues[ Index ];
+            return std::string( GetStringPtr( Index ) );
         }
 
         pcstr GetStringPtr( i32 Index ) const
         {
             ASSERT( Index >= 0 && Index < Values::Count );
-            return m_asValues[ Index ].c_str();
+            return (m_StringMask & (1 << Index)) ? m_Strings.Get( m_aValues[ Index ].String ) : "";
         }
 
         const Math::Vector3 GetVector3( void ) const
@@ -215,10 +455,13 @@ namespace Properties
 
         void SetValue( i32 Index, const std::string& Value )
         {
-            ASSERT( Index >= 0 && Index < Values::Count );
-            m_asValues[ Index ] = Value;
+            u32 Length = (Value.length() < StringStore::MaxSize) ?
+                static_cast<u32>(Value.length()) : StringStore::MaxSize;
+            SetString( Index, Value.c_str(), Length );
         }
 
+        void SetValue( i32 Index, pcstr pszValue );
+
         void SetValue( const Math::Vector3& Value )
         {
             m_aValues[ 0 ].Float32 = Value.x;
@@ -274,6 +517,17 @@ namespace Properties
         }
 
 
+    protected:
+
+        /// <summary>
+        ///   Stores a string value in the packed string buffer.
+        /// </summary>
+        /// <param name="Index">The value index.</param>
+        /// <param name="pszValue">The string to store.</param>
+        /// <param name="Length">The length of the string excluding the terminator.</param>
+        void SetString( i32 Index, pcstr pszValue, u32 Length );
+
+
     protected:
 
         static pcstr            sm_kpszValue1Name;
@@ -282,6 +536,7 @@ namespace Properties
         static pcstr            sm_kpszValue4Name;
 
         pcstr                   m_pszName;
+        Id                      m_Id;
 
         u32                     m_Type;
         u32                     m_Flags;
@@ -291,17 +546,224 @@ namespace Properties
             u32                 Boolean;
             i32                 Int32;
             f32                 Float32;
+            u32                 String;     // Offset into m_Strings
         };
         Value                   m_aValues[ Values::Count ];
-        std::string             m_asValues[ Values::Count ];
+
+        // Bit n is set when value n holds an offset into m_Strings.
+        u32                     m_StringMask;
 
         const pcstr*            m_apszEnumOptions;
 
         pcstr                   m_apszValueNames[ Values::Count ];
+
+        StringStore             m_Strings;
     };
 
     typedef std::vector<Properties::Property>       Array;
     typedef Array::iterator                         Iterator;
     typedef Array::const_iterator                   ConstIterator;
-}
 
+
+    /// <summary>
+    ///   Hash map from property ids to their index in a property array.  Objects build one over
+    ///    their properties so single property gets and sets are a hash lookup instead of a scan
+    ///    comparing names.
+    /// </summary>
+    class Map
+    {
+    public:
+
+        static const u32 InvalidIndex               = static_cast<u32>(-1);
+
+        Map( void )
+            : m_Count( 0 )
+            , m_Mask( 0 )
+        {
+        }
+
+        /// <summary>
+        ///   Rebuilds the map from a property array.
+        /// </summary>
+        /// <param name="Properties">The properties to index.</param>
+        void Build( const Array& Properties );
+
+        /// <summary>
+        ///   Adds or replaces the index for an id.
+        /// </summary>
+        /// <param name="PropertyId">The property id.</param>
+        /// <param name="Index">The index of the property.</param>
+        void Insert( Id PropertyId, u32 Index );
+
+        /// <summary>
+        ///   Finds the index for an id.
+        /// </summary>
+        /// <remarks>Inlined for performance.</remarks>
+        /// <param name="PropertyId">The property id.</param>
+        /// <returns>The index of the property or InvalidIndex.</returns>
+        u32 Find( Id PropertyId ) const
+        {
+            if ( m_Count != 0 )
+            {
+                for ( u32 Slot = PropertyId & m_Mask; ; Slot = (Slot + 1) & m_Mask )
+                {
+                    const Entry& e = m_aEntries[ Slot ];
+                    if ( e.Key == PropertyId )
+                    {
+                        return e.Index;
+                    }
+                    else if ( e.Key == InvalidId )
+                    {
+                        break;
+                    }
+                }
+            }
+
+            return InvalidIndex;
+        }
+
+        /// <summary>
+        ///   Removes all the entries.
+        /// </summary>
+        void Clear( void );
+
+        /// <summary>
+        ///   Returns the number of entries.
+        /// </summary>
+        u32 Size( void ) const
+        {
+            return m_Count;
+        }
+
+
+    protected:
+
+        void Grow( void );
+
+        struct Entry
+        {
+            Id                  Key;
+            u32                 Index;
+        };
+
+        std::vector<Entry>      m_aEntries;
+        u32                     m_Count;
+        u32                     m_Mask;
+    };
+
+
+    /// <summary>
+    ///   Finds a property in an array by id.  Meant for small arrays; use a Map for repeated
+    ///    lookups.
+    /// </summary>
+    /// <param name="Properties">The properties to search.</param>
+    /// <param name="PropertyId">The property id.</param>
+    /// <returns>An iterator to the property or Properties.end().</returns>
+    inline ConstIterator Find( const Array& Properties, Id PropertyId )
+    {
+        ConstIterator it = Properties.begin();
+        for ( ; it != Properties.end(); it++ )
+        {
+            if ( it->GetId() == PropertyId )
+            {
+                break;
+            }
+        }
+        return it;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// <summary>
+    ///   A set of property changes to apply to an object, e.g. an editor edit or a replicated
+    ///    network update.  Unlike a full property array it only holds the properties that
+    ///    changed, and records the System::Changes bits the changes imply so that objects and the
+    ///    change control manager can skip work that the changes do not affect.
+    /// </summary>
+    /// <remarks>
+    ///   Changing the same property more than once coalesces into a single entry; the last value
+    ///    set wins.  Clear keeps the storage so a set reused every frame does not allocate.
+    /// </remarks>
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class ChangeSet
+    {
+    public:
+
+        ChangeSet( void )
+            : m_Changes( System::Changes::None )
+        {
+        }
+
+        /// <summary>
+        ///   Adds a property to the change set, or returns the entry already holding it.
+        /// </summary>
+        /// <remarks>The name of the id must have been interned with Names::Intern.</remarks>
+        /// <param name="PropertyId">The id of the property that changed.</param>
+        /// <param name="PropertyType">The type of the property from Properties::Values.</param>
+        /// <param name="Changes">The system changes implied by changing the property.</param>
+        /// <returns>The entry to set the new values on.</returns>
+        Property& Add( Id PropertyId, u32 PropertyType,
+                       System::Changes::BitMask Changes=System::Changes::None );
+
+        /// <summary>
+        ///   Adds a copy of a property to the change set, replacing any entry already holding it.
+        /// </summary>
+        /// <param name="Source">The property that changed.</param>
+        /// <param name="Changes">The system changes implied by changing the property.</param>
+        void Add( const Property& Source, System::Changes::BitMask Changes=System::Changes::None );
+
+        /// <summary>
+        ///   Finds a changed property.
+        /// </summary>
+        /// <remarks>Inlined for performance.</remarks>
+        /// <param name="PropertyId">The property id.</param>
+        /// <returns>The changed property or NULL if it did not change.</returns>
+        const Property* Find( Id PropertyId ) const
+        {
+            u32 Index = m_Index.Find( PropertyId );
+            return (Index != Map::InvalidIndex) ? &m_Properties[ Index ] : NULL;
+        }
+
+        /// <summary>
+        ///   Returns the changed properties as an array, for objects that only implement
+        ///    SetProperties.
+        /// </summary>
+        const Array& GetProperties( void ) const
+        {
+            return m_Properties;
+        }
+
+        /// <summary>
+        ///   Returns the union of the system changes of all the entries.
+        /// </summary>
+        System::Changes::BitMask GetChanges( void ) const
+        {
+            return m_Changes;
+        }
+
+        /// <summary>
+        ///   Returns the number of changed properties.
+        /// </summary>
+        u32 GetCount( void ) const
+        {
+            return static_cast<u32>(m_Properties.size());
+        }
+
+        Bool IsEmpty( void ) const
+        {
+            return m_Properties.empty();
+        }
+
+        /// <summary>
+        ///   Removes all the entries, keeping the storage for reuse.
+        /// </summary>
+        void Clear( void );
+
+
+    protected:
+
+        Array                       m_Properties;
+        Map                         m_Index;
+        System::Changes::BitMask    m_Changes;
+    };
+}
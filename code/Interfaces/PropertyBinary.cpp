@@ -0,0 +1,351 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#include <string.h>
+
+#include "../BaseTypes/BaseTypes.h"
+#include "Interface.h"
+
+
+namespace Interface
+{
+namespace Properties
+{
+namespace Binary
+{
+    //
+    // How a single value is stored in a record.
+    //
+    enum ValueClass
+    {
+        e_None, e_Bool, e_Int, e_Float, e_String
+    };
+
+    static ValueClass GetValueClass( u32 ValueType )
+    {
+        switch ( ValueType )
+        {
+        case Values::None:
+            return e_None;
+
+        case Values::Boolean:
+            return e_Bool;
+
+        case Values::Enum:
+        case Values::Int32:
+            return e_Int;
+
+        case Values::String:
+        case Values::Path:
+            return e_String;
+
+        default:
+            // Float32, Angle and the components of the vector, quaternion and color types.
+            return e_Float;
+        }
+    }
+
+
+    static inline u32 Align4( u32 Size )
+    {
+        return (Size + 3) & ~3;
+    }
+
+
+    ///////////////////////////////////////////////////////////////////////////////
+    // Write - Encode a property array
+    Error
+    Writer::Write(
+        const Array& Properties,
+        std::vector<u8>& Buffer
+        )
+    {
+        //
+        // First pass: collect the unique names and size the string data.
+        //
+        m_Names.Clear();
+        m_aNameIndices.clear();
+
+        u32 StringSize = 0;
+        for ( u32 i=0; i < Properties.size(); i++ )
+        {
+            const Property& p = Properties[ i ];
+            ASSERT( p.GetName() != NULL );
+
+            if ( m_Names.Find( p.GetId() ) == Map::InvalidIndex )
+            {
+                m_Names.Insert( p.GetId(), static_cast<u32>(m_aNameIndices.size()) );
+                m_aNameIndices.push_back( i );
+                StringSize += static_cast<u32>(strlen( p.GetName() )) + 1;
+            }
+
+            for ( i32 v=0; v < static_cast<i32>(Values::Count); v++ )
+            {
+                if ( GetValueClass( p.GetValueType( v ) ) == e_String )
+                {
+                    StringSize += static_cast<u32>(strlen( p.GetStringPtr( v ) )) + 1;
+                }
+            }
+        }
+        StringSize = Align4( StringSize );
+
+        u32 NameCount = static_cast<u32>(m_aNameIndices.size());
+        u32 RecordCount = static_cast<u32>(Properties.size());
+        u32 TotalSize = sizeof (Header) + NameCount * sizeof (NameEntry) +
+                        RecordCount * sizeof (Record) + StringSize;
+
+        Buffer.resize( TotalSize );
+
+        u8* pBuffer = &Buffer[ 0 ];
+        Header* pHeader = reinterpret_cast<Header*>(pBuffer);
+        NameEntry* pNames = reinterpret_cast<NameEntry*>(pHeader + 1);
+        Record* pRecords = reinterpret_cast<Record*>(pNames + NameCount);
+        char* pStrings = reinterpret_cast<char*>(pRecords + RecordCount);
+        u32 StringOffset = 0;
+
+        pHeader->Magic = LittleEndian( Magic );
+        pHeader->Version = LittleEndian( Version );
+        pHeader->NameCount = LittleEndian( NameCount );
+        pHeader->RecordCount = LittleEndian( RecordCount );
+        pHeader->StringSize = LittleEndian( StringSize );
+        pHeader->TotalSize = LittleEndian( TotalSize );
+
+        //
+        // Second pass: names, then the records with their string values.
+        //
+        for ( u32 i=0; i < NameCount; i++ )
+        {
+            const Property& p = Properties[ m_aNameIndices[ i ] ];
+            u32 Length = static_cast<u32>(strlen( p.GetName() )) + 1;
+
+            pNames[ i ].NameId = LittleEndian( p.GetId() );
+            pNames[ i ].NameOffset = LittleEndian( StringOffset );
+            memcpy( pStrings + StringOffset, p.GetName(), Length );
+            StringOffset += Length;
+        }
+
+        for ( u32 i=0; i < RecordCount; i++ )
+        {
+            const Property& p = Properties[ i ];
+            Record& r = pRecords[ i ];
+
+            r.NameIndex = LittleEndian( m_Names.Find( p.GetId() ) );
+            r.Type = LittleEndian( p.GetType() );
+            r.Flags = LittleEndian( p.GetFlags() );
+
+            for ( i32 v=0; v < static_cast<i32>(Values::Count); v++ )
+            {
+                u32 Raw = 0;
+
+                switch ( GetValueClass( p.GetValueType( v ) ) )
+                {
+                case e_None:
+                    break;
+
+                case e_Bool:
+                    Raw = p.GetBool( v );
+                    break;
+
+                case e_Int:
+                    Raw = static_cast<u32>(p.GetInt32( v ));
+                    break;
+
+                case e_Float:
+                {
+                    union { u32 Raw; f32 Float32; } Value;
+                    Value.Float32 = p.GetFloat32( v );
+                    Raw = Value.Raw;
+                    break;
+                }
+
+                case e_String:
+                {
+                    pcstr pszValue = p.GetStringPtr( v );
+                    u32 Length = static_cast<u32>(strlen( pszValue )) + 1;
+
+                    memcpy( pStrings + StringOffset, pszValue, Length );
+                    Raw = StringOffset;
+                    StringOffset += Length;
+                    break;
+                }
+                }
+
+                r.aValues[ v ] = LittleEndian( Raw );
+            }
+        }
+
+        //
+        // Zero the alignment padding so identical arrays produce identical buffers.
+        //
+        ASSERT( StringOffset <= StringSize );
+        memset( pStrings + StringOffset, 0, StringSize - StringOffset );
+
+        return Errors::Success;
+    }
+
+
+    Reader::Reader(
+        void
+        )
+        : m_pNames( NULL )
+        , m_pRecords( NULL )
+        , m_pStrings( NULL )
+        , m_RecordCount( 0 )
+    {
+    }
+
+
+    ///////////////////////////////////////////////////////////////////////////////
+    // Attach - Attach to and validate an encoded buffer
+    Error
+    Reader::Attach(
+        const void* pBuffer,
+        u32 Size
+        )
+    {
+        m_RecordCount = 0;
+
+        if ( pBuffer == NULL || Size < sizeof (Header) )
+        {
+            return Errors::File::InvalidFormat;
+        }
+        ASSERTMSG( (reinterpret_cast<uptr>(pBuffer) & 3) == 0, "Property buffers must be 4 byte aligned." );
+
+        const Header* pHeader = reinterpret_cast<const Header*>(pBuffer);
+        if ( LittleEndian( pHeader->Magic ) != Magic || LittleEndian( pHeader->Version ) != Version )
+        {
+            return Errors::File::InvalidFormat;
+        }
+
+        u64 NameCount = LittleEndian( pHeader->NameCount );
+        u64 RecordCount = LittleEndian( pHeader->RecordCount );
+        u64 StringSize = LittleEndian( pHeader->StringSize );
+        u64 TotalSize = sizeof (Header) + NameCount * sizeof (NameEntry) +
+                        RecordCount * sizeof (Record) + StringSize;
+
+        if ( TotalSize != LittleEndian( pHeader->TotalSize ) || TotalSize > Size ||
+             (StringSize > 0 && reinterpret_cast<pcstr>(pBuffer)[ TotalSize - 1 ] != '\0') )
+        {
+            return Errors::File::InvalidFormat;
+        }
+
+        const NameEntry* pNames = reinterpret_cast<const NameEntry*>(pHeader + 1);
+        const Record* pRecords = reinterpret_cast<const Record*>(pNames + NameCount);
+        pcstr pStrings = reinterpret_cast<pcstr>(pRecords + RecordCount);
+
+        //
+        // Check every offset once here so views never have to.
+        //
+        for ( u32 i=0; i < NameCount; i++ )
+        {
+            u32 NameOffset = LittleEndian( pNames[ i ].NameOffset );
+            if ( NameOffset >= StringSize )
+            {
+                return Errors::File::InvalidFormat;
+            }
+
+            //
+            // The id must be that of the name and must not collide with a different name already
+            //  interned, otherwise the views would hand out a name that does not match the id.
+            //
+            Id NameId = LittleEndian( pNames[ i ].NameId );
+            pcstr pszInterned = Names::GetName( NameId );
+            if ( MakeId( pStrings + NameOffset ) != NameId ||
+                 (pszInterned != NULL && strcmp( pszInterned, pStrings + NameOffset ) != 0) )
+            {
+                return Errors::File::InvalidFormat;
+            }
+        }
+
+        for ( u32 i=0; i < RecordCount; i++ )
+        {
+            const Record& r = pRecords[ i ];
+            if ( LittleEndian( r.NameIndex ) >= NameCount )
+            {
+                return Errors::File::InvalidFormat;
+            }
+
+            u32 Type = LittleEndian( r.Type );
+            for ( u32 v=0; v < Values::Count; v++, Type >>= 8 )
+            {
+                if ( GetValueClass( Type & Values::Mask ) == e_String &&
+                     LittleEndian( r.aValues[ v ] ) >= StringSize )
+                {
+                    return Errors::File::InvalidFormat;
+                }
+            }
+        }
+
+        //
+        // Only intern the names of a buffer that is valid so GetName works for everything read.
+        //
+        for ( u32 i=0; i < NameCount; i++ )
+        {
+            Names::Intern( pStrings + LittleEndian( pNames[ i ].NameOffset ) );
+        }
+
+        m_pNames = pNames;
+        m_pRecords = pRecords;
+        m_pStrings = pStrings;
+        m_RecordCount = static_cast<u32>(RecordCount);
+
+        return Errors::Success;
+    }
+
+
+    ///////////////////////////////////////////////////////////////////////////////
+    // Read - Convert the views into properties
+    void
+    Reader::Read(
+        Array& Properties
+        ) const
+    {
+        Properties.reserve( Properties.size() + m_RecordCount );
+
+        for ( u32 i=0; i < m_RecordCount; i++ )
+        {
+            View v = Get( i );
+
+            Properties.push_back( Property( v.GetName(), v.GetId(), v.GetType(), v.GetFlags() ) );
+            Property& p = Properties.back();
+
+            for ( i32 Index=0; Index < static_cast<i32>(Values::Count); Index++ )
+            {
+                switch ( GetValueClass( v.GetValueType( Index ) ) )
+                {
+                case e_None:
+                    break;
+
+                case e_Bool:
+                    p.SetValue( Index, v.GetBool( Index ) );
+                    break;
+
+                case e_Int:
+                    p.SetValue( Index, v.GetInt32( Index ) );
+                    break;
+
+                case e_Float:
+                    p.SetValue( Index, v.GetFloat32( Index ) );
+                    break;
+
+                case e_String:
+                    p.SetValue( Index, v.GetStringPtr( Index ) );
+                    break;
+                }
+            }
+        }
+    }
+}
+}
+}
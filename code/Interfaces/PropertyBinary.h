@@ -0,0 +1,253 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#pragma once
+
+/*******************************************************************************
+* NAMESPACE: Properties::Binary
+*
+* DESCRIPTION:
+* Versioned little-endian binary encoding of property arrays.
+*
+* LAYOUT:
+*   Header
+*   Name table      Header.NameCount     x NameEntry   (each property id once, with its name)
+*   Record table    Header.RecordCount   x Record      (one per property)
+*   String data     Header.StringSize    bytes         (NULL terminated strings)
+*
+* All fields are 32 bit little-endian and every table is 4 byte aligned, so a
+* buffer can be read in place.  Names and string values are offsets into the
+* string data and are handed out as pointers into the buffer.  Enum option
+* tables and value names are static metadata owned by the systems and are not
+* stored.
+*******************************************************************************/
+
+namespace Properties
+{
+namespace Binary
+{
+    static const u32 Magic                          = 0x42505253;   // "SRPB"
+    static const u32 Version                        = 1;
+
+    struct Header
+    {
+        u32                     Magic;
+        u32                     Version;
+        u32                     NameCount;
+        u32                     RecordCount;
+        u32                     StringSize;
+        u32                     TotalSize;
+    };
+
+    struct NameEntry
+    {
+        Id                      NameId;
+        u32                     NameOffset;         // Offset into the string data
+    };
+
+    struct Record
+    {
+        u32                     NameIndex;          // Index into the name table
+        u32                     Type;
+        u32                     Flags;
+        u32                     aValues[ Values::Count ];   // Raw bits or string data offsets
+    };
+
+
+    /// <summary>
+    ///   Swaps a value between host and little-endian byte order.
+    /// </summary>
+    /// <remarks>Inlined for performance; a no-op on little-endian hosts.</remarks>
+    inline u32 LittleEndian( u32 Value )
+    {
+#if defined( __BYTE_ORDER__ ) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        return __builtin_bswap32( Value );
+#else
+        return Value;
+#endif
+    }
+
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// <summary>
+    ///   Encodes property arrays.  The writer keeps its scratch tables between calls so that
+    ///    repeatedly snapshotting objects does not allocate once it has warmed up.
+    /// </summary>
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class Writer
+    {
+    public:
+
+        /// <summary>
+        ///   Encodes a property array.
+        /// </summary>
+        /// <param name="Properties">The properties to encode.</param>
+        /// <param name="Buffer">The buffer to write to.  It is resized to the encoded size.</param>
+        /// <returns>An error code.</returns>
+        Error Write( const Array& Properties, std::vector<u8>& Buffer );
+
+
+    protected:
+
+        Map                     m_Names;
+        std::vector<u32>        m_aNameIndices;
+    };
+
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// <summary>
+    ///   Zero-copy reader over an encoded buffer.  The buffer must stay alive, unchanged and 4
+    ///    byte aligned for as long as the reader or anything it returned is in use.
+    /// </summary>
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class Reader
+    {
+    public:
+
+        /// <summary>
+        ///   A read-only property that references the buffer directly.
+        /// </summary>
+        class View
+        {
+            friend class Reader;
+
+        public:
+
+            Id GetId( void ) const
+            {
+                return LittleEndian( m_pNames[ LittleEndian( m_pRecord->NameIndex ) ].NameId );
+            }
+
+            pcstr GetName( void ) const
+            {
+                return m_pStrings +
+                    LittleEndian( m_pNames[ LittleEndian( m_pRecord->NameIndex ) ].NameOffset );
+            }
+
+            u32 GetType( void ) const
+            {
+                return LittleEndian( m_pRecord->Type );
+            }
+
+            u32 GetValueType( i32 Index ) const
+            {
+                ASSERT( Index >= 0 && Index < Values::Count );
+                return (GetType() >> (Index * 8)) & Values::Mask;
+            }
+
+            u32 GetFlags( void ) const
+            {
+                return LittleEndian( m_pRecord->Flags );
+            }
+
+            Bool GetBool( i32 Index ) const
+            {
+                return GetRaw( Index );
+            }
+
+            i32 GetInt32( i32 Index ) const
+            {
+                return static_cast<i32>(GetRaw( Index ));
+            }
+
+            f32 GetFloat32( i32 Index ) const
+            {
+                union { u32 Raw; f32 Float32; } Value;
+                Value.Raw = GetRaw( Index );
+                return Value.Float32;
+            }
+
+            /// <summary>
+            ///   Returns a string value.  The pointer refers into the buffer.
+            /// </summary>
+            pcstr GetStringPtr( i32 Index ) const
+            {
+                return m_pStrings + GetRaw( Index );
+            }
+
+
+        protected:
+
+            u32 GetRaw( i32 Index ) const
+            {
+                ASSERT( Index >= 0 && Index < Values::Count );
+                return LittleEndian( m_pRecord->aValues[ Index ] );
+            }
+
+            const Record*       m_pRecord;
+            const NameEntry*    m_pNames;
+            pcstr               m_pStrings;
+        };
+
+
+        Reader( void );
+
+        /// <summary>
+        ///   Attaches the reader to an encoded buffer and validates it.
+        /// </summary>
+        /// <remarks>
+        ///   The names of a valid buffer are interned; a name whose id does not match it or that
+        ///    collides with a different interned name makes the buffer invalid.
+        /// </remarks>
+        /// <param name="pBuffer">The encoded buffer.</param>
+        /// <param name="Size">The size of the buffer in bytes.</param>
+        /// <returns>Errors::Success or Errors::File::InvalidFormat.</returns>
+        Error Attach( const void* pBuffer, u32 Size );
+
+        /// <summary>
+        ///   Returns the number of properties in the buffer.
+        /// </summary>
+        u32 GetCount( void ) const
+        {
+            return m_RecordCount;
+        }
+
+        /// <summary>
+        ///   Returns a view of a property in the buffer.
+        /// </summary>
+        /// <remarks>Inlined for performance.</remarks>
+        /// <param name="Index">The index of the property.</param>
+        /// <returns>A view of the property.</returns>
+        View Get( u32 Index ) const
+        {
+            ASSERT( Index < m_RecordCount );
+
+            View v;
+            v.m_pRecord = m_pRecords + Index;
+            v.m_pNames = m_pNames;
+            v.m_pStrings = m_pStrings;
+            return v;
+        }
+
+        /// <summary>
+        ///   Appends all the properties in the buffer to a property array.
+        /// </summary>
+        /// <remarks>
+        ///   Property names point into the buffer; string values are copied into the properties.
+        /// </remarks>
+        /// <param name="Properties">The array to append to.</param>
+        void Read( Array& Properties ) const;
+
+
+    protected:
+
+        const NameEntry*        m_pNames;
+        const Record*           m_pRecords;
+        pcstr                   m_pStrings;
+        u32                     m_RecordCount;
+    };
+}
+}
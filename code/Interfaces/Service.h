@@ -39,6 +39,11 @@ public:
     ///   Interface class for providing access to other systems' ISystem, ISystemScene, and
     ///    ISystemObject.
     /// </summary>
+    /// <remarks>
+    ///   Single properties are matched on Properties::Property::GetId(), so providers are
+    ///    expected to keep a Properties::Map per system, scene and object instead of comparing
+    ///    names against the full property array.
+    /// </remarks>
     ////////////////////////////////////////////////////////////////////////////////////////////////
 
     class ISystemAccess
@@ -294,6 +299,14 @@ public:
 		/// </param>
 		virtual void getJobRatios( f32* jobRatios ) = 0;
 
+		/// <summary cref=IInstrumentation::getJobCPUUsage>
+		///		Get the share of all the CPUs that one type of job used over the last update interval,
+		///		from the ticks passed to CaptureJobCounterTicks.
+		/// </summary>
+		/// <param name="jobType">u32 - The type of the job; a member of System::Types.</param>
+		/// <returns>f32 - CPU utilization (0-100f).</returns>
+		virtual f32 getJobCPUUsage( u32 jobType ) = 0;
+
 	};
 
 	/// <summary>
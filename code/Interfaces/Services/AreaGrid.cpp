@@ -0,0 +1,412 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#include <math.h>
+#include <algorithm>
+
+#include "AreaGrid.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetCell - Gets the grid cell holding a coordinate
+static inline i32
+GetCell(
+    f32 Value,
+    f32 InvCellSize
+    )
+{
+    // Far away coordinates are clamped so that the cell fits
+    const f32 Limit = 1e8f;
+    f32 Cell = floorf( Value * InvCellSize );
+    return static_cast<i32>(std::max( -Limit, std::min( Cell, Limit ) ));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetBucket - Hashes a grid cell to a bucket
+static inline u32
+GetBucket(
+    i32 x,
+    i32 z,
+    u32 BucketCount
+    )
+{
+    u32 Hash = (static_cast<u32>(x) * 73856093) ^ (static_cast<u32>(z) * 19349663);
+    return Hash & (BucketCount - 1);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// AreaGrid - Starts with no areas
+AreaGrid::AreaGrid(
+    f32 CellSize
+    )
+    : m_InvCellSize( 1.0f / CellSize )
+    , m_aBucketStart( sm_BucketCount + 1, 0 )
+{
+    ASSERT( CellSize > 0.0f );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ~AreaGrid
+AreaGrid::~AreaGrid(
+    void
+    )
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ChangeOccurred - Queues a changed area
+Error
+AreaGrid::ChangeOccurred(
+    ISubject* pSubject,
+    System::Changes::BitMask ChangeType
+    )
+{
+    //
+    // A subject going away is inside its own destructor and cannot be cast any more.
+    //
+    if ( ChangeType == 0 )
+    {
+        Queue( pSubject, NULL );
+    }
+    else if ( ChangeType & System::Changes::POI::Area )
+    {
+        IAreaObject* pArea = dynamic_cast<IAreaObject*>(pSubject);
+        if ( pArea != NULL )
+        {
+            Queue( pSubject, pArea );
+        }
+    }
+
+    return Errors::Success;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SetArea - Queues an area to read
+void
+AreaGrid::SetArea(
+    IAreaObject* pArea
+    )
+{
+    ASSERT( pArea != NULL );
+
+    ISubject* pSubject = dynamic_cast<ISubject*>(pArea);
+    ASSERTMSG( pSubject != NULL, "Areas must be subjects." );
+    Queue( pSubject, pArea );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// RemoveArea - Queues an area to drop
+void
+AreaGrid::RemoveArea(
+    ISubject* pSubject
+    )
+{
+    ASSERT( pSubject != NULL );
+    Queue( pSubject, NULL );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Queue - Queues an area for Update
+void
+AreaGrid::Queue(
+    ISubject* pSubject,
+    IAreaObject* pArea
+    )
+{
+    Queued Change;
+    Change.pSubject = pSubject;
+    Change.pArea = pArea;
+
+    SCOPED_SPIN_LOCK( m_QueueMutex );
+    m_aQueued.push_back( Change );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Update - Reads the queued areas and rebins the grid if any changed
+void
+AreaGrid::Update(
+    void
+    )
+{
+    std::vector<Queued> aQueued;
+    {
+        SCOPED_SPIN_LOCK( m_QueueMutex );
+        aQueued.swap( m_aQueued );
+    }
+
+    if ( aQueued.empty() )
+    {
+        return;
+    }
+
+    PROFILE_ZONE( "AreaGrid::Update" );
+
+    //
+    // Only the last change queued for a subject counts; a subject removed may already be gone,
+    //  so it is never read.
+    //
+    std::stable_sort( aQueued.begin(), aQueued.end(), IsQueuedBefore );
+
+    for ( size_t i=0; i < aQueued.size(); i++ )
+    {
+        ISubject* pSubject = aQueued[ i ].pSubject;
+        IAreaObject* pArea = aQueued[ i ].pArea;
+        if ( i + 1 < aQueued.size() && aQueued[ i + 1 ].pSubject == pSubject )
+        {
+            continue;
+        }
+
+        if ( pArea == NULL || !pArea->IsAreaActive() )
+        {
+            Drop( pSubject );
+            continue;
+        }
+
+        std::map<ISubject*, u32>::iterator it = m_AreaIndex.find( pSubject );
+        u32 Index;
+        if ( it != m_AreaIndex.end() )
+        {
+            Index = it->second;
+        }
+        else
+        {
+            Index = static_cast<u32>(m_aAreas.size());
+            m_aAreas.push_back( Area() );
+            m_AreaIndex[ pSubject ] = Index;
+        }
+
+        Area& Target = m_aAreas[ Index ];
+        pArea->GetAreaBB( Target.Min, Target.Max );
+        Target.TypeBit = 1 << pArea->GetAreaType();
+        Target.pArea = pArea;
+        Target.pSubject = pSubject;
+    }
+
+    Build();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// IsQueuedBefore - Orders queued changes by subject
+Bool
+AreaGrid::IsQueuedBefore(
+    const Queued& a,
+    const Queued& b
+    )
+{
+    return a.pSubject < b.pSubject;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Drop - Drops an area, moving the last one into its place
+void
+AreaGrid::Drop(
+    ISubject* pSubject
+    )
+{
+    std::map<ISubject*, u32>::iterator it = m_AreaIndex.find( pSubject );
+    if ( it == m_AreaIndex.end() )
+    {
+        return;
+    }
+
+    u32 Index = it->second;
+    m_AreaIndex.erase( it );
+
+    if ( Index + 1 < m_aAreas.size() )
+    {
+        m_aAreas[ Index ] = m_aAreas.back();
+        m_AreaIndex[ m_aAreas[ Index ].pSubject ] = Index;
+    }
+    m_aAreas.pop_back();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Build - Bins the areas in the buckets of the cells they are over
+void
+AreaGrid::Build(
+    void
+    )
+{
+    //
+    // List the buckets of each area once, then count and fill the buckets.
+    //
+    std::vector<u32> aAreaBuckets;
+    std::vector<u32> aAreaFirst;
+    std::vector<u32> aCells;
+
+    m_aLargeAreas.clear();
+    aAreaFirst.reserve( m_aAreas.size() + 1 );
+
+    for ( u32 a=0; a < static_cast<u32>(m_aAreas.size()); a++ )
+    {
+        aAreaFirst.push_back( static_cast<u32>(aAreaBuckets.size()) );
+
+        const Area& Current = m_aAreas[ a ];
+        i32 MinX = GetCell( Current.Min.x, m_InvCellSize );
+        i32 MinZ = GetCell( Current.Min.z, m_InvCellSize );
+        i32 MaxX = GetCell( Current.Max.x, m_InvCellSize );
+        i32 MaxZ = GetCell( Current.Max.z, m_InvCellSize );
+
+        u32 Width = static_cast<u32>(MaxX - MinX) + 1;
+        u32 Depth = static_cast<u32>(MaxZ - MinZ) + 1;
+        if ( Width > sm_MaxAreaCells || Depth > sm_MaxAreaCells || Width * Depth > sm_MaxAreaCells )
+        {
+            m_aLargeAreas.push_back( a );
+            continue;
+        }
+
+        aCells.clear();
+        for ( i32 x=MinX; x <= MaxX; x++ )
+        {
+            for ( i32 z=MinZ; z <= MaxZ; z++ )
+            {
+                aCells.push_back( GetBucket( x, z, sm_BucketCount ) );
+            }
+        }
+        std::sort( aCells.begin(), aCells.end() );
+        aCells.erase( std::unique( aCells.begin(), aCells.end() ), aCells.end() );
+
+        aAreaBuckets.insert( aAreaBuckets.end(), aCells.begin(), aCells.end() );
+    }
+    aAreaFirst.push_back( static_cast<u32>(aAreaBuckets.size()) );
+
+    std::fill( m_aBucketStart.begin(), m_aBucketStart.end(), 0 );
+    for ( size_t i=0; i < aAreaBuckets.size(); i++ )
+    {
+        m_aBucketStart[ aAreaBuckets[ i ] + 1 ]++;
+    }
+    for ( u32 b=0; b < sm_BucketCount; b++ )
+    {
+        m_aBucketStart[ b + 1 ] += m_aBucketStart[ b ];
+    }
+
+    std::vector<u32> aFill( m_aBucketStart.begin(), m_aBucketStart.end() - 1 );
+    m_aBucketAreas.resize( aAreaBuckets.size() );
+
+    for ( u32 a=0; a < static_cast<u32>(m_aAreas.size()); a++ )
+    {
+        for ( u32 i=aAreaFirst[ a ]; i < aAreaFirst[ a + 1 ]; i++ )
+        {
+            m_aBucketAreas[ aFill[ aAreaBuckets[ i ] ]++ ] = a;
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Query - Tests each point against the areas of its bucket and the large areas
+void
+AreaGrid::Query(
+    const Math::Vector3* aPoints,
+    u32 Count,
+    Membership* pAreasAtPoints,
+    Membership* pPointsInAreas,
+    u32 TypeMask
+    ) const
+{
+    ASSERT( aPoints != NULL || Count == 0 );
+
+    // The areas each point is inside, point by point
+    std::vector<u32> aFirst;
+    std::vector<u32> aAreas;
+    aFirst.reserve( Count + 1 );
+
+    for ( u32 p=0; p < Count; p++ )
+    {
+        aFirst.push_back( static_cast<u32>(aAreas.size()) );
+
+        const Math::Vector3& Point = aPoints[ p ];
+        u32 Bucket = GetBucket( GetCell( Point.x, m_InvCellSize ), GetCell( Point.z, m_InvCellSize ),
+                                sm_BucketCount );
+
+        for ( u32 l=0; l < 2; l++ )
+        {
+            const u32* aIndices;
+            u32 IndexCount;
+            if ( l == 0 )
+            {
+                aIndices = m_aBucketAreas.empty() ? NULL : &m_aBucketAreas[ 0 ] + m_aBucketStart[ Bucket ];
+                IndexCount = m_aBucketStart[ Bucket + 1 ] - m_aBucketStart[ Bucket ];
+            }
+            else
+            {
+                aIndices = m_aLargeAreas.empty() ? NULL : &m_aLargeAreas[ 0 ];
+                IndexCount = static_cast<u32>(m_aLargeAreas.size());
+            }
+
+            for ( u32 i=0; i < IndexCount; i++ )
+            {
+                const Area& Candidate = m_aAreas[ aIndices[ i ] ];
+
+                if ( (Candidate.TypeBit & TypeMask) != 0 &&
+                     Point.x >= Candidate.Min.x && Point.x <= Candidate.Max.x &&
+                     Point.y >= Candidate.Min.y && Point.y <= Candidate.Max.y &&
+                     Point.z >= Candidate.Min.z && Point.z <= Candidate.Max.z )
+                {
+                    aAreas.push_back( aIndices[ i ] );
+                }
+            }
+        }
+    }
+    aFirst.push_back( static_cast<u32>(aAreas.size()) );
+
+    //
+    // Turn the list inside out for the points in each area; going through the points in order
+    //  keeps each area's points in order.
+    //
+    if ( pPointsInAreas != NULL )
+    {
+        u32 AreaCount = static_cast<u32>(m_aAreas.size());
+        std::vector<u32>& aAreaFirst = pPointsInAreas->aFirst;
+        std::vector<u32>& aInside = pPointsInAreas->aMembers;
+
+        aAreaFirst.assign( AreaCount + 1, 0 );
+        for ( size_t i=0; i < aAreas.size(); i++ )
+        {
+            aAreaFirst[ aAreas[ i ] + 1 ]++;
+        }
+        for ( u32 a=0; a < AreaCount; a++ )
+        {
+            aAreaFirst[ a + 1 ] += aAreaFirst[ a ];
+        }
+
+        std::vector<u32> aFill( aAreaFirst.begin(), aAreaFirst.end() - 1 );
+        aInside.resize( aAreas.size() );
+
+        for ( u32 p=0; p < Count; p++ )
+        {
+            for ( u32 i=aFirst[ p ]; i < aFirst[ p + 1 ]; i++ )
+            {
+                aInside[ aFill[ aAreas[ i ] ]++ ] = p;
+            }
+        }
+    }
+
+    if ( pAreasAtPoints != NULL )
+    {
+        pAreasAtPoints->aFirst.swap( aFirst );
+        pAreasAtPoints->aMembers.swap( aAreas );
+    }
+}
@@ -0,0 +1,183 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#pragma once
+
+//
+// core includes
+//
+#include "../../BaseTypes/BaseTypes.h"
+#include "../../BaseTypes/TbbSpinMutex.h"
+#include "../Interface.h"
+#include <map>
+#include <vector>
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// <summary>
+///   Spatial index of the active areas of a scene, answering which areas a batch of points, such
+///    as the positions of the agents of an AI system, are inside.  Testing every agent against
+///    every area costs the product of their counts; the grid only tests a point against the
+///    areas over its cell.
+/// </summary>
+/// <remarks>
+///   The areas are binned in a grid of cells over the x-z plane, y being up, hashed into a fixed
+///    number of buckets.  An area over more cells than sm_MaxAreaCells is kept in a short list
+///    tested against every point instead.
+/// <para>
+///   The grid observes the areas for System::Changes::POI::Area.  A change only queues the area;
+///    Update, called once a frame by the system owning the grid, reads the box, type and state of
+///    the queued areas and rebins them, dropping those no longer active.
+/// </para>
+/// <para>
+///   Areas are kept by their ISubject.  A subject going away notifies its observers from its own
+///    destructor, when it can no longer be cast to IAreaObject, so it is dropped by its subject
+///    pointer alone.
+/// </para>
+/// </remarks>
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class AreaGrid : public IObserver
+{
+public:
+
+    static const u32 AllTypes = static_cast<u32>(-1);
+
+    /// <summary>
+    ///   The members of each of a list of items, such as the areas each point is inside.  The
+    ///    members of item i are aMembers[ aFirst[ i ] ] up to aMembers[ aFirst[ i + 1 ] ].
+    /// </summary>
+    struct Membership
+    {
+        std::vector<u32>    aFirst;
+        std::vector<u32>    aMembers;
+    };
+
+
+    /// <summary>
+    ///   Constructor.
+    /// </summary>
+    /// <param name="CellSize">The side of the grid cells, around the size of a typical
+    ///  area.</param>
+    AreaGrid( f32 CellSize=16.0f );
+
+    /// <summary>
+    ///   Destructor.
+    /// </summary>
+    virtual ~AreaGrid( void );
+
+    /// <summary cref="IObserver::ChangeOccurred">
+    ///   Queues an area for the next Update.  Safe to call from any thread.
+    /// </summary>
+    /// <param name="pSubject">The area's subject; changes of subjects not implementing
+    ///  IAreaObject are ignored.</param>
+    /// <param name="ChangeType">System::Changes::POI::Area, or 0 if the subject is going
+    ///  away.</param>
+    /// <returns>Errors::Success.</returns>
+    virtual Error ChangeOccurred( ISubject* pSubject, System::Changes::BitMask ChangeType );
+
+    /// <summary>
+    ///   Queues an area to be read by the next Update, such as when it is first created.  Safe to
+    ///    call from any thread.
+    /// </summary>
+    /// <param name="pArea">The area, which must also be an ISubject.</param>
+    void SetArea( IAreaObject* pArea );
+
+    /// <summary>
+    ///   Queues an area to be dropped by the next Update.  Safe to call from any thread.
+    /// </summary>
+    /// <param name="pSubject">The area's subject.</param>
+    void RemoveArea( ISubject* pSubject );
+
+    /// <summary>
+    ///   Reads the areas queued since the last call and rebins them.  Not safe to call while
+    ///    Query runs.
+    /// </summary>
+    void Update( void );
+
+    /// <summary>
+    ///   Gets the number of active areas as of the last Update.
+    /// </summary>
+    u32 GetAreaCount( void ) const
+    {
+        return static_cast<u32>(m_aAreas.size());
+    }
+
+    /// <summary>
+    ///   Gets an active area by its index, from 0 up to GetAreaCount.  Indices change with Update.
+    /// </summary>
+    IAreaObject* GetArea( u32 Index ) const
+    {
+        ASSERT( Index < m_aAreas.size() );
+        return m_aAreas[ Index ].pArea;
+    }
+
+    /// <summary>
+    ///   Finds the active areas each of a batch of points is inside, in a single pass over the
+    ///    points.  Safe to call from several threads at once.
+    /// </summary>
+    /// <param name="aPoints">The points.</param>
+    /// <param name="Count">The number of points.</param>
+    /// <param name="pAreasAtPoints">If not NULL, returns the indices of the areas each point is
+    ///  inside.</param>
+    /// <param name="pPointsInAreas">If not NULL, returns the indices of the points inside each
+    ///  area, in increasing order.</param>
+    /// <param name="TypeMask">The area types to look for, as bits shifted left by
+    ///  IAreaObject::AreaType.</param>
+    void Query( const Math::Vector3* aPoints, u32 Count, Membership* pAreasAtPoints,
+                Membership* pPointsInAreas, u32 TypeMask=AllTypes ) const;
+
+
+protected:
+
+    static const u32 sm_BucketCount = 1024;             // A power of 2
+    static const u32 sm_MaxAreaCells = 64;
+
+    struct Area
+    {
+        Math::Vector3       Min;
+        Math::Vector3       Max;
+        u32                 TypeBit;
+        IAreaObject*        pArea;
+        ISubject*           pSubject;
+    };
+
+    // An area queued for Update; pArea is NULL when it is removed
+    struct Queued
+    {
+        ISubject*           pSubject;
+        IAreaObject*        pArea;
+    };
+
+    static Bool IsQueuedBefore( const Queued& a, const Queued& b );
+
+    void Queue( ISubject* pSubject, IAreaObject* pArea );
+    void Drop( ISubject* pSubject );
+    void Build( void );
+
+    f32                             m_InvCellSize;
+
+    // The active areas and their index by subject
+    std::vector<Area>               m_aAreas;
+    std::map<ISubject*, u32>        m_AreaIndex;
+
+    // The areas over the cells hashed to bucket b are m_aBucketAreas[ m_aBucketStart[ b ] ] up to
+    //  the next start; areas over too many cells are in m_aLargeAreas
+    std::vector<u32>                m_aBucketStart;
+    std::vector<u32>                m_aBucketAreas;
+    std::vector<u32>                m_aLargeAreas;
+
+    DEFINE_SPIN_MUTEX( m_QueueMutex );
+    std::vector<Queued>             m_aQueued;
+};
@@ -0,0 +1,1881 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "BvhCollision.h"
+
+
+const f32 BvhCollision::sm_RebuildCostRatio = 1.5f;
+const f32 BvhCollision::sm_MaxPacketSpread = 2.0f;
+const f32 BvhCollision::sm_GroundSlack = 1e-4f;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetAxis - Gets a component of a vector by index
+static inline f32
+GetAxis(
+    const Math::Vector3& v,
+    u32 Axis
+    )
+{
+    return (Axis == 0) ? v.x : (Axis == 1) ? v.y : v.z;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SurfaceArea - Gets the surface area of a box, 0 for an empty one
+static inline f32
+SurfaceArea(
+    const Math::Vector3& Min,
+    const Math::Vector3& Max
+    )
+{
+    Math::Vector3 Size = Max - Min;
+    if ( Size.x < 0.0f || Size.y < 0.0f || Size.z < 0.0f )
+    {
+        return 0.0f;
+    }
+    return 2.0f * (Size.x * Size.y + Size.y * Size.z + Size.z * Size.x);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// HalfPerimeter - Gets the sum of the sides of a box
+static inline f32
+HalfPerimeter(
+    const Math::Vector3& Min,
+    const Math::Vector3& Max
+    )
+{
+    Math::Vector3 Size = Max - Min;
+    return Size.x + Size.y + Size.z;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Grow - Grows a box to contain another
+static inline void
+Grow(
+    Math::Vector3& Min,
+    Math::Vector3& Max,
+    const Math::Vector3& OtherMin,
+    const Math::Vector3& OtherMax
+    )
+{
+    Min.x = std::min( Min.x, OtherMin.x );
+    Min.y = std::min( Min.y, OtherMin.y );
+    Min.z = std::min( Min.z, OtherMin.z );
+    Max.x = std::max( Max.x, OtherMax.x );
+    Max.y = std::max( Max.y, OtherMax.y );
+    Max.z = std::max( Max.z, OtherMax.z );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// InvertAxis - Gets the reciprocal of a ray direction, keeping it finite for the slab tests
+static inline f32
+InvertAxis(
+    f32 Direction
+    )
+{
+    if ( fabsf( Direction ) > 1e-20f )
+    {
+        return 1.0f / Direction;
+    }
+    return (Direction < 0.0f) ? -1e30f : 1e30f;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// BvhCollision - Starts with no objects and no requests
+BvhCollision::BvhCollision(
+    void
+    )
+    : m_bRebuild( False )
+    , m_bRefit( False )
+    , m_bRebuildGround( False )
+    , m_BuildCost( 0.0f )
+    , m_GroundCellSize( 0.0f )
+    , m_GroundSize( 0 )
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ~BvhCollision
+BvhCollision::~BvhCollision(
+    void
+    )
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SetObject - Adds an object or updates its box
+void
+BvhCollision::SetObject(
+    pcstr pszName,
+    const Math::Vector3& Min,
+    const Math::Vector3& Max,
+    Bool bGround
+    )
+{
+    ASSERT( pszName != NULL );
+
+    std::map<std::string, u32>::iterator it = m_ObjectIndex.find( pszName );
+    if ( it != m_ObjectIndex.end() )
+    {
+        Object& Target = m_aObjects[ it->second ];
+
+        // Ground objects are kept in the ground grid rather than the hierarchy
+        if ( Target.bGround != bGround )
+        {
+            m_bRebuild = True;
+        }
+        else if ( bGround )
+        {
+            m_bRebuildGround = True;
+        }
+        else
+        {
+            m_bRefit = True;
+        }
+
+        Target.pszName = pszName;
+        Target.Min = Min;
+        Target.Max = Max;
+        Target.bGround = bGround;
+    }
+    else
+    {
+        Object Target;
+        Target.pszName = pszName;
+        Target.Min = Min;
+        Target.Max = Max;
+        Target.bGround = bGround;
+
+        m_ObjectIndex[ pszName ] = static_cast<u32>(m_aObjects.size());
+        m_aObjects.push_back( Target );
+        m_bRebuild = True;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// RemoveObject - Removes an object, moving the last object into its place
+void
+BvhCollision::RemoveObject(
+    pcstr pszName
+    )
+{
+    std::map<std::string, u32>::iterator it = m_ObjectIndex.find( pszName );
+    if ( it == m_ObjectIndex.end() )
+    {
+        return;
+    }
+
+    u32 Index = it->second;
+    m_ObjectIndex.erase( it );
+
+    if ( Index + 1 != m_aObjects.size() )
+    {
+        m_aObjects[ Index ] = m_aObjects.back();
+        m_ObjectIndex[ m_aObjects[ Index ].pszName ] = Index;
+    }
+    m_aObjects.pop_back();
+    m_bRebuild = True;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Test - Queues a request
+Coll::Handle
+BvhCollision::Test(
+    const Coll::Request& Request
+    )
+{
+    if ( Request.m_Type != Coll::e_LineTest )
+    {
+        return Coll::InvalidHandle;
+    }
+
+    SCOPED_SPIN_LOCK( m_SlotsMutex );
+
+    Coll::Handle Handle;
+    if ( !m_aFreeHandles.empty() )
+    {
+        Handle = m_aFreeHandles.back();
+        m_aFreeHandles.pop_back();
+    }
+    else
+    {
+        Handle = static_cast<Coll::Handle>(m_aSlots.size());
+        m_aSlots.push_back( Slot() );
+    }
+
+    Slot& Queued = m_aSlots[ Handle ];
+    Queued.Request = Request;
+    Queued.Request.m_Handle = Handle;
+    Queued.State = e_Pending;
+    m_aQueued.push_back( Handle );
+
+    return Handle;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// LineTest - Queues a line test
+Coll::Handle
+BvhCollision::LineTest(
+    const Math::Vector3& Position0,
+    const Math::Vector3& Position1,
+    Coll::Request& Request
+    )
+{
+    Request.m_Position0 = Position0;
+    Request.m_Position1 = Position1;
+    Request.m_Type = Coll::e_LineTest;
+    Request.m_Handle = Test( Request );
+
+    return Request.m_Handle;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Finalize - Gets the results of a resolved request and frees its handle
+Bool
+BvhCollision::Finalize(
+    Coll::Handle Handle,
+    Coll::Result* Result
+    )
+{
+    SCOPED_SPIN_LOCK( m_SlotsMutex );
+
+    if ( Handle >= m_aSlots.size() || m_aSlots[ Handle ].State != e_Resolved )
+    {
+        return False;
+    }
+
+    Slot& Resolved = m_aSlots[ Handle ];
+    if ( Result != NULL )
+    {
+        *Result = Resolved.Result;
+        Result->m_Finalized = 1;
+    }
+    Resolved.State = e_Free;
+    m_aFreeHandles.push_back( Handle );
+
+    return True;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Resolve - Brings the hierarchy up to date and traces the queued requests
+void
+BvhCollision::Resolve(
+    ITaskManager* pTaskManager,
+    ISystemTask* pSystemTask
+    )
+{
+    PROFILE_ZONE( "BvhCollision::Resolve" );
+
+    //
+    // Take the queued requests, so requests made while resolving go to the next batch.
+    //
+    {
+        SCOPED_SPIN_LOCK( m_SlotsMutex );
+
+        m_aBatch.swap( m_aQueued );
+        m_aQueued.clear();
+
+        m_aBatchRequests.resize( m_aBatch.size() );
+        for ( size_t i=0; i < m_aBatch.size(); i++ )
+        {
+            m_aBatchRequests[ i ] = m_aSlots[ m_aBatch[ i ] ].Request;
+        }
+    }
+
+    if ( m_bRebuild )
+    {
+        Build();
+    }
+    else if ( m_bRefit && Refit() > m_BuildCost * sm_RebuildCostRatio )
+    {
+        Build();
+    }
+
+    if ( m_bRebuildGround )
+    {
+        BuildGround();
+    }
+
+    u32 Count = static_cast<u32>(m_aBatch.size());
+    m_aBatchResults.resize( Count );
+
+    FormPackets();
+
+    u32 PacketCount = static_cast<u32>(m_aPackets.size());
+    u32 MinPacketsPerJob = sm_MinRequestsPerJob / sm_PacketSize;
+
+    if ( pTaskManager != NULL && PacketCount > MinPacketsPerJob )
+    {
+        pTaskManager->ParallelFor( pSystemTask, ResolveRange, this, 0, PacketCount, MinPacketsPerJob );
+    }
+    else
+    {
+        ResolveRange( this, 0, PacketCount );
+    }
+
+    {
+        SCOPED_SPIN_LOCK( m_SlotsMutex );
+
+        for ( u32 i=0; i < Count; i++ )
+        {
+            Slot& Resolved = m_aSlots[ m_aBatch[ i ] ];
+            Resolved.Result = m_aBatchResults[ i ];
+            Resolved.State = e_Resolved;
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ResolveRange - Traces a range of the packets, called by ParallelFor
+void
+BvhCollision::ResolveRange(
+    void* pParam,
+    u32 Begin,
+    u32 End
+    )
+{
+    BvhCollision* pCollision = reinterpret_cast<BvhCollision*>(pParam);
+
+    for ( u32 i=Begin; i < End; i++ )
+    {
+        const Packet& Rays = pCollision->m_aPackets[ i ];
+
+        if ( Rays.Count > 1 )
+        {
+            pCollision->TracePacket( Rays );
+        }
+        else
+        {
+            u32 Request = Rays.aRequest[ 0 ];
+            pCollision->Trace( pCollision->m_aBatchRequests[ Request ], pCollision->m_aBatchResults[ Request ] );
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SpreadBits - Spreads the low 10 bits of a value 3 bits apart, for Morton codes
+static inline u32
+SpreadBits(
+    u32 Value
+    )
+{
+    Value &= 0x3FF;
+    Value = (Value | (Value << 16)) & 0x030000FF;
+    Value = (Value | (Value << 8)) & 0x0300F00F;
+    Value = (Value | (Value << 4)) & 0x030C30C3;
+    Value = (Value | (Value << 2)) & 0x09249249;
+    return Value;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// FormPackets - Groups the batch into packets of coherent rays.  The requests are sorted by the
+//  octant of their direction, then along a Morton curve through their start points, and runs of
+//  the same octant are cut into packets.
+void
+BvhCollision::FormPackets(
+    void
+    )
+{
+    u32 Count = static_cast<u32>(m_aBatchRequests.size());
+    m_aPackets.clear();
+
+    if ( Count == 0 )
+    {
+        return;
+    }
+
+    Math::Vector3 Min( FLT_MAX, FLT_MAX, FLT_MAX );
+    Math::Vector3 Max( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+    for ( u32 i=0; i < Count; i++ )
+    {
+        Grow( Min, Max, m_aBatchRequests[ i ].m_Position0, m_aBatchRequests[ i ].m_Position0 );
+    }
+
+    Math::Vector3 Extent = Max - Min;
+    Math::Vector3 Scale( (Extent.x > 0.0f) ? 511.0f / Extent.x : 0.0f,
+                         (Extent.y > 0.0f) ? 511.0f / Extent.y : 0.0f,
+                         (Extent.z > 0.0f) ? 511.0f / Extent.z : 0.0f );
+
+    m_aPacketKeys.clear();
+    for ( u32 i=0; i < Count; i++ )
+    {
+        const Coll::Request& Request = m_aBatchRequests[ i ];
+
+        // Ground probes skip the hierarchy, so they have nothing to share
+        if ( Request.m_Flags & Coll::e_Ground )
+        {
+            Packet Probe;
+            Probe.aRequest[ 0 ] = i;
+            Probe.Count = 1;
+            m_aPackets.push_back( Probe );
+            continue;
+        }
+
+        Math::Vector3 Direction = Request.m_Position1 - Request.m_Position0;
+        Math::Vector3 Cell = Request.m_Position0 - Min;
+
+        u64 Octant = ((Direction.x < 0.0f) ? 1 : 0) | ((Direction.y < 0.0f) ? 2 : 0) |
+                     ((Direction.z < 0.0f) ? 4 : 0);
+        u64 Morton = SpreadBits( static_cast<u32>(Cell.x * Scale.x) ) |
+                     (SpreadBits( static_cast<u32>(Cell.y * Scale.y) ) << 1) |
+                     (SpreadBits( static_cast<u32>(Cell.z * Scale.z) ) << 2);
+
+        // The octant and code in the high bits, the request in the low bits
+        m_aPacketKeys.push_back( (((Octant << 27) | Morton) << 32) | i );
+    }
+
+    std::sort( m_aPacketKeys.begin(), m_aPacketKeys.end() );
+    Count = static_cast<u32>(m_aPacketKeys.size());
+
+    //
+    // Cut the sorted requests into packets, starting a new one when the octant changes or when
+    //  the box around the rays would grow much larger than the rays themselves, as the rays are
+    //  culled together against it.
+    //
+    Packet Rays;
+    Rays.Count = 0;
+    u64 PacketOctant = 0;
+    Math::Vector3 PacketMin;
+    Math::Vector3 PacketMax;
+    f32 PacketLength = 0.0f;
+
+    for ( u32 i=0; i < Count; i++ )
+    {
+        u64 Octant = m_aPacketKeys[ i ] >> 59;
+        u32 Index = static_cast<u32>(m_aPacketKeys[ i ]);
+        const Coll::Request& Request = m_aBatchRequests[ Index ];
+
+        Math::Vector3 Min( FLT_MAX, FLT_MAX, FLT_MAX );
+        Math::Vector3 Max( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+        Grow( Min, Max, Request.m_Position0, Request.m_Position0 );
+        Grow( Min, Max, Request.m_Position1, Request.m_Position1 );
+        f32 Length = HalfPerimeter( Min, Max );
+
+        if ( Rays.Count > 0 )
+        {
+            Grow( Min, Max, PacketMin, PacketMax );
+            Length = std::max( Length, PacketLength );
+
+            if ( Rays.Count == sm_PacketSize || Octant != PacketOctant ||
+                 HalfPerimeter( Min, Max ) > Length * sm_MaxPacketSpread )
+            {
+                m_aPackets.push_back( Rays );
+                Rays.Count = 0;
+
+                Min = Math::Vector3( FLT_MAX, FLT_MAX, FLT_MAX );
+                Max = Math::Vector3( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+                Grow( Min, Max, Request.m_Position0, Request.m_Position0 );
+                Grow( Min, Max, Request.m_Position1, Request.m_Position1 );
+                Length = HalfPerimeter( Min, Max );
+            }
+        }
+
+        PacketOctant = Octant;
+        PacketMin = Min;
+        PacketMax = Max;
+        PacketLength = Length;
+        Rays.aRequest[ Rays.Count++ ] = Index;
+    }
+
+    if ( Rays.Count > 0 )
+    {
+        m_aPackets.push_back( Rays );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Build - Builds the hierarchy from scratch
+void
+BvhCollision::Build(
+    void
+    )
+{
+    PROFILE_ZONE( "BvhCollision::Build" );
+
+    m_bRebuild = False;
+    m_bRefit = False;
+    m_aNodes.clear();
+    m_aBuildNodes.clear();
+
+    // Object indices may have changed, so the ground grid is rebuilt along with the hierarchy
+    m_bRebuildGround = True;
+
+    m_aObjectIndices.clear();
+    for ( u32 i=0; i < static_cast<u32>(m_aObjects.size()); i++ )
+    {
+        if ( !m_aObjects[ i ].bGround )
+        {
+            m_aObjectIndices.push_back( i );
+        }
+    }
+    u32 Count = static_cast<u32>(m_aObjectIndices.size());
+
+    if ( Count == 0 )
+    {
+        m_BuildCost = 0.0f;
+        return;
+    }
+
+    //
+    // Build a binary hierarchy, collapse it to 4 children per node, then compute the boxes.
+    //
+    m_aBuildNodes.reserve( 2 * Count );
+    u32 Root = BuildRange( 0, Count, 0 );
+    Collapse( Root );
+    m_aBuildNodes.clear();
+
+    m_BuildCost = Refit();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// BuildRange - Builds the binary hierarchy over a range of m_aObjectIndices, splitting it where
+//  the surface area heuristic is lowest, or at the median past sm_MaxSAHDepth
+u32
+BvhCollision::BuildRange(
+    u32 First,
+    u32 Count,
+    u32 Depth
+    )
+{
+    BuildNode Build;
+    Build.Min = Math::Vector3( FLT_MAX, FLT_MAX, FLT_MAX );
+    Build.Max = Math::Vector3( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+    Build.aChild[ 0 ] = sm_InvalidNode;
+    Build.aChild[ 1 ] = sm_InvalidNode;
+    Build.First = First;
+    Build.Count = Count;
+
+    Math::Vector3 CentroidMin( FLT_MAX, FLT_MAX, FLT_MAX );
+    Math::Vector3 CentroidMax( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+
+    for ( u32 i=First; i < First + Count; i++ )
+    {
+        const Object& Target = m_aObjects[ m_aObjectIndices[ i ] ];
+        Math::Vector3 Centroid = (Target.Min + Target.Max) * 0.5f;
+
+        Grow( Build.Min, Build.Max, Target.Min, Target.Max );
+        Grow( CentroidMin, CentroidMax, Centroid, Centroid );
+    }
+
+    u32 Index = static_cast<u32>(m_aBuildNodes.size());
+    m_aBuildNodes.push_back( Build );
+
+    if ( Count <= sm_MaxLeafObjects )
+    {
+        return Index;
+    }
+
+    //
+    // Bin the centroids along each axis and keep the cheapest split.
+    //
+    f32 BestCost = FLT_MAX;
+    u32 BestAxis = 0;
+    u32 BestSplit = 0;
+
+    for ( u32 Axis=0; Axis < 3 && Depth < sm_MaxSAHDepth; Axis++ )
+    {
+        f32 Low = GetAxis( CentroidMin, Axis );
+        f32 Extent = GetAxis( CentroidMax, Axis ) - Low;
+        if ( Extent <= 0.0f )
+        {
+            continue;
+        }
+        f32 Scale = sm_SAHBins / Extent;
+
+        u32 aBinCount[ sm_SAHBins ] = { 0 };
+        Math::Vector3 aBinMin[ sm_SAHBins ];
+        Math::Vector3 aBinMax[ sm_SAHBins ];
+        for ( u32 b=0; b < sm_SAHBins; b++ )
+        {
+            aBinMin[ b ] = Math::Vector3( FLT_MAX, FLT_MAX, FLT_MAX );
+            aBinMax[ b ] = Math::Vector3( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+        }
+
+        for ( u32 i=First; i < First + Count; i++ )
+        {
+            const Object& Target = m_aObjects[ m_aObjectIndices[ i ] ];
+            f32 Centroid = (GetAxis( Target.Min, Axis ) + GetAxis( Target.Max, Axis )) * 0.5f;
+            u32 Bin = std::min( static_cast<u32>((Centroid - Low) * Scale), sm_SAHBins - 1 );
+
+            aBinCount[ Bin ]++;
+            Grow( aBinMin[ Bin ], aBinMax[ Bin ], Target.Min, Target.Max );
+        }
+
+        // Sweep from the right to get the cost of the right side of every split
+        f32 aRightCost[ sm_SAHBins ];
+        Math::Vector3 Min( FLT_MAX, FLT_MAX, FLT_MAX );
+        Math::Vector3 Max( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+        u32 RightCount = 0;
+        for ( u32 b=sm_SAHBins - 1; b > 0; b-- )
+        {
+            Grow( Min, Max, aBinMin[ b ], aBinMax[ b ] );
+            RightCount += aBinCount[ b ];
+            aRightCost[ b ] = SurfaceArea( Min, Max ) * RightCount;
+        }
+
+        Min = Math::Vector3( FLT_MAX, FLT_MAX, FLT_MAX );
+        Max = Math::Vector3( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+        u32 LeftCount = 0;
+        for ( u32 b=0; b < sm_SAHBins - 1; b++ )
+        {
+            Grow( Min, Max, aBinMin[ b ], aBinMax[ b ] );
+            LeftCount += aBinCount[ b ];
+
+            if ( LeftCount == 0 || LeftCount == Count )
+            {
+                continue;
+            }
+
+            f32 Cost = SurfaceArea( Min, Max ) * LeftCount + aRightCost[ b + 1 ];
+            if ( Cost < BestCost )
+            {
+                BestCost = Cost;
+                BestAxis = Axis;
+                BestSplit = b + 1;
+            }
+        }
+    }
+
+    //
+    // Partition the objects, halving the range at the median centroid along the widest axis
+    //  when the depth is past the limit or the centroids could not be binned apart.
+    //
+    u32 LeftCount;
+
+    if ( BestCost < FLT_MAX )
+    {
+        f32 Low = GetAxis( CentroidMin, BestAxis );
+        f32 Scale = sm_SAHBins / (GetAxis( CentroidMax, BestAxis ) - Low);
+
+        struct IsLeft
+        {
+            const std::vector<Object>* paObjects;
+            u32 Axis;
+            f32 Low;
+            f32 Scale;
+            u32 Split;
+
+            bool operator()( u32 i ) const
+            {
+                const Object& Target = (*paObjects)[ i ];
+                f32 Centroid = (GetAxis( Target.Min, Axis ) + GetAxis( Target.Max, Axis )) * 0.5f;
+                return std::min( static_cast<u32>((Centroid - Low) * Scale), sm_SAHBins - 1 ) < Split;
+            }
+        };
+        IsLeft Predicate = { &m_aObjects, BestAxis, Low, Scale, BestSplit };
+
+        std::vector<u32>::iterator itFirst = m_aObjectIndices.begin() + First;
+        LeftCount = static_cast<u32>(std::partition( itFirst, itFirst + Count, Predicate ) - itFirst);
+    }
+    else
+    {
+        Math::Vector3 Extent = CentroidMax - CentroidMin;
+        u32 WidestAxis = (Extent.x >= Extent.y && Extent.x >= Extent.z) ? 0 :
+                         (Extent.y >= Extent.z) ? 1 : 2;
+
+        struct IsBelow
+        {
+            const std::vector<Object>* paObjects;
+            u32 Axis;
+
+            bool operator()( u32 i, u32 j ) const
+            {
+                const Object& a = (*paObjects)[ i ];
+                const Object& b = (*paObjects)[ j ];
+                return GetAxis( a.Min, Axis ) + GetAxis( a.Max, Axis ) <
+                       GetAxis( b.Min, Axis ) + GetAxis( b.Max, Axis );
+            }
+        };
+        IsBelow Predicate = { &m_aObjects, WidestAxis };
+
+        LeftCount = Count / 2;
+        std::vector<u32>::iterator itFirst = m_aObjectIndices.begin() + First;
+        std::nth_element( itFirst, itFirst + LeftCount, itFirst + Count, Predicate );
+    }
+
+    u32 Left = BuildRange( First, LeftCount, Depth + 1 );
+    u32 Right = BuildRange( First + LeftCount, Count - LeftCount, Depth + 1 );
+
+    m_aBuildNodes[ Index ].aChild[ 0 ] = Left;
+    m_aBuildNodes[ Index ].aChild[ 1 ] = Right;
+    m_aBuildNodes[ Index ].Count = 0;
+
+    return Index;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Collapse - Makes a 4 wide node of a binary node by pulling up the largest grandchildren, then
+//  collapses the children.  Returns the index of the new node.
+u32
+BvhCollision::Collapse(
+    u32 BuildIndex
+    )
+{
+    u32 aChildren[ 4 ];
+    u32 ChildCount = 0;
+
+    const BuildNode& Build = m_aBuildNodes[ BuildIndex ];
+    if ( Build.Count > 0 )
+    {
+        // A leaf at the root
+        aChildren[ ChildCount++ ] = BuildIndex;
+    }
+    else
+    {
+        aChildren[ ChildCount++ ] = Build.aChild[ 0 ];
+        aChildren[ ChildCount++ ] = Build.aChild[ 1 ];
+
+        while ( ChildCount < 4 )
+        {
+            // Open the inner child with the largest surface
+            u32 Largest = 4;
+            f32 LargestArea = -1.0f;
+            for ( u32 i=0; i < ChildCount; i++ )
+            {
+                const BuildNode& Child = m_aBuildNodes[ aChildren[ i ] ];
+                f32 Area = SurfaceArea( Child.Min, Child.Max );
+                if ( Child.Count == 0 && Area > LargestArea )
+                {
+                    Largest = i;
+                    LargestArea = Area;
+                }
+            }
+
+            if ( Largest == 4 )
+            {
+                break;
+            }
+
+            u32 Opened = aChildren[ Largest ];
+            aChildren[ Largest ] = m_aBuildNodes[ Opened ].aChild[ 0 ];
+            aChildren[ ChildCount++ ] = m_aBuildNodes[ Opened ].aChild[ 1 ];
+        }
+    }
+
+    u32 Index = static_cast<u32>(m_aNodes.size());
+    m_aNodes.push_back( Node() );
+
+    for ( u32 i=0; i < 4; i++ )
+    {
+        u32 Child = sm_InvalidNode;
+        u32 Count = 0;
+
+        if ( i < ChildCount )
+        {
+            const BuildNode& ChildBuild = m_aBuildNodes[ aChildren[ i ] ];
+            if ( ChildBuild.Count > 0 )
+            {
+                Child = ChildBuild.First;
+                Count = ChildBuild.Count;
+            }
+            else
+            {
+                Child = Collapse( aChildren[ i ] );
+            }
+        }
+
+        m_aNodes[ Index ].aChild[ i ] = Child;
+        m_aNodes[ Index ].aCount[ i ] = Count;
+    }
+
+    return Index;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Refit - Recomputes the boxes of the hierarchy from the object boxes.  Returns the cost of the
+//  hierarchy relative to the surface of the root.
+f32
+BvhCollision::Refit(
+    void
+    )
+{
+    m_bRefit = False;
+
+    f32 Cost = 0.0f;
+    Math::Vector3 RootMin( FLT_MAX, FLT_MAX, FLT_MAX );
+    Math::Vector3 RootMax( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+
+    // Children come after their parents, so walk backwards
+    for ( size_t n=m_aNodes.size(); n-- > 0; )
+    {
+        Node& Current = m_aNodes[ n ];
+
+        Math::Vector3 aMin[ 4 ];
+        Math::Vector3 aMax[ 4 ];
+
+        for ( u32 i=0; i < 4; i++ )
+        {
+            Math::Vector3 Min( FLT_MAX, FLT_MAX, FLT_MAX );
+            Math::Vector3 Max( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+
+            if ( Current.aCount[ i ] > 0 )
+            {
+                for ( u32 o=Current.aChild[ i ]; o < Current.aChild[ i ] + Current.aCount[ i ]; o++ )
+                {
+                    const Object& Target = m_aObjects[ m_aObjectIndices[ o ] ];
+                    Grow( Min, Max, Target.Min, Target.Max );
+                }
+                Cost += SurfaceArea( Min, Max ) * Current.aCount[ i ];
+            }
+            else if ( Current.aChild[ i ] != sm_InvalidNode )
+            {
+                const Node& Child = m_aNodes[ Current.aChild[ i ] ];
+
+                __m128 xMinX = Child.MinX, xMinY = Child.MinY, xMinZ = Child.MinZ;
+                __m128 xMaxX = Child.MaxX, xMaxY = Child.MaxY, xMaxZ = Child.MaxZ;
+                xMinX = _mm_min_ps( xMinX, _mm_shuffle_ps( xMinX, xMinX, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+                xMinY = _mm_min_ps( xMinY, _mm_shuffle_ps( xMinY, xMinY, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+                xMinZ = _mm_min_ps( xMinZ, _mm_shuffle_ps( xMinZ, xMinZ, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+                xMaxX = _mm_max_ps( xMaxX, _mm_shuffle_ps( xMaxX, xMaxX, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+                xMaxY = _mm_max_ps( xMaxY, _mm_shuffle_ps( xMaxY, xMaxY, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+                xMaxZ = _mm_max_ps( xMaxZ, _mm_shuffle_ps( xMaxZ, xMaxZ, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+                xMinX = _mm_min_ss( xMinX, _mm_movehl_ps( xMinX, xMinX ) );
+                xMinY = _mm_min_ss( xMinY, _mm_movehl_ps( xMinY, xMinY ) );
+                xMinZ = _mm_min_ss( xMinZ, _mm_movehl_ps( xMinZ, xMinZ ) );
+                xMaxX = _mm_max_ss( xMaxX, _mm_movehl_ps( xMaxX, xMaxX ) );
+                xMaxY = _mm_max_ss( xMaxY, _mm_movehl_ps( xMaxY, xMaxY ) );
+                xMaxZ = _mm_max_ss( xMaxZ, _mm_movehl_ps( xMaxZ, xMaxZ ) );
+
+                _mm_store_ss( &Min.x, xMinX );
+                _mm_store_ss( &Min.y, xMinY );
+                _mm_store_ss( &Min.z, xMinZ );
+                _mm_store_ss( &Max.x, xMaxX );
+                _mm_store_ss( &Max.y, xMaxY );
+                _mm_store_ss( &Max.z, xMaxZ );
+
+                Cost += SurfaceArea( Min, Max );
+            }
+
+            aMin[ i ] = Min;
+            aMax[ i ] = Max;
+
+            if ( n == 0 )
+            {
+                Grow( RootMin, RootMax, Min, Max );
+            }
+        }
+
+        Current.MinX = _mm_setr_ps( aMin[ 0 ].x, aMin[ 1 ].x, aMin[ 2 ].x, aMin[ 3 ].x );
+        Current.MinY = _mm_setr_ps( aMin[ 0 ].y, aMin[ 1 ].y, aMin[ 2 ].y, aMin[ 3 ].y );
+        Current.MinZ = _mm_setr_ps( aMin[ 0 ].z, aMin[ 1 ].z, aMin[ 2 ].z, aMin[ 3 ].z );
+        Current.MaxX = _mm_setr_ps( aMax[ 0 ].x, aMax[ 1 ].x, aMax[ 2 ].x, aMax[ 3 ].x );
+        Current.MaxY = _mm_setr_ps( aMax[ 0 ].y, aMax[ 1 ].y, aMax[ 2 ].y, aMax[ 3 ].y );
+        Current.MaxZ = _mm_setr_ps( aMax[ 0 ].z, aMax[ 1 ].z, aMax[ 2 ].z, aMax[ 3 ].z );
+    }
+
+    f32 RootArea = SurfaceArea( RootMin, RootMax );
+    return (RootArea > 0.0f) ? Cost / RootArea : Cost;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// BuildGround - Builds the ground grid.  Each cell of the finest level lists the ground objects
+//  over it, and every level keeps the height range of the objects over its cells.
+void
+BvhCollision::BuildGround(
+    void
+    )
+{
+    PROFILE_ZONE( "BvhCollision::BuildGround" );
+
+    m_bRebuildGround = False;
+    m_aGroundLevels.clear();
+    m_aGroundCellStart.clear();
+    m_aGroundCellObjects.clear();
+    m_GroundSize = 0;
+
+    //
+    // Size the cells to about the footprint of a ground object.
+    //
+    Math::Vector3 Min( FLT_MAX, FLT_MAX, FLT_MAX );
+    Math::Vector3 Max( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+    f32 Footprint = 0.0f;
+    u32 Count = 0;
+
+    for ( u32 i=0; i < static_cast<u32>(m_aObjects.size()); i++ )
+    {
+        const Object& Target = m_aObjects[ i ];
+        if ( Target.bGround )
+        {
+            Grow( Min, Max, Target.Min, Target.Max );
+            Footprint += std::max( Target.Max.x - Target.Min.x, Target.Max.z - Target.Min.z );
+            Count++;
+        }
+    }
+
+    if ( Count == 0 )
+    {
+        return;
+    }
+
+    f32 Extent = std::max( Max.x - Min.x, Max.z - Min.z );
+    f32 CellSize = std::max( Footprint / Count, Extent / sm_MaxGroundCells );
+    if ( CellSize <= 0.0f )
+    {
+        CellSize = 1.0f;
+    }
+
+    u32 Cells = static_cast<u32>(ceilf( Extent / CellSize )) + 1;
+    m_GroundSize = 1;
+    while ( m_GroundSize < Cells && m_GroundSize < sm_MaxGroundCells )
+    {
+        m_GroundSize *= 2;
+    }
+    m_GroundCellSize = std::max( CellSize, Extent / m_GroundSize );
+    m_GroundMin = Min;
+
+    //
+    // Bucket the objects into the cells they cover, counting first.
+    //
+    m_aGroundCellStart.assign( m_GroundSize * m_GroundSize + 1, 0 );
+
+    for ( u32 Pass=0; Pass < 2; Pass++ )
+    {
+        for ( u32 i=0; i < static_cast<u32>(m_aObjects.size()); i++ )
+        {
+            const Object& Target = m_aObjects[ i ];
+            if ( !Target.bGround )
+            {
+                continue;
+            }
+
+            u32 X0 = GroundCell( Target.Min.x - m_GroundMin.x );
+            u32 X1 = GroundCell( Target.Max.x - m_GroundMin.x );
+            u32 Z0 = GroundCell( Target.Min.z - m_GroundMin.z );
+            u32 Z1 = GroundCell( Target.Max.z - m_GroundMin.z );
+
+            for ( u32 z=Z0; z <= Z1; z++ )
+            {
+                for ( u32 x=X0; x <= X1; x++ )
+                {
+                    u32 Cell = z * m_GroundSize + x;
+                    if ( Pass == 0 )
+                    {
+                        m_aGroundCellStart[ Cell + 1 ]++;
+                    }
+                    else
+                    {
+                        m_aGroundCellObjects[ m_aGroundCellStart[ Cell ]++ ] = i;
+                    }
+                }
+            }
+        }
+
+        if ( Pass == 0 )
+        {
+            for ( u32 c=0; c < m_GroundSize * m_GroundSize; c++ )
+            {
+                m_aGroundCellStart[ c + 1 ] += m_aGroundCellStart[ c ];
+            }
+            m_aGroundCellObjects.resize( m_aGroundCellStart.back() );
+        }
+    }
+
+    // Filling moved each start to the next cell's start
+    for ( u32 c=m_GroundSize * m_GroundSize; c > 0; c-- )
+    {
+        m_aGroundCellStart[ c ] = m_aGroundCellStart[ c - 1 ];
+    }
+    m_aGroundCellStart[ 0 ] = 0;
+
+    //
+    // Height ranges of the finest cells, then of each coarser level from the 2x2 cells below.
+    //
+    m_aGroundLevels.resize( 1 );
+    m_aGroundLevels[ 0 ].resize( m_GroundSize * m_GroundSize );
+
+    for ( u32 c=0; c < m_GroundSize * m_GroundSize; c++ )
+    {
+        GroundRange& Range = m_aGroundLevels[ 0 ][ c ];
+        Range.Min = FLT_MAX;
+        Range.Max = -FLT_MAX;
+
+        for ( u32 o=m_aGroundCellStart[ c ]; o < m_aGroundCellStart[ c + 1 ]; o++ )
+        {
+            const Object& Target = m_aObjects[ m_aGroundCellObjects[ o ] ];
+            Range.Min = std::min( Range.Min, Target.Min.y );
+            Range.Max = std::max( Range.Max, Target.Max.y );
+        }
+    }
+
+    for ( u32 Size=m_GroundSize / 2; Size > 0; Size /= 2 )
+    {
+        m_aGroundLevels.push_back( std::vector<GroundRange>( Size * Size ) );
+        const std::vector<GroundRange>& Below = m_aGroundLevels[ m_aGroundLevels.size() - 2 ];
+        std::vector<GroundRange>& Level = m_aGroundLevels.back();
+
+        for ( u32 z=0; z < Size; z++ )
+        {
+            for ( u32 x=0; x < Size; x++ )
+            {
+                const GroundRange* aBelow[ 4 ] =
+                {
+                    &Below[ (2 * z) * (2 * Size) + 2 * x ],
+                    &Below[ (2 * z) * (2 * Size) + 2 * x + 1 ],
+                    &Below[ (2 * z + 1) * (2 * Size) + 2 * x ],
+                    &Below[ (2 * z + 1) * (2 * Size) + 2 * x + 1 ],
+                };
+
+                GroundRange& Range = Level[ z * Size + x ];
+                Range.Min = std::min( std::min( aBelow[ 0 ]->Min, aBelow[ 1 ]->Min ),
+                                      std::min( aBelow[ 2 ]->Min, aBelow[ 3 ]->Min ) );
+                Range.Max = std::max( std::max( aBelow[ 0 ]->Max, aBelow[ 1 ]->Max ),
+                                      std::max( aBelow[ 2 ]->Max, aBelow[ 3 ]->Max ) );
+            }
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GroundCell - Gets the column or row of the ground grid at an offset from its minimum corner
+u32
+BvhCollision::GroundCell(
+    f32 Offset
+    ) const
+{
+    f32 Cell = floorf( Offset / m_GroundCellSize );
+    if ( Cell <= 0.0f )
+    {
+        return 0;
+    }
+    return std::min( static_cast<u32>(Cell), m_GroundSize - 1 );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// IsIgnored - Checks the request's flags and ignored object against an object
+Bool
+BvhCollision::IsIgnored(
+    const Coll::Request& Request,
+    const Object& Target
+    ) const
+{
+    if ( (Request.m_Flags & Coll::e_Ground) && !Target.bGround )
+    {
+        return True;
+    }
+    if ( (Request.m_Flags & Coll::e_IgnoreGround) && Target.bGround )
+    {
+        return True;
+    }
+    if ( Request.m_Ignore != NULL &&
+         (Request.m_Ignore == Target.pszName || strcmp( Request.m_Ignore, Target.pszName ) == 0) )
+    {
+        return True;
+    }
+    return False;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// TraceObject - Intersects a segment with an object's box.  Sets where along the segment it enters
+//  the box and the axis of the face it enters through.
+Bool
+BvhCollision::TraceObject(
+    const Ray& Segment,
+    const Object& Target,
+    f32& t,
+    u32& Axis
+    ) const
+{
+    f32 Enter = 0.0f;
+    f32 Exit = t;
+
+    // A segment starting inside reports the face facing its direction
+    Math::Vector3 Direction( fabsf( Segment.Direction.x ), fabsf( Segment.Direction.y ),
+                             fabsf( Segment.Direction.z ) );
+    u32 EnterAxis = (Direction.x >= Direction.y && Direction.x >= Direction.z) ? 0 :
+                    (Direction.y >= Direction.z) ? 1 : 2;
+
+    for ( u32 a=0; a < 3; a++ )
+    {
+        f32 Origin = GetAxis( Segment.Origin, a );
+        f32 Inv = GetAxis( Segment.InvDirection, a );
+        f32 t0 = (GetAxis( Target.Min, a ) - Origin) * Inv;
+        f32 t1 = (GetAxis( Target.Max, a ) - Origin) * Inv;
+        if ( t0 > t1 )
+        {
+            std::swap( t0, t1 );
+        }
+
+        if ( t0 > Enter )
+        {
+            Enter = t0;
+            EnterAxis = a;
+        }
+        Exit = std::min( Exit, t1 );
+
+        if ( Enter > Exit )
+        {
+            return False;
+        }
+    }
+
+    t = Enter;
+    Axis = EnterAxis;
+    return True;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// MakeRay - Sets up the ray of a line test
+void
+BvhCollision::MakeRay(
+    const Coll::Request& Request,
+    Ray& Segment
+    )
+{
+    Segment.Origin = Request.m_Position0;
+    Segment.Direction = Request.m_Position1 - Request.m_Position0;
+    Segment.InvDirection = Math::Vector3( InvertAxis( Segment.Direction.x ),
+                                          InvertAxis( Segment.Direction.y ),
+                                          InvertAxis( Segment.Direction.z ) );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// WriteResult - Fills in the result of a line test from its nearest hit
+void
+BvhCollision::WriteResult(
+    const Coll::Request& Request,
+    const Ray& Segment,
+    const Hit& Nearest,
+    Coll::Result& Result
+    )
+{
+    Result.m_Position = Request.m_Position1;
+    Result.m_Normal = Math::Vector3( 0.0f, 0.0f, 0.0f );
+    Result.m_Hit = NULL;
+    Result.m_Depth = 0.0f;
+    Result.m_Finalized = 0;
+    Result.m_Valid = False;
+
+    if ( Nearest.pObject != NULL )
+    {
+        Result.m_Position = Segment.Origin + Segment.Direction * Nearest.t;
+
+        f32 Normal = (GetAxis( Segment.Direction, Nearest.Axis ) > 0.0f) ? -1.0f : 1.0f;
+        Result.m_Normal = Math::Vector3( (Nearest.Axis == 0) ? Normal : 0.0f,
+                                         (Nearest.Axis == 1) ? Normal : 0.0f,
+                                         (Nearest.Axis == 2) ? Normal : 0.0f );
+        Result.m_Hit = Nearest.pObject->pszName;
+        Result.m_Valid = True;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Trace - Finds the first object a line test hits
+void
+BvhCollision::Trace(
+    const Coll::Request& Request,
+    Coll::Result& Result
+    ) const
+{
+    Ray Segment;
+    MakeRay( Request, Segment );
+
+    // The segment runs from t = 0 to t = 1
+    Hit Nearest;
+    Nearest.t = 1.0f;
+    Nearest.pObject = NULL;
+    Nearest.Axis = 0;
+
+    // Ground objects are only in the ground grid
+    if ( (Request.m_Flags & Coll::e_Ground) == 0 && !m_aNodes.empty() )
+    {
+        TraceNode( Request, Segment, 0, Nearest );
+    }
+    if ( (Request.m_Flags & Coll::e_IgnoreGround) == 0 )
+    {
+        TraceGround( Request, Segment, Nearest );
+    }
+
+    WriteResult( Request, Segment, Nearest, Result );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// TraceLeaf - Tests a ray against the objects of a leaf or ground cell, keeping the nearest hit
+void
+BvhCollision::TraceLeaf(
+    const Coll::Request& Request,
+    const Ray& Segment,
+    const u32* aIndices,
+    u32 Count,
+    Hit& Nearest
+    ) const
+{
+    for ( u32 o=0; o < Count; o++ )
+    {
+        const Object& Target = m_aObjects[ aIndices[ o ] ];
+        f32 t = Nearest.t;
+        u32 Axis;
+
+        if ( !IsIgnored( Request, Target ) && TraceObject( Segment, Target, t, Axis ) &&
+             (t < Nearest.t || Nearest.pObject == NULL) )
+        {
+            Nearest.t = t;
+            Nearest.pObject = &Target;
+            Nearest.Axis = Axis;
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// TraceNode - Traces a single ray through the subtree of a node, keeping the nearest hit
+void
+BvhCollision::TraceNode(
+    const Coll::Request& Request,
+    const Ray& Segment,
+    u32 Root,
+    Hit& Nearest
+    ) const
+{
+    __m128 xOriginX = _mm_set1_ps( Segment.Origin.x );
+    __m128 xOriginY = _mm_set1_ps( Segment.Origin.y );
+    __m128 xOriginZ = _mm_set1_ps( Segment.Origin.z );
+    __m128 xInvX = _mm_set1_ps( Segment.InvDirection.x );
+    __m128 xInvY = _mm_set1_ps( Segment.InvDirection.y );
+    __m128 xInvZ = _mm_set1_ps( Segment.InvDirection.z );
+
+    struct Entry
+    {
+        u32 Node;
+        f32 Enter;
+    };
+    Entry aStack[ sm_TraceStackSize ];
+    u32 StackSize = 0;
+
+    aStack[ StackSize ].Node = Root;
+    aStack[ StackSize ].Enter = 0.0f;
+    StackSize++;
+
+    while ( StackSize > 0 )
+    {
+        Entry Top = aStack[ --StackSize ];
+        if ( Top.Enter > Nearest.t )
+        {
+            continue;
+        }
+        const Node& Current = m_aNodes[ Top.Node ];
+
+        //
+        // Slab test against the 4 children at once.
+        //
+        __m128 t0 = _mm_mul_ps( _mm_sub_ps( Current.MinX, xOriginX ), xInvX );
+        __m128 t1 = _mm_mul_ps( _mm_sub_ps( Current.MaxX, xOriginX ), xInvX );
+        __m128 xEnter = _mm_min_ps( t0, t1 );
+        __m128 xExit = _mm_max_ps( t0, t1 );
+
+        t0 = _mm_mul_ps( _mm_sub_ps( Current.MinY, xOriginY ), xInvY );
+        t1 = _mm_mul_ps( _mm_sub_ps( Current.MaxY, xOriginY ), xInvY );
+        xEnter = _mm_max_ps( xEnter, _mm_min_ps( t0, t1 ) );
+        xExit = _mm_min_ps( xExit, _mm_max_ps( t0, t1 ) );
+
+        t0 = _mm_mul_ps( _mm_sub_ps( Current.MinZ, xOriginZ ), xInvZ );
+        t1 = _mm_mul_ps( _mm_sub_ps( Current.MaxZ, xOriginZ ), xInvZ );
+        xEnter = _mm_max_ps( xEnter, _mm_min_ps( t0, t1 ) );
+        xExit = _mm_min_ps( xExit, _mm_max_ps( t0, t1 ) );
+
+        xEnter = _mm_max_ps( xEnter, _mm_setzero_ps() );
+        xExit = _mm_min_ps( xExit, _mm_set1_ps( Nearest.t ) );
+
+        int Mask = _mm_movemask_ps( _mm_cmple_ps( xEnter, xExit ) );
+        if ( Mask == 0 )
+        {
+            continue;
+        }
+
+        const f32* aEnter = reinterpret_cast<const f32*>(&xEnter);
+
+        //
+        // Test the objects of hit leaves now and push the hit nodes farthest first, so the
+        //  nearest is visited next.
+        //
+        u32 aOrder[ 4 ];
+        u32 OrderCount = 0;
+
+        for ( u32 i=0; i < 4; i++ )
+        {
+            if ( (Mask & (1 << i)) == 0 )
+            {
+                continue;
+            }
+
+            if ( Current.aCount[ i ] > 0 )
+            {
+                TraceLeaf( Request, Segment, &m_aObjectIndices[ Current.aChild[ i ] ], Current.aCount[ i ],
+                           Nearest );
+            }
+            else if ( Current.aChild[ i ] != sm_InvalidNode )
+            {
+                u32 Insert = OrderCount++;
+                while ( Insert > 0 && aEnter[ aOrder[ Insert - 1 ] ] < aEnter[ i ] )
+                {
+                    aOrder[ Insert ] = aOrder[ Insert - 1 ];
+                    Insert--;
+                }
+                aOrder[ Insert ] = i;
+            }
+        }
+
+        for ( u32 i=0; i < OrderCount; i++ )
+        {
+            ASSERT( StackSize < sizeof( aStack ) / sizeof( aStack[ 0 ] ) );
+            aStack[ StackSize ].Node = Current.aChild[ aOrder[ i ] ];
+            aStack[ StackSize ].Enter = aEnter[ aOrder[ i ] ];
+            StackSize++;
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// TraceGround - Traces a single ray over the ground grid, keeping the nearest hit.  The ray starts
+//  from the smallest cell of the pyramid holding all of it and only descends into the cells whose
+//  height range it passes through, nearest first, testing the 4 cells below a cell at once.
+void
+BvhCollision::TraceGround(
+    const Coll::Request& Request,
+    const Ray& Segment,
+    Hit& Nearest
+    ) const
+{
+    if ( m_GroundSize == 0 )
+    {
+        return;
+    }
+
+    // Cells are widened a little so rounding never drops an object on a cell edge
+    f32 Slack = sm_GroundSlack * m_GroundCellSize * m_GroundSize;
+
+    struct Entry
+    {
+        u32 Level;
+        u32 X;
+        u32 Z;
+        f32 Enter;
+        f32 Exit;
+    };
+    Entry aStack[ 64 ];
+    u32 StackSize = 0;
+
+    //
+    // Only the part of the ray over the grid can hit the ground, so a ground probe usually
+    //  starts right at the cell below it.
+    //
+    Math::Vector3 End = Segment.Origin + Segment.Direction * Nearest.t;
+    u32 X0 = GroundCell( std::min( Segment.Origin.x, End.x ) - m_GroundMin.x );
+    u32 X1 = GroundCell( std::max( Segment.Origin.x, End.x ) - m_GroundMin.x );
+    u32 Z0 = GroundCell( std::min( Segment.Origin.z, End.z ) - m_GroundMin.z );
+    u32 Z1 = GroundCell( std::max( Segment.Origin.z, End.z ) - m_GroundMin.z );
+
+    u32 Level = 0;
+    while ( (X0 >> Level) != (X1 >> Level) || (Z0 >> Level) != (Z1 >> Level) )
+    {
+        Level++;
+    }
+
+    aStack[ StackSize ].Level = Level;
+    aStack[ StackSize ].X = X0 >> Level;
+    aStack[ StackSize ].Z = Z0 >> Level;
+    aStack[ StackSize ].Enter = 0.0f;
+    aStack[ StackSize ].Exit = Nearest.t;
+    StackSize++;
+
+    __m128 xOriginX = _mm_set1_ps( Segment.Origin.x );
+    __m128 xOriginY = _mm_set1_ps( Segment.Origin.y );
+    __m128 xOriginZ = _mm_set1_ps( Segment.Origin.z );
+    __m128 xDirectionY = _mm_set1_ps( Segment.Direction.y );
+    __m128 xInvX = _mm_set1_ps( Segment.InvDirection.x );
+    __m128 xInvZ = _mm_set1_ps( Segment.InvDirection.z );
+    __m128 xSlack = _mm_set1_ps( Slack );
+
+    while ( StackSize > 0 )
+    {
+        Entry Top = aStack[ --StackSize ];
+        if ( Top.Enter > Nearest.t )
+        {
+            continue;
+        }
+
+        if ( Top.Level == 0 )
+        {
+            u32 Cell = Top.Z * m_GroundSize + Top.X;
+            u32 First = m_aGroundCellStart[ Cell ];
+            TraceLeaf( Request, Segment, &m_aGroundCellObjects[ First ], m_aGroundCellStart[ Cell + 1 ] - First,
+                       Nearest );
+            continue;
+        }
+
+        //
+        // Clip the ray to the 2x2 cells below, in SSE lanes, and check it against their heights.
+        //
+        u32 Size = m_GroundSize >> (Top.Level - 1);
+        f32 ChildSize = m_GroundCellSize * static_cast<f32>(1 << (Top.Level - 1));
+        f32 MinX = m_GroundMin.x + ChildSize * (2 * Top.X) - Slack;
+        f32 MinZ = m_GroundMin.z + ChildSize * (2 * Top.Z) - Slack;
+        f32 MaxX = MinX + ChildSize + 2.0f * Slack;
+        f32 MaxZ = MinZ + ChildSize + 2.0f * Slack;
+
+        __m128 t0 = _mm_mul_ps( _mm_sub_ps( _mm_setr_ps( MinX, MinX + ChildSize, MinX, MinX + ChildSize ), xOriginX ), xInvX );
+        __m128 t1 = _mm_mul_ps( _mm_sub_ps( _mm_setr_ps( MaxX, MaxX + ChildSize, MaxX, MaxX + ChildSize ), xOriginX ), xInvX );
+        __m128 xEnter = _mm_max_ps( _mm_set1_ps( Top.Enter ), _mm_min_ps( t0, t1 ) );
+        __m128 xExit = _mm_min_ps( _mm_set1_ps( std::min( Top.Exit, Nearest.t ) ), _mm_max_ps( t0, t1 ) );
+
+        t0 = _mm_mul_ps( _mm_sub_ps( _mm_setr_ps( MinZ, MinZ, MinZ + ChildSize, MinZ + ChildSize ), xOriginZ ), xInvZ );
+        t1 = _mm_mul_ps( _mm_sub_ps( _mm_setr_ps( MaxZ, MaxZ, MaxZ + ChildSize, MaxZ + ChildSize ), xOriginZ ), xInvZ );
+        xEnter = _mm_max_ps( xEnter, _mm_min_ps( t0, t1 ) );
+        xExit = _mm_min_ps( xExit, _mm_max_ps( t0, t1 ) );
+
+        // The ranges of a row of 2 cells are next to each other
+        const std::vector<GroundRange>& Below = m_aGroundLevels[ Top.Level - 1 ];
+        __m128 xRow0 = _mm_loadu_ps( &Below[ (2 * Top.Z) * Size + 2 * Top.X ].Min );
+        __m128 xRow1 = _mm_loadu_ps( &Below[ (2 * Top.Z + 1) * Size + 2 * Top.X ].Min );
+        __m128 xRangeMin = _mm_sub_ps( _mm_shuffle_ps( xRow0, xRow1, _MM_SHUFFLE( 2, 0, 2, 0 ) ), xSlack );
+        __m128 xRangeMax = _mm_add_ps( _mm_shuffle_ps( xRow0, xRow1, _MM_SHUFFLE( 3, 1, 3, 1 ) ), xSlack );
+
+        __m128 y0 = _mm_add_ps( xOriginY, _mm_mul_ps( xDirectionY, xEnter ) );
+        __m128 y1 = _mm_add_ps( xOriginY, _mm_mul_ps( xDirectionY, xExit ) );
+
+        __m128 xCross = _mm_cmple_ps( xEnter, xExit );
+        xCross = _mm_and_ps( xCross, _mm_cmple_ps( _mm_min_ps( y0, y1 ), xRangeMax ) );
+        xCross = _mm_and_ps( xCross, _mm_cmpge_ps( _mm_max_ps( y0, y1 ), xRangeMin ) );
+
+        int Mask = _mm_movemask_ps( xCross );
+        if ( Mask == 0 )
+        {
+            continue;
+        }
+
+        //
+        // Push the cells crossed farthest first, so the nearest is visited next.
+        //
+        const f32* aEnter = reinterpret_cast<const f32*>(&xEnter);
+        const f32* aExit = reinterpret_cast<const f32*>(&xExit);
+        u32 aOrder[ 4 ];
+        u32 OrderCount = 0;
+
+        for ( u32 c=0; c < 4; c++ )
+        {
+            if ( Mask & (1 << c) )
+            {
+                u32 Insert = OrderCount++;
+                while ( Insert > 0 && aEnter[ aOrder[ Insert - 1 ] ] < aEnter[ c ] )
+                {
+                    aOrder[ Insert ] = aOrder[ Insert - 1 ];
+                    Insert--;
+                }
+                aOrder[ Insert ] = c;
+            }
+        }
+
+        for ( u32 i=0; i < OrderCount; i++ )
+        {
+            u32 c = aOrder[ i ];
+
+            ASSERT( StackSize < sizeof( aStack ) / sizeof( aStack[ 0 ] ) );
+            aStack[ StackSize ].Level = Top.Level - 1;
+            aStack[ StackSize ].X = 2 * Top.X + (c & 1);
+            aStack[ StackSize ].Z = 2 * Top.Z + (c >> 1);
+            aStack[ StackSize ].Enter = aEnter[ c ];
+            aStack[ StackSize ].Exit = aExit[ c ];
+            StackSize++;
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SegmentBounds - Gets the box around the rays of a packet, each cut at its nearest hit so far.
+//  The bounds are broadcast to all lanes.
+void
+BvhCollision::SegmentBounds(
+    const PacketLanes& Lanes,
+    const Hit* aNearest,
+    __m128* aMin,
+    __m128* aMax
+    )
+{
+    __m128 xNearest = _mm_setr_ps( aNearest[ 0 ].t, aNearest[ 1 ].t, aNearest[ 2 ].t, aNearest[ 3 ].t );
+    const __m128* aOrigin = &Lanes.OriginX;
+    const __m128* aDirection = &Lanes.DirectionX;
+
+    for ( u32 a=0; a < 3; a++ )
+    {
+        __m128 xEnd = _mm_add_ps( aOrigin[ a ], _mm_mul_ps( aDirection[ a ], xNearest ) );
+        __m128 xMin = _mm_min_ps( aOrigin[ a ], xEnd );
+        __m128 xMax = _mm_max_ps( aOrigin[ a ], xEnd );
+
+        xMin = _mm_min_ps( xMin, _mm_shuffle_ps( xMin, xMin, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+        xMax = _mm_max_ps( xMax, _mm_shuffle_ps( xMax, xMax, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+        aMin[ a ] = _mm_min_ps( xMin, _mm_shuffle_ps( xMin, xMin, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+        aMax[ a ] = _mm_max_ps( xMax, _mm_shuffle_ps( xMax, xMax, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// TracePacket - Traces the rays of a packet together, one ray per SSE lane.  Subtrees only one of
+//  the rays reaches are finished by TraceNode.
+void
+BvhCollision::TracePacket(
+    const Packet& Rays
+    )
+{
+    ASSERT( Rays.Count > 1 && Rays.Count <= sm_PacketSize );
+
+    const Coll::Request* apRequests[ sm_PacketSize ];
+    Ray aRays[ sm_PacketSize ];
+    Hit aNearest[ sm_PacketSize ];
+
+    // Unused lanes repeat the first ray and are masked out.  Rays only hitting the ground skip
+    //  the hierarchy.
+    int HierarchyLanes = 0;
+    for ( u32 l=0; l < sm_PacketSize; l++ )
+    {
+        apRequests[ l ] = &m_aBatchRequests[ Rays.aRequest[ (l < Rays.Count) ? l : 0 ] ];
+        MakeRay( *apRequests[ l ], aRays[ l ] );
+        aNearest[ l ].t = 1.0f;
+        aNearest[ l ].pObject = NULL;
+        aNearest[ l ].Axis = 0;
+
+        if ( l < Rays.Count && (apRequests[ l ]->m_Flags & Coll::e_Ground) == 0 )
+        {
+            HierarchyLanes |= 1 << l;
+        }
+    }
+
+    if ( !m_aNodes.empty() && HierarchyLanes != 0 )
+    {
+        PacketLanes Lanes;
+        Lanes.OriginX = _mm_setr_ps( aRays[ 0 ].Origin.x, aRays[ 1 ].Origin.x, aRays[ 2 ].Origin.x, aRays[ 3 ].Origin.x );
+        Lanes.OriginY = _mm_setr_ps( aRays[ 0 ].Origin.y, aRays[ 1 ].Origin.y, aRays[ 2 ].Origin.y, aRays[ 3 ].Origin.y );
+        Lanes.OriginZ = _mm_setr_ps( aRays[ 0 ].Origin.z, aRays[ 1 ].Origin.z, aRays[ 2 ].Origin.z, aRays[ 3 ].Origin.z );
+        Lanes.InvX = _mm_setr_ps( aRays[ 0 ].InvDirection.x, aRays[ 1 ].InvDirection.x,
+                                  aRays[ 2 ].InvDirection.x, aRays[ 3 ].InvDirection.x );
+        Lanes.InvY = _mm_setr_ps( aRays[ 0 ].InvDirection.y, aRays[ 1 ].InvDirection.y,
+                                  aRays[ 2 ].InvDirection.y, aRays[ 3 ].InvDirection.y );
+        Lanes.InvZ = _mm_setr_ps( aRays[ 0 ].InvDirection.z, aRays[ 1 ].InvDirection.z,
+                                  aRays[ 2 ].InvDirection.z, aRays[ 3 ].InvDirection.z );
+
+        Lanes.DirectionX = _mm_setr_ps( aRays[ 0 ].Direction.x, aRays[ 1 ].Direction.x,
+                                        aRays[ 2 ].Direction.x, aRays[ 3 ].Direction.x );
+        Lanes.DirectionY = _mm_setr_ps( aRays[ 0 ].Direction.y, aRays[ 1 ].Direction.y,
+                                        aRays[ 2 ].Direction.y, aRays[ 3 ].Direction.y );
+        Lanes.DirectionZ = _mm_setr_ps( aRays[ 0 ].Direction.z, aRays[ 1 ].Direction.z,
+                                        aRays[ 2 ].Direction.z, aRays[ 3 ].Direction.z );
+
+        Lanes.GroundMask = 0;
+        Lanes.IgnoreGroundMask = 0;
+        Lanes.IgnoreMask = 0;
+
+        for ( u32 l=0; l < sm_PacketSize; l++ )
+        {
+            // The axis a ray starting inside a box reports, see TraceObject
+            Math::Vector3 Direction( fabsf( aRays[ l ].Direction.x ), fabsf( aRays[ l ].Direction.y ),
+                                     fabsf( aRays[ l ].Direction.z ) );
+            Lanes.aInsideAxis[ l ] = (Direction.x >= Direction.y && Direction.x >= Direction.z) ? 0 :
+                                     (Direction.y >= Direction.z) ? 1 : 2;
+
+            // The flags IsIgnored checks, so the leaves can check them for all lanes at once
+            Lanes.GroundMask |= (apRequests[ l ]->m_Flags & Coll::e_Ground) ? (1 << l) : 0;
+            Lanes.IgnoreGroundMask |= (apRequests[ l ]->m_Flags & Coll::e_IgnoreGround) ? (1 << l) : 0;
+            Lanes.IgnoreMask |= (apRequests[ l ]->m_Ignore != NULL) ? (1 << l) : 0;
+        }
+
+        // The rays head the same way, so their summed direction orders the children
+        __m128 xHeadingX = _mm_add_ps( Lanes.DirectionX, _mm_movehl_ps( Lanes.DirectionX, Lanes.DirectionX ) );
+        __m128 xHeadingY = _mm_add_ps( Lanes.DirectionY, _mm_movehl_ps( Lanes.DirectionY, Lanes.DirectionY ) );
+        __m128 xHeadingZ = _mm_add_ps( Lanes.DirectionZ, _mm_movehl_ps( Lanes.DirectionZ, Lanes.DirectionZ ) );
+        xHeadingX = _mm_add_ps( xHeadingX, _mm_shuffle_ps( xHeadingX, xHeadingX, _MM_SHUFFLE( 1, 1, 1, 1 ) ) );
+        xHeadingY = _mm_add_ps( xHeadingY, _mm_shuffle_ps( xHeadingY, xHeadingY, _MM_SHUFFLE( 1, 1, 1, 1 ) ) );
+        xHeadingZ = _mm_add_ps( xHeadingZ, _mm_shuffle_ps( xHeadingZ, xHeadingZ, _MM_SHUFFLE( 1, 1, 1, 1 ) ) );
+        xHeadingX = _mm_shuffle_ps( xHeadingX, xHeadingX, _MM_SHUFFLE( 0, 0, 0, 0 ) );
+        xHeadingY = _mm_shuffle_ps( xHeadingY, xHeadingY, _MM_SHUFFLE( 0, 0, 0, 0 ) );
+        xHeadingZ = _mm_shuffle_ps( xHeadingZ, xHeadingZ, _MM_SHUFFLE( 0, 0, 0, 0 ) );
+
+        __m128 aBoundsMin[ 3 ];
+        __m128 aBoundsMax[ 3 ];
+        SegmentBounds( Lanes, aNearest, aBoundsMin, aBoundsMax );
+
+        __m128 xNearest = _mm_set1_ps( 1.0f );
+
+        struct Entry
+        {
+            u32 Node;
+            int Mask;                       // Rays that reached the node
+        };
+        Entry aStack[ sm_TraceStackSize ];
+        u32 StackSize = 0;
+
+        aStack[ StackSize ].Node = 0;
+        aStack[ StackSize ].Mask = HierarchyLanes;
+        StackSize++;
+
+        while ( StackSize > 0 )
+        {
+            Entry Top = aStack[ --StackSize ];
+            const Node& Current = m_aNodes[ Top.Node ];
+
+            //
+            // Overlap test of the 4 children against the box around the rays.  Empty children
+            //  have empty boxes and never overlap.
+            //
+            __m128 xOverlap = _mm_and_ps( _mm_cmple_ps( Current.MinX, aBoundsMax[ 0 ] ),
+                                          _mm_cmple_ps( aBoundsMin[ 0 ], Current.MaxX ) );
+            xOverlap = _mm_and_ps( xOverlap, _mm_and_ps( _mm_cmple_ps( Current.MinY, aBoundsMax[ 1 ] ),
+                                                         _mm_cmple_ps( aBoundsMin[ 1 ], Current.MaxY ) ) );
+            xOverlap = _mm_and_ps( xOverlap, _mm_and_ps( _mm_cmple_ps( Current.MinZ, aBoundsMax[ 2 ] ),
+                                                         _mm_cmple_ps( aBoundsMin[ 2 ], Current.MaxZ ) ) );
+
+            int ChildMask = _mm_movemask_ps( xOverlap );
+            if ( ChildMask == 0 )
+            {
+                continue;
+            }
+
+            // How far along the rays the center of each child is, to visit the nearest first
+            __m128 xDistance = _mm_mul_ps( _mm_add_ps( Current.MinX, Current.MaxX ), xHeadingX );
+            xDistance = _mm_add_ps( xDistance, _mm_mul_ps( _mm_add_ps( Current.MinY, Current.MaxY ), xHeadingY ) );
+            xDistance = _mm_add_ps( xDistance, _mm_mul_ps( _mm_add_ps( Current.MinZ, Current.MaxZ ), xHeadingZ ) );
+            const f32* aDistance = reinterpret_cast<const f32*>(&xDistance);
+
+            u32 aOrder[ 4 ];
+            int aMask[ 4 ];
+            u32 OrderCount = 0;
+
+            for ( u32 i=0; i < 4; i++ )
+            {
+                if ( (ChildMask & (1 << i)) == 0 )
+                {
+                    continue;
+                }
+
+                //
+                // The box around the rays only rules out children away from all of them, so slab
+                //  test the child against each ray, one per lane.
+                //
+                __m128 t0 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( reinterpret_cast<const f32*>(&Current.MinX)[ i ] ), Lanes.OriginX ), Lanes.InvX );
+                __m128 t1 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( reinterpret_cast<const f32*>(&Current.MaxX)[ i ] ), Lanes.OriginX ), Lanes.InvX );
+                __m128 xEnter = _mm_min_ps( t0, t1 );
+                __m128 xExit = _mm_max_ps( t0, t1 );
+
+                t0 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( reinterpret_cast<const f32*>(&Current.MinY)[ i ] ), Lanes.OriginY ), Lanes.InvY );
+                t1 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( reinterpret_cast<const f32*>(&Current.MaxY)[ i ] ), Lanes.OriginY ), Lanes.InvY );
+                xEnter = _mm_max_ps( xEnter, _mm_min_ps( t0, t1 ) );
+                xExit = _mm_min_ps( xExit, _mm_max_ps( t0, t1 ) );
+
+                t0 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( reinterpret_cast<const f32*>(&Current.MinZ)[ i ] ), Lanes.OriginZ ), Lanes.InvZ );
+                t1 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( reinterpret_cast<const f32*>(&Current.MaxZ)[ i ] ), Lanes.OriginZ ), Lanes.InvZ );
+                xEnter = _mm_max_ps( xEnter, _mm_min_ps( t0, t1 ) );
+                xExit = _mm_min_ps( xExit, _mm_max_ps( t0, t1 ) );
+
+                xEnter = _mm_max_ps( xEnter, _mm_setzero_ps() );
+                xExit = _mm_min_ps( xExit, xNearest );
+
+                int Mask = _mm_movemask_ps( _mm_cmple_ps( xEnter, xExit ) ) & Top.Mask;
+                if ( Mask == 0 )
+                {
+                    continue;
+                }
+
+                if ( Current.aCount[ i ] > 0 )
+                {
+                    if ( TracePacketLeaf( Lanes, apRequests, Mask, Current.aChild[ i ], Current.aCount[ i ],
+                                          aNearest ) )
+                    {
+                        // Hits shorten the rays
+                        xNearest = _mm_setr_ps( aNearest[ 0 ].t, aNearest[ 1 ].t, aNearest[ 2 ].t, aNearest[ 3 ].t );
+                        SegmentBounds( Lanes, aNearest, aBoundsMin, aBoundsMax );
+                    }
+                }
+                else if ( (Mask & (Mask - 1)) == 0 )
+                {
+                    // The packet diverged; a single ray is left
+                    u32 l = (Mask & 1) ? 0 : (Mask & 2) ? 1 : (Mask & 4) ? 2 : 3;
+                    TraceNode( *apRequests[ l ], aRays[ l ], Current.aChild[ i ], aNearest[ l ] );
+                    xNearest = _mm_setr_ps( aNearest[ 0 ].t, aNearest[ 1 ].t, aNearest[ 2 ].t, aNearest[ 3 ].t );
+                }
+                else
+                {
+                    u32 Insert = OrderCount++;
+                    while ( Insert > 0 && aDistance[ aOrder[ Insert - 1 ] ] < aDistance[ i ] )
+                    {
+                        aOrder[ Insert ] = aOrder[ Insert - 1 ];
+                        aMask[ Insert ] = aMask[ Insert - 1 ];
+                        Insert--;
+                    }
+                    aOrder[ Insert ] = i;
+                    aMask[ Insert ] = Mask;
+                }
+            }
+
+            for ( u32 i=0; i < OrderCount; i++ )
+            {
+                ASSERT( StackSize < sizeof( aStack ) / sizeof( aStack[ 0 ] ) );
+                aStack[ StackSize ].Node = Current.aChild[ aOrder[ i ] ];
+                aStack[ StackSize ].Mask = aMask[ i ];
+                StackSize++;
+            }
+        }
+    }
+
+    for ( u32 l=0; l < Rays.Count; l++ )
+    {
+        if ( (apRequests[ l ]->m_Flags & Coll::e_IgnoreGround) == 0 )
+        {
+            TraceGround( *apRequests[ l ], aRays[ l ], aNearest[ l ] );
+        }
+        WriteResult( *apRequests[ l ], aRays[ l ], aNearest[ l ], m_aBatchResults[ Rays.aRequest[ l ] ] );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// TracePacketLeaf - Tests the rays of a packet that reached a leaf against its objects, one ray
+//  per SSE lane, keeping the nearest hit of each ray.  Returns True if any ray hit.
+Bool
+BvhCollision::TracePacketLeaf(
+    const PacketLanes& Lanes,
+    const Coll::Request* const* apRequests,
+    int Mask,
+    u32 First,
+    u32 Count,
+    Hit* aNearest
+    ) const
+{
+    Bool bHit = False;
+
+    __m128 xNearest = _mm_setr_ps( aNearest[ 0 ].t, aNearest[ 1 ].t, aNearest[ 2 ].t, aNearest[ 3 ].t );
+    int MissMask = 0;
+    for ( u32 l=0; l < sm_PacketSize; l++ )
+    {
+        MissMask |= (aNearest[ l ].pObject == NULL) ? (1 << l) : 0;
+    }
+
+    for ( u32 o=First; o < First + Count; o++ )
+    {
+        const Object& Target = m_aObjects[ m_aObjectIndices[ o ] ];
+
+        int Active = Mask & ~(Target.bGround ? Lanes.IgnoreGroundMask : Lanes.GroundMask);
+        if ( Active & Lanes.IgnoreMask )
+        {
+            for ( u32 l=0; l < sm_PacketSize; l++ )
+            {
+                if ( (Active & Lanes.IgnoreMask & (1 << l)) && IsIgnored( *apRequests[ l ], Target ) )
+                {
+                    Active &= ~(1 << l);
+                }
+            }
+        }
+        if ( Active == 0 )
+        {
+            continue;
+        }
+
+        __m128 t0 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( Target.Min.x ), Lanes.OriginX ), Lanes.InvX );
+        __m128 t1 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( Target.Max.x ), Lanes.OriginX ), Lanes.InvX );
+        __m128 xEnterX = _mm_min_ps( t0, t1 );
+        __m128 xExit = _mm_max_ps( t0, t1 );
+
+        t0 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( Target.Min.y ), Lanes.OriginY ), Lanes.InvY );
+        t1 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( Target.Max.y ), Lanes.OriginY ), Lanes.InvY );
+        __m128 xEnterY = _mm_min_ps( t0, t1 );
+        xExit = _mm_min_ps( xExit, _mm_max_ps( t0, t1 ) );
+
+        t0 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( Target.Min.z ), Lanes.OriginZ ), Lanes.InvZ );
+        t1 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( Target.Max.z ), Lanes.OriginZ ), Lanes.InvZ );
+        __m128 xEnterZ = _mm_min_ps( t0, t1 );
+        xExit = _mm_min_ps( xExit, _mm_max_ps( t0, t1 ) );
+
+        __m128 xEnter = _mm_max_ps( _mm_max_ps( xEnterX, xEnterY ), _mm_max_ps( xEnterZ, _mm_setzero_ps() ) );
+        xExit = _mm_min_ps( xExit, xNearest );
+
+        // Like TraceLeaf, a hit must be nearer than the last one unless it is the first
+        int HitMask = _mm_movemask_ps( _mm_cmple_ps( xEnter, xExit ) ) & Active &
+                      (_mm_movemask_ps( _mm_cmplt_ps( xEnter, xNearest ) ) | MissMask);
+        if ( HitMask == 0 )
+        {
+            continue;
+        }
+
+        const f32* aEnter = reinterpret_cast<const f32*>(&xEnter);
+        const f32* aEnterX = reinterpret_cast<const f32*>(&xEnterX);
+        const f32* aEnterY = reinterpret_cast<const f32*>(&xEnterY);
+        const f32* aEnterZ = reinterpret_cast<const f32*>(&xEnterZ);
+
+        for ( u32 l=0; l < sm_PacketSize; l++ )
+        {
+            if ( (HitMask & (1 << l)) == 0 )
+            {
+                continue;
+            }
+
+            // Pick the axis the way TraceObject does, the first axis entered last
+            f32 Enter = 0.0f;
+            u32 Axis = Lanes.aInsideAxis[ l ];
+            if ( aEnterX[ l ] > Enter )
+            {
+                Enter = aEnterX[ l ];
+                Axis = 0;
+            }
+            if ( aEnterY[ l ] > Enter )
+            {
+                Enter = aEnterY[ l ];
+                Axis = 1;
+            }
+            if ( aEnterZ[ l ] > Enter )
+            {
+                Axis = 2;
+            }
+
+            aNearest[ l ].t = aEnter[ l ];
+            aNearest[ l ].pObject = &Target;
+            aNearest[ l ].Axis = Axis;
+        }
+
+        xNearest = _mm_setr_ps( aNearest[ 0 ].t, aNearest[ 1 ].t, aNearest[ 2 ].t, aNearest[ 3 ].t );
+        MissMask &= ~HitMask;
+        bHit = True;
+    }
+
+    return bHit;
+}
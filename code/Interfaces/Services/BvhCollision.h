@@ -0,0 +1,301 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#pragma once
+
+//
+// core includes
+//
+#include "../../BaseTypes/BaseTypes.h"
+#include "../../BaseTypes/TbbSpinMutex.h"
+#include "../Interface.h"
+#include <xmmintrin.h>
+#include <map>
+#include <string>
+#include <vector>
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// <summary>
+///   Collision provider that answers the requests of a frame as one batch.  Test and LineTest only
+///    queue a request; Resolve, called once a frame by the system owning the provider, builds or
+///    refits a bounding volume hierarchy over the object boxes and traces the queued requests in
+///    parallel.  Finalize returns the results from then on.
+/// </summary>
+/// <remarks>
+///   The hierarchy is built with the surface area heuristic and stored 4 children to a node, so a
+///    ray is tested against the 4 child boxes of a node at once with SSE.  Moving objects only
+///    refit it; it is rebuilt when objects are added or removed or when refitting has made it
+///    noticeably worse than a fresh build.
+/// <para>
+///   Requests heading the same way from nearby start points, such as a flock probing the ground,
+///    are traced as packets of 4 rays, one per SSE lane.  A packet first culls the children of a
+///    node with the box around its rays, then tests the children left against each ray.  A
+///    subtree only one ray of a packet reaches is traced for that ray alone, and requests too far
+///    apart to share a packet are traced alone from the start.
+/// </para>
+/// <para>
+///   The ground, y being up, is kept apart in a grid over the x-z plane with a pyramid of
+///    coarser levels holding the height range of 2x2 cells of the level below.  A ray descends it
+///    only into the cells whose height range it passes through, so Coll::e_Ground requests never
+///    touch the hierarchy and Coll::e_IgnoreGround requests never touch the grid.
+/// </para>
+/// </remarks>
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class BvhCollision : public IService::ICollision
+{
+public:
+
+    /// <summary>
+    ///   Constructor.
+    /// </summary>
+    BvhCollision( void );
+
+    /// <summary>
+    ///   Destructor.
+    /// </summary>
+    virtual ~BvhCollision( void );
+
+    /// <summary>
+    ///   Adds an object or updates the box of an object already added.  Not safe to call while
+    ///    Resolve runs.
+    /// </summary>
+    /// <param name="pszName">The name of the object, reported in Coll::Result::m_Hit.  It is not
+    ///  copied so it must stay valid until the object is removed.</param>
+    /// <param name="Min">The minimum corner of the object's box.</param>
+    /// <param name="Max">The maximum corner of the object's box.</param>
+    /// <param name="bGround">True if the object is part of the ground (see Coll::Flags).  Ground
+    ///  objects are kept in a grid over the x-z plane rather than in the hierarchy, and moving one
+    ///  rebuilds the grid, so they should rarely move.</param>
+    void SetObject( pcstr pszName, const Math::Vector3& Min, const Math::Vector3& Max,
+                    Bool bGround=False );
+
+    /// <summary>
+    ///   Removes an object.  Not safe to call while Resolve runs.
+    /// </summary>
+    /// <param name="pszName">The name of the object.</param>
+    void RemoveObject( pcstr pszName );
+
+    /// <summary cref="ICollision::Test">
+    ///   Queues a request for the next Resolve.  Safe to call from any thread.
+    /// </summary>
+    /// <param name="Request">Collision request; only Coll::e_LineTest is supported.</param>
+    /// <returns>A handle used to get the results, or Coll::InvalidHandle.</returns>
+    virtual Coll::Handle Test( const Coll::Request& Request );
+
+    /// <summary cref="ICollision::LineTest">
+    ///   Queues a line test for the next Resolve.  Safe to call from any thread.
+    /// </summary>
+    virtual Coll::Handle LineTest( const Math::Vector3& Position0, const Math::Vector3& Position1,
+                                   Coll::Request& Request );
+
+    /// <summary cref="ICollision::Finalize">
+    ///   Gets the results of a resolved request and releases its handle.  Safe to call from any
+    ///    thread.
+    /// </summary>
+    /// <returns>True if the request has been resolved.</returns>
+    virtual Bool Finalize( Coll::Handle Handle, Coll::Result* Result );
+
+    /// <summary>
+    ///   Resolves the requests queued since the last call.
+    /// </summary>
+    /// <param name="pTaskManager">Task manager to trace the requests in parallel with, or NULL
+    ///  to trace them on the calling thread.</param>
+    /// <param name="pSystemTask">The task calling, passed on to ITaskManager::ParallelFor.</param>
+    void Resolve( ITaskManager* pTaskManager=NULL, ISystemTask* pSystemTask=NULL );
+
+
+protected:
+
+    static const u32 sm_MaxLeafObjects = 4;
+    static const u32 sm_SAHBins = 16;
+    static const u32 sm_MinRequestsPerJob = 64;
+    static const u32 sm_PacketSize = 4;
+    static const u32 sm_MaxGroundCells = 512;       // Per side of the ground grid
+
+    // Past this depth the binary hierarchy is split at the median instead of by surface area.
+    //  A median split halves the objects, of which there are fewer than 2^32, so no path is
+    //  longer than sm_MaxDepth however the objects are laid out.
+    static const u32 sm_MaxSAHDepth = 32;
+    static const u32 sm_MaxDepth = sm_MaxSAHDepth + 32;
+
+    // A traversal pops a node and pushes at most 4 children, so its stack holds at most 3 nodes
+    //  for every level of the path to the node it is in
+    static const u32 sm_TraceStackSize = 3 * sm_MaxDepth + 1;
+
+    // Refits are kept until the hierarchy costs this much more than it did when built
+    static const f32 sm_RebuildCostRatio;
+
+    // Rays are packed together while the box around them is at most this much larger than the
+    //  longest of them, measured by the sum of the box sides
+    static const f32 sm_MaxPacketSpread;
+
+    // How much the ground cells are widened, relative to the whole grid, against rounding
+    static const f32 sm_GroundSlack;
+
+    static const u32 sm_InvalidNode = u32(-1);
+
+    struct Object
+    {
+        pcstr           pszName;
+        Math::Vector3   Min;
+        Math::Vector3   Max;
+        Bool            bGround;
+    };
+
+    // A node of the hierarchy, with the boxes of its 4 children stored across SSE lanes.  A child
+    //  is either another node or, if its count is not 0, a range of m_aObjectIndices.  Unused
+    //  children have empty boxes.
+    struct Node
+    {
+        __m128          MinX, MinY, MinZ;
+        __m128          MaxX, MaxY, MaxZ;
+        u32             aChild[ 4 ];
+        u32             aCount[ 4 ];
+    };
+
+    // A node of the binary hierarchy the 4 wide one is collapsed from
+    struct BuildNode
+    {
+        Math::Vector3   Min;
+        Math::Vector3   Max;
+        u32             aChild[ 2 ];
+        u32             First;
+        u32             Count;
+    };
+
+    enum SlotState
+    {
+        e_Free,
+        e_Pending,
+        e_Resolved,
+    };
+
+    struct Slot
+    {
+        Coll::Request   Request;
+        Coll::Result    Result;
+        SlotState       State;
+    };
+
+    // A ray between the positions of a line test
+    struct Ray
+    {
+        Math::Vector3   Origin;
+        Math::Vector3   Direction;
+        Math::Vector3   InvDirection;
+    };
+
+    // The nearest object a ray has hit so far
+    struct Hit
+    {
+        f32             t;
+        const Object*   pObject;
+        u32             Axis;
+    };
+
+    // The heights of the ground objects over a cell of the ground grid
+    struct GroundRange
+    {
+        f32             Min;
+        f32             Max;
+    };
+
+    // Requests of the batch traced together
+    struct Packet
+    {
+        u32             aRequest[ sm_PacketSize ];
+        u32             Count;
+    };
+
+    // The rays of a packet across SSE lanes
+    struct PacketLanes
+    {
+        __m128          OriginX, OriginY, OriginZ;
+        __m128          DirectionX, DirectionY, DirectionZ;
+        __m128          InvX, InvY, InvZ;
+        u32             aInsideAxis[ sm_PacketSize ];
+
+        // Lane masks of the rays only hitting the ground, skipping it and ignoring an object
+        int             GroundMask;
+        int             IgnoreGroundMask;
+        int             IgnoreMask;
+    };
+
+    void Build( void );
+    u32 BuildRange( u32 First, u32 Count, u32 Depth );
+    u32 Collapse( u32 BuildIndex );
+    f32 Refit( void );
+
+    void BuildGround( void );
+    u32 GroundCell( f32 Offset ) const;
+
+    void FormPackets( void );
+
+    static void MakeRay( const Coll::Request& Request, Ray& Segment );
+    static void WriteResult( const Coll::Request& Request, const Ray& Segment, const Hit& Nearest,
+                             Coll::Result& Result );
+
+    void Trace( const Coll::Request& Request, Coll::Result& Result ) const;
+    static void SegmentBounds( const PacketLanes& Lanes, const Hit* aNearest, __m128* aMin,
+                               __m128* aMax );
+    void TracePacket( const Packet& Rays );
+    void TraceNode( const Coll::Request& Request, const Ray& Segment, u32 Root, Hit& Nearest ) const;
+    Bool TracePacketLeaf( const PacketLanes& Lanes, const Coll::Request* const* apRequests, int Mask,
+                          u32 First, u32 Count, Hit* aNearest ) const;
+    void TraceGround( const Coll::Request& Request, const Ray& Segment, Hit& Nearest ) const;
+    void TraceLeaf( const Coll::Request& Request, const Ray& Segment, const u32* aIndices, u32 Count,
+                    Hit& Nearest ) const;
+    Bool TraceObject( const Ray& Segment, const Object& Target, f32& t, u32& Axis ) const;
+    Bool IsIgnored( const Coll::Request& Request, const Object& Target ) const;
+
+    static void ResolveRange( void* pParam, u32 Begin, u32 End );
+
+    // Objects and their index by name
+    std::vector<Object>             m_aObjects;
+    std::map<std::string, u32>      m_ObjectIndex;
+    Bool                            m_bRebuild;
+    Bool                            m_bRefit;
+    Bool                            m_bRebuildGround;
+
+    // The hierarchy; m_aNodes[ 0 ] is the root, every node comes before its children
+    std::vector<Node>               m_aNodes;
+    std::vector<u32>                m_aObjectIndices;
+    std::vector<BuildNode>          m_aBuildNodes;
+    f32                             m_BuildCost;
+
+    // The ground grid, m_GroundSize cells a side.  m_aGroundLevels[ 0 ] holds the height ranges of
+    //  the cells and each following level those of 2x2 cells of the level before.  The objects
+    //  over cell c are m_aGroundCellObjects[ m_aGroundCellStart[ c ] ] up to the next start.
+    Math::Vector3                   m_GroundMin;
+    f32                             m_GroundCellSize;
+    u32                             m_GroundSize;
+    std::vector< std::vector<GroundRange> > m_aGroundLevels;
+    std::vector<u32>                m_aGroundCellStart;
+    std::vector<u32>                m_aGroundCellObjects;
+
+    // Requests by handle, the handles free for reuse and the handles queued for Resolve
+    DEFINE_SPIN_MUTEX( m_SlotsMutex );
+    std::vector<Slot>               m_aSlots;
+    std::vector<Coll::Handle>       m_aFreeHandles;
+    std::vector<Coll::Handle>       m_aQueued;
+
+    // The batch being resolved
+    std::vector<Coll::Handle>       m_aBatch;
+    std::vector<Coll::Request>      m_aBatchRequests;
+    std::vector<Coll::Result>       m_aBatchResults;
+    std::vector<u64>                m_aPacketKeys;
+    std::vector<Packet>             m_aPackets;
+};
@@ -53,7 +53,7 @@ namespace Coll
 		pcstr         m_Ignore;     // Name of object to ignore in collision
 		Flags         m_Flags;      // Flags (see Coll::Flags)
 
-		Request() { memset( this, 0, sizeof( this ) ); }
+		Request() { memset( static_cast<void*>(this), 0, sizeof( *this ) ); }
 		void SetIgnore( pcstr Ignore ) { m_Ignore = Ignore; }
 		void SetFlags( Coll::Flags Flags ) { m_Flags = Flags; }
 	};
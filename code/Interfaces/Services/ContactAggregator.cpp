@@ -0,0 +1,313 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#include <math.h>
+#include <xmmintrin.h>
+#include <algorithm>
+
+#include "ContactAggregator.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetCluster - Gets the cluster cell of a coordinate, offset to be positive
+static inline u64
+GetCluster(
+    f32 Value,
+    f32 InvClusterSize,
+    u32 Bits
+    )
+{
+    // Far away coordinates are clamped to the outermost cells
+    const f32 Half = static_cast<f32>(1 << (Bits - 1));
+    f32 Cell = floorf( Value * InvClusterSize );
+    Cell = std::max( -Half, std::min( Cell, Half - 1.0f ) );
+    return static_cast<u64>(Cell + Half);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ContactAggregator - Starts with no contacts
+ContactAggregator::ContactAggregator(
+    f32 ImpactThreshold,
+    f32 ClusterSize,
+    u32 MaxEvents
+    )
+    : m_ImpactThreshold( ImpactThreshold )
+    , m_InvClusterSize( 1.0f / ClusterSize )
+    , m_MaxEvents( MaxEvents )
+{
+    ASSERT( ClusterSize > 0.0f );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ~ContactAggregator
+ContactAggregator::~ContactAggregator(
+    void
+    )
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ChangeOccurred - Collects the contact of a changed object, or forgets one shutting down
+Error
+ContactAggregator::ChangeOccurred(
+    ISubject* pSubject,
+    System::Changes::BitMask ChangeType
+    )
+{
+    if ( pSubject == NULL || pSubject == static_cast<ISubject*>(this) )
+    {
+        return Errors::Success;
+    }
+
+    if ( ChangeType == 0 )
+    {
+        //
+        // CSubject calls this from its destructor, when the object can no longer be cast to
+        //  IContactObject, so find its contacts and events by subject.
+        //
+        SCOPED_SPIN_LOCK( m_ContactsMutex );
+
+        for ( size_t i=0; i < m_apSubjects.size(); i++ )
+        {
+            if ( m_apSubjects[ i ] == pSubject )
+            {
+                m_apSources[ i ] = NULL;
+                m_apSubjects[ i ] = NULL;
+            }
+        }
+
+        for ( size_t i=0; i < m_aEvents.size(); i++ )
+        {
+            if ( m_aEvents[ i ].pSubject == pSubject )
+            {
+                m_aEvents[ i ].pSource = NULL;
+                m_aEvents[ i ].pSubject = NULL;
+            }
+        }
+    }
+    else if ( ChangeType & System::Changes::POI::Contact )
+    {
+        IContactObject* pContact = dynamic_cast<IContactObject*>(pSubject);
+        const IContactObject::Info* pInfo = (pContact != NULL) ? pContact->GetContact() : NULL;
+        if ( pInfo != NULL )
+        {
+            Append( *pInfo, pContact, pSubject );
+        }
+    }
+
+    return Errors::Success;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// AddContact - Appends a contact, with the subject of its source if it has one
+void
+ContactAggregator::AddContact(
+    const IContactObject::Info& Contact,
+    IContactObject* pSource
+    )
+{
+    Append( Contact, pSource, dynamic_cast<ISubject*>(pSource) );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Append - Appends a contact to the arrays
+void
+ContactAggregator::Append(
+    const IContactObject::Info& Contact,
+    IContactObject* pSource,
+    ISubject* pSubject
+    )
+{
+    SCOPED_SPIN_LOCK( m_ContactsMutex );
+
+    m_aPositionX.push_back( Contact.m_Position.x );
+    m_aPositionY.push_back( Contact.m_Position.y );
+    m_aPositionZ.push_back( Contact.m_Position.z );
+    m_aImpact.push_back( Contact.m_Impact );
+    m_aContacts.push_back( Contact );
+    m_apSources.push_back( pSource );
+    m_apSubjects.push_back( pSubject );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Resolve - Filters, clusters and sorts the collected contacts
+void
+ContactAggregator::Resolve(
+    void
+    )
+{
+    m_aEvents.clear();
+
+    if ( m_aImpact.empty() )
+    {
+        return;
+    }
+
+    PROFILE_ZONE( "ContactAggregator::Resolve" );
+
+    //
+    // Keep the contacts at or over the threshold, 4 at a time.
+    //
+    u32 Count = static_cast<u32>(m_aImpact.size());
+    m_aKeys.resize( Count );
+
+    u32 Kept = 0;
+    u32 i = 0;
+    __m128 Threshold = _mm_set1_ps( m_ImpactThreshold );
+
+    for ( ; i + 4 <= Count; i += 4 )
+    {
+        int Mask = _mm_movemask_ps( _mm_cmpge_ps( _mm_loadu_ps( &m_aImpact[ i ] ), Threshold ) );
+
+        for ( u32 Lane=0; Mask != 0; Lane++, Mask >>= 1 )
+        {
+            if ( Mask & 1 )
+            {
+                m_aKeys[ Kept++ ].Index = i + Lane;
+            }
+        }
+    }
+    for ( ; i < Count; i++ )
+    {
+        if ( m_aImpact[ i ] >= m_ImpactThreshold )
+        {
+            m_aKeys[ Kept++ ].Index = i;
+        }
+    }
+    m_aKeys.resize( Kept );
+
+    //
+    // Cluster the contacts by cell.
+    //
+    for ( u32 k=0; k < Kept; k++ )
+    {
+        u32 Index = m_aKeys[ k ].Index;
+        u64 x = GetCluster( m_aPositionX[ Index ], m_InvClusterSize, sm_ClusterBits );
+        u64 y = GetCluster( m_aPositionY[ Index ], m_InvClusterSize, sm_ClusterBits );
+        u64 z = GetCluster( m_aPositionZ[ Index ], m_InvClusterSize, sm_ClusterBits );
+        m_aKeys[ k ].Cell = (x << (2 * sm_ClusterBits)) | (y << sm_ClusterBits) | z;
+    }
+    std::sort( m_aKeys.begin(), m_aKeys.end(), IsKeyBefore );
+
+    for ( u32 First=0; First < Kept; )
+    {
+        u32 End = First + 1;
+        while ( End < Kept && m_aKeys[ End ].Cell == m_aKeys[ First ].Cell )
+        {
+            End++;
+        }
+
+        u32 Strongest = m_aKeys[ First ].Index;
+        f32 TotalImpact = 0.0f;
+        f32 SumX = 0.0f;
+        f32 SumY = 0.0f;
+        f32 SumZ = 0.0f;
+
+        for ( u32 k=First; k < End; k++ )
+        {
+            u32 Index = m_aKeys[ k ].Index;
+            f32 Impact = m_aImpact[ Index ];
+
+            TotalImpact += Impact;
+            SumX += m_aPositionX[ Index ] * Impact;
+            SumY += m_aPositionY[ Index ] * Impact;
+            SumZ += m_aPositionZ[ Index ] * Impact;
+
+            if ( Impact > m_aImpact[ Strongest ] )
+            {
+                Strongest = Index;
+            }
+        }
+
+        Event Cluster;
+        Cluster.Contact = m_aContacts[ Strongest ];
+        Cluster.TotalImpact = TotalImpact;
+        Cluster.Count = End - First;
+        Cluster.pSource = m_apSources[ Strongest ];
+        Cluster.pSubject = m_apSubjects[ Strongest ];
+
+        if ( TotalImpact > 0.0f )
+        {
+            f32 InvTotal = 1.0f / TotalImpact;
+            Cluster.Contact.m_Position = Math::Vector3( SumX * InvTotal, SumY * InvTotal,
+                                                        SumZ * InvTotal );
+        }
+
+        m_aEvents.push_back( Cluster );
+        First = End;
+    }
+
+    //
+    // Strongest first; the clusters are in cell order, so ties stay in the same order every run.
+    //
+    std::stable_sort( m_aEvents.begin(), m_aEvents.end(), IsEventBefore );
+    if ( m_aEvents.size() > m_MaxEvents )
+    {
+        m_aEvents.resize( m_MaxEvents );
+    }
+
+    m_aPositionX.clear();
+    m_aPositionY.clear();
+    m_aPositionZ.clear();
+    m_aImpact.clear();
+    m_aContacts.clear();
+    m_apSources.clear();
+    m_apSubjects.clear();
+
+    if ( !m_aEvents.empty() )
+    {
+        PostChanges( System::Changes::POI::Contact );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetContact - Gets the strongest event's contact
+const IContactObject::Info*
+ContactAggregator::GetContact(
+    void
+    )
+{
+    return m_aEvents.empty() ? NULL : &m_aEvents[ 0 ].Contact;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// IsKeyBefore - Orders contacts by cell, then by the order they came in
+Bool
+ContactAggregator::IsKeyBefore(
+    const Key& a,
+    const Key& b
+    )
+{
+    return a.Cell < b.Cell || (a.Cell == b.Cell && a.Index < b.Index);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// IsEventBefore - Orders events by impact, strongest first
+Bool
+ContactAggregator::IsEventBefore(
+    const Event& a,
+    const Event& b
+    )
+{
+    return a.Contact.m_Impact > b.Contact.m_Impact;
+}
@@ -0,0 +1,198 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#pragma once
+
+//
+// core includes
+//
+#include "../../BaseTypes/BaseTypes.h"
+#include "../../BaseTypes/TbbSpinMutex.h"
+#include "../Interface.h"
+#include <vector>
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// <summary>
+///   Collects the contacts of a frame and reduces them to a short list of events, so that systems
+///    reacting to contacts, such as audio and particles, see one event per place things hit
+///    rather than every resting contact.
+/// </summary>
+/// <remarks>
+///   The aggregator observes the contact objects for System::Changes::POI::Contact and copies
+///    their contact.  Resolve, called once a frame by the system owning the aggregator, drops the
+///    contacts weaker than the impact threshold, clusters the rest by the cell of a grid they fall
+///    in, and sorts the clusters by impact, strongest first.  It then posts
+///    System::Changes::POI::Contact to its own observers, which read GetEvents.
+/// <para>
+///   The positions and impacts of the contacts, which filtering and clustering go through, are
+///    stored as separate arrays; the rest of a contact is only read for the strongest contact of
+///    each cluster.
+/// </para>
+/// <para>
+///   Observers only interested in a single contact can keep using IContactObject; GetContact
+///    returns the strongest event of the last Resolve.
+/// </para>
+/// </remarks>
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class ContactAggregator : public IObserver, public CSubject, public IContactObject
+{
+public:
+
+    /// <summary>
+    ///   The contacts of a cluster.
+    /// </summary>
+    struct Event
+    {
+        // The strongest contact of the cluster, but with the position averaged over the cluster,
+        //  weighted by impact
+        IContactObject::Info    Contact;
+
+        f32                     TotalImpact;
+        u32                     Count;
+
+        // The object that reported the strongest contact, or NULL if it has since shut down
+        IContactObject*         pSource;
+
+        // The subject of pSource, by which it is forgotten when it shuts down, or NULL
+        ISubject*               pSubject;
+    };
+    typedef std::vector<Event>  EventArray;
+
+
+    /// <summary>
+    ///   Constructor.
+    /// </summary>
+    /// <param name="ImpactThreshold">Contacts with a lower m_Impact are dropped.</param>
+    /// <param name="ClusterSize">The side of the grid cells contacts are clustered by.</param>
+    /// <param name="MaxEvents">The most events kept by Resolve; the weakest are dropped.</param>
+    ContactAggregator( f32 ImpactThreshold=0.0f, f32 ClusterSize=1.0f,
+                       u32 MaxEvents=static_cast<u32>(-1) );
+
+    /// <summary>
+    ///   Destructor.
+    /// </summary>
+    virtual ~ContactAggregator( void );
+
+    /// <summary>
+    ///   Sets the impact under which contacts are dropped, from the next Resolve on.
+    /// </summary>
+    void SetImpactThreshold( f32 ImpactThreshold )
+    {
+        m_ImpactThreshold = ImpactThreshold;
+    }
+
+    /// <summary>
+    ///   Sets the side of the grid cells contacts are clustered by, from the next Resolve on.
+    /// </summary>
+    void SetClusterSize( f32 ClusterSize )
+    {
+        ASSERT( ClusterSize > 0.0f );
+        m_InvClusterSize = 1.0f / ClusterSize;
+    }
+
+    /// <summary>
+    ///   Sets the most events kept by Resolve.
+    /// </summary>
+    void SetMaxEvents( u32 MaxEvents )
+    {
+        m_MaxEvents = MaxEvents;
+    }
+
+    /// <summary cref="IObserver::ChangeOccurred">
+    ///   Collects the contact of a contact object.  Safe to call from any thread.
+    /// </summary>
+    /// <param name="pSubject">The contact object's subject; subjects not implementing
+    ///  IContactObject are ignored.</param>
+    /// <param name="ChangeType">System::Changes::POI::Contact, or 0 if the object is shutting
+    ///  down.  A subject shutting down is no longer an IContactObject, so its contacts and events
+    ///  are found by the subject recorded when they were collected.</param>
+    /// <returns>Errors::Success.</returns>
+    virtual Error ChangeOccurred( ISubject* pSubject, System::Changes::BitMask ChangeType );
+
+    /// <summary>
+    ///   Collects a contact.  Safe to call from any thread.
+    /// </summary>
+    /// <param name="Contact">The contact.</param>
+    /// <param name="pSource">The object reporting it, or NULL.  If it is also an ISubject it is
+    ///  forgotten when it shuts down.</param>
+    void AddContact( const IContactObject::Info& Contact, IContactObject* pSource=NULL );
+
+    /// <summary>
+    ///   Reduces the contacts collected since the last call to events and posts
+    ///    System::Changes::POI::Contact if there are any.  Not safe to call while contacts are
+    ///    being collected.
+    /// </summary>
+    void Resolve( void );
+
+    /// <summary>
+    ///   Gets the events of the last Resolve.
+    /// </summary>
+    /// <returns>The events, strongest first.</returns>
+    const EventArray& GetEvents( void ) const
+    {
+        return m_aEvents;
+    }
+
+    /// <summary cref="ISubject::GetPotentialSystemChanges">
+    ///   Gets the changes the aggregator posts.
+    /// </summary>
+    /// <returns>System::Changes::POI::Contact.</returns>
+    virtual System::Changes::BitMask GetPotentialSystemChanges( void )
+    {
+        return System::Changes::POI::Contact;
+    }
+
+    /// <summary cref="IContactObject::GetContact">
+    ///   Gets the strongest event of the last Resolve.
+    /// </summary>
+    /// <returns>The event's contact, or NULL if there were no events.</returns>
+    virtual const IContactObject::Info* GetContact( void );
+
+
+protected:
+
+    static const u32 sm_ClusterBits = 21;               // Per axis of a cluster key
+
+    // A collected contact's cluster and index
+    struct Key
+    {
+        u64                 Cell;
+        u32                 Index;
+    };
+
+    void Append( const IContactObject::Info& Contact, IContactObject* pSource, ISubject* pSubject );
+
+    static Bool IsKeyBefore( const Key& a, const Key& b );
+    static Bool IsEventBefore( const Event& a, const Event& b );
+
+    f32                             m_ImpactThreshold;
+    f32                             m_InvClusterSize;
+    u32                             m_MaxEvents;
+
+    // The contacts collected, the positions and impacts apart from the rest
+    DEFINE_SPIN_MUTEX( m_ContactsMutex );
+    std::vector<f32>                m_aPositionX;
+    std::vector<f32>                m_aPositionY;
+    std::vector<f32>                m_aPositionZ;
+    std::vector<f32>                m_aImpact;
+    std::vector<IContactObject::Info> m_aContacts;
+    std::vector<IContactObject*>    m_apSources;
+    std::vector<ISubject*>          m_apSubjects;
+
+    // Resolve's scratch and results
+    std::vector<Key>                m_aKeys;
+    EventArray                      m_aEvents;
+};
@@ -0,0 +1,144 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#include "GeometryStore.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GeometryStore - Starts with no objects
+GeometryStore::GeometryStore(
+    u32 BufferCount
+    )
+    : m_BufferCount( BufferCount )
+    , m_Frame( 0 )
+{
+    ASSERT( BufferCount >= 2 && BufferCount <= MaxBuffers );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ~GeometryStore
+GeometryStore::~GeometryStore(
+    void
+    )
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Add - Adds an object to every buffer
+u32
+GeometryStore::Add(
+    void
+    )
+{
+    u32 Slot;
+
+    if ( !m_aFreeSlots.empty() )
+    {
+        Slot = m_aFreeSlots.back();
+        m_aFreeSlots.pop_back();
+
+        for ( u32 i=0; i < m_BufferCount; i++ )
+        {
+            m_aBuffers[ i ].aPositions[ Slot ] = Math::Vector3::Zero;
+            m_aBuffers[ i ].aOrientations[ Slot ] = Math::Quaternion::Zero;
+            m_aBuffers[ i ].aScales[ Slot ] = Math::Vector3::One;
+        }
+    }
+    else
+    {
+        Slot = static_cast<u32>(m_aChanges.size());
+        m_aChanges.push_back( 0 );
+
+        for ( u32 i=0; i < m_BufferCount; i++ )
+        {
+            m_aBuffers[ i ].aPositions.push_back( Math::Vector3::Zero );
+            m_aBuffers[ i ].aOrientations.push_back( Math::Quaternion::Zero );
+            m_aBuffers[ i ].aScales.push_back( Math::Vector3::One );
+        }
+    }
+
+    return Slot;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Remove - Frees an object's slot
+void
+GeometryStore::Remove(
+    u32 Slot
+    )
+{
+    ASSERT( Slot < m_aChanges.size() );
+
+    m_aChanges[ Slot ] = 0;
+    m_aFreeSlots.push_back( Slot );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Flip - Publishes the back buffer and copies the newer values into the next one
+void
+GeometryStore::Flip(
+    void
+    )
+{
+    PROFILE_ZONE( "GeometryStore::Flip" );
+
+    //
+    // Gather the objects written this frame; their list replaces the oldest one.
+    //
+    std::vector<u32>& aWritten = m_aaWritten[ m_Frame % (m_BufferCount - 1) ];
+    aWritten.clear();
+    m_aChanged.clear();
+
+    u32 Count = static_cast<u32>(m_aChanges.size());
+
+    for ( u32 Slot=0; Slot < Count; Slot++ )
+    {
+        if ( m_aChanges[ Slot ] != 0 )
+        {
+            Change Written;
+            Written.Slot = Slot;
+            Written.Changes = m_aChanges[ Slot ];
+            m_aChanged.push_back( Written );
+
+            aWritten.push_back( Slot );
+            m_aChanges[ Slot ] = 0;
+        }
+    }
+
+    m_Frame++;
+
+    //
+    // The new back buffer was last written BufferCount - 1 frames ago; copy what was written
+    //  since from the front buffer.
+    //
+    const Buffer& Front = m_aBuffers[ GetFrontIndex( 0 ) ];
+    Buffer& Back = m_aBuffers[ GetBackIndex() ];
+
+    for ( u32 i=0; i < m_BufferCount - 1; i++ )
+    {
+        const std::vector<u32>& aSlots = m_aaWritten[ i ];
+
+        for ( size_t j=0; j < aSlots.size(); j++ )
+        {
+            u32 Slot = aSlots[ j ];
+            Back.aPositions[ Slot ] = Front.aPositions[ Slot ];
+            Back.aOrientations[ Slot ] = Front.aOrientations[ Slot ];
+            Back.aScales[ Slot ] = Front.aScales[ Slot ];
+        }
+    }
+}
@@ -0,0 +1,208 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#pragma once
+
+//
+// core includes
+//
+#include "../../BaseTypes/BaseTypes.h"
+#include "../Interface.h"
+#include <vector>
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// <summary>
+///   Positions, orientations and scales of the objects of a geometry system, kept in two or three
+///    buffers so that other systems can read them while the geometry system writes them.
+/// </summary>
+/// <remarks>
+///   Writers, such as the geometry or physics system's jobs, set the values of a frame in the back
+///    buffer while readers, such as graphics and AI, read the values of the previous frame from the
+///    front buffer.  Flip, called once a frame while neither reads nor writes are running, such as
+///    when the scheduler distributes changes, makes the back buffer the front.  With three buffers
+///    the frame before the front can also be read, by readers running a frame behind.
+/// <para>
+///   An IGeometryObject can return the pointers of GetPosition, GetOrientation and GetScale; they
+///    stay valid until the next Flip.
+/// </para>
+/// </remarks>
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class GeometryStore
+{
+public:
+
+    static const u32 MaxBuffers = 3;
+
+    /// <summary>
+    ///   An object whose values changed in the last frame.
+    /// </summary>
+    struct Change
+    {
+        u32                         Slot;
+        System::Changes::BitMask    Changes;
+    };
+    typedef std::vector<Change>     ChangeArray;
+
+
+    /// <summary>
+    ///   Constructor.
+    /// </summary>
+    /// <param name="BufferCount">The number of buffers, 2 or 3.</param>
+    GeometryStore( u32 BufferCount=2 );
+
+    /// <summary>
+    ///   Destructor.
+    /// </summary>
+    ~GeometryStore( void );
+
+    /// <summary>
+    ///   Adds an object, at the origin, with no rotation and a scale of one in every buffer.  Not
+    ///    safe to call while the store is read or written.
+    /// </summary>
+    /// <returns>The object's slot.</returns>
+    u32 Add( void );
+
+    /// <summary>
+    ///   Removes an object; its slot can be returned by a later Add.  Not safe to call while the
+    ///    store is read or written.
+    /// </summary>
+    /// <param name="Slot">The object's slot.</param>
+    void Remove( u32 Slot );
+
+    /// <summary>
+    ///   Sets an object's position in the back buffer.  Safe to call from any thread as long as
+    ///    only one thread writes an object.
+    /// </summary>
+    void SetPosition( u32 Slot, const Math::Vector3& Position )
+    {
+        ASSERT( Slot < m_aChanges.size() );
+        m_aBuffers[ GetBackIndex() ].aPositions[ Slot ] = Position;
+        m_aChanges[ Slot ] |= System::Changes::Geometry::Position;
+    }
+
+    /// <summary>
+    ///   Sets an object's orientation in the back buffer.  Safe to call from any thread as long as
+    ///    only one thread writes an object.
+    /// </summary>
+    void SetOrientation( u32 Slot, const Math::Quaternion& Orientation )
+    {
+        ASSERT( Slot < m_aChanges.size() );
+        m_aBuffers[ GetBackIndex() ].aOrientations[ Slot ] = Orientation;
+        m_aChanges[ Slot ] |= System::Changes::Geometry::Orientation;
+    }
+
+    /// <summary>
+    ///   Sets an object's scale in the back buffer.  Safe to call from any thread as long as only
+    ///    one thread writes an object.
+    /// </summary>
+    void SetScale( u32 Slot, const Math::Vector3& Scale )
+    {
+        ASSERT( Slot < m_aChanges.size() );
+        m_aBuffers[ GetBackIndex() ].aScales[ Slot ] = Scale;
+        m_aChanges[ Slot ] |= System::Changes::Geometry::Scale;
+    }
+
+    /// <summary>
+    ///   Gets an object's position from a front buffer.  Safe to call from any thread.
+    /// </summary>
+    /// <param name="Slot">The object's slot.</param>
+    /// <param name="Lag">0 for the last frame flipped, 1 for the frame before with three
+    ///  buffers.</param>
+    const Math::Vector3* GetPosition( u32 Slot, u32 Lag=0 ) const
+    {
+        return &m_aBuffers[ GetFrontIndex( Lag ) ].aPositions[ Slot ];
+    }
+
+    /// <summary>
+    ///   Gets an object's orientation from a front buffer.  Safe to call from any thread.
+    /// </summary>
+    /// <param name="Slot">The object's slot.</param>
+    /// <param name="Lag">0 for the last frame flipped, 1 for the frame before with three
+    ///  buffers.</param>
+    const Math::Quaternion* GetOrientation( u32 Slot, u32 Lag=0 ) const
+    {
+        return &m_aBuffers[ GetFrontIndex( Lag ) ].aOrientations[ Slot ];
+    }
+
+    /// <summary>
+    ///   Gets an object's scale from a front buffer.  Safe to call from any thread.
+    /// </summary>
+    /// <param name="Slot">The object's slot.</param>
+    /// <param name="Lag">0 for the last frame flipped, 1 for the frame before with three
+    ///  buffers.</param>
+    const Math::Vector3* GetScale( u32 Slot, u32 Lag=0 ) const
+    {
+        return &m_aBuffers[ GetFrontIndex( Lag ) ].aScales[ Slot ];
+    }
+
+    /// <summary>
+    ///   Makes the back buffer the front and brings the new back buffer up to date with it.  Not
+    ///    safe to call while the store is read or written.
+    /// </summary>
+    void Flip( void );
+
+    /// <summary>
+    ///   Gets the number of Flip calls so far.
+    /// </summary>
+    u32 GetFrame( void ) const
+    {
+        return m_Frame;
+    }
+
+    /// <summary>
+    ///   Gets the objects written in the frame made front by the last Flip, in slot order, for the
+    ///    system owning the store to post their changes.
+    /// </summary>
+    const ChangeArray& GetChanges( void ) const
+    {
+        return m_aChanged;
+    }
+
+
+protected:
+
+    struct Buffer
+    {
+        std::vector<Math::Vector3>      aPositions;
+        std::vector<Math::Quaternion>   aOrientations;
+        std::vector<Math::Vector3>      aScales;
+    };
+
+    u32 GetBackIndex( void ) const
+    {
+        return (m_Frame + 1) % m_BufferCount;
+    }
+
+    u32 GetFrontIndex( u32 Lag ) const
+    {
+        ASSERT( Lag + 1 < m_BufferCount );
+        return (m_Frame + m_BufferCount - Lag) % m_BufferCount;
+    }
+
+    u32                             m_BufferCount;
+    u32                             m_Frame;
+    Buffer                          m_aBuffers[ MaxBuffers ];
+
+    // The changes written to the back buffer so far, by slot
+    std::vector<System::Changes::BitMask> m_aChanges;
+
+    // The slots written in each of the last frames, which a buffer needs copied when it becomes
+    //  the back buffer again
+    std::vector<u32>                m_aaWritten[ MaxBuffers - 1 ];
+
+    std::vector<u32>                m_aFreeSlots;
+    ChangeArray                     m_aChanged;
+};
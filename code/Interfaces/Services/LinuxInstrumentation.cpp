@@ -0,0 +1,412 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#if defined( __linux__ )
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <algorithm>
+#include <chrono>
+
+#include "LinuxInstrumentation.h"
+
+
+//
+// Hardware counter events, in HardwareCounter order.
+//
+static const u64 s_aCounterEvents[ LinuxInstrumentation::e_HardwareCounterCount ] =
+{
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetTime - Gets the steady clock in nanoseconds
+static u64
+GetTime(
+    void
+    )
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// LinuxInstrumentation - Takes the first samples and opens the hardware counters
+LinuxInstrumentation::LinuxInstrumentation(
+    f32 UpdateInterval
+    )
+    : m_UpdateInterval( UpdateInterval )
+    , m_Elapsed( 0.0f )
+    , m_Frames( 0 )
+    , m_FPS( 0.0f )
+    , m_ActiveThreadCount( 0 )
+{
+    long CPUCount = sysconf( _SC_NPROCESSORS_CONF );
+    m_CPUCount = (CPUCount > 0) ? static_cast<i32>(CPUCount) : 1;
+    m_ActiveThreadCount = m_CPUCount;
+
+    m_aCPUCounters.assign( m_CPUCount + 1, 0.0 );
+    ReadCPUTimes( m_aBusy, m_aTotal );
+
+    for ( u32 i=0; i < System::Types::MAX; i++ )
+    {
+        m_aFrameTicks[ i ].store( 0, std::memory_order_relaxed );
+        m_aIntervalTicks[ i ] = 0;
+        m_aJobRatios[ i ] = 0.0f;
+        m_aJobUsage[ i ] = 0.0f;
+    }
+
+    //
+    // Count user space events of this process and of the threads it creates from now on.  Opening
+    //  fails when the kernel does not allow it or the hardware has no such counter.
+    //
+    for ( u32 i=0; i < e_HardwareCounterCount; i++ )
+    {
+        perf_event_attr Attr;
+        memset( &Attr, 0, sizeof( Attr ) );
+        Attr.size = sizeof( Attr );
+        Attr.type = PERF_TYPE_HARDWARE;
+        Attr.config = s_aCounterEvents[ i ];
+        Attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        Attr.inherit = 1;
+        Attr.exclude_kernel = 1;
+        Attr.exclude_hv = 1;
+
+        m_aCounterFiles[ i ] = static_cast<int>(syscall( __NR_perf_event_open, &Attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC ));
+        m_aCounterValues[ i ] = 0;
+        m_aCounterRates[ i ] = 0.0;
+    }
+
+    u16 Cpu;
+    m_RefreshTicks = Profiler::ReadTimer( Cpu );
+    m_RefreshTime = GetTime();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ~LinuxInstrumentation - Closes the hardware counters
+LinuxInstrumentation::~LinuxInstrumentation(
+    void
+    )
+{
+    for ( u32 i=0; i < e_HardwareCounterCount; i++ )
+    {
+        if ( m_aCounterFiles[ i ] >= 0 )
+        {
+            close( m_aCounterFiles[ i ] );
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// UpdatePeriodicData - Counts a frame and refreshes the stats when they are old
+void
+LinuxInstrumentation::UpdatePeriodicData(
+    f32 deltaTime
+    )
+{
+    //
+    // Job ratios of the frame that just ended.
+    //
+    i64 aTicks[ System::Types::MAX ];
+    i64 TotalTicks = 0;
+
+    for ( u32 i=0; i < System::Types::MAX; i++ )
+    {
+        aTicks[ i ] = m_aFrameTicks[ i ].exchange( 0, std::memory_order_relaxed );
+        m_aIntervalTicks[ i ] += aTicks[ i ];
+        TotalTicks += aTicks[ i ];
+    }
+
+    for ( u32 i=0; i < System::Types::MAX; i++ )
+    {
+        m_aJobRatios[ i ] = (TotalTicks > 0) ? static_cast<f32>(aTicks[ i ]) / TotalTicks : 0.0f;
+    }
+
+    m_Frames++;
+    m_Elapsed += deltaTime;
+
+    if ( m_Elapsed >= m_UpdateInterval )
+    {
+        m_FPS = (m_Elapsed > 0.0f) ? m_Frames / m_Elapsed : 0.0f;
+        m_Frames = 0;
+        m_Elapsed = 0.0f;
+
+        Refresh();
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Refresh - Samples the CPU times and hardware counters
+void
+LinuxInstrumentation::Refresh(
+    void
+    )
+{
+    u16 Cpu;
+    u64 Ticks = Profiler::ReadTimer( Cpu );
+    u64 Time = GetTime();
+
+    f64 Seconds = (Time - m_RefreshTime) * 1e-9;
+    if ( Seconds <= 0.0 )
+    {
+        return;
+    }
+
+    //
+    // Share of all the CPUs each job type used.  The job ticks are timer ticks, so measure the
+    //  timer over the same interval.
+    //
+    f64 Capacity = static_cast<f64>(Ticks - m_RefreshTicks) * m_CPUCount;
+
+    for ( u32 i=0; i < System::Types::MAX; i++ )
+    {
+        f64 Usage = (Capacity > 0.0) ? 100.0 * m_aIntervalTicks[ i ] / Capacity : 0.0;
+        m_aJobUsage[ i ] = static_cast<f32>((Usage < 100.0) ? Usage : 100.0);
+        m_aIntervalTicks[ i ] = 0;
+    }
+
+    m_RefreshTicks = Ticks;
+    m_RefreshTime = Time;
+
+    //
+    // CPU load, per CPU then the total.
+    //
+    std::vector<u64> aBusy;
+    std::vector<u64> aTotal;
+    ReadCPUTimes( aBusy, aTotal );
+
+    for ( i32 i=0; i <= m_CPUCount; i++ )
+    {
+        u64 Total = aTotal[ i ] - m_aTotal[ i ];
+        u64 Busy = aBusy[ i ] - m_aBusy[ i ];
+        // Idle and iowait can step back, so keep the load in range
+        m_aCPUCounters[ i ] = (aTotal[ i ] > m_aTotal[ i ] && aBusy[ i ] >= m_aBusy[ i ]) ?
+            std::min( 100.0 * Busy / Total, 100.0 ) : 0.0;
+    }
+
+    m_aBusy.swap( aBusy );
+    m_aTotal.swap( aTotal );
+
+    //
+    // Hardware counter rates, scaled up when the kernel multiplexed the counters.
+    //
+    for ( u32 i=0; i < e_HardwareCounterCount; i++ )
+    {
+        u64 aValues[ 3 ];           // Value, time enabled, time running
+
+        if ( m_aCounterFiles[ i ] >= 0 &&
+             read( m_aCounterFiles[ i ], aValues, sizeof( aValues ) ) == sizeof( aValues ) )
+        {
+            u64 Value = (aValues[ 2 ] > 0) ?
+                static_cast<u64>(static_cast<f64>(aValues[ 0 ]) * aValues[ 1 ] / aValues[ 2 ]) : 0;
+
+            m_aCounterRates[ i ] = (Value >= m_aCounterValues[ i ]) ?
+                (Value - m_aCounterValues[ i ]) / Seconds : 0.0;
+            m_aCounterValues[ i ] = Value;
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ReadCPUTimes - Reads the busy and total jiffies of each CPU and of all of them
+void
+LinuxInstrumentation::ReadCPUTimes(
+    std::vector<u64>& Busy,
+    std::vector<u64>& Total
+    )
+{
+    Busy.assign( m_CPUCount + 1, 0 );
+    Total.assign( m_CPUCount + 1, 0 );
+
+    FILE* pFile = fopen( "/proc/stat", "r" );
+    if ( pFile == NULL )
+    {
+        return;
+    }
+
+    char szLine[ 512 ];
+    while ( fgets( szLine, sizeof( szLine ), pFile ) != NULL )
+    {
+        if ( strncmp( szLine, "cpu", 3 ) != 0 )
+        {
+            // The CPU lines come first
+            break;
+        }
+
+        // "cpu" is all of them, "cpuN" a single one; offline CPUs have no line
+        char* pszFields = szLine + 3;
+        i32 Index = m_CPUCount;
+        if ( *pszFields != ' ' )
+        {
+            Index = static_cast<i32>(strtol( pszFields, &pszFields, 10 ));
+            if ( Index < 0 || Index >= m_CPUCount )
+            {
+                continue;
+            }
+        }
+
+        // user nice system idle iowait irq softirq steal; guest time is already part of user
+        u64 aFields[ 8 ] = { 0 };
+        for ( u32 i=0; i < 8; i++ )
+        {
+            aFields[ i ] = strtoull( pszFields, &pszFields, 10 );
+        }
+
+        u64 Sum = 0;
+        for ( u32 i=0; i < 8; i++ )
+        {
+            Sum += aFields[ i ];
+        }
+        Total[ Index ] = Sum;
+        Busy[ Index ] = Sum - aFields[ 3 ] - aFields[ 4 ];
+    }
+
+    fclose( pFile );
+}
+
+
+i32
+LinuxInstrumentation::getCPUCount(
+    void
+    )
+{
+    return m_CPUCount;
+}
+
+
+i32
+LinuxInstrumentation::getNumCounters(
+    void
+    )
+{
+    return m_CPUCount + 1;
+}
+
+
+void
+LinuxInstrumentation::getCPUCounters(
+    f64* CPUCounters
+    )
+{
+    memcpy( CPUCounters, &m_aCPUCounters[ 0 ], m_aCPUCounters.size() * sizeof( f64 ) );
+}
+
+
+f32
+LinuxInstrumentation::getCurrentFPS(
+    void
+    )
+{
+    return m_FPS;
+}
+
+
+void
+LinuxInstrumentation::setActiveThreadCount(
+    i32 activeThreadCount
+    )
+{
+    m_ActiveThreadCount = activeThreadCount;
+}
+
+
+i32
+LinuxInstrumentation::getActiveThreadCount(
+    void
+    )
+{
+    return m_ActiveThreadCount;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CaptureJobCounterTicks - Adds to the ticks of a job type
+void
+LinuxInstrumentation::CaptureJobCounterTicks(
+    u32 jobType,
+    i64 jobCounterTicks
+    )
+{
+    if ( jobType != System::Types::Null )
+    {
+        u32 Index = System::Types::GetIndex( jobType );
+        m_aFrameTicks[ Index ].fetch_add( jobCounterTicks, std::memory_order_relaxed );
+    }
+}
+
+
+i32
+LinuxInstrumentation::getJobCount(
+    void
+    )
+{
+    return System::Types::MAX;
+}
+
+
+void
+LinuxInstrumentation::getJobRatios(
+    f32* jobRatios
+    )
+{
+    memcpy( jobRatios, m_aJobRatios, sizeof( m_aJobRatios ) );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// getJobCPUUsage - Gets the share of all CPUs a job type used
+f32
+LinuxInstrumentation::getJobCPUUsage(
+    u32 jobType
+    )
+{
+    if ( jobType == System::Types::Null )
+    {
+        return 0.0f;
+    }
+    return m_aJobUsage[ System::Types::GetIndex( jobType ) ];
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetHardwareCounter - Gets the rate of a hardware counter
+Bool
+LinuxInstrumentation::GetHardwareCounter(
+    HardwareCounter Counter,
+    f64& PerSecond
+    )
+{
+    ASSERT( Counter < e_HardwareCounterCount );
+
+    if ( m_aCounterFiles[ Counter ] < 0 )
+    {
+        return False;
+    }
+    PerSecond = m_aCounterRates[ Counter ];
+    return True;
+}
+
+#endif
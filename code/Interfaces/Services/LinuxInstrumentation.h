@@ -0,0 +1,128 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#pragma once
+
+//
+// core includes
+//
+#include "../../BaseTypes/BaseTypes.h"
+#include "../Interface.h"
+#include <atomic>
+#include <vector>
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// <summary>
+///   Instrumentation provider for Linux.  CPU load comes from /proc/stat and, where the kernel
+///    allows it (see /proc/sys/kernel/perf_event_paranoid), hardware counters of this process
+///    come from perf_event_open.
+/// </summary>
+/// <remarks>
+///   The hardware counters follow the threads created after construction, so create the
+///    provider before the task manager starts its threads.
+/// </remarks>
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class LinuxInstrumentation : public IService::IInstrumentation
+{
+public:
+
+    /// <summary>
+    ///   Hardware counters sampled for the process.
+    /// </summary>
+    enum HardwareCounter
+    {
+        e_Cycles,
+        e_Instructions,
+        e_CacheMisses,                  // Last level cache
+
+        e_HardwareCounterCount
+    };
+
+
+    /// <summary>
+    ///   Constructor.
+    /// </summary>
+    /// <param name="UpdateInterval">Seconds between refreshes of the cached stats.</param>
+    LinuxInstrumentation( f32 UpdateInterval = 0.5f );
+
+    /// <summary>
+    ///   Destructor.
+    /// </summary>
+    virtual ~LinuxInstrumentation( void );
+
+    /// <summary cref="IInstrumentation::UpdatePeriodicData">
+    ///   Counts a frame, updates the job ratios and refreshes the cached stats once the update
+    ///    interval has elapsed.
+    /// </summary>
+    /// <param name="deltaTime">Elapsed wall-clock time since the last call.</param>
+    virtual void UpdatePeriodicData( f32 deltaTime );
+
+    virtual i32 getCPUCount( void );
+    virtual i32 getNumCounters( void );
+    virtual void getCPUCounters( f64* CPUCounters );
+    virtual f32 getCurrentFPS( void );
+    virtual void setActiveThreadCount( i32 activeThreadCount );
+    virtual i32 getActiveThreadCount( void );
+
+    /// <summary cref="IInstrumentation::CaptureJobCounterTicks">
+    ///   Adds to the ticks of a job type.  Safe to call from any thread.
+    /// </summary>
+    virtual void CaptureJobCounterTicks( u32 jobType, i64 jobCounterTicks );
+
+    virtual i32 getJobCount( void );
+    virtual void getJobRatios( f32* jobRatios );
+    virtual f32 getJobCPUUsage( u32 jobType );
+
+    /// <summary>
+    ///   Gets the rate of a hardware counter over the last update interval.
+    /// </summary>
+    /// <param name="Counter">The counter.</param>
+    /// <param name="PerSecond">Set to the events per second.</param>
+    /// <returns>False if the counter is not available.</returns>
+    Bool GetHardwareCounter( HardwareCounter Counter, f64& PerSecond );
+
+
+protected:
+
+    void Refresh( void );
+    void ReadCPUTimes( std::vector<u64>& Busy, std::vector<u64>& Total );
+
+    f32                             m_UpdateInterval;
+    f32                             m_Elapsed;
+    u32                             m_Frames;
+    f32                             m_FPS;
+    i32                             m_ActiveThreadCount;
+
+    // Busy and total jiffies of each CPU, then of all of them, at the last refresh
+    i32                             m_CPUCount;
+    std::vector<u64>                m_aBusy;
+    std::vector<u64>                m_aTotal;
+    std::vector<f64>                m_aCPUCounters;
+
+    // Job ticks since the last frame and since the last refresh, by System::Types::GetIndex
+    std::atomic<i64>                m_aFrameTicks[ System::Types::MAX ];
+    i64                             m_aIntervalTicks[ System::Types::MAX ];
+    f32                             m_aJobRatios[ System::Types::MAX ];
+    f32                             m_aJobUsage[ System::Types::MAX ];
+
+    // Timer ticks and time of the last refresh, to convert job ticks to time
+    u64                             m_RefreshTicks;
+    u64                             m_RefreshTime;
+
+    int                             m_aCounterFiles[ e_HardwareCounterCount ];
+    u64                             m_aCounterValues[ e_HardwareCounterCount ];
+    f64                             m_aCounterRates[ e_HardwareCounterCount ];
+};
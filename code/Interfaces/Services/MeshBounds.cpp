@@ -0,0 +1,229 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#include <emmintrin.h>
+#include <algorithm>
+
+#include "MeshBounds.h"
+
+
+const u32 MeshBounds::sm_BlockSize;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// LoadPosition - Loads the 3 floats of a position without reading past them
+static inline __m128
+LoadPosition(
+    const u8* pPosition
+    )
+{
+    __m128 XY = _mm_castpd_ps( _mm_load_sd( reinterpret_cast<const double*>(pPosition) ) );
+    __m128 Z = _mm_load_ss( reinterpret_cast<const f32*>(pPosition) + 2 );
+    return _mm_movelh_ps( XY, Z );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// MeshBounds - Starts with nothing published
+MeshBounds::MeshBounds(
+    f32 Epsilon
+    )
+    : m_Epsilon( Epsilon )
+    , m_bPublished( False )
+    , m_Min( Math::Vector3::Zero )
+    , m_Max( Math::Vector3::Zero )
+    , m_pPositions( NULL )
+    , m_Stride( 0 )
+    , m_Count( 0 )
+{
+    ASSERT( Epsilon >= 0.0f );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Update - Finds the positions in a view, if their stream changed
+Bool
+MeshBounds::Update(
+    u32 StreamsChanged,
+    const VertexLayout& Layout,
+    const IGraphicsObject::StreamView& Positions,
+    ITaskManager* pTaskManager,
+    ISystemTask* pSystemTask
+    )
+{
+    u32 Stream = Layout.GetUsageStream( VertexDecl::Usage::Position );
+    if ( Stream == VertexLayout::None || (StreamsChanged & (static_cast<u32>(1) << Stream)) == 0 )
+    {
+        return False;
+    }
+
+    u32 Type;
+    i32 Offset = Layout.GetUsageOffset( VertexDecl::Usage::Position, Type );
+    ASSERTMSG( Type == VertexDecl::Type::Float3 || Type == VertexDecl::Type::Float4,
+               "MeshBounds only reads float positions." );
+    ASSERT( Layout.GetStride( Stream ) == Positions.Stride );
+
+    const u8* pPositions = reinterpret_cast<const u8*>(Positions.pData) + Offset;
+    return Update( pPositions, Positions.Stride, Positions.Count, pTaskManager, pSystemTask );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Update - Reduces the positions and publishes the box if it moved out of the epsilon
+Bool
+MeshBounds::Update(
+    const void* pPositions,
+    u32 Stride,
+    u32 Count,
+    ITaskManager* pTaskManager,
+    ISystemTask* pSystemTask
+    )
+{
+    PROFILE_ZONE( "MeshBounds::Update" );
+
+    Block Bounds = { { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f } };
+
+    u32 Blocks = (Count + sm_BlockSize - 1) / sm_BlockSize;
+
+    if ( pTaskManager != NULL && Blocks > 1 )
+    {
+        //
+        // Reduce each block into its own bounds, then the blocks' bounds here.
+        //
+        m_pPositions = reinterpret_cast<const u8*>(pPositions);
+        m_Stride = Stride;
+        m_Count = Count;
+        m_aBlocks.resize( Blocks );
+
+        pTaskManager->ParallelFor( pSystemTask, ReduceRange, this, 0, Blocks );
+
+        __m128 Min = _mm_loadu_ps( m_aBlocks[ 0 ].aMin );
+        __m128 Max = _mm_loadu_ps( m_aBlocks[ 0 ].aMax );
+        for ( u32 i=1; i < Blocks; i++ )
+        {
+            Min = _mm_min_ps( Min, _mm_loadu_ps( m_aBlocks[ i ].aMin ) );
+            Max = _mm_max_ps( Max, _mm_loadu_ps( m_aBlocks[ i ].aMax ) );
+        }
+        _mm_storeu_ps( Bounds.aMin, Min );
+        _mm_storeu_ps( Bounds.aMax, Max );
+
+        m_pPositions = NULL;
+    }
+    else if ( Count > 0 )
+    {
+        Reduce( reinterpret_cast<const u8*>(pPositions), Stride, Count, Bounds );
+    }
+
+    //
+    // Keep the published box while it holds the vertices and is no more than twice the epsilon
+    //  too large on any side.
+    //
+    if ( m_bPublished )
+    {
+        const f32* pMin = &m_Min.x;
+        const f32* pMax = &m_Max.x;
+        Bool bOutside = False;
+        Bool bShrunk = False;
+
+        for ( u32 i=0; i < 3; i++ )
+        {
+            bOutside |= Bounds.aMin[ i ] < pMin[ i ] || Bounds.aMax[ i ] > pMax[ i ];
+            bShrunk |= Bounds.aMin[ i ] - pMin[ i ] > 2.0f * m_Epsilon ||
+                       pMax[ i ] - Bounds.aMax[ i ] > 2.0f * m_Epsilon;
+        }
+
+        if ( !bOutside && !bShrunk )
+        {
+            return False;
+        }
+    }
+
+    m_Min.x = Bounds.aMin[ 0 ] - m_Epsilon;
+    m_Min.y = Bounds.aMin[ 1 ] - m_Epsilon;
+    m_Min.z = Bounds.aMin[ 2 ] - m_Epsilon;
+    m_Max.x = Bounds.aMax[ 0 ] + m_Epsilon;
+    m_Max.y = Bounds.aMax[ 1 ] + m_Epsilon;
+    m_Max.z = Bounds.aMax[ 2 ] + m_Epsilon;
+    m_bPublished = True;
+
+    return True;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ReduceRange - Reduces a range of blocks, called by ParallelFor
+void
+MeshBounds::ReduceRange(
+    void* pParam,
+    u32 Begin,
+    u32 End
+    )
+{
+    MeshBounds* pBounds = reinterpret_cast<MeshBounds*>(pParam);
+
+    for ( u32 i=Begin; i < End; i++ )
+    {
+        u32 First = i * sm_BlockSize;
+        u32 Count = std::min( sm_BlockSize, pBounds->m_Count - First );
+
+        Reduce( pBounds->m_pPositions + static_cast<size_t>(First) * pBounds->m_Stride,
+                pBounds->m_Stride, Count, pBounds->m_aBlocks[ i ] );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Reduce - Computes the min and max of positions, 4 at a time into 2 pairs of accumulators
+void
+MeshBounds::Reduce(
+    const u8* pPositions,
+    u32 Stride,
+    u32 Count,
+    Block& Bounds
+    )
+{
+    ASSERT( Count > 0 );
+
+    __m128 Min0 = LoadPosition( pPositions );
+    __m128 Max0 = Min0;
+    __m128 Min1 = Min0;
+    __m128 Max1 = Min0;
+
+    const u8* p = pPositions;
+    const u8* pEnd4 = pPositions + static_cast<size_t>(Count & ~3u) * Stride;
+    const u8* pEnd = pPositions + static_cast<size_t>(Count) * Stride;
+
+    for ( ; p != pEnd4; p += 4 * Stride )
+    {
+        __m128 P0 = LoadPosition( p );
+        __m128 P1 = LoadPosition( p + Stride );
+        __m128 P2 = LoadPosition( p + 2 * Stride );
+        __m128 P3 = LoadPosition( p + 3 * Stride );
+
+        Min0 = _mm_min_ps( Min0, _mm_min_ps( P0, P1 ) );
+        Max0 = _mm_max_ps( Max0, _mm_max_ps( P0, P1 ) );
+        Min1 = _mm_min_ps( Min1, _mm_min_ps( P2, P3 ) );
+        Max1 = _mm_max_ps( Max1, _mm_max_ps( P2, P3 ) );
+    }
+
+    for ( ; p != pEnd; p += Stride )
+    {
+        __m128 P = LoadPosition( p );
+        Min0 = _mm_min_ps( Min0, P );
+        Max0 = _mm_max_ps( Max0, P );
+    }
+
+    _mm_storeu_ps( Bounds.aMin, _mm_min_ps( Min0, Min1 ) );
+    _mm_storeu_ps( Bounds.aMax, _mm_max_ps( Max0, Max1 ) );
+}
@@ -0,0 +1,129 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#pragma once
+
+//
+// core includes
+//
+#include "../../BaseTypes/BaseTypes.h"
+#include "../Interface.h"
+#include "VertexLayout.h"
+#include <vector>
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// <summary>
+///   The axis-aligned bounding box of a deforming mesh, recomputed from the vertex positions only
+///    when they change and published only when it moves noticeably, for the graphics object
+///    returning it from IGraphicsObject::GetAABB and posting System::Changes::Graphics::AABB.
+/// </summary>
+/// <remarks>
+///   The published box always contains the vertices.  When they grow out of it, the box is
+///    published again with a margin of the epsilon on every side, so that small growth over the
+///    next frames stays inside it; when they shrink more than twice the epsilon away from it, it
+///    is published again shrunk.  An epsilon of 0 publishes every change of the box.
+/// <para>
+///   The positions are reduced with SSE min/max, and in parallel blocks for large meshes.
+/// </para>
+/// </remarks>
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class MeshBounds
+{
+public:
+
+    /// <summary>
+    ///   Constructor.
+    /// </summary>
+    /// <param name="Epsilon">How far the vertices can move before the box is published
+    ///  again.</param>
+    MeshBounds( f32 Epsilon=0.0f );
+
+    /// <summary>
+    ///   Sets how far the vertices can move before the box is published again.
+    /// </summary>
+    void SetEpsilon( f32 Epsilon )
+    {
+        ASSERT( Epsilon >= 0.0f );
+        m_Epsilon = Epsilon;
+    }
+
+    /// <summary>
+    ///   Recomputes the box if the position stream changed.
+    /// </summary>
+    /// <param name="StreamsChanged">A bitmask with a bit per vertex stream of the layout
+    ///  changed, such as MeshStreams::GetStreamsChanged returns for a producer numbering its
+    ///  streams as the layout does.</param>
+    /// <param name="Layout">The layout of the vertices; its Position element must be Float3 or
+    ///  Float4.</param>
+    /// <param name="Positions">The vertices of the stream holding the positions.</param>
+    /// <param name="pTaskManager">Task manager to reduce large meshes in parallel with, or NULL
+    ///  to reduce them on the calling thread.</param>
+    /// <param name="pSystemTask">The task calling, passed on to ITaskManager::ParallelFor.</param>
+    /// <returns>True if the published box changed and System::Changes::Graphics::AABB should be
+    ///  posted.</returns>
+    Bool Update( u32 StreamsChanged, const VertexLayout& Layout,
+                 const IGraphicsObject::StreamView& Positions,
+                 ITaskManager* pTaskManager=NULL, ISystemTask* pSystemTask=NULL );
+
+    /// <summary>
+    ///   Recomputes the box from vertex positions, whichever streams changed.
+    /// </summary>
+    /// <param name="pPositions">The position of the first vertex, as 3 floats.</param>
+    /// <param name="Stride">The size of a vertex.</param>
+    /// <param name="Count">The number of vertices.</param>
+    /// <param name="pTaskManager">Task manager to reduce large meshes in parallel with, or
+    ///  NULL.</param>
+    /// <param name="pSystemTask">The task calling, passed on to ITaskManager::ParallelFor.</param>
+    /// <returns>True if the published box changed.</returns>
+    Bool Update( const void* pPositions, u32 Stride, u32 Count,
+                 ITaskManager* pTaskManager=NULL, ISystemTask* pSystemTask=NULL );
+
+    /// <summary>
+    ///   Gets the published box.
+    /// </summary>
+    /// <param name="Min">The returned minimum AABB point.</param>
+    /// <param name="Max">The returned maximum AABB point.</param>
+    void GetAABB( Math::Vector3& Min, Math::Vector3& Max ) const
+    {
+        Min = m_Min;
+        Max = m_Max;
+    }
+
+
+protected:
+
+    static const u32 sm_BlockSize = 16384;              // Vertices per parallel job
+
+    struct Block
+    {
+        f32                 aMin[ 4 ];
+        f32                 aMax[ 4 ];
+    };
+
+    static void ReduceRange( void* pParam, u32 Begin, u32 End );
+    static void Reduce( const u8* pPositions, u32 Stride, u32 Count, Block& Bounds );
+
+    f32                             m_Epsilon;
+    Bool                            m_bPublished;
+    Math::Vector3                   m_Min;
+    Math::Vector3                   m_Max;
+
+    // The positions being reduced and the bounds of each of their blocks
+    const u8*                       m_pPositions;
+    u32                             m_Stride;
+    u32                             m_Count;
+    std::vector<Block>              m_aBlocks;
+};
@@ -0,0 +1,281 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#include <string.h>
+#include <algorithm>
+
+#include "MeshStreams.h"
+#include "VertexLayout.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+// MeshStreams - Starts with no streams written
+MeshStreams::MeshStreams(
+    void
+    )
+    : m_StreamsChanged( 0 )
+{
+    for ( u32 i=0; i < MaxStreams; i++ )
+    {
+        m_apCurrent[ i ] = NULL;
+        m_apWriting[ i ] = NULL;
+        m_aVersions[ i ] = 0;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ~MeshStreams - Frees every buffer
+MeshStreams::~MeshStreams(
+    void
+    )
+{
+    for ( size_t i=0; i < m_apBuffers.size(); i++ )
+    {
+        ASSERT( m_apBuffers[ i ]->Views == 0 );
+        delete m_apBuffers[ i ];
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// BeginWrite - Gets a buffer no view points into
+void*
+MeshStreams::BeginWrite(
+    u32 Stream,
+    u32 Stride,
+    u32 Count,
+    Bool bPreserve
+    )
+{
+    ASSERT( Stream < MaxStreams );
+    ASSERT( m_apWriting[ Stream ] == NULL );
+
+    Buffer* pBuffer;
+    Buffer* pCurrent;
+    {
+        SCOPED_SPIN_LOCK( m_Mutex );
+        pBuffer = GetFreeBuffer();
+        pCurrent = m_apCurrent[ Stream ];
+    }
+
+    pBuffer->Stride = Stride;
+    pBuffer->Count = Count;
+    pBuffer->aData.resize( static_cast<size_t>(Stride) * Count );
+
+    //
+    // The current buffer is only replaced by EndWrite, called by the same thread, so it can be
+    //  read without the lock.
+    //
+    if ( bPreserve && pCurrent != NULL )
+    {
+        size_t Size = std::min( pBuffer->aData.size(), pCurrent->aData.size() );
+        if ( Size > 0 )
+        {
+            memcpy( &pBuffer->aData[ 0 ], &pCurrent->aData[ 0 ], Size );
+        }
+    }
+
+    m_apWriting[ Stream ] = pBuffer;
+
+    return pBuffer->aData.empty() ? NULL : &pBuffer->aData[ 0 ];
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// EndWrite - Publishes the written buffer and retires the one it replaces
+void
+MeshStreams::EndWrite(
+    u32 Stream
+    )
+{
+    ASSERT( Stream < MaxStreams );
+    ASSERT( m_apWriting[ Stream ] != NULL );
+
+    SCOPED_SPIN_LOCK( m_Mutex );
+
+    Buffer* pRetired = m_apCurrent[ Stream ];
+    if ( pRetired != NULL )
+    {
+        pRetired->bRetired = True;
+        if ( pRetired->Views == 0 )
+        {
+            m_apFree.push_back( pRetired );
+        }
+    }
+
+    Buffer* pBuffer = m_apWriting[ Stream ];
+    pBuffer->Version = ++m_aVersions[ Stream ];
+    m_apCurrent[ Stream ] = pBuffer;
+    m_apWriting[ Stream ] = NULL;
+
+    m_StreamsChanged |= static_cast<u32>(1) << Stream;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Map - Hands out the current buffer of a stream
+Bool
+MeshStreams::Map(
+    u32 Stream,
+    IGraphicsObject::StreamView& View
+    )
+{
+    ASSERT( Stream < MaxStreams );
+
+    SCOPED_SPIN_LOCK( m_Mutex );
+
+    Buffer* pBuffer = m_apCurrent[ Stream ];
+    if ( pBuffer == NULL )
+    {
+        return False;
+    }
+
+    pBuffer->Views++;
+
+    View.pData = pBuffer->aData.empty() ? NULL : &pBuffer->aData[ 0 ];
+    View.Stride = pBuffer->Stride;
+    View.Count = pBuffer->Count;
+    View.Version = pBuffer->Version;
+    View.Token = pBuffer;
+
+    return True;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Unmap - Releases a buffer, freeing it if it has been replaced
+void
+MeshStreams::Unmap(
+    const IGraphicsObject::StreamView& View
+    )
+{
+    Buffer* pBuffer = reinterpret_cast<Buffer*>(View.Token);
+
+    SCOPED_SPIN_LOCK( m_Mutex );
+
+    ASSERT( pBuffer->Views > 0 );
+    if ( --pBuffer->Views == 0 && pBuffer->bRetired )
+    {
+        m_apFree.push_back( pBuffer );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetStreamsChanged - Gets and clears the written streams
+u32
+MeshStreams::GetStreamsChanged(
+    void
+    )
+{
+    SCOPED_SPIN_LOCK( m_Mutex );
+
+    u32 StreamsChanged = m_StreamsChanged;
+    m_StreamsChanged = 0;
+
+    return StreamsChanged;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CopyIndices - Copies or widens/narrows the indices of a view
+void
+MeshStreams::CopyIndices(
+    void* pIndices,
+    u32 IndexType,
+    const IGraphicsObject::StreamView& Source
+    )
+{
+    u32 Size = IndexDecl::CalculateSize( IndexType );
+
+    if ( Source.Stride == Size )
+    {
+        memcpy( pIndices, Source.pData, static_cast<size_t>(Size) * Source.Count );
+    }
+    else if ( Size == sizeof (u32) )
+    {
+        ASSERT( Source.Stride == sizeof (u16) );
+        const u16* pSource = reinterpret_cast<const u16*>(Source.pData);
+        u32* pDest = reinterpret_cast<u32*>(pIndices);
+
+        for ( u32 i=0; i < Source.Count; i++ )
+        {
+            pDest[ i ] = pSource[ i ];
+        }
+    }
+    else
+    {
+        ASSERT( Source.Stride == sizeof (u32) );
+        const u32* pSource = reinterpret_cast<const u32*>(Source.pData);
+        u16* pDest = reinterpret_cast<u16*>(pIndices);
+
+        for ( u32 i=0; i < Source.Count; i++ )
+        {
+            ASSERT( pSource[ i ] <= 0xFFFF );
+            pDest[ i ] = static_cast<u16>(pSource[ i ]);
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CopyVertices - Converts a view's vertices into another declaration
+void
+MeshStreams::CopyVertices(
+    void* pVertices,
+    const VertexDecl::Element* pVertexDecl,
+    u32 nVertexDeclCount,
+    u32 nStreamIndex,
+    const IGraphicsObject::StreamView& Source,
+    const VertexDecl::Element* pSourceDecl,
+    u32 nSourceDeclCount,
+    u32 nSourceStreamIndex
+    )
+{
+    VertexLayout DestLayout( pVertexDecl, nVertexDeclCount );
+    VertexLayout SourceLayout( pSourceDecl, nSourceDeclCount );
+    ASSERT( SourceLayout.GetStride( nSourceStreamIndex ) == Source.Stride );
+
+    VertexConverter Converter( DestLayout, nStreamIndex, SourceLayout, nSourceStreamIndex );
+    Converter.Convert( pVertices, Source.pData, Source.Count );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetFreeBuffer - Reuses a released buffer or allocates one; called with the lock held
+MeshStreams::Buffer*
+MeshStreams::GetFreeBuffer(
+    void
+    )
+{
+    Buffer* pBuffer;
+
+    if ( !m_apFree.empty() )
+    {
+        pBuffer = m_apFree.back();
+        m_apFree.pop_back();
+    }
+    else
+    {
+        pBuffer = new Buffer;
+        m_apBuffers.push_back( pBuffer );
+    }
+
+    pBuffer->Version = 0;
+    pBuffer->Views = 0;
+    pBuffer->bRetired = False;
+
+    return pBuffer;
+}
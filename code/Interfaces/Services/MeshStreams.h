@@ -0,0 +1,153 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#pragma once
+
+//
+// core includes
+//
+#include "../../BaseTypes/BaseTypes.h"
+#include "../../BaseTypes/TbbSpinMutex.h"
+#include "../Interface.h"
+#include <vector>
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// <summary>
+///   The index and vertex streams of a procedural mesh, such as a tree or a fire, kept so that
+///    the graphics object producing them can hand them out with IGraphicsObject::MapIndices and
+///    MapVertices instead of copying them.
+/// </summary>
+/// <remarks>
+///   The producer fills a stream between BeginWrite and EndWrite.  Each write goes to a buffer no
+///    view points into, which EndWrite makes the stream's current buffer; the buffer it replaces
+///    is reused once the last view of it is unmapped.  Consumers can therefore keep a view while
+///    the producer writes the next version of the stream.
+/// <para>
+///   Streams are numbered by the producer, up to MaxStreams, such as one per vertex stream of
+///    each submesh and one for the indices.
+/// </para>
+/// </remarks>
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class MeshStreams
+{
+public:
+
+    static const u32 MaxStreams = 32;
+
+
+    /// <summary>
+    ///   Constructor.
+    /// </summary>
+    MeshStreams( void );
+
+    /// <summary>
+    ///   Destructor.  Every view must have been unmapped.
+    /// </summary>
+    ~MeshStreams( void );
+
+    /// <summary>
+    ///   Gets a buffer to write the next version of a stream into.  Not safe to call from several
+    ///    threads for the same stream.
+    /// </summary>
+    /// <param name="Stream">The stream.</param>
+    /// <param name="Stride">The size of an index or vertex.</param>
+    /// <param name="Count">The number of indices or vertices.</param>
+    /// <param name="bPreserve">True to start from the current version of the stream rather than
+    ///  from undefined contents, for producers updating part of it.</param>
+    /// <returns>The buffer, of Stride * Count bytes.</returns>
+    void* BeginWrite( u32 Stream, u32 Stride, u32 Count, Bool bPreserve=False );
+
+    /// <summary>
+    ///   Makes the buffer written since BeginWrite the current version of the stream.
+    /// </summary>
+    /// <param name="Stream">The stream.</param>
+    void EndWrite( u32 Stream );
+
+    /// <summary>
+    ///   Maps the current version of a stream.  Safe to call from any thread.
+    /// </summary>
+    /// <param name="Stream">The stream.</param>
+    /// <param name="View">The returned view.</param>
+    /// <returns>True if the stream has been written and the view must be unmapped.</returns>
+    Bool Map( u32 Stream, IGraphicsObject::StreamView& View );
+
+    /// <summary>
+    ///   Releases a view returned by Map.  Safe to call from any thread.
+    /// </summary>
+    /// <param name="View">The view.</param>
+    void Unmap( const IGraphicsObject::StreamView& View );
+
+    /// <summary>
+    ///   Gets the streams written since the last call.
+    /// </summary>
+    /// <returns>A bitmask with a bit per stream.</returns>
+    u32 GetStreamsChanged( void );
+
+    /// <summary>
+    ///   Copies the indices of a view, converting them to another size if needed.
+    /// </summary>
+    /// <param name="pIndices">The returned index list.</param>
+    /// <param name="IndexType">The IndexDecl::Type of the returned indices.</param>
+    /// <param name="Source">The view.</param>
+    static void CopyIndices( void* pIndices, u32 IndexType,
+                             const IGraphicsObject::StreamView& Source );
+
+    /// <summary>
+    ///   Copies the vertices of a view into another declaration in a single pass.
+    /// </summary>
+    /// <remarks>
+    ///   The elements are converted as VertexConverter does; callers converting the same
+    ///    declarations every frame can keep a VertexConverter instead.
+    /// </remarks>
+    /// <param name="pVertices">The returned vertex list.</param>
+    /// <param name="pVertexDecl">The declaration of the returned vertices.</param>
+    /// <param name="nVertexDeclCount">Element count in pVertexDecl.</param>
+    /// <param name="nStreamIndex">Index of the stream of pVertexDecl to return.</param>
+    /// <param name="Source">The view.</param>
+    /// <param name="pSourceDecl">The declaration of the view's vertices.</param>
+    /// <param name="nSourceDeclCount">Element count in pSourceDecl.</param>
+    /// <param name="nSourceStreamIndex">Index of the stream of pSourceDecl the view holds.</param>
+    static void CopyVertices( void* pVertices, const VertexDecl::Element* pVertexDecl,
+                              u32 nVertexDeclCount, u32 nStreamIndex,
+                              const IGraphicsObject::StreamView& Source,
+                              const VertexDecl::Element* pSourceDecl, u32 nSourceDeclCount,
+                              u32 nSourceStreamIndex );
+
+
+protected:
+
+    // A buffer holding a version of a stream
+    struct Buffer
+    {
+        std::vector<u8>     aData;
+        u32                 Stride;
+        u32                 Count;
+        u32                 Version;
+        u32                 Views;
+        Bool                bRetired;
+    };
+
+    Buffer* GetFreeBuffer( void );
+
+    DEFINE_SPIN_MUTEX( m_Mutex );
+    Buffer*                         m_apCurrent[ MaxStreams ];
+    Buffer*                         m_apWriting[ MaxStreams ];
+    u32                             m_aVersions[ MaxStreams ];
+    u32                             m_StreamsChanged;
+
+    std::vector<Buffer*>            m_apFree;
+    std::vector<Buffer*>            m_apBuffers;
+};
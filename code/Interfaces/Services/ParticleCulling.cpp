@@ -0,0 +1,420 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#include <xmmintrin.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "ParticleCulling.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ParticleCulling - Starts with a view culling nothing
+ParticleCulling::ParticleCulling(
+    void
+    )
+    : m_Eye( Math::Vector3::Zero )
+    , m_PixelScale( 1.0f )
+    , m_MinPixelSize( 1.0f )
+    , m_pGroups( NULL )
+{
+    for ( u32 i=0; i < 6; i++ )
+    {
+        m_aaPlanes[ i ][ 0 ] = 0.0f;
+        m_aaPlanes[ i ][ 1 ] = 0.0f;
+        m_aaPlanes[ i ][ 2 ] = 0.0f;
+        m_aaPlanes[ i ][ 3 ] = 1.0f;
+    }
+
+    static const f32 aPixelSizes[ TierCount ] = { 8.0f, 3.0f, 1.0f, 0.0f };
+    for ( u32 i=0; i < TierCount; i++ )
+    {
+        m_aTierPixelSizes[ i ] = aPixelSizes[ i ];
+        m_aIntervals[ i ] = 1 << i;
+    }
+    m_aIntervals[ Hidden ] = 16;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SetView - Extracts the frustum planes from the rows of the transform
+void
+ParticleCulling::SetView(
+    const Math::Matrix4x4& ViewProjection,
+    const Math::Vector3& Eye,
+    f32 PixelScale
+    )
+{
+    //
+    // Row i of the transform gives the clip coordinate i of a point; the point is inside a
+    //  plane when 0 <= z <= w and -w <= x, y <= w.
+    //
+    const f32* m = ViewProjection.m;
+    f32 aaRows[ 4 ][ 4 ];
+    for ( u32 Row=0; Row < 4; Row++ )
+    {
+        for ( u32 Column=0; Column < 4; Column++ )
+        {
+            aaRows[ Row ][ Column ] = m[ Column * 4 + Row ];
+        }
+    }
+
+    for ( u32 i=0; i < 4; i++ )
+    {
+        m_aaPlanes[ 0 ][ i ] = aaRows[ 3 ][ i ] + aaRows[ 0 ][ i ];
+        m_aaPlanes[ 1 ][ i ] = aaRows[ 3 ][ i ] - aaRows[ 0 ][ i ];
+        m_aaPlanes[ 2 ][ i ] = aaRows[ 3 ][ i ] + aaRows[ 1 ][ i ];
+        m_aaPlanes[ 3 ][ i ] = aaRows[ 3 ][ i ] - aaRows[ 1 ][ i ];
+        m_aaPlanes[ 4 ][ i ] = aaRows[ 2 ][ i ];
+        m_aaPlanes[ 5 ][ i ] = aaRows[ 3 ][ i ] - aaRows[ 2 ][ i ];
+    }
+
+    //
+    // Normalize the planes so that their distances compare with the particles' radii.
+    //
+    for ( u32 i=0; i < 6; i++ )
+    {
+        f32* pPlane = m_aaPlanes[ i ];
+        f32 Length = sqrtf( pPlane[ 0 ] * pPlane[ 0 ] + pPlane[ 1 ] * pPlane[ 1 ] +
+                            pPlane[ 2 ] * pPlane[ 2 ] );
+        if ( Length > 0.0f )
+        {
+            for ( u32 j=0; j < 4; j++ )
+            {
+                pPlane[ j ] /= Length;
+            }
+        }
+    }
+
+    m_Eye = Eye;
+    m_PixelScale = PixelScale;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SetTier - Sets the pixel size and update interval of a tier
+void
+ParticleCulling::SetTier(
+    u32 Tier,
+    f32 PixelSize,
+    u32 UpdateInterval
+    )
+{
+    ASSERT( Tier < TierCount );
+    ASSERT( UpdateInterval > 0 );
+
+    m_aTierPixelSizes[ Tier ] = PixelSize;
+    m_aIntervals[ Tier ] = UpdateInterval;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SetHiddenInterval - Sets the update interval of groups with nothing visible
+void
+ParticleCulling::SetHiddenInterval(
+    u32 UpdateInterval
+    )
+{
+    ASSERT( UpdateInterval > 0 );
+    m_aIntervals[ Hidden ] = UpdateInterval;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Cull - Culls the chunks of every visible group as work items, then merges each group's lists
+//  and picks its tier
+void
+ParticleCulling::Cull(
+    ParticleGroups& Groups,
+    ITaskManager* pTaskManager,
+    ISystemTask* pSystemTask
+    )
+{
+    PROFILE_ZONE( "ParticleCulling::Cull" );
+
+    u32 GroupCount = Groups.GetGroupCount();
+
+    m_pGroups = &Groups;
+    m_aGroups.resize( GroupCount );
+    m_aItems.clear();
+
+    for ( u32 i=0; i < GroupCount; i++ )
+    {
+        GroupResult& Result = m_aGroups[ i ];
+        ParticleStore& Store = Groups.GetStore( i );
+
+        //
+        // Groups whose box is off screen or too small get no work items, so culling them costs
+        //  no more than updating them.
+        //
+        u32 Count = 0;
+        if ( Groups.IsVisible( i ) && IsStoreVisible( Store ) )
+        {
+            Count = Store.GetCount();
+        }
+        u32 Chunks = (Count + ParticleStore::ChunkSize - 1) / ParticleStore::ChunkSize;
+
+        //
+        // Chunks list their particles at their own start, rounded up to 4 for the SSE loop.
+        //
+        Result.aVisible.resize( std::max( (Count + 3) & ~3u, 4u ) );
+        Result.aChunkCounts.assign( Chunks, 0 );
+        Result.aChunkPixels.assign( Chunks, 0.0f );
+
+        for ( u32 Chunk=0; Chunk < Chunks; Chunk++ )
+        {
+            WorkItem Item = { i, Chunk };
+            m_aItems.push_back( Item );
+        }
+    }
+
+    u32 Items = static_cast<u32>(m_aItems.size());
+
+    if ( pTaskManager != NULL && Items > 1 )
+    {
+        pTaskManager->ParallelFor( pSystemTask, CullItems, this, 0, Items );
+    }
+    else
+    {
+        CullItems( this, 0, Items );
+    }
+
+    for ( u32 i=0; i < GroupCount; i++ )
+    {
+        GroupResult& Result = m_aGroups[ i ];
+
+        u32 Write = 0;
+        f32 MaxPixels = 0.0f;
+
+        for ( u32 Chunk=0; Chunk < Result.aChunkCounts.size(); Chunk++ )
+        {
+            u32 Begin = Chunk * ParticleStore::ChunkSize;
+            u32 Count = Result.aChunkCounts[ Chunk ];
+
+            if ( Write != Begin && Count > 0 )
+            {
+                memmove( &Result.aVisible[ Write ], &Result.aVisible[ Begin ],
+                         Count * sizeof (u32) );
+            }
+
+            Write += Count;
+            MaxPixels = std::max( MaxPixels, Result.aChunkPixels[ Chunk ] );
+        }
+
+        Result.VisibleCount = Write;
+
+        if ( Write == 0 )
+        {
+            Result.Tier = Hidden;
+        }
+        else
+        {
+            Result.Tier = TierCount - 1;
+            for ( u32 Tier=0; Tier < TierCount - 1; Tier++ )
+            {
+                if ( MaxPixels >= m_aTierPixelSizes[ Tier ] )
+                {
+                    Result.Tier = Tier;
+                    break;
+                }
+            }
+        }
+
+        Groups.SetUpdateInterval( i, m_aIntervals[ Result.Tier ] );
+    }
+
+    m_pGroups = NULL;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetColumns - Gets a group's columns with the list of its visible particles
+void
+ParticleCulling::GetColumns(
+    ParticleGroups& Groups,
+    u32 Group,
+    IGraphicsParticleObject::ParticleColumns& Columns
+    ) const
+{
+    Groups.GetStore( Group ).GetColumns( Columns );
+
+    if ( Group < m_aGroups.size() )
+    {
+        Columns.pVisible = &m_aGroups[ Group ].aVisible[ 0 ];
+        Columns.VisibleCount = m_aGroups[ Group ].VisibleCount;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// IsStoreVisible - Tests the box of a group's particles, grown by half its largest particle,
+//  against the planes, and the largest particle's pixel size at the box's nearest point
+Bool
+ParticleCulling::IsStoreVisible(
+    const ParticleStore& Store
+    ) const
+{
+    Math::Vector3 Min;
+    Math::Vector3 Max;
+    f32 MaxSize;
+
+    if ( !Store.GetBounds( Min, Max, MaxSize ) )
+    {
+        return False;
+    }
+
+    f32 Radius = MaxSize * 0.5f;
+
+    for ( u32 p=0; p < 6; p++ )
+    {
+        //
+        // The corner farthest along the plane's normal is the last one to leave it.
+        //
+        const f32* pPlane = m_aaPlanes[ p ];
+        f32 Distance = (pPlane[ 0 ] >= 0.0f ? Max.x : Min.x) * pPlane[ 0 ] +
+                       (pPlane[ 1 ] >= 0.0f ? Max.y : Min.y) * pPlane[ 1 ] +
+                       (pPlane[ 2 ] >= 0.0f ? Max.z : Min.z) * pPlane[ 2 ] + pPlane[ 3 ];
+        if ( Distance < -Radius )
+        {
+            return False;
+        }
+    }
+
+    Math::Vector3 Nearest( std::min( std::max( m_Eye.x, Min.x ), Max.x ) - m_Eye.x,
+                           std::min( std::max( m_Eye.y, Min.y ), Max.y ) - m_Eye.y,
+                           std::min( std::max( m_Eye.z, Min.z ), Max.z ) - m_Eye.z );
+    f32 Distance = sqrtf( std::max( Nearest.Dot( Nearest ), 1e-6f ) );
+
+    //
+    // Leave a margin for the estimate of the particle loop's reciprocal square root.
+    //
+    return MaxSize * m_PixelScale >= m_MinPixelSize * Distance * 0.99f;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CullItems - Culls a range of chunks, called by ParallelFor
+void
+ParticleCulling::CullItems(
+    void* pParam,
+    u32 Begin,
+    u32 End
+    )
+{
+    ParticleCulling* pCulling = reinterpret_cast<ParticleCulling*>(pParam);
+
+    for ( u32 i=Begin; i < End; i++ )
+    {
+        const WorkItem& Item = pCulling->m_aItems[ i ];
+        pCulling->CullChunk( pCulling->m_pGroups->GetStore( Item.Group ),
+                             pCulling->m_aGroups[ Item.Group ], Item.Chunk );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CullChunk - Tests the particles of a chunk 4 at a time against the planes and the pixel size,
+//  listing the ones left at the chunk's start
+void
+ParticleCulling::CullChunk(
+    ParticleStore& Store,
+    GroupResult& Result,
+    u32 Chunk
+    ) const
+{
+    IGraphicsParticleObject::ParticleColumns Columns;
+    Store.GetColumns( Columns );
+
+    u32 Begin = Chunk * ParticleStore::ChunkSize;
+    u32 End = std::min( Begin + ParticleStore::ChunkSize, Columns.Count );
+
+    __m128 aaPlanes[ 6 ][ 4 ];
+    for ( u32 i=0; i < 6; i++ )
+    {
+        for ( u32 j=0; j < 4; j++ )
+        {
+            aaPlanes[ i ][ j ] = _mm_set1_ps( m_aaPlanes[ i ][ j ] );
+        }
+    }
+
+    __m128 EyeX = _mm_set1_ps( m_Eye.x );
+    __m128 EyeY = _mm_set1_ps( m_Eye.y );
+    __m128 EyeZ = _mm_set1_ps( m_Eye.z );
+    __m128 PixelScale = _mm_set1_ps( m_PixelScale );
+    __m128 MinPixelSize = _mm_set1_ps( m_MinPixelSize );
+    __m128 MinDistance2 = _mm_set1_ps( 1e-6f );
+    __m128 Half = _mm_set1_ps( 0.5f );
+    __m128 MaxPixels = _mm_setzero_ps();
+
+    u32* pVisible = &Result.aVisible[ Begin ];
+    u32 Count = 0;
+
+    for ( u32 i=Begin; i < End; i += 4 )
+    {
+        __m128 x = _mm_loadu_ps( Columns.pPositionX + i );
+        __m128 y = _mm_loadu_ps( Columns.pPositionY + i );
+        __m128 z = _mm_loadu_ps( Columns.pPositionZ + i );
+        __m128 Size = _mm_loadu_ps( Columns.pSize + i );
+        __m128 NegRadius = _mm_sub_ps( _mm_setzero_ps(), _mm_mul_ps( Size, Half ) );
+
+        __m128 Inside = _mm_cmpeq_ps( Half, Half );
+        for ( u32 p=0; p < 6; p++ )
+        {
+            __m128 Distance = _mm_add_ps(
+                _mm_add_ps( _mm_mul_ps( x, aaPlanes[ p ][ 0 ] ), _mm_mul_ps( y, aaPlanes[ p ][ 1 ] ) ),
+                _mm_add_ps( _mm_mul_ps( z, aaPlanes[ p ][ 2 ] ), aaPlanes[ p ][ 3 ] ) );
+            Inside = _mm_and_ps( Inside, _mm_cmpge_ps( Distance, NegRadius ) );
+        }
+
+        //
+        // The size in pixels shrinks with the distance to the eye.
+        //
+        __m128 dx = _mm_sub_ps( x, EyeX );
+        __m128 dy = _mm_sub_ps( y, EyeY );
+        __m128 dz = _mm_sub_ps( z, EyeZ );
+        __m128 Distance2 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, dx ), _mm_mul_ps( dy, dy ) ),
+                                       _mm_mul_ps( dz, dz ) );
+        __m128 Pixels = _mm_mul_ps( _mm_mul_ps( Size, PixelScale ),
+                                    _mm_rsqrt_ps( _mm_max_ps( Distance2, MinDistance2 ) ) );
+
+        __m128 Keep = _mm_and_ps( Inside, _mm_cmpge_ps( Pixels, MinPixelSize ) );
+        MaxPixels = _mm_max_ps( MaxPixels, _mm_and_ps( Keep, Pixels ) );
+
+        //
+        // List the particles kept without branching on each; the padding past End is dropped.
+        //
+        u32 Kept = _mm_movemask_ps( Keep );
+        if ( End - i < 4 )
+        {
+            Kept &= (1 << (End - i)) - 1;
+        }
+
+        pVisible[ Count ] = i;
+        Count += Kept & 1;
+        pVisible[ Count ] = i + 1;
+        Count += (Kept >> 1) & 1;
+        pVisible[ Count ] = i + 2;
+        Count += (Kept >> 2) & 1;
+        pVisible[ Count ] = i + 3;
+        Count += (Kept >> 3) & 1;
+    }
+
+    f32 aMaxPixels[ 4 ];
+    _mm_storeu_ps( aMaxPixels, MaxPixels );
+
+    Result.aChunkCounts[ Chunk ] = Count;
+    Result.aChunkPixels[ Chunk ] = std::max( std::max( aMaxPixels[ 0 ], aMaxPixels[ 1 ] ),
+                                             std::max( aMaxPixels[ 2 ], aMaxPixels[ 3 ] ) );
+}
@@ -0,0 +1,165 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#pragma once
+
+//
+// core includes
+//
+#include "../../BaseTypes/BaseTypes.h"
+#include "../Interface.h"
+#include "ParticleGroups.h"
+#include <vector>
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// <summary>
+///   Culls the particles of ParticleGroups against the view, leaving the graphics system only
+///    the particles on screen and at least a pixel across, and throttles the simulation of the
+///    groups by how large they appear.
+/// </summary>
+/// <remarks>
+///   Particles are tested 4 at a time with SSE against the 6 planes of the view frustum, as
+///    spheres of their Size across, and their projected size in pixels is estimated from their
+///    distance to the eye.  Groups are first tested whole with ParticleStore::GetBounds, so
+///    those off screen or too small cost nothing per particle.  The chunks of every other group
+///    are culled as ITaskManager::ParallelFor work items, each writing its own part of the
+///    group's list, like ParticleGroups updates.
+/// <para>
+///   A group's LOD tier is the first whose pixel size its largest visible particle reaches, and
+///    sets how often ParticleGroups updates it.  Groups with nothing visible, or hidden with
+///    ParticleGroups::SetVisible, are updated at the hidden interval.
+/// </para>
+/// </remarks>
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class ParticleCulling
+{
+public:
+
+    static const u32 TierCount = 4;
+    static const u32 Hidden = TierCount;                // The tier of groups with nothing visible
+
+
+    /// <summary>
+    ///   Constructor.  The tiers start at 8, 3, 1 and 0 pixels, updated every 1, 2, 4 and 8
+    ///    frames, and hidden groups every 16.
+    /// </summary>
+    ParticleCulling( void );
+
+    /// <summary>
+    ///   Sets the view to cull against.
+    /// </summary>
+    /// <param name="ViewProjection">The view and projection transform, mapping the frustum to
+    ///  -1 to 1 in x and y and 0 to 1 in z.</param>
+    /// <param name="Eye">The position of the eye.</param>
+    /// <param name="PixelScale">The pixels across of an object a unit across, a unit away, that
+    ///  is, the viewport height over 2 tan( fovy / 2 ).</param>
+    void SetView( const Math::Matrix4x4& ViewProjection, const Math::Vector3& Eye,
+                  f32 PixelScale );
+
+    /// <summary>
+    ///   Sets the pixels across below which particles are culled.
+    /// </summary>
+    void SetMinPixelSize( f32 MinPixelSize )
+    {
+        m_MinPixelSize = MinPixelSize;
+    }
+
+    /// <summary>
+    ///   Sets an LOD tier.
+    /// </summary>
+    /// <param name="Tier">The tier, tiers being in decreasing order of size.</param>
+    /// <param name="PixelSize">The pixels across the largest visible particle of a group must
+    ///  reach for the group to be in the tier.</param>
+    /// <param name="UpdateInterval">The calls to ParticleGroups::Update per update of the
+    ///  group.</param>
+    void SetTier( u32 Tier, f32 PixelSize, u32 UpdateInterval );
+
+    /// <summary>
+    ///   Sets how often groups with nothing visible are updated.
+    /// </summary>
+    void SetHiddenInterval( u32 UpdateInterval );
+
+    /// <summary>
+    ///   Culls the particles of every group, and sets how often each group is updated.  Call it
+    ///    after ParticleGroups::Update.
+    /// </summary>
+    /// <param name="Groups">The groups.</param>
+    /// <param name="pTaskManager">Task manager to spread the groups over, or NULL to cull them
+    ///  on the calling thread.</param>
+    /// <param name="pSystemTask">The task calling, passed on to ITaskManager::ParallelFor.</param>
+    void Cull( ParticleGroups& Groups, ITaskManager* pTaskManager=NULL,
+               ISystemTask* pSystemTask=NULL );
+
+    /// <summary>
+    ///   Gets the columns of a group with its visible particles, valid until the next update or
+    ///    cull, for IGraphicsParticleObject::GetParticleColumns.
+    /// </summary>
+    void GetColumns( ParticleGroups& Groups, u32 Group,
+                     IGraphicsParticleObject::ParticleColumns& Columns ) const;
+
+    /// <summary>
+    ///   Gets the number of visible particles of a group.
+    /// </summary>
+    u32 GetVisibleCount( u32 Group ) const
+    {
+        ASSERT( Group < m_aGroups.size() );
+        return m_aGroups[ Group ].VisibleCount;
+    }
+
+    /// <summary>
+    ///   Gets the LOD tier of a group, or Hidden.
+    /// </summary>
+    u32 GetTier( u32 Group ) const
+    {
+        ASSERT( Group < m_aGroups.size() );
+        return m_aGroups[ Group ].Tier;
+    }
+
+
+protected:
+
+    struct GroupResult
+    {
+        std::vector<u32>    aVisible;
+        std::vector<u32>    aChunkCounts;
+        std::vector<f32>    aChunkPixels;       // Largest pixel size in each chunk
+        u32                 VisibleCount;
+        u32                 Tier;
+    };
+
+    struct WorkItem
+    {
+        u32                 Group;
+        u32                 Chunk;
+    };
+
+    Bool IsStoreVisible( const ParticleStore& Store ) const;
+    static void CullItems( void* pParam, u32 Begin, u32 End );
+    void CullChunk( ParticleStore& Store, GroupResult& Result, u32 Chunk ) const;
+
+    f32                             m_aaPlanes[ 6 ][ 4 ];
+    Math::Vector3                   m_Eye;
+    f32                             m_PixelScale;
+    f32                             m_MinPixelSize;
+
+    f32                             m_aTierPixelSizes[ TierCount ];
+    u32                             m_aIntervals[ TierCount + 1 ];
+
+    // The groups being culled
+    ParticleGroups*                 m_pGroups;
+    std::vector<GroupResult>        m_aGroups;
+    std::vector<WorkItem>           m_aItems;
+};
@@ -0,0 +1,267 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#include <math.h>
+
+#include "ParticleGroups.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Mix - Scrambles the seed of an emission work item, so that neighbouring chunks and updates
+//  get unrelated numbers
+static inline u32
+Mix(
+    u32 Seed,
+    u32 Frame,
+    u32 Chunk
+    )
+{
+    u32 h = Seed ^ (Frame * 0x9E3779B9) ^ (Chunk * 0x85EBCA6B);
+    h ^= h >> 16;
+    h *= 0x7FEB352D;
+    h ^= h >> 15;
+    h *= 0x846CA68B;
+    h ^= h >> 16;
+    return h;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ParticleGroups - Starts with no groups
+ParticleGroups::ParticleGroups(
+    void
+    )
+    : m_Frame( 0 )
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ~ParticleGroups - Frees the groups
+ParticleGroups::~ParticleGroups(
+    void
+    )
+{
+    for ( size_t i=0; i < m_apGroups.size(); i++ )
+    {
+        delete m_apGroups[ i ];
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// AddGroup - Adds a group emitting nothing until given a rate
+u32
+ParticleGroups::AddGroup(
+    ParticleStore::Integrator Method,
+    EmitFunction pfnEmit,
+    void* pParam,
+    u32 Seed
+    )
+{
+    Group* pGroup = new Group( Method );
+    pGroup->pfnEmit = pfnEmit;
+    pGroup->pParam = pParam;
+    pGroup->Seed = Seed;
+    pGroup->Rate = 0.0f;
+    pGroup->Pending = 0.0f;
+    pGroup->Acceleration = Math::Vector3::Zero;
+    pGroup->Drag = 0.0f;
+    pGroup->Emitted = 0;
+    pGroup->bVisible = True;
+    pGroup->Interval = 1;
+    pGroup->Elapsed = 0.0f;
+    pGroup->bUpdating = False;
+
+    m_apGroups.push_back( pGroup );
+
+    return static_cast<u32>(m_apGroups.size()) - 1;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SetEmissionRate - Sets the particles per second of a group
+void
+ParticleGroups::SetEmissionRate(
+    u32 Group,
+    f32 Rate
+    )
+{
+    ASSERT( Group < m_apGroups.size() );
+    ASSERT( Rate >= 0.0f );
+    m_apGroups[ Group ]->Rate = Rate;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SetForces - Sets the acceleration and drag of a group
+void
+ParticleGroups::SetForces(
+    u32 Group,
+    const Math::Vector3& Acceleration,
+    f32 Drag
+    )
+{
+    ASSERT( Group < m_apGroups.size() );
+    m_apGroups[ Group ]->Acceleration = Acceleration;
+    m_apGroups[ Group ]->Drag = Drag;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SetUpdateInterval - Sets the calls to Update per update of a group
+void
+ParticleGroups::SetUpdateInterval(
+    u32 Group,
+    u32 Interval
+    )
+{
+    ASSERT( Group < m_apGroups.size() );
+    ASSERT( Interval > 0 );
+    m_apGroups[ Group ]->Interval = Interval;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Update - Lists the chunks of every group as work items, runs them, then ends each group
+void
+ParticleGroups::Update(
+    f32 DeltaTime,
+    ITaskManager* pTaskManager,
+    ISystemTask* pSystemTask
+    )
+{
+    PROFILE_ZONE( "ParticleGroups::Update" );
+
+    m_aItems.clear();
+
+    for ( u32 i=0; i < m_apGroups.size(); i++ )
+    {
+        Group& G = *m_apGroups[ i ];
+
+        //
+        // Throttled groups wait for their turn, offset by the group so that they take turns.
+        //
+        G.Elapsed += DeltaTime;
+        G.bUpdating = (m_Frame + i) % G.Interval == 0;
+        if ( !G.bUpdating )
+        {
+            G.Emitted = 0;
+            continue;
+        }
+
+        f32 Elapsed = G.Elapsed;
+        G.Elapsed = 0.0f;
+
+        //
+        // Carry the fraction of a particle over to the next update, so that low rates emit.
+        //
+        u32 EmitCount = 0;
+        if ( G.pfnEmit != NULL )
+        {
+            f32 Emit = G.Pending + G.Rate * Elapsed;
+            f32 Whole = floorf( Emit );
+            G.Pending = Emit - Whole;
+            EmitCount = static_cast<u32>(Whole);
+        }
+
+        u32 Chunks = G.Store.BeginUpdate( Elapsed, G.Acceleration, G.Drag, EmitCount );
+
+        for ( u32 Chunk=0; Chunk < Chunks; Chunk++ )
+        {
+            WorkItem Item = { i, Chunk };
+            m_aItems.push_back( Item );
+        }
+    }
+
+    u32 Items = static_cast<u32>(m_aItems.size());
+    u32 Groups = static_cast<u32>(m_apGroups.size());
+
+    if ( pTaskManager != NULL && Items > 1 )
+    {
+        pTaskManager->ParallelFor( pSystemTask, UpdateItems, this, 0, Items );
+    }
+    else
+    {
+        UpdateItems( this, 0, Items );
+    }
+
+    if ( pTaskManager != NULL && Groups > 1 )
+    {
+        pTaskManager->ParallelFor( pSystemTask, EndGroups, this, 0, Groups );
+    }
+    else
+    {
+        EndGroups( this, 0, Groups );
+    }
+
+    m_Frame++;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// UpdateItems - Updates or emits into a range of chunks, called by ParallelFor
+void
+ParticleGroups::UpdateItems(
+    void* pParam,
+    u32 Begin,
+    u32 End
+    )
+{
+    ParticleGroups* pGroups = reinterpret_cast<ParticleGroups*>(pParam);
+
+    for ( u32 i=Begin; i < End; i++ )
+    {
+        const WorkItem& Item = pGroups->m_aItems[ i ];
+        Group& G = *pGroups->m_apGroups[ Item.Group ];
+
+        if ( Item.Chunk < G.Store.GetFirstEmitChunk() )
+        {
+            G.Store.UpdateChunk( Item.Chunk );
+        }
+        else
+        {
+            u32 First;
+            u32 Count = G.Store.GetEmitRange( Item.Chunk, First );
+
+            ParticleRandom Random( Mix( G.Seed, pGroups->m_Frame, Item.Chunk ) );
+            u32 Emitted = G.pfnEmit( G.pParam, G.Store, First, Count, Random );
+            ASSERT( Emitted <= Count );
+
+            G.Store.SetEmitted( Item.Chunk, Emitted );
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// EndGroups - Merges the chunks of a range of groups, called by ParallelFor
+void
+ParticleGroups::EndGroups(
+    void* pParam,
+    u32 Begin,
+    u32 End
+    )
+{
+    ParticleGroups* pGroups = reinterpret_cast<ParticleGroups*>(pParam);
+
+    for ( u32 i=Begin; i < End; i++ )
+    {
+        Group& G = *pGroups->m_apGroups[ i ];
+        if ( G.bUpdating )
+        {
+            G.Emitted = G.Store.EndUpdate();
+        }
+    }
+}
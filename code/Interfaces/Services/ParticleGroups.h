@@ -0,0 +1,241 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#pragma once
+
+//
+// core includes
+//
+#include "../../BaseTypes/BaseTypes.h"
+#include "../Interface.h"
+#include "ParticleStore.h"
+#include <vector>
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// <summary>
+///   A random number generator for emitters running on several threads, which
+///    Math::Random::GetRandomFloat, sharing rand's state, cannot serve.
+/// </summary>
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class ParticleRandom
+{
+public:
+
+    /// <summary>
+    ///   Constructor.
+    /// </summary>
+    /// <param name="Seed">The seed; generators with the same seed return the same numbers.</param>
+    ParticleRandom( u32 Seed )
+        : m_State( Seed != 0 ? Seed : 0x9E3779B9 )
+    {
+    }
+
+    /// <summary>
+    ///   Gets the next random number.
+    /// </summary>
+    u32 GetNext( void )
+    {
+        m_State ^= m_State << 13;
+        m_State ^= m_State >> 17;
+        m_State ^= m_State << 5;
+        return m_State;
+    }
+
+    /// <summary>
+    ///   Gets a random float, as Math::Random::GetRandomFloat does.
+    /// </summary>
+    /// <returns>A float from a to b.</returns>
+    f32 GetFloat( f32 a, f32 b )
+    {
+        f32 f = static_cast<f32>(GetNext() >> 8) * (1.0f / 16777216.0f);
+        return f * (b - a) + a;
+    }
+
+
+protected:
+
+    u32                             m_State;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// <summary>
+///   The particle groups of a particle system, updated as one set of ITaskManager::ParallelFor
+///    work items: a work item per ParticleStore chunk of each group, and per chunk of the
+///    particles each group emits, so that a single large emitter is spread over every thread.
+/// </summary>
+/// <remarks>
+///   Each work item writes only its own chunk and its own count of live or emitted particles, so
+///    they need no lock; ParticleStore::EndUpdate then merges the counts of each group, with a
+///    work item per group.
+/// <para>
+///   Emission work items get a ParticleRandom seeded from the group, the update and the chunk,
+///    so the particles emitted do not depend on which thread runs which item.
+/// </para>
+/// </remarks>
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class ParticleGroups
+{
+public:
+
+    /// <summary>
+    ///   Emits the particles of a group, called from any thread.
+    /// </summary>
+    /// <param name="pParam">The parameter given to AddGroup.</param>
+    /// <param name="Store">The particles of the group, to write through its Get*Column
+    ///  accessors.</param>
+    /// <param name="First">The index of the first particle to emit.</param>
+    /// <param name="Count">The number of particles wanted.</param>
+    /// <param name="Random">A generator for this call only.</param>
+    /// <returns>The number of particles emitted from First, up to Count.</returns>
+    typedef u32 (*EmitFunction)( void* pParam, ParticleStore& Store, u32 First, u32 Count,
+                                 ParticleRandom& Random );
+
+
+    /// <summary>
+    ///   Constructor.
+    /// </summary>
+    ParticleGroups( void );
+
+    /// <summary>
+    ///   Destructor.
+    /// </summary>
+    ~ParticleGroups( void );
+
+    /// <summary>
+    ///   Adds a group.
+    /// </summary>
+    /// <param name="Method">The integrator.</param>
+    /// <param name="pfnEmit">The emitter, or NULL for a group only emitted into with
+    ///  ParticleStore::Emit.</param>
+    /// <param name="pParam">The parameter to pass to the emitter.</param>
+    /// <param name="Seed">The seed of the group's random numbers.</param>
+    /// <returns>The group.</returns>
+    u32 AddGroup( ParticleStore::Integrator Method, EmitFunction pfnEmit, void* pParam, u32 Seed );
+
+    /// <summary>
+    ///   Sets how many particles a group emits per second.
+    /// </summary>
+    void SetEmissionRate( u32 Group, f32 Rate );
+
+    /// <summary>
+    ///   Sets the acceleration and drag of a group's particles.
+    /// </summary>
+    void SetForces( u32 Group, const Math::Vector3& Acceleration, f32 Drag );
+
+    /// <summary>
+    ///   Sets how often a group is updated, such as less often for a distant group.
+    /// </summary>
+    /// <remarks>
+    ///   The group is updated on every Interval-th call to Update, with the time elapsed since
+    ///    its last update, so that its particles age and move as far.  Groups with the same
+    ///    interval are updated on different calls, to spread their cost.
+    /// </remarks>
+    /// <param name="Group">The group.</param>
+    /// <param name="Interval">The number of calls to Update per update of the group, from 1.</param>
+    void SetUpdateInterval( u32 Group, u32 Interval );
+
+    /// <summary>
+    ///   Sets whether a group is shown, as IGraphicsParticleObject::ParticleGroupData::visible.
+    /// </summary>
+    void SetVisible( u32 Group, Bool bVisible )
+    {
+        ASSERT( Group < m_apGroups.size() );
+        m_apGroups[ Group ]->bVisible = bVisible;
+    }
+
+    /// <summary>
+    ///   Checks whether a group is shown.
+    /// </summary>
+    Bool IsVisible( u32 Group ) const
+    {
+        ASSERT( Group < m_apGroups.size() );
+        return m_apGroups[ Group ]->bVisible;
+    }
+
+    /// <summary>
+    ///   Ages, moves and compacts the particles of every group, then emits the new ones.
+    /// </summary>
+    /// <param name="DeltaTime">The elapsed time, above 0.</param>
+    /// <param name="pTaskManager">Task manager to spread the groups over, or NULL to update them
+    ///  on the calling thread.</param>
+    /// <param name="pSystemTask">The task calling, passed on to ITaskManager::ParallelFor.</param>
+    void Update( f32 DeltaTime, ITaskManager* pTaskManager=NULL, ISystemTask* pSystemTask=NULL );
+
+    /// <summary>
+    ///   Gets the number of groups.
+    /// </summary>
+    u32 GetGroupCount( void ) const
+    {
+        return static_cast<u32>(m_apGroups.size());
+    }
+
+    /// <summary>
+    ///   Gets the particles of a group.
+    /// </summary>
+    ParticleStore& GetStore( u32 Group )
+    {
+        ASSERT( Group < m_apGroups.size() );
+        return m_apGroups[ Group ]->Store;
+    }
+
+    /// <summary>
+    ///   Gets the number of particles a group emitted in the last update.
+    /// </summary>
+    u32 GetEmitted( u32 Group ) const
+    {
+        ASSERT( Group < m_apGroups.size() );
+        return m_apGroups[ Group ]->Emitted;
+    }
+
+
+protected:
+
+    struct Group
+    {
+        Group( ParticleStore::Integrator Method ) : Store( Method ) {}
+
+        ParticleStore       Store;
+        EmitFunction        pfnEmit;
+        void*               pParam;
+        u32                 Seed;
+        f32                 Rate;
+        f32                 Pending;            // Fraction of a particle left to emit
+        Math::Vector3       Acceleration;
+        f32                 Drag;
+        u32                 Emitted;
+        Bool                bVisible;
+
+        // Throttling: the calls to Update per update, and the time since the last update
+        u32                 Interval;
+        f32                 Elapsed;
+        Bool                bUpdating;
+    };
+
+    struct WorkItem
+    {
+        u32                 Group;
+        u32                 Chunk;
+    };
+
+    static void UpdateItems( void* pParam, u32 Begin, u32 End );
+    static void EndGroups( void* pParam, u32 Begin, u32 End );
+
+    std::vector<Group*>             m_apGroups;
+    std::vector<WorkItem>           m_aItems;
+    u32                             m_Frame;
+};
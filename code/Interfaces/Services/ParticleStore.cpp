@@ -0,0 +1,704 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#include <xmmintrin.h>
+#include <float.h>
+#include <string.h>
+#include <algorithm>
+
+#include "ParticleStore.h"
+
+
+const u32 ParticleStore::ChunkSize;
+
+///////////////////////////////////////////////////////////////////////////////
+// Pad - Rounds a particle count up to whole SSE registers
+static inline u32
+Pad(
+    u32 Count
+    )
+{
+    return (Count + 3) & ~3u;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ParticleStore - Starts empty
+ParticleStore::ParticleStore(
+    Integrator Method
+    )
+    : m_Method( Method )
+    , m_Columns( Method == e_Verlet ? e_ColumnCount : e_PreviousX )
+    , m_Count( 0 )
+    , m_FirstNew( 0 )
+    , m_PreviousDeltaTime( 0.0f )
+    , m_UpdateChunks( 0 )
+    , m_EmitCount( 0 )
+{
+    ResetBounds( m_Bounds );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Reserve - Reserves every column in use
+void
+ParticleStore::Reserve(
+    u32 Capacity
+    )
+{
+    for ( u32 i=0; i < m_Columns; i++ )
+    {
+        m_aaColumns[ i ].reserve( Pad( Capacity ) );
+    }
+    m_aColors.reserve( Pad( Capacity ) );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Emit - Scatters particles into the columns
+void
+ParticleStore::Emit(
+    const IGraphicsParticleObject::ParticleData* pParticles,
+    u32 Count
+    )
+{
+    u32 First = Allocate( Count );
+
+    f32* pPositionX = &m_aaColumns[ e_PositionX ][ First ];
+    f32* pPositionY = &m_aaColumns[ e_PositionY ][ First ];
+    f32* pPositionZ = &m_aaColumns[ e_PositionZ ][ First ];
+    f32* pVelocityX = &m_aaColumns[ e_VelocityX ][ First ];
+    f32* pVelocityY = &m_aaColumns[ e_VelocityY ][ First ];
+    f32* pVelocityZ = &m_aaColumns[ e_VelocityZ ][ First ];
+    f32* pSize = &m_aaColumns[ e_Size ][ First ];
+    f32* pTime = &m_aaColumns[ e_Time ][ First ];
+    f32* pLifeTime = &m_aaColumns[ e_LifeTime ][ First ];
+    f32* pMass = &m_aaColumns[ e_Mass ][ First ];
+    u32* pColor = &m_aColors[ First ];
+
+    for ( u32 i=0; i < Count; i++ )
+    {
+        const IGraphicsParticleObject::ParticleData& Particle = pParticles[ i ];
+
+        pPositionX[ i ] = Particle.Position.x;
+        pPositionY[ i ] = Particle.Position.y;
+        pPositionZ[ i ] = Particle.Position.z;
+        pVelocityX[ i ] = Particle.Velocity.x;
+        pVelocityY[ i ] = Particle.Velocity.y;
+        pVelocityZ[ i ] = Particle.Velocity.z;
+        pSize[ i ] = Particle.Size;
+        pTime[ i ] = Particle.Time;
+        pLifeTime[ i ] = Particle.LifeTime;
+        pMass[ i ] = Particle.Mass;
+        pColor[ i ] = Particle.Color;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Allocate - Grows the columns by a number of particles
+u32
+ParticleStore::Allocate(
+    u32 Count
+    )
+{
+    u32 First = m_Count;
+
+    m_Count += Count;
+    Resize( m_Count );
+
+    return First;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Update - Integrates then compacts a chunk at a time, while it is in the cache
+void
+ParticleStore::Update(
+    f32 DeltaTime,
+    const Math::Vector3& Acceleration,
+    f32 Drag
+    )
+{
+    PROFILE_ZONE( "ParticleStore::Update" );
+
+    Step Params;
+    SetStep( Params, DeltaTime, Acceleration, Drag );
+
+    u32 Padded = Pad( m_Count );
+    u32 Write = 0;
+
+    ResetBounds( m_Bounds );
+
+    for ( u32 Begin=0; Begin < Padded; Begin += ChunkSize )
+    {
+        u32 End = std::min( Begin + ChunkSize, Padded );
+
+        if ( m_Method == e_Verlet )
+        {
+            IntegrateVerlet( Begin, End, Params );
+        }
+        else
+        {
+            Integrate( Begin, End, Params );
+        }
+
+        Bounds Box;
+        Write = Compact( Begin, End, Write, Box );
+        AddBounds( m_Bounds, Box );
+    }
+
+    m_Count = Write;
+    m_FirstNew = m_Count;
+    Resize( m_Count );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// BeginUpdate - Pads the particles to whole chunks, and adds the emission chunks after them
+u32
+ParticleStore::BeginUpdate(
+    f32 DeltaTime,
+    const Math::Vector3& Acceleration,
+    f32 Drag,
+    u32 EmitCount
+    )
+{
+    SetStep( m_Step, DeltaTime, Acceleration, Drag );
+
+    m_UpdateChunks = (m_Count + ChunkSize - 1) / ChunkSize;
+    m_EmitCount = EmitCount;
+
+    u32 Padded = m_UpdateChunks * ChunkSize;
+    Resize( Padded + EmitCount );
+
+    //
+    // Resize only kills the padding to a multiple of 4; kill the rest of the last chunk too.
+    //
+    for ( u32 i=m_Count; i < Padded; i++ )
+    {
+        m_aaColumns[ e_Time ][ i ] = 0.0f;
+        m_aaColumns[ e_LifeTime ][ i ] = 0.0f;
+    }
+
+    u32 Chunks = m_UpdateChunks + (EmitCount + ChunkSize - 1) / ChunkSize;
+    m_aChunkCounts.assign( Chunks, 0 );
+    m_aChunkBounds.resize( m_UpdateChunks );
+
+    return Chunks;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// UpdateChunk - Integrates a chunk and compacts it to its start
+void
+ParticleStore::UpdateChunk(
+    u32 Chunk
+    )
+{
+    ASSERT( Chunk < m_UpdateChunks );
+
+    u32 Begin = Chunk * ChunkSize;
+    u32 End = Begin + ChunkSize;
+
+    if ( m_Method == e_Verlet )
+    {
+        IntegrateVerlet( Begin, End, m_Step );
+    }
+    else
+    {
+        Integrate( Begin, End, m_Step );
+    }
+
+    m_aChunkCounts[ Chunk ] = Compact( Begin, End, Begin, m_aChunkBounds[ Chunk ] ) - Begin;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetEmitRange - Gets where an emission chunk starts and how much of the emission it holds
+u32
+ParticleStore::GetEmitRange(
+    u32 Chunk,
+    u32& First
+    ) const
+{
+    ASSERT( Chunk >= m_UpdateChunks && Chunk < m_aChunkCounts.size() );
+
+    First = Chunk * ChunkSize;
+    return std::min( ChunkSize, m_EmitCount - (Chunk - m_UpdateChunks) * ChunkSize );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// EndUpdate - Moves each chunk's particles down to where the previous chunks' end
+u32
+ParticleStore::EndUpdate(
+    void
+    )
+{
+    u32 Chunks = static_cast<u32>(m_aChunkCounts.size());
+    u32 Write = 0;
+    u32 Survivors = 0;
+
+    ResetBounds( m_Bounds );
+    for ( u32 Chunk=0; Chunk < m_UpdateChunks; Chunk++ )
+    {
+        AddBounds( m_Bounds, m_aChunkBounds[ Chunk ] );
+    }
+
+    for ( u32 Chunk=0; Chunk < Chunks; Chunk++ )
+    {
+        if ( Chunk == m_UpdateChunks )
+        {
+            Survivors = Write;
+        }
+
+        u32 Begin = Chunk * ChunkSize;
+        u32 Count = m_aChunkCounts[ Chunk ];
+
+        if ( Write != Begin && Count > 0 )
+        {
+            for ( u32 c=0; c < m_Columns; c++ )
+            {
+                memmove( &m_aaColumns[ c ][ Write ], &m_aaColumns[ c ][ Begin ],
+                         Count * sizeof (f32) );
+            }
+            memmove( &m_aColors[ Write ], &m_aColors[ Begin ], Count * sizeof (u32) );
+        }
+
+        Write += Count;
+    }
+
+    if ( Chunks == m_UpdateChunks )
+    {
+        Survivors = Write;
+    }
+
+    m_Count = Write;
+    m_FirstNew = Survivors;
+    Resize( m_Count );
+
+    m_UpdateChunks = 0;
+    m_EmitCount = 0;
+    m_aChunkCounts.clear();
+
+    return m_Count - Survivors;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Clear - Removes every particle, keeping the memory
+void
+ParticleStore::Clear(
+    void
+    )
+{
+    m_Count = 0;
+    m_FirstNew = 0;
+    ResetBounds( m_Bounds );
+    Resize( 0 );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetBounds - Adds the particles added since the last update to its box
+Bool
+ParticleStore::GetBounds(
+    Math::Vector3& Min,
+    Math::Vector3& Max,
+    f32& MaxSize
+    ) const
+{
+    Bounds Box = m_Bounds;
+
+    for ( u32 i=m_FirstNew; i < m_Count; i++ )
+    {
+        for ( u32 Axis=0; Axis < 3; Axis++ )
+        {
+            f32 Position = m_aaColumns[ e_PositionX + Axis ][ i ];
+            Box.aMin[ Axis ] = std::min( Box.aMin[ Axis ], Position );
+            Box.aMax[ Axis ] = std::max( Box.aMax[ Axis ], Position );
+        }
+        Box.aMax[ 3 ] = std::max( Box.aMax[ 3 ], m_aaColumns[ e_Size ][ i ] );
+    }
+
+    Min = Math::Vector3( Box.aMin[ 0 ], Box.aMin[ 1 ], Box.aMin[ 2 ] );
+    Max = Math::Vector3( Box.aMax[ 0 ], Box.aMax[ 1 ], Box.aMax[ 2 ] );
+    MaxSize = Box.aMax[ 3 ];
+
+    return m_Count > 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetColumns - Points into the columns
+void
+ParticleStore::GetColumns(
+    IGraphicsParticleObject::ParticleColumns& Columns
+    ) const
+{
+    const f32* apColumns[ e_PreviousX ];
+    for ( u32 i=0; i < e_PreviousX; i++ )
+    {
+        apColumns[ i ] = m_Count > 0 ? &m_aaColumns[ i ][ 0 ] : NULL;
+    }
+
+    Columns.pPositionX = apColumns[ e_PositionX ];
+    Columns.pPositionY = apColumns[ e_PositionY ];
+    Columns.pPositionZ = apColumns[ e_PositionZ ];
+    Columns.pVelocityX = apColumns[ e_VelocityX ];
+    Columns.pVelocityY = apColumns[ e_VelocityY ];
+    Columns.pVelocityZ = apColumns[ e_VelocityZ ];
+    Columns.pSize = apColumns[ e_Size ];
+    Columns.pTime = apColumns[ e_Time ];
+    Columns.pLifeTime = apColumns[ e_LifeTime ];
+    Columns.pMass = apColumns[ e_Mass ];
+    Columns.pColor = m_Count > 0 ? &m_aColors[ 0 ] : NULL;
+    Columns.Count = m_Count;
+    Columns.pVisible = NULL;
+    Columns.VisibleCount = m_Count;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CopyParticles - Gathers the columns into records
+void
+ParticleStore::CopyParticles(
+    IGraphicsParticleObject::ParticleData* pParticles
+    ) const
+{
+    for ( u32 i=0; i < m_Count; i++ )
+    {
+        IGraphicsParticleObject::ParticleData& Particle = pParticles[ i ];
+
+        Particle.Position.x = m_aaColumns[ e_PositionX ][ i ];
+        Particle.Position.y = m_aaColumns[ e_PositionY ][ i ];
+        Particle.Position.z = m_aaColumns[ e_PositionZ ][ i ];
+        Particle.Velocity.x = m_aaColumns[ e_VelocityX ][ i ];
+        Particle.Velocity.y = m_aaColumns[ e_VelocityY ][ i ];
+        Particle.Velocity.z = m_aaColumns[ e_VelocityZ ][ i ];
+        Particle.Size = m_aaColumns[ e_Size ][ i ];
+        Particle.Time = m_aaColumns[ e_Time ][ i ];
+        Particle.LifeTime = m_aaColumns[ e_LifeTime ][ i ];
+        Particle.Mass = m_aaColumns[ e_Mass ][ i ];
+        Particle.Color = m_aColors[ i ];
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ResetBounds - Empties a box
+void
+ParticleStore::ResetBounds(
+    Bounds& Box
+    )
+{
+    for ( u32 i=0; i < 4; i++ )
+    {
+        Box.aMin[ i ] = FLT_MAX;
+        Box.aMax[ i ] = -FLT_MAX;
+    }
+    Box.aMax[ 3 ] = 0.0f;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// AddBounds - Grows a box to hold another
+void
+ParticleStore::AddBounds(
+    Bounds& Box,
+    const Bounds& Other
+    )
+{
+    _mm_storeu_ps( Box.aMin, _mm_min_ps( _mm_loadu_ps( Box.aMin ), _mm_loadu_ps( Other.aMin ) ) );
+    _mm_storeu_ps( Box.aMax, _mm_max_ps( _mm_loadu_ps( Box.aMax ), _mm_loadu_ps( Other.aMax ) ) );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SetStep - Sets the parameters of an update and remembers its DeltaTime for the next one
+void
+ParticleStore::SetStep(
+    Step& Params,
+    f32 DeltaTime,
+    const Math::Vector3& Acceleration,
+    f32 Drag
+    )
+{
+    ASSERT( DeltaTime > 0.0f );
+
+    Params.DeltaTime = DeltaTime;
+    Params.PreviousDeltaTime = m_PreviousDeltaTime > 0.0f ? m_PreviousDeltaTime : DeltaTime;
+    Params.Damping = std::max( 0.0f, 1.0f - Drag * DeltaTime );
+    Params.Acceleration = Acceleration;
+
+    m_PreviousDeltaTime = DeltaTime;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Resize - Sizes the columns for a number of particles, the padding dead
+void
+ParticleStore::Resize(
+    u32 Count
+    )
+{
+    u32 Padded = Pad( Count );
+
+    for ( u32 i=0; i < m_Columns; i++ )
+    {
+        m_aaColumns[ i ].resize( Padded, 0.0f );
+    }
+    m_aColors.resize( Padded, 0 );
+
+    //
+    // The padding may hold particles moved down by Compact; a LifeTime of 0 keeps it dead.
+    //
+    for ( u32 i=Count; i < Padded; i++ )
+    {
+        m_aaColumns[ e_Time ][ i ] = 0.0f;
+        m_aaColumns[ e_LifeTime ][ i ] = 0.0f;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Integrate - Semi-implicit Euler: the velocity is updated first and moves the particle
+void
+ParticleStore::Integrate(
+    u32 Begin,
+    u32 End,
+    const Step& Params
+    )
+{
+    f32* pPositionX = &m_aaColumns[ e_PositionX ][ 0 ];
+    f32* pPositionY = &m_aaColumns[ e_PositionY ][ 0 ];
+    f32* pPositionZ = &m_aaColumns[ e_PositionZ ][ 0 ];
+    f32* pVelocityX = &m_aaColumns[ e_VelocityX ][ 0 ];
+    f32* pVelocityY = &m_aaColumns[ e_VelocityY ][ 0 ];
+    f32* pVelocityZ = &m_aaColumns[ e_VelocityZ ][ 0 ];
+    f32* pTime = &m_aaColumns[ e_Time ][ 0 ];
+
+    __m128 dt = _mm_set1_ps( Params.DeltaTime );
+    __m128 Damping = _mm_set1_ps( Params.Damping );
+    __m128 dvX = _mm_set1_ps( Params.Acceleration.x * Params.DeltaTime );
+    __m128 dvY = _mm_set1_ps( Params.Acceleration.y * Params.DeltaTime );
+    __m128 dvZ = _mm_set1_ps( Params.Acceleration.z * Params.DeltaTime );
+
+    for ( u32 i=Begin; i < End; i += 4 )
+    {
+        __m128 vX = _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( pVelocityX + i ), Damping ), dvX );
+        __m128 vY = _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( pVelocityY + i ), Damping ), dvY );
+        __m128 vZ = _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( pVelocityZ + i ), Damping ), dvZ );
+
+        _mm_storeu_ps( pVelocityX + i, vX );
+        _mm_storeu_ps( pVelocityY + i, vY );
+        _mm_storeu_ps( pVelocityZ + i, vZ );
+
+        _mm_storeu_ps( pPositionX + i,
+                       _mm_add_ps( _mm_loadu_ps( pPositionX + i ), _mm_mul_ps( vX, dt ) ) );
+        _mm_storeu_ps( pPositionY + i,
+                       _mm_add_ps( _mm_loadu_ps( pPositionY + i ), _mm_mul_ps( vY, dt ) ) );
+        _mm_storeu_ps( pPositionZ + i,
+                       _mm_add_ps( _mm_loadu_ps( pPositionZ + i ), _mm_mul_ps( vZ, dt ) ) );
+
+        _mm_storeu_ps( pTime + i, _mm_add_ps( _mm_loadu_ps( pTime + i ), dt ) );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// IntegrateVerlet - Time-corrected position Verlet: the particle moves by its last displacement,
+//  scaled by the ratio of the time steps, plus the acceleration, and the velocity is derived from
+//  the move
+void
+ParticleStore::IntegrateVerlet(
+    u32 Begin,
+    u32 End,
+    const Step& Params
+    )
+{
+    f32 DeltaTime = Params.DeltaTime;
+    const f32* pAcceleration = &Params.Acceleration.x;
+
+    __m128 dt = _mm_set1_ps( DeltaTime );
+    __m128 InvDeltaTime = _mm_set1_ps( 1.0f / DeltaTime );
+    __m128 MoveScale = _mm_set1_ps( Params.Damping * DeltaTime / Params.PreviousDeltaTime );
+
+    //
+    // Particles emitted since the last update have no previous position; start them from the
+    //  one their velocity gives a step of the last update before.
+    //
+    u32 FirstNew = std::max( Begin, m_FirstNew );
+    u32 LastNew = std::min( End, m_Count );
+
+    for ( u32 Axis=0; Axis < 3; Axis++ )
+    {
+        f32* pPosition = &m_aaColumns[ e_PositionX + Axis ][ 0 ];
+        f32* pVelocity = &m_aaColumns[ e_VelocityX + Axis ][ 0 ];
+        f32* pPrevious = &m_aaColumns[ e_PreviousX + Axis ][ 0 ];
+
+        for ( u32 i=FirstNew; i < LastNew; i++ )
+        {
+            pPrevious[ i ] = pPosition[ i ] - pVelocity[ i ] * Params.PreviousDeltaTime;
+        }
+
+        __m128 da = _mm_set1_ps( pAcceleration[ Axis ] * DeltaTime * DeltaTime );
+
+        for ( u32 i=Begin; i < End; i += 4 )
+        {
+            __m128 Position = _mm_loadu_ps( pPosition + i );
+            __m128 Move = _mm_sub_ps( Position, _mm_loadu_ps( pPrevious + i ) );
+            Move = _mm_add_ps( _mm_mul_ps( Move, MoveScale ), da );
+
+            _mm_storeu_ps( pPrevious + i, Position );
+            _mm_storeu_ps( pPosition + i, _mm_add_ps( Position, Move ) );
+            _mm_storeu_ps( pVelocity + i, _mm_mul_ps( Move, InvDeltaTime ) );
+        }
+    }
+
+    f32* pTime = &m_aaColumns[ e_Time ][ 0 ];
+    for ( u32 i=Begin; i < End; i += 4 )
+    {
+        _mm_storeu_ps( pTime + i, _mm_add_ps( _mm_loadu_ps( pTime + i ), dt ) );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CompactColumn - Moves the live elements of a chunk of a column down, whole blocks of 4 at a
+//  time when they are all alive; each element moves to an index at or before its own, so the
+//  column can be compacted in place
+template <typename T>
+static inline void
+CompactColumn(
+    T* pColumn,
+    u32 Begin,
+    u32 Write,
+    const u8* pAlive,
+    u32 Blocks
+    )
+{
+    const T* pRead = pColumn + Begin;
+    T* pWrite = pColumn + Write;
+
+    for ( u32 Block=0; Block < Blocks; Block++, pRead += 4 )
+    {
+        u32 Alive = pAlive[ Block ];
+
+        if ( Alive == 0xF )
+        {
+            memmove( pWrite, pRead, 4 * sizeof (T) );
+            pWrite += 4;
+        }
+        else if ( Alive != 0 )
+        {
+            for ( u32 Lane=0; Lane < 4; Lane++ )
+            {
+                *pWrite = pRead[ Lane ];
+                pWrite += (Alive >> Lane) & 1;
+            }
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Compact - Tests the particles of a chunk 4 at a time, bounding the live ones, then moves each
+//  column's live ones to where the previous chunks' live particles end
+u32
+ParticleStore::Compact(
+    u32 Begin,
+    u32 End,
+    u32 Write,
+    Bounds& Box
+    )
+{
+    const f32* pTime = &m_aaColumns[ e_Time ][ 0 ];
+    const f32* pLifeTime = &m_aaColumns[ e_LifeTime ][ 0 ];
+    const f32* pSize = &m_aaColumns[ e_Size ][ 0 ];
+    const f32* apPositions[ 3 ] =
+    {
+        &m_aaColumns[ e_PositionX ][ 0 ],
+        &m_aaColumns[ e_PositionY ][ 0 ],
+        &m_aaColumns[ e_PositionZ ][ 0 ],
+    };
+
+    //
+    // Dead lanes are bounded as FLT_MAX and -FLT_MAX, which min and max pass over.
+    //
+    __m128 Huge = _mm_set1_ps( FLT_MAX );
+    __m128 NegativeHuge = _mm_set1_ps( -FLT_MAX );
+    __m128 aMin[ 3 ] = { Huge, Huge, Huge };
+    __m128 aMax[ 3 ] = { NegativeHuge, NegativeHuge, NegativeHuge };
+    __m128 MaxSize = _mm_setzero_ps();
+
+    u8 aAlive[ ChunkSize / 4 ];
+    u32 Blocks = (End - Begin) / 4;
+    u32 Count = 0;
+
+    for ( u32 Block=0; Block < Blocks; Block++ )
+    {
+        u32 i = Begin + Block * 4;
+        __m128 AliveMask = _mm_cmplt_ps( _mm_loadu_ps( pTime + i ), _mm_loadu_ps( pLifeTime + i ) );
+
+        for ( u32 Axis=0; Axis < 3; Axis++ )
+        {
+            __m128 Position = _mm_and_ps( AliveMask, _mm_loadu_ps( apPositions[ Axis ] + i ) );
+            aMin[ Axis ] = _mm_min_ps( aMin[ Axis ],
+                                       _mm_or_ps( Position, _mm_andnot_ps( AliveMask, Huge ) ) );
+            aMax[ Axis ] = _mm_max_ps( aMax[ Axis ],
+                                       _mm_or_ps( Position, _mm_andnot_ps( AliveMask, NegativeHuge ) ) );
+        }
+        MaxSize = _mm_max_ps( MaxSize, _mm_and_ps( AliveMask, _mm_loadu_ps( pSize + i ) ) );
+
+        u32 Alive = _mm_movemask_ps( AliveMask );
+        aAlive[ Block ] = static_cast<u8>(Alive);
+        Count += (Alive & 1) + ((Alive >> 1) & 1) + ((Alive >> 2) & 1) + (Alive >> 3);
+    }
+
+    //
+    // Reduce the lanes of the box.
+    //
+    f32 aLanes[ 4 ];
+    for ( u32 Axis=0; Axis < 3; Axis++ )
+    {
+        _mm_storeu_ps( aLanes, aMin[ Axis ] );
+        Box.aMin[ Axis ] = std::min( std::min( aLanes[ 0 ], aLanes[ 1 ] ),
+                                     std::min( aLanes[ 2 ], aLanes[ 3 ] ) );
+        _mm_storeu_ps( aLanes, aMax[ Axis ] );
+        Box.aMax[ Axis ] = std::max( std::max( aLanes[ 0 ], aLanes[ 1 ] ),
+                                     std::max( aLanes[ 2 ], aLanes[ 3 ] ) );
+    }
+    _mm_storeu_ps( aLanes, MaxSize );
+    Box.aMin[ 3 ] = FLT_MAX;
+    Box.aMax[ 3 ] = std::max( std::max( aLanes[ 0 ], aLanes[ 1 ] ),
+                              std::max( aLanes[ 2 ], aLanes[ 3 ] ) );
+
+    //
+    // A chunk with no dead particles, and none dead before it, stays where it is.
+    //
+    if ( Write == Begin && Count == End - Begin )
+    {
+        return End;
+    }
+
+    for ( u32 c=0; c < m_Columns; c++ )
+    {
+        CompactColumn( &m_aaColumns[ c ][ 0 ], Begin, Write, aAlive, Blocks );
+    }
+    CompactColumn( &m_aColors[ 0 ], Begin, Write, aAlive, Blocks );
+
+    return Write + Count;
+}
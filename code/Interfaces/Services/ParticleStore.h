@@ -0,0 +1,283 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#pragma once
+
+//
+// core includes
+//
+#include "../../BaseTypes/BaseTypes.h"
+#include "../Interface.h"
+#include <vector>
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// <summary>
+///   The particles of a group kept as one array per member of
+///    IGraphicsParticleObject::ParticleData, integrated 4 at a time with SSE and handed to the
+///    graphics system with IGraphicsParticleObject::GetParticleColumns instead of copied.
+/// </summary>
+/// <remarks>
+///   A particle dies when its Time reaches its LifeTime.  Update removes the dead particles in a
+///    single pass moving the live ones down, keeping their order, rather than one at a time.
+/// <para>
+///   The Verlet integrator moves a particle by its last move scaled by the ratio of this update's
+///    DeltaTime to the last one's, so that it keeps its speed when the time between updates
+///    changes, such as when a group is updated less often.
+/// </para>
+/// <para>
+///   The columns are padded to a multiple of 4 particles, with padding that is never alive, so
+///    that the integrator needs no scalar tail.
+/// </para>
+/// </remarks>
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class ParticleStore
+{
+public:
+
+    enum Integrator
+    {
+        e_Euler,                        // Semi-implicit Euler on the velocities
+        e_Verlet,                       // Time-corrected position Verlet, deriving the velocities
+    };
+
+    static const u32 ChunkSize = 1024;  // Particles integrated and compacted together
+
+
+    /// <summary>
+    ///   Constructor.
+    /// </summary>
+    /// <param name="Method">The integrator.</param>
+    ParticleStore( Integrator Method=e_Euler );
+
+    /// <summary>
+    ///   Reserves room for particles, so that emitting up to that many does not reallocate.
+    /// </summary>
+    void Reserve( u32 Capacity );
+
+    /// <summary>
+    ///   Adds particles.
+    /// </summary>
+    /// <param name="pParticles">The particles.</param>
+    /// <param name="Count">The number of particles.</param>
+    void Emit( const IGraphicsParticleObject::ParticleData* pParticles, u32 Count );
+
+    /// <summary>
+    ///   Adds particles for the caller to fill through the Get*Column accessors.
+    /// </summary>
+    /// <param name="Count">The number of particles.</param>
+    /// <returns>The index of the first particle added.</returns>
+    u32 Allocate( u32 Count );
+
+    /// <summary>
+    ///   Ages and moves the particles, then removes the dead ones.
+    /// </summary>
+    /// <param name="DeltaTime">The elapsed time, above 0.</param>
+    /// <param name="Acceleration">The acceleration of every particle, such as gravity.</param>
+    /// <param name="Drag">The fraction of velocity lost per second.</param>
+    void Update( f32 DeltaTime, const Math::Vector3& Acceleration, f32 Drag=0.0f );
+
+    /// <summary>
+    ///   Starts an update done a chunk at a time, so that the chunks can be spread over threads.
+    /// </summary>
+    /// <remarks>
+    ///   The chunks before GetFirstEmitChunk hold the particles, and are integrated and compacted
+    ///    by UpdateChunk; the ones from it on are room for the caller to emit particles into, as
+    ///    given by GetEmitRange and recorded by SetEmitted.  Each chunk keeps its own count, so
+    ///    that calls for different chunks are safe from several threads at once.  EndUpdate then
+    ///    moves the chunks' particles together.
+    /// </remarks>
+    /// <param name="DeltaTime">The elapsed time, above 0.</param>
+    /// <param name="Acceleration">The acceleration of every particle, such as gravity.</param>
+    /// <param name="Drag">The fraction of velocity lost per second.</param>
+    /// <param name="EmitCount">The most particles to emit.</param>
+    /// <returns>The number of chunks.</returns>
+    u32 BeginUpdate( f32 DeltaTime, const Math::Vector3& Acceleration, f32 Drag, u32 EmitCount );
+
+    /// <summary>
+    ///   Gets the first chunk to emit particles into, once BeginUpdate has been called.
+    /// </summary>
+    u32 GetFirstEmitChunk( void ) const
+    {
+        return m_UpdateChunks;
+    }
+
+    /// <summary>
+    ///   Ages, moves and compacts the particles of a chunk.
+    /// </summary>
+    void UpdateChunk( u32 Chunk );
+
+    /// <summary>
+    ///   Gets the room for particles of an emission chunk.
+    /// </summary>
+    /// <param name="Chunk">The chunk.</param>
+    /// <param name="First">The returned index of the first particle, to write through the
+    ///  Get*Column accessors.</param>
+    /// <returns>The most particles that can be emitted into the chunk.</returns>
+    u32 GetEmitRange( u32 Chunk, u32& First ) const;
+
+    /// <summary>
+    ///   Records the number of particles emitted into an emission chunk, from its first one.
+    /// </summary>
+    void SetEmitted( u32 Chunk, u32 Count )
+    {
+        ASSERT( Chunk >= m_UpdateChunks && Chunk < m_aChunkCounts.size() );
+        m_aChunkCounts[ Chunk ] = Count;
+    }
+
+    /// <summary>
+    ///   Moves the particles of the chunks together, ending the update.
+    /// </summary>
+    /// <returns>The number of particles emitted.</returns>
+    u32 EndUpdate( void );
+
+    /// <summary>
+    ///   Removes every particle.
+    /// </summary>
+    void Clear( void );
+
+    /// <summary>
+    ///   Gets the number of particles.
+    /// </summary>
+    u32 GetCount( void ) const
+    {
+        return m_Count;
+    }
+
+    /// <summary>
+    ///   Gets a box holding the particles, as of the last update and with those added since.
+    /// </summary>
+    /// <param name="Min">The returned minimum corner of the positions.</param>
+    /// <param name="Max">The returned maximum corner of the positions.</param>
+    /// <param name="MaxSize">The returned largest Size.</param>
+    /// <returns>False if there are no particles.</returns>
+    Bool GetBounds( Math::Vector3& Min, Math::Vector3& Max, f32& MaxSize ) const;
+
+    /// <summary>
+    ///   Gets views of the columns, valid until the next call changing the store.
+    /// </summary>
+    void GetColumns( IGraphicsParticleObject::ParticleColumns& Columns ) const;
+
+    /// <summary>
+    ///   Copies the particles out, for IGraphicsParticleObject::GetParticles.
+    /// </summary>
+    /// <param name="pParticles">The returned particles, GetCount of them.</param>
+    void CopyParticles( IGraphicsParticleObject::ParticleData* pParticles ) const;
+
+    /// <summary>
+    ///   Gets a float column for writing, such as to fill particles returned by Allocate.
+    /// </summary>
+    f32* GetPositionColumn( u32 Axis )
+    {
+        ASSERT( Axis < 3 );
+        return &m_aaColumns[ e_PositionX + Axis ][ 0 ];
+    }
+
+    f32* GetVelocityColumn( u32 Axis )
+    {
+        ASSERT( Axis < 3 );
+        return &m_aaColumns[ e_VelocityX + Axis ][ 0 ];
+    }
+
+    f32* GetSizeColumn( void )
+    {
+        return &m_aaColumns[ e_Size ][ 0 ];
+    }
+
+    f32* GetTimeColumn( void )
+    {
+        return &m_aaColumns[ e_Time ][ 0 ];
+    }
+
+    f32* GetLifeTimeColumn( void )
+    {
+        return &m_aaColumns[ e_LifeTime ][ 0 ];
+    }
+
+    f32* GetMassColumn( void )
+    {
+        return &m_aaColumns[ e_Mass ][ 0 ];
+    }
+
+    u32* GetColorColumn( void )
+    {
+        return &m_aColors[ 0 ];
+    }
+
+
+protected:
+
+    enum Column
+    {
+        e_PositionX,
+        e_PositionY,
+        e_PositionZ,
+        e_VelocityX,
+        e_VelocityY,
+        e_VelocityZ,
+        e_Size,
+        e_Time,
+        e_LifeTime,
+        e_Mass,
+
+        // Verlet only: the positions of the previous update
+        e_PreviousX,
+        e_PreviousY,
+        e_PreviousZ,
+
+        e_ColumnCount
+    };
+
+    struct Step
+    {
+        f32                 DeltaTime;
+        f32                 PreviousDeltaTime;
+        f32                 Damping;
+        Math::Vector3       Acceleration;
+    };
+
+    // The box of a set of particles, with the largest Size in aMax[ 3 ]
+    struct Bounds
+    {
+        f32                 aMin[ 4 ];
+        f32                 aMax[ 4 ];
+    };
+
+    static void ResetBounds( Bounds& Box );
+    static void AddBounds( Bounds& Box, const Bounds& Other );
+
+    void SetStep( Step& Params, f32 DeltaTime, const Math::Vector3& Acceleration, f32 Drag );
+    void Resize( u32 Count );
+    void Integrate( u32 Begin, u32 End, const Step& Params );
+    void IntegrateVerlet( u32 Begin, u32 End, const Step& Params );
+    u32 Compact( u32 Begin, u32 End, u32 Write, Bounds& Box );
+
+    Integrator                      m_Method;
+    u32                             m_Columns;          // Float columns in use
+    u32                             m_Count;
+    u32                             m_FirstNew;         // Particles not integrated yet
+    Bounds                          m_Bounds;           // Of the particles before m_FirstNew
+    f32                             m_PreviousDeltaTime;    // Of the last update, or 0
+
+    // The update done a chunk at a time
+    Step                            m_Step;
+    u32                             m_UpdateChunks;
+    u32                             m_EmitCount;
+    std::vector<u32>                m_aChunkCounts;
+    std::vector<Bounds>             m_aChunkBounds;
+
+    std::vector<f32>                m_aaColumns[ e_ColumnCount ];
+    std::vector<u32>                m_aColors;
+};
@@ -0,0 +1,793 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#include <math.h>
+#include <algorithm>
+
+#include "SweepAndPrune.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetCell - Gets the grid cell holding a coordinate
+static inline i32
+GetCell(
+    f32 Value,
+    f32 InvCellSize
+    )
+{
+    // Far away coordinates are clamped so that the cell fits
+    const f32 Limit = 1e8f;
+    f32 Cell = floorf( Value * InvCellSize );
+    return static_cast<i32>(std::max( -Limit, std::min( Cell, Limit ) ));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SweepAndPrune - Starts with no proxies
+SweepAndPrune::SweepAndPrune(
+    f32 CellSize
+    )
+    : m_InvCellSize( 1.0f / CellSize )
+    , m_aBuckets( sm_BucketCount )
+{
+    ASSERT( CellSize > 0.0f );
+
+    for ( u32 i=0; i < sm_BucketCount; i++ )
+    {
+        m_aBuckets[ i ].bDirty = False;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ~SweepAndPrune
+SweepAndPrune::~SweepAndPrune(
+    void
+    )
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Add - Adds a proxy; Update puts it in its buckets
+SweepAndPrune::Handle
+SweepAndPrune::Add(
+    const IIntersectionObject::Info& Info
+    )
+{
+    ASSERT( Info.AABBMin.x <= Info.AABBMax.x && Info.AABBMin.y <= Info.AABBMax.y &&
+            Info.AABBMin.z <= Info.AABBMax.z );
+
+    Handle Added;
+    if ( !m_aFreeHandles.empty() )
+    {
+        Added = m_aFreeHandles.back();
+        m_aFreeHandles.pop_back();
+    }
+    else
+    {
+        Added = static_cast<Handle>(m_aProxies.size());
+        m_aProxies.push_back( Proxy() );
+        m_aBoxes.push_back( Box() );
+    }
+
+    SetBox( Added, Info );
+    m_aBoxes[ Added ].Partners = 0;
+
+    Proxy& New = m_aProxies[ Added ];
+    New.Info = Info;
+    New.aBuckets.clear();
+    New.aPartners.clear();
+    New.aIntersections.clear();
+    New.bUsed = True;
+    New.bAdded = True;
+    New.bNew = False;
+    New.bMoved = False;
+    New.bChanged = False;
+
+    m_aAdded.push_back( Added );
+    return Added;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Set - Updates a proxy's box; Update sorts its ends
+void
+SweepAndPrune::Set(
+    Handle Proxy,
+    const IIntersectionObject::Info& Info
+    )
+{
+    ASSERT( Proxy < m_aProxies.size() && m_aProxies[ Proxy ].bUsed );
+    ASSERT( Info.AABBMin.x <= Info.AABBMax.x && Info.AABBMin.y <= Info.AABBMax.y &&
+            Info.AABBMin.z <= Info.AABBMax.z );
+
+    SweepAndPrune::Proxy& Target = m_aProxies[ Proxy ];
+    Target.Info = Info;
+    SetBox( Proxy, Info );
+
+    if ( !Target.bMoved && !Target.bAdded )
+    {
+        Target.bMoved = True;
+        m_aMoved.push_back( Proxy );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Remove - Ends a proxy's overlaps; Update drops its box ends
+void
+SweepAndPrune::Remove(
+    Handle Proxy
+    )
+{
+    ASSERT( Proxy < m_aProxies.size() && m_aProxies[ Proxy ].bUsed );
+
+    SweepAndPrune::Proxy& Target = m_aProxies[ Proxy ];
+    while ( !Target.aPartners.empty() )
+    {
+        RemovePair( Proxy, Target.aPartners.back() );
+    }
+
+    Target.bUsed = False;
+    Target.aIntersections.clear();
+    m_aRemoved.push_back( Proxy );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetIntersections - Gets the objects overlapping a proxy
+const IIntersectionObject::InfoArray&
+SweepAndPrune::GetIntersections(
+    Handle Proxy
+    ) const
+{
+    ASSERT( Proxy < m_aProxies.size() );
+    return m_aProxies[ Proxy ].aIntersections;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Update - Moves the proxies between buckets, then sorts the buckets they are in, tracking the
+//  overlaps that start and stop
+void
+SweepAndPrune::Update(
+    void
+    )
+{
+    PROFILE_ZONE( "SweepAndPrune::Update" );
+
+    //
+    // Take the removed proxies out of their buckets.
+    //
+    for ( size_t i=0; i < m_aRemoved.size(); i++ )
+    {
+        Proxy& Removed = m_aProxies[ m_aRemoved[ i ] ];
+        for ( size_t b=0; b < Removed.aBuckets.size(); b++ )
+        {
+            Leave( Removed.aBuckets[ b ], m_aRemoved[ i ] );
+        }
+        Removed.aBuckets.clear();
+    }
+
+    //
+    // Move the moved proxies to the buckets of the cells they are now over, and put the added
+    //  ones in theirs.
+    //
+    for ( size_t i=0; i < m_aMoved.size(); i++ )
+    {
+        Proxy& Moved = m_aProxies[ m_aMoved[ i ] ];
+        if ( !Moved.bUsed )
+        {
+            continue;
+        }
+
+        i32 aCells[ 4 ];
+        GetCells( m_aMoved[ i ], aCells );
+
+        if ( aCells[ 0 ] == Moved.aCells[ 0 ] && aCells[ 1 ] == Moved.aCells[ 1 ] &&
+             aCells[ 2 ] == Moved.aCells[ 2 ] && aCells[ 3 ] == Moved.aCells[ 3 ] )
+        {
+            for ( size_t b=0; b < Moved.aBuckets.size(); b++ )
+            {
+                MarkDirty( Moved.aBuckets[ b ] );
+            }
+        }
+        else
+        {
+            Rebucket( m_aMoved[ i ] );
+        }
+    }
+
+    for ( size_t i=0; i < m_aAdded.size(); i++ )
+    {
+        Proxy& Added = m_aProxies[ m_aAdded[ i ] ];
+        if ( Added.bUsed )
+        {
+            Added.bAdded = False;
+            Rebucket( m_aAdded[ i ] );
+        }
+    }
+    m_aAdded.clear();
+
+    //
+    // Sort the buckets.
+    //
+    for ( size_t i=0; i < m_aDirty.size(); i++ )
+    {
+        UpdateBucket( m_aDirty[ i ] );
+    }
+    m_aDirty.clear();
+
+    //
+    // A proxy that left a bucket may no longer share one with a partner, so no sort saw them part.
+    //
+    for ( size_t i=0; i < m_aRebucketed.size(); i++ )
+    {
+        Handle Rebucketed = m_aRebucketed[ i ];
+        const std::vector<Handle>& aPartners = m_aProxies[ Rebucketed ].aPartners;
+
+        for ( size_t p=aPartners.size(); p > 0; p-- )
+        {
+            if ( !Overlaps( Rebucketed, aPartners[ p - 1 ] ) )
+            {
+                RemovePair( Rebucketed, aPartners[ p - 1 ] );
+            }
+        }
+    }
+    m_aRebucketed.clear();
+
+    //
+    // The objects overlapping a moved one see it change.
+    //
+    for ( size_t i=0; i < m_aMoved.size(); i++ )
+    {
+        Proxy& Moved = m_aProxies[ m_aMoved[ i ] ];
+        Moved.bMoved = False;
+
+        if ( Moved.bUsed )
+        {
+            for ( size_t p=0; p < Moved.aPartners.size(); p++ )
+            {
+                MarkChanged( Moved.aPartners[ p ] );
+            }
+        }
+    }
+    m_aMoved.clear();
+
+    //
+    // Publish the intersections of the changed proxies and list every pair.
+    //
+    m_aChanged.clear();
+    for ( size_t i=0; i < m_aChanging.size(); i++ )
+    {
+        Proxy& Changed = m_aProxies[ m_aChanging[ i ] ];
+        Changed.bChanged = False;
+        if ( !Changed.bUsed )
+        {
+            continue;
+        }
+
+        m_aChanged.push_back( m_aChanging[ i ] );
+        Changed.aIntersections.clear();
+
+        for ( size_t p=0; p < Changed.aPartners.size(); p++ )
+        {
+            Changed.aIntersections.push_back( m_aProxies[ Changed.aPartners[ p ] ].Info );
+        }
+    }
+    m_aChanging.clear();
+
+    m_aPairs.clear();
+    for ( Handle h=0; h < static_cast<Handle>(m_aProxies.size()); h++ )
+    {
+        if ( m_aBoxes[ h ].Partners == 0 )
+        {
+            continue;
+        }
+
+        const Proxy& Current = m_aProxies[ h ];
+        for ( size_t p=0; p < Current.aPartners.size(); p++ )
+        {
+            if ( h < Current.aPartners[ p ] )
+            {
+                Pair Overlap;
+                Overlap.First = h;
+                Overlap.Second = Current.aPartners[ p ];
+                m_aPairs.push_back( Overlap );
+            }
+        }
+    }
+    for ( size_t i=0; i < m_aPairs.size(); )
+    {
+        // Partners are in no order, so sort the pairs of each proxy
+        size_t End = i + 1;
+        while ( End < m_aPairs.size() && m_aPairs[ End ].First == m_aPairs[ i ].First )
+        {
+            End++;
+        }
+        std::sort( m_aPairs.begin() + i, m_aPairs.begin() + End, IsPairBefore );
+        i = End;
+    }
+
+    //
+    // The handles of the removed proxies are out of every list now.
+    //
+    m_aFreeHandles.insert( m_aFreeHandles.end(), m_aRemoved.begin(), m_aRemoved.end() );
+    m_aRemoved.clear();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// IsBefore - Orders box ends by value, minimums first so touching boxes overlap
+inline Bool
+SweepAndPrune::IsBefore(
+    const EndPoint& a,
+    const EndPoint& b
+    )
+{
+    return a.Value < b.Value || (a.Value == b.Value && (a.Data & 1) < (b.Data & 1));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// IsPairBefore - Orders pairs by their second handle
+Bool
+SweepAndPrune::IsPairBefore(
+    const Pair& a,
+    const Pair& b
+    )
+{
+    return a.Second < b.Second;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SetBox - Copies a proxy's box next to the others
+void
+SweepAndPrune::SetBox(
+    Handle Proxy,
+    const IIntersectionObject::Info& Info
+    )
+{
+    Box& Target = m_aBoxes[ Proxy ];
+    Target.aMin[ 0 ] = Info.AABBMin.x;
+    Target.aMin[ 1 ] = Info.AABBMin.y;
+    Target.aMin[ 2 ] = Info.AABBMin.z;
+    Target.aMax[ 0 ] = Info.AABBMax.x;
+    Target.aMax[ 1 ] = Info.AABBMax.y;
+    Target.aMax[ 2 ] = Info.AABBMax.z;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetCells - Gets the range of grid cells a proxy's box is over
+void
+SweepAndPrune::GetCells(
+    Handle Proxy,
+    i32* aCells
+    ) const
+{
+    const Box& Bounds = m_aBoxes[ Proxy ];
+    aCells[ 0 ] = GetCell( Bounds.aMin[ 0 ], m_InvCellSize );
+    aCells[ 1 ] = GetCell( Bounds.aMin[ 2 ], m_InvCellSize );
+    aCells[ 2 ] = GetCell( Bounds.aMax[ 0 ], m_InvCellSize );
+    aCells[ 3 ] = GetCell( Bounds.aMax[ 2 ], m_InvCellSize );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Rebucket - Moves a proxy to the buckets of the cells its box is over
+void
+SweepAndPrune::Rebucket(
+    Handle Proxy
+    )
+{
+    SweepAndPrune::Proxy& Target = m_aProxies[ Proxy ];
+    GetCells( Proxy, Target.aCells );
+
+    //
+    // Hash the cells; a box over as many cells as there are buckets is in all of them.
+    //
+    std::vector<u32> aBuckets;
+    u32 Width = static_cast<u32>(Target.aCells[ 2 ] - Target.aCells[ 0 ]) + 1;
+    u32 Depth = static_cast<u32>(Target.aCells[ 3 ] - Target.aCells[ 1 ]) + 1;
+
+    if ( Width >= sm_BucketCount || Depth >= sm_BucketCount || Width * Depth >= sm_BucketCount )
+    {
+        aBuckets.resize( sm_BucketCount );
+        for ( u32 i=0; i < sm_BucketCount; i++ )
+        {
+            aBuckets[ i ] = i;
+        }
+    }
+    else
+    {
+        for ( i32 x=Target.aCells[ 0 ]; x <= Target.aCells[ 2 ]; x++ )
+        {
+            for ( i32 z=Target.aCells[ 1 ]; z <= Target.aCells[ 3 ]; z++ )
+            {
+                u32 Hash = (static_cast<u32>(x) * 73856093) ^ (static_cast<u32>(z) * 19349663);
+                aBuckets.push_back( Hash & (sm_BucketCount - 1) );
+            }
+        }
+        std::sort( aBuckets.begin(), aBuckets.end() );
+        aBuckets.erase( std::unique( aBuckets.begin(), aBuckets.end() ), aBuckets.end() );
+    }
+
+    //
+    // Both lists are sorted, so walk them together.
+    //
+    Bool bLeft = False;
+    size_t o = 0;
+    size_t n = 0;
+
+    while ( o < Target.aBuckets.size() || n < aBuckets.size() )
+    {
+        if ( n == aBuckets.size() ||
+             (o < Target.aBuckets.size() && Target.aBuckets[ o ] < aBuckets[ n ]) )
+        {
+            Leave( Target.aBuckets[ o++ ], Proxy );
+            bLeft = True;
+        }
+        else if ( o == Target.aBuckets.size() || aBuckets[ n ] < Target.aBuckets[ o ] )
+        {
+            Join( aBuckets[ n++ ], Proxy );
+        }
+        else
+        {
+            MarkDirty( aBuckets[ n ] );
+            o++;
+            n++;
+        }
+    }
+
+    Target.aBuckets.swap( aBuckets );
+
+    if ( bLeft && !Target.aPartners.empty() )
+    {
+        m_aRebucketed.push_back( Proxy );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Join - Appends a proxy's box ends to a bucket
+void
+SweepAndPrune::Join(
+    u32 Bucket,
+    Handle Proxy
+    )
+{
+    SweepAndPrune::Bucket& Target = m_aBuckets[ Bucket ];
+    const Box& Bounds = m_aBoxes[ Proxy ];
+
+    for ( u32 a=0; a < 3; a++ )
+    {
+        EndPoint End;
+        End.Data = Proxy << 1;
+        End.Value = Bounds.aMin[ a ];
+        Target.aAxes[ a ].push_back( End );
+
+        End.Data |= 1;
+        End.Value = Bounds.aMax[ a ];
+        Target.aAxes[ a ].push_back( End );
+    }
+
+    Target.aAdded.push_back( Proxy );
+    MarkDirty( Bucket );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Leave - Lists a proxy whose box ends are to be dropped from a bucket
+void
+SweepAndPrune::Leave(
+    u32 Bucket,
+    Handle Proxy
+    )
+{
+    m_aBuckets[ Bucket ].aLeft.push_back( Proxy );
+    MarkDirty( Bucket );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// MarkDirty - Lists a bucket to update
+void
+SweepAndPrune::MarkDirty(
+    u32 Bucket
+    )
+{
+    if ( !m_aBuckets[ Bucket ].bDirty )
+    {
+        m_aBuckets[ Bucket ].bDirty = True;
+        m_aDirty.push_back( Bucket );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// UpdateBucket - Drops the ends of the proxies that left a bucket, sorts the ends of those that
+//  stayed, then merges in and sweeps those that joined
+void
+SweepAndPrune::UpdateBucket(
+    u32 Bucket
+    )
+{
+    SweepAndPrune::Bucket& Target = m_aBuckets[ Bucket ];
+    Target.bDirty = False;
+
+    if ( !Target.aLeft.empty() )
+    {
+        std::sort( Target.aLeft.begin(), Target.aLeft.end() );
+
+        for ( u32 a=0; a < 3; a++ )
+        {
+            std::vector<EndPoint>& Ends = Target.aAxes[ a ];
+
+            // In order, so the ends of the joined proxies stay at the back
+            u32 Kept = 0;
+            for ( size_t i=0; i < Ends.size(); i++ )
+            {
+                if ( !std::binary_search( Target.aLeft.begin(), Target.aLeft.end(),
+                                          Ends[ i ].Data >> 1 ) )
+                {
+                    Ends[ Kept++ ] = Ends[ i ];
+                }
+            }
+            Ends.resize( Kept );
+        }
+        Target.aLeft.clear();
+    }
+
+    //
+    // Refresh the ends of the proxies that were already in the bucket from their boxes and sort
+    //  them.  Overlaps with the joined proxies are left to the sweep.
+    //
+    u32 Count = static_cast<u32>(Target.aAxes[ 0 ].size() - 2 * Target.aAdded.size());
+
+    for ( u32 a=0; a < 3; a++ )
+    {
+        std::vector<EndPoint>& Ends = Target.aAxes[ a ];
+
+        for ( u32 i=0; i < Count; i++ )
+        {
+            const Box& Bounds = m_aBoxes[ Ends[ i ].Data >> 1 ];
+            Ends[ i ].Value = (Ends[ i ].Data & 1) ? Bounds.aMax[ a ] : Bounds.aMin[ a ];
+        }
+
+        Sort( Ends, Count );
+    }
+
+    if ( !Target.aAdded.empty() )
+    {
+        for ( u32 a=0; a < 3; a++ )
+        {
+            Merge( Target.aAxes[ a ], Count );
+        }
+
+        for ( size_t i=0; i < Target.aAdded.size(); i++ )
+        {
+            m_aProxies[ Target.aAdded[ i ] ].bNew = True;
+        }
+
+        Sweep( Target.aAxes[ 0 ] );
+
+        for ( size_t i=0; i < Target.aAdded.size(); i++ )
+        {
+            m_aProxies[ Target.aAdded[ i ] ].bNew = False;
+        }
+        Target.aAdded.clear();
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Sort - Insertion sorts the first ends of an axis.  An end passing another starts or stops the
+//  overlap of their boxes along the axis.
+void
+SweepAndPrune::Sort(
+    std::vector<EndPoint>& Ends,
+    u32 Count
+    )
+{
+    for ( u32 i=1; i < Count; i++ )
+    {
+        if ( !IsBefore( Ends[ i ], Ends[ i - 1 ] ) )
+        {
+            continue;
+        }
+
+        EndPoint Moving = Ends[ i ];
+        Handle MovingProxy = Moving.Data >> 1;
+        u32 j = i;
+
+        while ( j > 0 && IsBefore( Moving, Ends[ j - 1 ] ) )
+        {
+            const EndPoint& Passed = Ends[ j - 1 ];
+            Handle PassedProxy = Passed.Data >> 1;
+
+            if ( (Moving.Data & 1) == 0 && (Passed.Data & 1) != 0 )
+            {
+                // A minimum moved below a maximum
+                if ( Overlaps( MovingProxy, PassedProxy ) )
+                {
+                    AddPair( MovingProxy, PassedProxy );
+                }
+            }
+            else if ( (Moving.Data & 1) != 0 && (Passed.Data & 1) == 0 )
+            {
+                // A maximum moved below a minimum
+                RemovePair( MovingProxy, PassedProxy );
+            }
+
+            Ends[ j ] = Passed;
+            j--;
+        }
+
+        Ends[ j ] = Moving;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Merge - Sorts the ends appended to an axis after the first ones and merges them in
+void
+SweepAndPrune::Merge(
+    std::vector<EndPoint>& Ends,
+    u32 Count
+    )
+{
+    std::sort( Ends.begin() + Count, Ends.end(), IsBefore );
+    std::inplace_merge( Ends.begin(), Ends.begin() + Count, Ends.end(), IsBefore );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Sweep - Finds the overlaps of the joined proxies by sweeping along x.  Joined and known proxies
+//  are kept in separate active lists so that known proxies are never tested against each other.
+void
+SweepAndPrune::Sweep(
+    const std::vector<EndPoint>& Ends
+    )
+{
+    std::vector<Handle> aActive[ 2 ];                   // Known, then joined
+
+    for ( size_t i=0; i < Ends.size(); i++ )
+    {
+        Handle Current = Ends[ i ].Data >> 1;
+        Proxy& Owner = m_aProxies[ Current ];
+        std::vector<Handle>& Active = aActive[ Owner.bNew ? 1 : 0 ];
+
+        if ( Ends[ i ].Data & 1 )
+        {
+            // Leaving; move the last active proxy into its place
+            Handle Last = Active.back();
+            Active[ Owner.Active ] = Last;
+            m_aProxies[ Last ].Active = Owner.Active;
+            Active.pop_back();
+            continue;
+        }
+
+        for ( u32 l=(Owner.bNew ? 0 : 1); l < 2; l++ )
+        {
+            for ( size_t o=0; o < aActive[ l ].size(); o++ )
+            {
+                if ( Overlaps( Current, aActive[ l ][ o ] ) )
+                {
+                    AddPair( Current, aActive[ l ][ o ] );
+                }
+            }
+        }
+
+        Owner.Active = static_cast<u32>(Active.size());
+        Active.push_back( Current );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Overlaps - Checks if the boxes of 2 proxies overlap
+Bool
+SweepAndPrune::Overlaps(
+    Handle a,
+    Handle b
+    ) const
+{
+    const Box& A = m_aBoxes[ a ];
+    const Box& B = m_aBoxes[ b ];
+
+    return A.aMin[ 0 ] <= B.aMax[ 0 ] && B.aMin[ 0 ] <= A.aMax[ 0 ] &&
+           A.aMin[ 1 ] <= B.aMax[ 1 ] && B.aMin[ 1 ] <= A.aMax[ 1 ] &&
+           A.aMin[ 2 ] <= B.aMax[ 2 ] && B.aMin[ 2 ] <= A.aMax[ 2 ];
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// AddPair - Records an overlap, if not already recorded by this or another bucket
+void
+SweepAndPrune::AddPair(
+    Handle a,
+    Handle b
+    )
+{
+    std::vector<Handle>& aPartners = m_aProxies[ a ].aPartners;
+    if ( std::find( aPartners.begin(), aPartners.end(), b ) != aPartners.end() )
+    {
+        return;
+    }
+
+    aPartners.push_back( b );
+    m_aProxies[ b ].aPartners.push_back( a );
+    m_aBoxes[ a ].Partners++;
+    m_aBoxes[ b ].Partners++;
+    MarkChanged( a );
+    MarkChanged( b );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// RemovePair - Drops an overlap, if recorded
+void
+SweepAndPrune::RemovePair(
+    Handle a,
+    Handle b
+    )
+{
+    // Most ends passing each other belong to boxes overlapping nothing; the counts next to the
+    //  boxes tell without touching the partner lists
+    if ( m_aBoxes[ a ].Partners == 0 || m_aBoxes[ b ].Partners == 0 )
+    {
+        return;
+    }
+
+    std::vector<Handle>& aPartners = m_aProxies[ a ].aPartners;
+    std::vector<Handle>::iterator it = std::find( aPartners.begin(), aPartners.end(), b );
+    if ( it == aPartners.end() )
+    {
+        return;
+    }
+
+    *it = aPartners.back();
+    aPartners.pop_back();
+
+    std::vector<Handle>& bPartners = m_aProxies[ b ].aPartners;
+    it = std::find( bPartners.begin(), bPartners.end(), a );
+    ASSERT( it != bPartners.end() );
+    *it = bPartners.back();
+    bPartners.pop_back();
+
+    m_aBoxes[ a ].Partners--;
+    m_aBoxes[ b ].Partners--;
+
+    MarkChanged( a );
+    MarkChanged( b );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// MarkChanged - Lists a proxy whose intersections changed
+void
+SweepAndPrune::MarkChanged(
+    Handle Changed
+    )
+{
+    Proxy& Target = m_aProxies[ Changed ];
+    if ( Target.bUsed && !Target.bChanged )
+    {
+        Target.bChanged = True;
+        m_aChanging.push_back( Changed );
+    }
+}
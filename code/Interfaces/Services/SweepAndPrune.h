@@ -0,0 +1,222 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#pragma once
+
+//
+// core includes
+//
+#include "../../BaseTypes/BaseTypes.h"
+#include "../Interface.h"
+#include <vector>
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// <summary>
+///   Broadphase that finds the overlapping boxes of a set of objects with incremental sweep and
+///    prune.  The box ends are kept sorted along each axis; as objects move only a little from
+///    frame to frame, insertion sort brings them back in order in close to linear time, and the
+///    ends swapping places are exactly where overlaps start and stop.
+/// </summary>
+/// <remarks>
+///   A single set of axes sorts every box against every other, so the ends of objects far apart
+///    still swap places whenever their projections cross, which with y up and a wide flat world
+///    happens all the time along y.  The space is instead cut into a grid of cells over the x-z
+///    plane, hashed into a fixed number of buckets, and each bucket sorts only the boxes over its
+///    cells.  A box over several buckets is sorted in each; an overlap found in any of them is
+///    only recorded once.
+/// <para>
+///   Each proxy carries the IIntersectionObject::Info of its object.  After Update, an object
+///    implementing IIntersectionObject returns GetIntersections for its proxy from its own
+///    GetIntersections, and the objects listed by GetChanged post
+///    System::Changes::POI::Intersection.
+/// </para>
+/// <para>
+///   Proxies added to a bucket, such as when a scene loads or when an object moves into new
+///    cells, are sorted separately and merged in, and only their overlaps are searched for with a
+///    sweep.
+/// </para>
+/// </remarks>
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class SweepAndPrune
+{
+public:
+
+    typedef u32 Handle;
+    static const Handle InvalidHandle = static_cast<Handle>(-1);
+
+    /// <summary>
+    ///   A pair of proxies whose boxes overlap, the lower handle first.
+    /// </summary>
+    struct Pair
+    {
+        Handle          First;
+        Handle          Second;
+    };
+    typedef std::vector<Pair>       PairArray;
+
+
+    /// <summary>
+    ///   Constructor.
+    /// </summary>
+    /// <param name="CellSize">The side of the grid cells.  A few times the size of a typical
+    ///  object keeps most objects in a single cell while keeping the cells sparse.</param>
+    SweepAndPrune( f32 CellSize=16.0f );
+
+    /// <summary>
+    ///   Destructor.
+    /// </summary>
+    ~SweepAndPrune( void );
+
+    /// <summary>
+    ///   Adds a proxy for an object.  Its overlaps are found by the next Update.
+    /// </summary>
+    /// <param name="Info">The object's information, with its box in AABBMin and AABBMax.  The
+    ///  name is not copied so it must stay valid until the proxy is removed.</param>
+    /// <returns>A handle to the proxy.</returns>
+    Handle Add( const IIntersectionObject::Info& Info );
+
+    /// <summary>
+    ///   Updates the information and box of a proxy.
+    /// </summary>
+    /// <param name="Proxy">The proxy.</param>
+    /// <param name="Info">The object's information.</param>
+    void Set( Handle Proxy, const IIntersectionObject::Info& Info );
+
+    /// <summary>
+    ///   Removes a proxy.  Its overlaps end right away; the handle is reused after the next
+    ///    Update.
+    /// </summary>
+    /// <param name="Proxy">The proxy.</param>
+    void Remove( Handle Proxy );
+
+    /// <summary>
+    ///   Brings the overlaps up to date with the proxies added, set and removed since the last
+    ///    call.
+    /// </summary>
+    void Update( void );
+
+    /// <summary>
+    ///   Gets the overlapping pairs found by the last Update.
+    /// </summary>
+    /// <returns>The pairs, sorted by first then second handle.</returns>
+    const PairArray& GetPairs( void ) const
+    {
+        return m_aPairs;
+    }
+
+    /// <summary>
+    ///   Gets the proxies whose intersections changed in the last Update, either because an
+    ///    overlap started or stopped or because an object they overlap was set.
+    /// </summary>
+    /// <returns>The proxies, in no particular order.</returns>
+    const std::vector<Handle>& GetChanged( void ) const
+    {
+        return m_aChanged;
+    }
+
+    /// <summary>
+    ///   Gets the objects a proxy overlapped as of the last Update.
+    /// </summary>
+    /// <param name="Proxy">The proxy.</param>
+    /// <returns>The information of the objects overlapping it.</returns>
+    const IIntersectionObject::InfoArray& GetIntersections( Handle Proxy ) const;
+
+
+protected:
+
+    static const u32 sm_BucketCount = 4096;             // A power of 2
+
+    // An end of a box along an axis; Data is the proxy shifted left once, ored with 1 for a
+    //  maximum
+    struct EndPoint
+    {
+        f32             Value;
+        u32             Data;
+    };
+
+    // Boxes are kept apart from the proxies so that the overlap tests of a sort stay in cache
+    struct Box
+    {
+        f32             aMin[ 3 ];
+        f32             aMax[ 3 ];
+        u32             Partners;   // The size of the proxy's partner list
+        u32             Pad;
+    };
+
+    struct Proxy
+    {
+        IIntersectionObject::Info           Info;
+        i32                                 aCells[ 4 ];    // Lowest x and z cell, then highest
+        std::vector<u32>                    aBuckets;       // Sorted
+        std::vector<Handle>                 aPartners;
+        IIntersectionObject::InfoArray      aIntersections;
+        u32                                 Active;         // Index in a sweep's active list
+        Bool                                bUsed;
+        Bool                                bAdded;         // Not yet in any bucket
+        Bool                                bNew;           // Added to the bucket being updated
+        Bool                                bMoved;
+        Bool                                bChanged;
+    };
+
+    // The box ends of the proxies over the cells hashed to a bucket, sorted as of the last Update
+    //  except for those of the proxies added since, which are appended
+    struct Bucket
+    {
+        std::vector<EndPoint>               aAxes[ 3 ];
+        std::vector<Handle>                 aAdded;
+        std::vector<Handle>                 aLeft;
+        Bool                                bDirty;
+    };
+
+    static Bool IsBefore( const EndPoint& a, const EndPoint& b );
+    static Bool IsPairBefore( const Pair& a, const Pair& b );
+
+    void SetBox( Handle Proxy, const IIntersectionObject::Info& Info );
+    void GetCells( Handle Proxy, i32* aCells ) const;
+    void Rebucket( Handle Proxy );
+    void Join( u32 Bucket, Handle Proxy );
+    void Leave( u32 Bucket, Handle Proxy );
+    void MarkDirty( u32 Bucket );
+
+    void UpdateBucket( u32 Bucket );
+    void Sort( std::vector<EndPoint>& Ends, u32 Count );
+    void Merge( std::vector<EndPoint>& Ends, u32 Count );
+    void Sweep( const std::vector<EndPoint>& Ends );
+
+    Bool Overlaps( Handle a, Handle b ) const;
+    void AddPair( Handle a, Handle b );
+    void RemovePair( Handle a, Handle b );
+    void MarkChanged( Handle Changed );
+
+    f32                             m_InvCellSize;
+
+    std::vector<Proxy>              m_aProxies;
+    std::vector<Box>                m_aBoxes;
+    std::vector<Handle>             m_aFreeHandles;
+    std::vector<Handle>             m_aRemoved;
+    std::vector<Handle>             m_aAdded;
+    std::vector<Handle>             m_aMoved;
+
+    // The buckets, the buckets to update and the proxies that left a bucket in this Update
+    std::vector<Bucket>             m_aBuckets;
+    std::vector<u32>                m_aDirty;
+    std::vector<Handle>             m_aRebucketed;
+
+    // The results of the last Update, and the proxies changed since
+    PairArray                       m_aPairs;
+    std::vector<Handle>             m_aChanged;
+    std::vector<Handle>             m_aChanging;
+};
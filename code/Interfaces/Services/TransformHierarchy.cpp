@@ -0,0 +1,565 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#include <xmmintrin.h>
+#include <algorithm>
+
+#include "TransformHierarchy.h"
+
+
+const u32 TransformHierarchy::sm_None;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Compose - Computes a world transform from the local transform and the parent's world
+//  transform, a row of the result at a time
+static inline void
+Compose(
+    const f32* pLocal,
+    const f32* pParent,
+    f32* pWorld
+    )
+{
+    __m128 Parent0 = _mm_loadu_ps( pParent );
+    __m128 Parent1 = _mm_loadu_ps( pParent + 4 );
+    __m128 Parent2 = _mm_loadu_ps( pParent + 8 );
+    __m128 Parent3 = _mm_loadu_ps( pParent + 12 );
+
+    for ( u32 Row=0; Row < 16; Row += 4 )
+    {
+        __m128 Sum = _mm_add_ps(
+            _mm_add_ps( _mm_mul_ps( _mm_set1_ps( pLocal[ Row ] ), Parent0 ),
+                        _mm_mul_ps( _mm_set1_ps( pLocal[ Row + 1 ] ), Parent1 ) ),
+            _mm_add_ps( _mm_mul_ps( _mm_set1_ps( pLocal[ Row + 2 ] ), Parent2 ),
+                        _mm_mul_ps( _mm_set1_ps( pLocal[ Row + 3 ] ), Parent3 ) ) );
+
+        _mm_storeu_ps( pWorld + Row, Sum );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// TransformHierarchy - Starts with no objects
+TransformHierarchy::TransformHierarchy(
+    void
+    )
+    : m_bRelink( False )
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ~TransformHierarchy
+TransformHierarchy::~TransformHierarchy(
+    void
+    )
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ChangeOccurred - Marks a changed object, or drops one shutting down
+Error
+TransformHierarchy::ChangeOccurred(
+    ISubject* pSubject,
+    System::Changes::BitMask ChangeType
+    )
+{
+    if ( ChangeType == 0 )
+    {
+        //
+        // CSubject calls this from its destructor, when the object can no longer be cast to
+        //  IGeometryObject, so drop it by subject.
+        //
+        Queue( NULL, pSubject, NULL, NULL, Queued::e_Remove );
+    }
+    else if ( ChangeType & System::Changes::Geometry::All )
+    {
+        IGeometryObject* pObject = dynamic_cast<IGeometryObject*>(pSubject);
+        if ( pObject != NULL )
+        {
+            Queue( pObject, pSubject, NULL, NULL, Queued::e_Local );
+        }
+    }
+
+    return Errors::Success;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SetParent - Queues a link
+void
+TransformHierarchy::SetParent(
+    IGeometryObject* pObject,
+    IGeometryObject* pParent
+    )
+{
+    ASSERT( pObject != NULL );
+    ASSERT( pObject != pParent );
+
+    Queue( pObject, dynamic_cast<ISubject*>(pObject), pParent,
+           pParent != NULL ? dynamic_cast<ISubject*>(pParent) : NULL, Queued::e_Parent );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// RemoveObject - Queues an object to be dropped
+void
+TransformHierarchy::RemoveObject(
+    IGeometryObject* pObject
+    )
+{
+    Queue( pObject, dynamic_cast<ISubject*>(pObject), NULL, NULL, Queued::e_Remove );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Update - Applies the queued changes and recomputes the changed world transforms
+void
+TransformHierarchy::Update(
+    ITaskManager* pTaskManager,
+    ISystemTask* pSystemTask
+    )
+{
+    m_apChanged.clear();
+
+    {
+        SCOPED_SPIN_LOCK( m_QueueMutex );
+        m_aApplying.swap( m_aQueued );
+    }
+
+    if ( m_aApplying.empty() )
+    {
+        return;
+    }
+
+    PROFILE_ZONE( "TransformHierarchy::Update" );
+
+    //
+    // Apply the changes in the order they were queued.
+    //
+    for ( size_t i=0; i < m_aApplying.size(); i++ )
+    {
+        const Queued& Change = m_aApplying[ i ];
+        IGeometryObject* pObject = Change.pObject;
+
+        if ( pObject == NULL )
+        {
+            std::map<ISubject*, IGeometryObject*>::iterator itSubject =
+                m_SubjectObjects.find( Change.pSubject );
+            if ( itSubject != m_SubjectObjects.end() )
+            {
+                pObject = itSubject->second;
+            }
+        }
+
+        std::map<IGeometryObject*, u32>::iterator it = m_NodeIndex.find( pObject );
+
+        switch ( Change.Change )
+        {
+        case Queued::e_Local:
+            if ( it != m_NodeIndex.end() )
+            {
+                m_aDirty[ it->second ] = 1;
+            }
+            break;
+
+        case Queued::e_Parent:
+            if ( Change.pObject != Change.pParent )
+            {
+                u32 Node = Add( Change.pObject, Change.pSubject );
+                if ( Change.pParent != NULL )
+                {
+                    Add( Change.pParent, Change.pParentSubject );
+                }
+
+                if ( m_apParentObjects[ Node ] != Change.pParent )
+                {
+                    m_apParentObjects[ Node ] = Change.pParent;
+                    m_aDirty[ Node ] = 1;
+                    m_bRelink = True;
+                }
+            }
+            break;
+
+        case Queued::e_Remove:
+            if ( it != m_NodeIndex.end() )
+            {
+                m_apObjects[ it->second ] = NULL;
+                m_NodeIndex.erase( it );
+                m_SubjectObjects.erase( Change.pSubject );
+                m_bRelink = True;
+            }
+            break;
+        }
+    }
+    m_aApplying.clear();
+
+    if ( m_bRelink )
+    {
+        Relink();
+    }
+
+    u32 Count = static_cast<u32>(m_apObjects.size());
+
+    for ( u32 i=0; i < Count; i++ )
+    {
+        if ( m_aDirty[ i ] )
+        {
+            ReadLocal( i );
+        }
+    }
+
+    //
+    // Recompute a level at a time; a node is dirty if it or its parent is.
+    //
+    for ( size_t Level=0; Level + 1 < m_aLevelStart.size(); Level++ )
+    {
+        u32 Begin = m_aLevelStart[ Level ];
+        u32 End = m_aLevelStart[ Level + 1 ];
+
+        if ( pTaskManager != NULL && End - Begin > sm_MinNodesPerJob )
+        {
+            pTaskManager->ParallelFor( pSystemTask, UpdateRange, this, Begin, End,
+                                       sm_MinNodesPerJob );
+        }
+        else
+        {
+            UpdateRange( this, Begin, End );
+        }
+    }
+
+    for ( u32 i=0; i < Count; i++ )
+    {
+        if ( m_aDirty[ i ] )
+        {
+            m_apChanged.push_back( m_apObjects[ i ] );
+            m_aDirty[ i ] = 0;
+        }
+    }
+
+    if ( !m_apChanged.empty() )
+    {
+        PostChanges( System::Changes::Geometry::Position | System::Changes::Geometry::Orientation );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// UpdateRange - Recomputes the dirty nodes of a range of a level, called by ParallelFor
+void
+TransformHierarchy::UpdateRange(
+    void* pParam,
+    u32 Begin,
+    u32 End
+    )
+{
+    TransformHierarchy* pHierarchy = reinterpret_cast<TransformHierarchy*>(pParam);
+
+    for ( u32 i=Begin; i < End; i++ )
+    {
+        u32 Parent = pHierarchy->m_aParents[ i ];
+
+        if ( Parent == sm_None )
+        {
+            if ( pHierarchy->m_aDirty[ i ] )
+            {
+                pHierarchy->m_aWorld[ i ] = pHierarchy->m_aLocal[ i ];
+            }
+        }
+        else if ( pHierarchy->m_aDirty[ i ] || pHierarchy->m_aDirty[ Parent ] )
+        {
+            pHierarchy->m_aDirty[ i ] = 1;
+            Compose( pHierarchy->m_aLocal[ i ].m, pHierarchy->m_aWorld[ Parent ].m,
+                     pHierarchy->m_aWorld[ i ].m );
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetWorldTransform - Gets an object's cached world transform
+const Math::Matrix4x4*
+TransformHierarchy::GetWorldTransform(
+    IGeometryObject* pObject
+    ) const
+{
+    std::map<IGeometryObject*, u32>::const_iterator it = m_NodeIndex.find( pObject );
+
+    return it != m_NodeIndex.end() ? &m_aWorld[ it->second ] : NULL;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetParent - Gets an object's parent
+IGeometryObject*
+TransformHierarchy::GetParent(
+    IGeometryObject* pObject
+    ) const
+{
+    std::map<IGeometryObject*, u32>::const_iterator it = m_NodeIndex.find( pObject );
+
+    return it != m_NodeIndex.end() ? m_apParentObjects[ it->second ] : NULL;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Queue - Appends a change for the next Update
+void
+TransformHierarchy::Queue(
+    IGeometryObject* pObject,
+    ISubject* pSubject,
+    IGeometryObject* pParent,
+    ISubject* pParentSubject,
+    Queued::Type Change
+    )
+{
+    Queued Entry;
+    Entry.pObject = pObject;
+    Entry.pSubject = pSubject;
+    Entry.pParent = pParent;
+    Entry.pParentSubject = pParentSubject;
+    Entry.Change = Change;
+
+    SCOPED_SPIN_LOCK( m_QueueMutex );
+    m_aQueued.push_back( Entry );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Add - Gets an object's node, appending a root for it if it has none
+u32
+TransformHierarchy::Add(
+    IGeometryObject* pObject,
+    ISubject* pSubject
+    )
+{
+    std::map<IGeometryObject*, u32>::iterator it = m_NodeIndex.find( pObject );
+
+    if ( it != m_NodeIndex.end() )
+    {
+        return it->second;
+    }
+
+    u32 Node = static_cast<u32>(m_apObjects.size());
+
+    m_apObjects.push_back( pObject );
+    m_apParentObjects.push_back( NULL );
+    m_aParents.push_back( sm_None );
+    m_aLocal.push_back( Math::Matrix4x4::Identity );
+    m_aWorld.push_back( Math::Matrix4x4::Identity );
+    m_aDirty.push_back( 1 );
+    m_NodeIndex[ pObject ] = Node;
+    if ( pSubject != NULL )
+    {
+        m_SubjectObjects[ pSubject ] = pObject;
+    }
+    m_bRelink = True;
+
+    return Node;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ReadLocal - Reads an object's local transform, scaled, rotated then translated
+void
+TransformHierarchy::ReadLocal(
+    u32 Node
+    )
+{
+    IGeometryObject* pObject = m_apObjects[ Node ];
+    Math::Matrix4x4& Local = m_aLocal[ Node ];
+
+    Local.Transformation( *pObject->GetPosition(), *pObject->GetOrientation() );
+
+    const Math::Vector3& Scale = *pObject->GetScale();
+    for ( u32 i=0; i < 3; i++ )
+    {
+        Local.m[ i ] *= Scale.x;
+        Local.m[ 4 + i ] *= Scale.y;
+        Local.m[ 8 + i ] *= Scale.z;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Relink - Drops the removed nodes and sorts the rest breadth first
+void
+TransformHierarchy::Relink(
+    void
+    )
+{
+    m_bRelink = False;
+
+    u32 Count = static_cast<u32>(m_apObjects.size());
+
+    //
+    // Find the parent of each node; the children of removed nodes become roots.
+    //
+    std::vector<u32> aParents( Count, sm_None );
+    std::vector<u32> aFirstChild( Count + 1, 0 );
+
+    for ( u32 i=0; i < Count; i++ )
+    {
+        if ( m_apObjects[ i ] == NULL || m_apParentObjects[ i ] == NULL )
+        {
+            continue;
+        }
+
+        std::map<IGeometryObject*, u32>::iterator it = m_NodeIndex.find( m_apParentObjects[ i ] );
+        if ( it != m_NodeIndex.end() )
+        {
+            aParents[ i ] = it->second;
+            aFirstChild[ it->second + 1 ]++;
+        }
+        else
+        {
+            m_apParentObjects[ i ] = NULL;
+            m_aDirty[ i ] = 1;
+        }
+    }
+
+    for ( u32 i=0; i < Count; i++ )
+    {
+        aFirstChild[ i + 1 ] += aFirstChild[ i ];
+    }
+
+    std::vector<u32> aChildren( aFirstChild[ Count ] );
+    std::vector<u32> aNext( aFirstChild.begin(), aFirstChild.end() - 1 );
+
+    for ( u32 i=0; i < Count; i++ )
+    {
+        if ( aParents[ i ] != sm_None )
+        {
+            aChildren[ aNext[ aParents[ i ] ]++ ] = i;
+        }
+    }
+
+    //
+    // Walk the nodes breadth first from the roots.  Nodes linked in a cycle, and those below
+    //  them, are never reached from a root; the parents of a node left over lead up to a cycle,
+    //  and the node of it they lead to is made a root.
+    //
+    std::vector<u32> aOrder;
+    std::vector<u32> aDepths( Count, sm_None );
+    std::vector<u32> aWalkedUp( Count, sm_None );
+    u32 MaxDepth = 0;
+
+    aOrder.reserve( Count );
+
+    for ( u32 Pass=0; Pass < 2; Pass++ )
+    {
+        for ( u32 Start=0; Start < Count; Start++ )
+        {
+            if ( m_apObjects[ Start ] == NULL || aDepths[ Start ] != sm_None ||
+                 (Pass == 0 && aParents[ Start ] != sm_None) )
+            {
+                continue;
+            }
+
+            u32 Root = Start;
+
+            if ( aParents[ Start ] != sm_None )
+            {
+                ASSERTMSG( False, "Transform hierarchy has a cycle." );
+
+                while ( aWalkedUp[ Root ] != Start )
+                {
+                    aWalkedUp[ Root ] = Start;
+                    Root = aParents[ Root ];
+                }
+
+                aParents[ Root ] = sm_None;
+                m_apParentObjects[ Root ] = NULL;
+                m_aDirty[ Root ] = 1;
+            }
+
+            size_t Walked = aOrder.size();
+            aOrder.push_back( Root );
+            aDepths[ Root ] = 0;
+
+            for ( ; Walked < aOrder.size(); Walked++ )
+            {
+                u32 Node = aOrder[ Walked ];
+
+                for ( u32 c=aFirstChild[ Node ]; c < aFirstChild[ Node + 1 ]; c++ )
+                {
+                    u32 Child = aChildren[ c ];
+                    if ( aDepths[ Child ] == sm_None )
+                    {
+                        aDepths[ Child ] = aDepths[ Node ] + 1;
+                        MaxDepth = std::max( MaxDepth, aDepths[ Child ] );
+                        aOrder.push_back( Child );
+                    }
+                }
+            }
+        }
+    }
+
+    //
+    // Sort by depth, keeping the walk order within a level, and move the nodes there.
+    //
+    u32 Live = static_cast<u32>(aOrder.size());
+    m_aLevelStart.assign( MaxDepth + 2, 0 );
+
+    for ( u32 i=0; i < Live; i++ )
+    {
+        m_aLevelStart[ aDepths[ aOrder[ i ] ] + 1 ]++;
+    }
+    for ( u32 Level=0; Level <= MaxDepth; Level++ )
+    {
+        m_aLevelStart[ Level + 1 ] += m_aLevelStart[ Level ];
+    }
+    if ( Live == 0 )
+    {
+        m_aLevelStart.clear();
+    }
+
+    std::vector<u32> aNewIndex( Count, sm_None );
+    std::vector<u32> aFill( m_aLevelStart.begin(), m_aLevelStart.end() );
+
+    for ( u32 i=0; i < Live; i++ )
+    {
+        u32 Node = aOrder[ i ];
+        aNewIndex[ Node ] = aFill[ aDepths[ Node ] ]++;
+    }
+
+    ObjectArray apObjects( Live );
+    ObjectArray apParentObjects( Live );
+    std::vector<u32> aNewParents( Live );
+    std::vector<Math::Matrix4x4> aLocal( Live );
+    std::vector<Math::Matrix4x4> aWorld( Live );
+    std::vector<u8> aDirty( Live );
+
+    for ( u32 i=0; i < Live; i++ )
+    {
+        u32 Node = aOrder[ i ];
+        u32 New = aNewIndex[ Node ];
+
+        apObjects[ New ] = m_apObjects[ Node ];
+        apParentObjects[ New ] = m_apParentObjects[ Node ];
+        aNewParents[ New ] = aParents[ Node ] != sm_None ? aNewIndex[ aParents[ Node ] ] : sm_None;
+        aLocal[ New ] = m_aLocal[ Node ];
+        aWorld[ New ] = m_aWorld[ Node ];
+        aDirty[ New ] = m_aDirty[ Node ];
+        m_NodeIndex[ apObjects[ New ] ] = New;
+    }
+
+    m_apObjects.swap( apObjects );
+    m_apParentObjects.swap( apParentObjects );
+    m_aParents.swap( aNewParents );
+    m_aLocal.swap( aLocal );
+    m_aWorld.swap( aWorld );
+    m_aDirty.swap( aDirty );
+}
@@ -0,0 +1,188 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#pragma once
+
+//
+// core includes
+//
+#include "../../BaseTypes/BaseTypes.h"
+#include "../../BaseTypes/TbbSpinMutex.h"
+#include "../Interface.h"
+#include <map>
+#include <vector>
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// <summary>
+///   Parent-child links between geometry objects, keeping the world transform of every object
+///    from the local position, orientation and scale the objects expose.
+/// </summary>
+/// <remarks>
+///   The objects are stored breadth first in flat arrays, so that the parents of the objects of
+///    a level are all in the levels before it.  Update recomputes the levels in order, each in
+///    parallel, and only for the objects whose local transform changed and those below them; the
+///    world transforms of the others are kept from the last Update.
+/// <para>
+///   The hierarchy observes the objects for System::Changes::Geometry changes.  A change only
+///    marks the object; Update, called once a frame by the system owning the hierarchy, reads the
+///    local transforms of the marked objects.  The links are set with SetParent, such as by the
+///    system handling System::Changes::ParentLink, and also take effect with the next Update.
+///    An object going away is dropped by its subject, since CSubject tells the hierarchy from its
+///    own destructor, when the object can no longer be cast to IGeometryObject.
+/// </para>
+/// <para>
+///   Update posts System::Changes::Geometry::Position and Orientation to the observers of the
+///    hierarchy if any world transform changed; GetChangedObjects lists the objects whose world
+///    transform did.
+/// </para>
+/// </remarks>
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class TransformHierarchy : public IObserver, public CSubject
+{
+public:
+
+    typedef std::vector<IGeometryObject*>   ObjectArray;
+
+
+    /// <summary>
+    ///   Constructor.
+    /// </summary>
+    TransformHierarchy( void );
+
+    /// <summary>
+    ///   Destructor.
+    /// </summary>
+    virtual ~TransformHierarchy( void );
+
+    /// <summary cref="IObserver::ChangeOccurred">
+    ///   Marks an object's local transform to be read by the next Update.  Safe to call from any
+    ///    thread.
+    /// </summary>
+    /// <param name="pSubject">The object's subject; subjects not implementing IGeometryObject are
+    ///  ignored.</param>
+    /// <param name="ChangeType">System::Changes::Geometry changes, or 0 if the object is going
+    ///  away.</param>
+    /// <returns>Errors::Success.</returns>
+    virtual Error ChangeOccurred( ISubject* pSubject, System::Changes::BitMask ChangeType );
+
+    /// <summary>
+    ///   Links an object to a parent for the next Update, adding either to the hierarchy if it is
+    ///    not in it yet.  Safe to call from any thread.
+    /// </summary>
+    /// <param name="pObject">The object, which must also be an ISubject to be dropped when it goes
+    ///  away.</param>
+    /// <param name="pParent">The parent, or NULL to make the object a root.</param>
+    void SetParent( IGeometryObject* pObject, IGeometryObject* pParent );
+
+    /// <summary>
+    ///   Drops an object with the next Update; its children become roots.  Safe to call from any
+    ///    thread.
+    /// </summary>
+    /// <param name="pObject">The object.</param>
+    void RemoveObject( IGeometryObject* pObject );
+
+    /// <summary>
+    ///   Applies the links and local transforms changed since the last call and recomputes the
+    ///    world transforms they affect.  Not safe to call while world transforms are read.
+    /// </summary>
+    /// <param name="pTaskManager">Task manager to recompute each level in parallel with, or NULL
+    ///  to recompute on the calling thread.</param>
+    /// <param name="pSystemTask">The task calling, passed on to ITaskManager::ParallelFor.</param>
+    void Update( ITaskManager* pTaskManager=NULL, ISystemTask* pSystemTask=NULL );
+
+    /// <summary>
+    ///   Gets the world transform of an object as of the last Update.
+    /// </summary>
+    /// <param name="pObject">The object.</param>
+    /// <returns>The transform, or NULL if the object is not in the hierarchy.</returns>
+    const Math::Matrix4x4* GetWorldTransform( IGeometryObject* pObject ) const;
+
+    /// <summary>
+    ///   Gets the parent of an object as of the last Update.
+    /// </summary>
+    /// <param name="pObject">The object.</param>
+    /// <returns>The parent, or NULL if the object is a root or not in the hierarchy.</returns>
+    IGeometryObject* GetParent( IGeometryObject* pObject ) const;
+
+    /// <summary>
+    ///   Gets the objects whose world transform changed in the last Update, parents before their
+    ///    children.
+    /// </summary>
+    const ObjectArray& GetChangedObjects( void ) const
+    {
+        return m_apChanged;
+    }
+
+    /// <summary cref="ISubject::GetPotentialSystemChanges">
+    ///   Gets the changes the hierarchy posts.
+    /// </summary>
+    /// <returns>System::Changes::Geometry::Position and Orientation.</returns>
+    virtual System::Changes::BitMask GetPotentialSystemChanges( void )
+    {
+        return System::Changes::Geometry::Position | System::Changes::Geometry::Orientation;
+    }
+
+
+protected:
+
+    static const u32 sm_None = static_cast<u32>(-1);
+    static const u32 sm_MinNodesPerJob = 256;
+
+    // A change queued for Update
+    struct Queued
+    {
+        enum Type
+        {
+            e_Local,
+            e_Parent,
+            e_Remove,
+        };
+
+        // The subjects are found when queued, as the objects may be gone by Update; a removal
+        //  queued by a subject going away only has pSubject
+        IGeometryObject*    pObject;
+        ISubject*           pSubject;
+        IGeometryObject*    pParent;
+        ISubject*           pParentSubject;
+        Type                Change;
+    };
+
+    void Queue( IGeometryObject* pObject, ISubject* pSubject, IGeometryObject* pParent,
+                ISubject* pParentSubject, Queued::Type Change );
+    u32 Add( IGeometryObject* pObject, ISubject* pSubject );
+    void ReadLocal( u32 Node );
+    void Relink( void );
+
+    static void UpdateRange( void* pParam, u32 Begin, u32 End );
+
+    // The nodes, breadth first; the nodes of level l are m_aLevelStart[ l ] up to the next start
+    ObjectArray                     m_apObjects;
+    ObjectArray                     m_apParentObjects;
+    std::vector<u32>                m_aParents;
+    std::vector<Math::Matrix4x4>    m_aLocal;
+    std::vector<Math::Matrix4x4>    m_aWorld;
+    std::vector<u8>                 m_aDirty;
+    std::vector<u32>                m_aLevelStart;
+    std::map<IGeometryObject*, u32> m_NodeIndex;
+    std::map<ISubject*, IGeometryObject*> m_SubjectObjects;
+    Bool                            m_bRelink;
+
+    ObjectArray                     m_apChanged;
+
+    DEFINE_SPIN_MUTEX( m_QueueMutex );
+    std::vector<Queued>             m_aQueued;
+    std::vector<Queued>             m_aApplying;
+};
@@ -0,0 +1,493 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#include <string.h>
+#include <emmintrin.h>
+#include <algorithm>
+
+#include "VertexLayout.h"
+
+
+const u32 VertexConverter::sm_BatchSize;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// IsFloatType - Checks if a vertex element type is made of floats
+static inline Bool
+IsFloatType(
+    u32 Type
+    )
+{
+    return Type >= VertexDecl::Type::Float1 && Type <= VertexDecl::Type::Float4;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// IsSigned - Checks if a usage holds directions, packed from -1 to 1 rather than 0 to 1
+static inline Bool
+IsSigned(
+    u32 Usage
+    )
+{
+    return Usage == VertexDecl::Usage::Normal || Usage == VertexDecl::Usage::Tangent;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CopyElement - Copies an element, with constant sizes for the common ones so that the copy is
+//  inlined
+static inline void
+CopyElement(
+    u8* pDest,
+    const u8* pSource,
+    u32 Size
+    )
+{
+    switch ( Size )
+    {
+    case 4:  memcpy( pDest, pSource, 4 ); break;
+    case 8:  memcpy( pDest, pSource, 8 ); break;
+    case 12: memcpy( pDest, pSource, 12 ); break;
+    case 16: memcpy( pDest, pSource, 16 ); break;
+    default: memcpy( pDest, pSource, Size ); break;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// LoadComponents - Loads the floats of an element, the missing ones as 0 and w as 1
+static inline __m128
+LoadComponents(
+    const u8* pSource,
+    u32 Components
+    )
+{
+    const f32* pValues = reinterpret_cast<const f32*>(pSource);
+    const __m128 ZeroOne = _mm_set_ps( 0.0f, 0.0f, 1.0f, 0.0f );
+
+    switch ( Components )
+    {
+    case 1:
+        return _mm_movelh_ps( _mm_load_ss( pValues ), ZeroOne );
+    case 2:
+        return _mm_movelh_ps( _mm_loadl_pi( _mm_setzero_ps(),
+                                            reinterpret_cast<const __m64*>(pValues) ),
+                              ZeroOne );
+    case 3:
+        return _mm_movelh_ps( _mm_loadl_pi( _mm_setzero_ps(),
+                                            reinterpret_cast<const __m64*>(pValues) ),
+                              _mm_unpacklo_ps( _mm_load_ss( pValues + 2 ), _mm_set_ss( 1.0f ) ) );
+    default:
+        return _mm_loadu_ps( pValues );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// VertexLayout - Computes the offsets, strides, usage table and hash of a declaration
+VertexLayout::VertexLayout(
+    const VertexDecl::Element* pElements,
+    u32 cElements
+    )
+    : m_aElements( pElements, pElements + cElements )
+    , m_aOffsets( cElements )
+    , m_Hash( 2166136261u )
+{
+    ASSERT( cElements < sm_NoElement );
+
+    memset( m_aStrides, 0, sizeof m_aStrides );
+    memset( m_aaUsageElements, sm_NoElement, sizeof m_aaUsageElements );
+
+    u32 aUsageCounts[ MaxUsages ] = { 0 };
+
+    for ( u32 i=0; i < cElements; i++ )
+    {
+        const VertexDecl::Element& Element = pElements[ i ];
+        ASSERT( Element.StreamIndex < MaxStreams );
+
+        m_aOffsets[ i ] = m_aStrides[ Element.StreamIndex ];
+        m_aStrides[ Element.StreamIndex ] += GetTypeSize( Element.Type );
+
+        //
+        // Elements are found by their usage and the order they have among the elements of the
+        //  usage, as VertexDecl::FindUsageInStream does.
+        //
+        if ( Element.Usage < MaxUsages )
+        {
+            u32 UsageIndex = aUsageCounts[ Element.Usage ]++;
+            if ( UsageIndex < MaxUsageIndices )
+            {
+                m_aaUsageElements[ Element.Usage ][ UsageIndex ] = static_cast<u8>(i);
+            }
+        }
+
+        const u32 aFields[] = { Element.Type, Element.Usage, Element.UsageIndex,
+                                Element.StreamIndex };
+        for ( u32 f=0; f < 4; f++ )
+        {
+            m_Hash = (m_Hash ^ aFields[ f ]) * 16777619u;
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// operator== - Compares the elements
+Bool
+VertexLayout::operator==(
+    const VertexLayout& Other
+    ) const
+{
+    if ( m_Hash != Other.m_Hash || m_aElements.size() != Other.m_aElements.size() )
+    {
+        return False;
+    }
+
+    for ( size_t i=0; i < m_aElements.size(); i++ )
+    {
+        const VertexDecl::Element& a = m_aElements[ i ];
+        const VertexDecl::Element& b = Other.m_aElements[ i ];
+
+        if ( a.Type != b.Type || a.Usage != b.Usage || a.UsageIndex != b.UsageIndex ||
+             a.StreamIndex != b.StreamIndex )
+        {
+            return False;
+        }
+    }
+
+    return True;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetTypeSize - Gets the size of a vertex element type
+u32
+VertexLayout::GetTypeSize(
+    u32 Type
+    )
+{
+    switch ( Type )
+    {
+    case VertexDecl::Type::Color:  return sizeof (u32);
+    case VertexDecl::Type::Float1: return sizeof (f32);
+    case VertexDecl::Type::Float2: return sizeof (f32) * 2;
+    case VertexDecl::Type::Float3: return sizeof (f32) * 3;
+    case VertexDecl::Type::Float4: return sizeof (f32) * 4;
+    case VertexDecl::Type::UByte4: return sizeof (u8) * 4;
+    default: ASSERT( False ); return 0;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// VertexConverter - Compiles the operations turning a source vertex into a destination one
+VertexConverter::VertexConverter(
+    const VertexLayout& Dest,
+    u32 DestStream,
+    const VertexLayout& Source,
+    u32 SourceStream
+    )
+    : m_DestStride( Dest.GetStride( DestStream ) )
+    , m_SourceStride( Source.GetStride( SourceStream ) )
+    , m_bCopy( False )
+{
+    u32 aUsageCounts[ VertexLayout::MaxUsages ] = { 0 };
+
+    for ( u32 i=0; i < Dest.GetElementCount(); i++ )
+    {
+        const VertexDecl::Element& To = Dest.GetElement( i );
+
+        u32 UsageIndex = To.Usage < VertexLayout::MaxUsages ? aUsageCounts[ To.Usage ]++ :
+                                                              VertexLayout::None;
+        if ( To.StreamIndex != DestStream )
+        {
+            continue;
+        }
+
+        u32 From = Source.FindElement( To.Usage, UsageIndex );
+        if ( From != VertexLayout::None && Source.GetElement( From ).StreamIndex != SourceStream )
+        {
+            From = VertexLayout::None;
+        }
+
+        Operation Op;
+        Op.DestOffset = Dest.GetOffset( i );
+        Op.DestSize = VertexLayout::GetTypeSize( To.Type );
+        Op.SourceOffset = 0;
+        Op.SourceSize = 0;
+        Op.Scale = 1.0f;
+        Op.Bias = 0.0f;
+        Op.bSwapRB = False;
+
+        u32 FromType = From != VertexLayout::None ? Source.GetElement( From ).Type : To.Type;
+        u32 FromSize = VertexLayout::GetTypeSize( FromType );
+
+        if ( From == VertexLayout::None )
+        {
+            Op.Op = Operation::e_Zero;
+        }
+        else if ( FromType == To.Type || (!IsFloatType( FromType ) && !IsFloatType( To.Type )) )
+        {
+            Op.Op = Operation::e_Copy;
+            Op.SourceOffset = Source.GetOffset( From );
+        }
+        else if ( IsFloatType( FromType ) && IsFloatType( To.Type ) )
+        {
+            //
+            // The common components are copied, the rest zeroed.
+            //
+            Op.Op = Operation::e_Copy;
+            Op.SourceOffset = Source.GetOffset( From );
+            Op.DestSize = std::min( Op.DestSize, FromSize );
+
+            u32 ZeroSize = VertexLayout::GetTypeSize( To.Type ) - Op.DestSize;
+            if ( ZeroSize > 0 )
+            {
+                Operation Zero = Op;
+                Zero.Op = Operation::e_Zero;
+                Zero.DestOffset = Op.DestOffset + Op.DestSize;
+                Zero.DestSize = ZeroSize;
+
+                m_aOperations.push_back( Op );
+                m_aOperations.push_back( Zero );
+                continue;
+            }
+        }
+        else if ( IsFloatType( FromType ) )
+        {
+            Op.Op = Operation::e_Pack;
+            Op.SourceOffset = Source.GetOffset( From );
+            Op.SourceSize = FromSize / sizeof (f32);
+            Op.Scale = IsSigned( To.Usage ) ? 127.5f : 255.0f;
+            Op.Bias = IsSigned( To.Usage ) ? 127.5f : 0.0f;
+            Op.bSwapRB = To.Type == VertexDecl::Type::Color;
+        }
+        else
+        {
+            Op.Op = Operation::e_Unpack;
+            Op.SourceOffset = Source.GetOffset( From );
+            Op.DestSize = Op.DestSize / sizeof (f32);
+            Op.Scale = IsSigned( To.Usage ) ? 1.0f / 127.5f : 1.0f / 255.0f;
+            Op.Bias = IsSigned( To.Usage ) ? -1.0f : 0.0f;
+            Op.bSwapRB = FromType == VertexDecl::Type::Color;
+        }
+
+        //
+        // Merge with the previous operation if both copy or both zero neighbouring bytes.
+        //
+        if ( !m_aOperations.empty() )
+        {
+            Operation& Last = m_aOperations.back();
+
+            if ( Last.Op == Op.Op && Last.DestOffset + Last.DestSize == Op.DestOffset &&
+                 ((Op.Op == Operation::e_Copy &&
+                   Last.SourceOffset + Last.DestSize == Op.SourceOffset) ||
+                  Op.Op == Operation::e_Zero) )
+            {
+                Last.DestSize += Op.DestSize;
+                continue;
+            }
+        }
+
+        m_aOperations.push_back( Op );
+    }
+
+    m_bCopy = m_aOperations.size() == 1 && m_aOperations[ 0 ].Op == Operation::e_Copy &&
+              m_aOperations[ 0 ].DestOffset == 0 && m_aOperations[ 0 ].SourceOffset == 0 &&
+              m_aOperations[ 0 ].DestSize == m_DestStride && m_DestStride == m_SourceStride;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Convert - Runs the operations over batches of vertices
+void
+VertexConverter::Convert(
+    void* pDest,
+    const void* pSource,
+    u32 Count
+    ) const
+{
+    u8* pTo = reinterpret_cast<u8*>(pDest);
+    const u8* pFrom = reinterpret_cast<const u8*>(pSource);
+
+    if ( m_bCopy )
+    {
+        memcpy( pTo, pFrom, static_cast<size_t>(m_DestStride) * Count );
+        return;
+    }
+
+    for ( u32 Start=0; Start < Count; Start += sm_BatchSize )
+    {
+        u32 BatchCount = std::min( sm_BatchSize, Count - Start );
+        u8* pDestBatch = pTo + static_cast<size_t>(Start) * m_DestStride;
+        const u8* pSourceBatch = pFrom + static_cast<size_t>(Start) * m_SourceStride;
+
+        for ( size_t i=0; i < m_aOperations.size(); i++ )
+        {
+            const Operation& Op = m_aOperations[ i ];
+            u8* pOpDest = pDestBatch + Op.DestOffset;
+            const u8* pOpSource = pSourceBatch + Op.SourceOffset;
+
+            switch ( Op.Op )
+            {
+            case Operation::e_Copy:
+                for ( u32 v=0; v < BatchCount; v++ )
+                {
+                    CopyElement( pOpDest + v * m_DestStride, pOpSource + v * m_SourceStride,
+                                 Op.DestSize );
+                }
+                break;
+
+            case Operation::e_Zero:
+                for ( u32 v=0; v < BatchCount; v++ )
+                {
+                    memset( pOpDest + v * m_DestStride, 0, Op.DestSize );
+                }
+                break;
+
+            case Operation::e_Pack:
+                Pack( Op, pOpDest, m_DestStride, pOpSource, m_SourceStride, BatchCount );
+                break;
+
+            case Operation::e_Unpack:
+                Unpack( Op, pOpDest, m_DestStride, pOpSource, m_SourceStride, BatchCount );
+                break;
+            }
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Pack - Packs float elements to bytes, 4 vertices at a time
+void
+VertexConverter::Pack(
+    const Operation& Op,
+    u8* pDest,
+    u32 DestStride,
+    const u8* pSource,
+    u32 SourceStride,
+    u32 Count
+    )
+{
+    const __m128 Scale = _mm_set1_ps( Op.Scale );
+    const __m128 Bias = _mm_set1_ps( Op.Bias );
+    const __m128 Default = _mm_set_ps( 1.0f, 0.0f, 0.0f, 0.0f );
+
+    for ( u32 v=0; v < Count; v += 4 )
+    {
+        u32 Lanes = std::min( 4u, Count - v );
+
+        //
+        // Load a vertex per register, then transpose to a component per register.
+        //
+        __m128 aVertices[ 4 ];
+
+        for ( u32 Lane=0; Lane < 4; Lane++ )
+        {
+            aVertices[ Lane ] = Lane < Lanes ?
+                LoadComponents( pSource + (v + Lane) * SourceStride, Op.SourceSize ) : Default;
+        }
+
+        _MM_TRANSPOSE4_PS( aVertices[ 0 ], aVertices[ 1 ], aVertices[ 2 ], aVertices[ 3 ] );
+
+        __m128i x = _mm_cvtps_epi32( _mm_add_ps( _mm_mul_ps( aVertices[ 0 ], Scale ), Bias ) );
+        __m128i y = _mm_cvtps_epi32( _mm_add_ps( _mm_mul_ps( aVertices[ 1 ], Scale ), Bias ) );
+        __m128i z = _mm_cvtps_epi32( _mm_add_ps( _mm_mul_ps( aVertices[ 2 ], Scale ), Bias ) );
+        __m128i w = _mm_cvtps_epi32( _mm_add_ps( _mm_mul_ps( aVertices[ 3 ], Scale ), Bias ) );
+
+        if ( Op.bSwapRB )
+        {
+            std::swap( x, z );
+        }
+
+        //
+        // Saturate to bytes, [ x0..x3 z0..z3 y0..y3 w0..w3 ], then interleave to a vertex per
+        //  dword, [ x0 y0 z0 w0 ... ].
+        //
+        __m128i Bytes = _mm_packus_epi16( _mm_packs_epi32( x, z ), _mm_packs_epi32( y, w ) );
+        Bytes = _mm_unpacklo_epi8( Bytes, _mm_srli_si128( Bytes, 8 ) );
+        Bytes = _mm_unpacklo_epi16( Bytes, _mm_srli_si128( Bytes, 8 ) );
+
+        u32 aPacked[ 4 ];
+        _mm_storeu_si128( reinterpret_cast<__m128i*>(aPacked), Bytes );
+
+        for ( u32 Lane=0; Lane < Lanes; Lane++ )
+        {
+            memcpy( pDest + (v + Lane) * DestStride, &aPacked[ Lane ], sizeof (u32) );
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Unpack - Unpacks byte elements to floats, 4 vertices at a time
+void
+VertexConverter::Unpack(
+    const Operation& Op,
+    u8* pDest,
+    u32 DestStride,
+    const u8* pSource,
+    u32 SourceStride,
+    u32 Count
+    )
+{
+    const __m128 Scale = _mm_set1_ps( Op.Scale );
+    const __m128 Bias = _mm_set1_ps( Op.Bias );
+    const __m128i Mask = _mm_set1_epi32( 0xFF );
+
+    for ( u32 v=0; v < Count; v += 4 )
+    {
+        u32 Lanes = std::min( 4u, Count - v );
+
+        u32 aPacked[ 4 ] = { 0 };
+        for ( u32 Lane=0; Lane < Lanes; Lane++ )
+        {
+            memcpy( &aPacked[ Lane ], pSource + (v + Lane) * SourceStride, sizeof (u32) );
+        }
+
+        __m128i Bytes = _mm_loadu_si128( reinterpret_cast<const __m128i*>(aPacked) );
+
+        __m128 x = _mm_cvtepi32_ps( _mm_and_si128( Bytes, Mask ) );
+        __m128 y = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( Bytes, 8 ), Mask ) );
+        __m128 z = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( Bytes, 16 ), Mask ) );
+        __m128 w = _mm_cvtepi32_ps( _mm_srli_epi32( Bytes, 24 ) );
+
+        if ( Op.bSwapRB )
+        {
+            std::swap( x, z );
+        }
+
+        x = _mm_add_ps( _mm_mul_ps( x, Scale ), Bias );
+        y = _mm_add_ps( _mm_mul_ps( y, Scale ), Bias );
+        z = _mm_add_ps( _mm_mul_ps( z, Scale ), Bias );
+        w = _mm_add_ps( _mm_mul_ps( w, Scale ), Bias );
+
+        // A vertex per register
+        _MM_TRANSPOSE4_PS( x, y, z, w );
+
+        f32 aaVertices[ 4 ][ 4 ];
+        _mm_storeu_ps( aaVertices[ 0 ], x );
+        _mm_storeu_ps( aaVertices[ 1 ], y );
+        _mm_storeu_ps( aaVertices[ 2 ], z );
+        _mm_storeu_ps( aaVertices[ 3 ], w );
+
+        for ( u32 Lane=0; Lane < Lanes; Lane++ )
+        {
+            CopyElement( pDest + (v + Lane) * DestStride,
+                         reinterpret_cast<const u8*>(aaVertices[ Lane ]),
+                         Op.DestSize * sizeof (f32) );
+        }
+    }
+}
@@ -0,0 +1,249 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#pragma once
+
+//
+// core includes
+//
+#include "../../BaseTypes/BaseTypes.h"
+#include "../Interface.h"
+#include <vector>
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// <summary>
+///   A vertex declaration compiled once, answering the questions VertexDecl::CalculateSize,
+///    CalculateUsageOffsetInVertex and FindUsageInStream answer by scanning the elements, with a
+///    table lookup.
+/// </summary>
+/// <remarks>
+///   A layout does not change once built.  Layouts built from the same elements have the same
+///    hash and compare equal, so that the objects sharing a declaration can share what is built
+///    from it, such as a VertexConverter.
+/// </remarks>
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class VertexLayout
+{
+public:
+
+    static const u32 MaxStreams = 16;
+    static const u32 MaxUsages = 8;
+    static const u32 MaxUsageIndices = 8;
+    static const u32 None = static_cast<u32>(-1);
+
+
+    /// <summary>
+    ///   Constructor.
+    /// </summary>
+    /// <param name="pElements">The vertex declaration.</param>
+    /// <param name="cElements">The number of vertex declaration elements.</param>
+    VertexLayout( const VertexDecl::Element* pElements, u32 cElements );
+
+    /// <summary>
+    ///   Gets the number of elements.
+    /// </summary>
+    u32 GetElementCount( void ) const
+    {
+        return static_cast<u32>(m_aElements.size());
+    }
+
+    /// <summary>
+    ///   Gets an element.
+    /// </summary>
+    const VertexDecl::Element& GetElement( u32 Element ) const
+    {
+        return m_aElements[ Element ];
+    }
+
+    /// <summary>
+    ///   Gets the offset of an element within a vertex of its stream.
+    /// </summary>
+    u32 GetOffset( u32 Element ) const
+    {
+        return m_aOffsets[ Element ];
+    }
+
+    /// <summary>
+    ///   Gets the size in bytes of a vertex of a stream.
+    /// </summary>
+    u32 GetStride( u32 StreamIndex=0 ) const
+    {
+        ASSERT( StreamIndex < MaxStreams );
+        return m_aStrides[ StreamIndex ];
+    }
+
+    /// <summary>
+    ///   Finds the element of a usage.
+    /// </summary>
+    /// <param name="Usage">The VertexDecl::Usage.</param>
+    /// <param name="UsageIndex">Which element of the usage, such as the texture coordinate
+    ///  set.</param>
+    /// <returns>The element, or None.</returns>
+    u32 FindElement( u32 Usage, u32 UsageIndex=0 ) const
+    {
+        if ( Usage >= MaxUsages || UsageIndex >= MaxUsageIndices )
+        {
+            return None;
+        }
+        u8 Element = m_aaUsageElements[ Usage ][ UsageIndex ];
+        return Element != sm_NoElement ? Element : None;
+    }
+
+    /// <summary>
+    ///   Gets the stream of a usage, as VertexDecl::FindUsageInStream does.
+    /// </summary>
+    /// <returns>The stream, or None if the layout has no such element.</returns>
+    u32 GetUsageStream( u32 Usage, u32 UsageIndex=0 ) const
+    {
+        u32 Element = FindElement( Usage, UsageIndex );
+        return Element != None ? m_aElements[ Element ].StreamIndex : None;
+    }
+
+    /// <summary>
+    ///   Gets the offset of a usage within a vertex of its stream.
+    /// </summary>
+    /// <param name="Usage">The VertexDecl::Usage.</param>
+    /// <param name="Type">The returned VertexDecl::Type of the element.</param>
+    /// <param name="UsageIndex">Which element of the usage.</param>
+    /// <returns>The offset in bytes, or -1 if the layout has no such element.</returns>
+    i32 GetUsageOffset( u32 Usage, u32& Type, u32 UsageIndex=0 ) const
+    {
+        u32 Element = FindElement( Usage, UsageIndex );
+        if ( Element == None )
+        {
+            return -1;
+        }
+        Type = m_aElements[ Element ].Type;
+        return static_cast<i32>(m_aOffsets[ Element ]);
+    }
+
+    /// <summary>
+    ///   Gets a hash of the elements.
+    /// </summary>
+    u32 GetHash( void ) const
+    {
+        return m_Hash;
+    }
+
+    /// <summary>
+    ///   Compares the elements of two layouts.
+    /// </summary>
+    Bool operator==( const VertexLayout& Other ) const;
+
+    /// <summary>
+    ///   Gets the size in bytes of an element type.
+    /// </summary>
+    static u32 GetTypeSize( u32 Type );
+
+
+protected:
+
+    static const u8 sm_NoElement = 0xFF;
+
+    std::vector<VertexDecl::Element> m_aElements;
+    std::vector<u32>                m_aOffsets;
+    u32                             m_aStrides[ MaxStreams ];
+    u8                              m_aaUsageElements[ MaxUsages ][ MaxUsageIndices ];
+    u32                             m_Hash;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// <summary>
+///   Converts the vertices of a stream of one layout to a stream of another, compiled once from
+///    the two layouts into a list of operations.
+/// </summary>
+/// <remarks>
+///   Each element of the destination is taken from the source element of the same usage and
+///    usage index:
+///   - elements of the same type, next to each other in both, are copied together;
+///   - float elements of another width keep the components they have in common, the rest zeroed;
+///   - floats are packed to UByte4 and Color elements, 4 vertices at a time with SSE, mapping -1
+///      to 1 to 0 to 255 for normals and tangents and 0 to 1 otherwise, and unpacked the same way;
+///      missing components are packed as 0, and w as 1;
+///   - elements with no source are zeroed.
+/// </remarks>
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class VertexConverter
+{
+public:
+
+    /// <summary>
+    ///   Constructor.
+    /// </summary>
+    /// <param name="Dest">The layout to convert to.</param>
+    /// <param name="DestStream">The stream of Dest to fill.</param>
+    /// <param name="Source">The layout to convert from.</param>
+    /// <param name="SourceStream">The stream of Source read.</param>
+    VertexConverter( const VertexLayout& Dest, u32 DestStream,
+                     const VertexLayout& Source, u32 SourceStream );
+
+    /// <summary>
+    ///   Converts vertices.  Safe to call from several threads at once.
+    /// </summary>
+    /// <param name="pDest">The returned vertices.</param>
+    /// <param name="pSource">The vertices to convert.</param>
+    /// <param name="Count">The number of vertices.</param>
+    void Convert( void* pDest, const void* pSource, u32 Count ) const;
+
+    /// <summary>
+    ///   Checks if the conversion is a plain copy.
+    /// </summary>
+    Bool IsCopy( void ) const
+    {
+        return m_bCopy;
+    }
+
+
+protected:
+
+    static const u32 sm_BatchSize = 64;                 // Vertices per pass over the operations
+
+    struct Operation
+    {
+        enum Type
+        {
+            e_Copy,
+            e_Zero,
+            e_Pack,
+            e_Unpack,
+        };
+
+        Type                Op;
+        u32                 DestOffset;
+        u32                 SourceOffset;
+
+        // Bytes for copies and zeroes, components for packing
+        u32                 DestSize;
+        u32                 SourceSize;
+
+        // Packing and unpacking
+        f32                 Scale;
+        f32                 Bias;
+        Bool                bSwapRB;
+    };
+
+    static void Pack( const Operation& Op, u8* pDest, u32 DestStride,
+                      const u8* pSource, u32 SourceStride, u32 Count );
+    static void Unpack( const Operation& Op, u8* pDest, u32 DestStride,
+                        const u8* pSource, u32 SourceStride, u32 Count );
+
+    u32                             m_DestStride;
+    u32                             m_SourceStride;
+    Bool                            m_bCopy;
+    std::vector<Operation>          m_aOperations;
+};
@@ -23,22 +23,88 @@ ISystem::ISystem(
 {
 }
 
+IService::IInstrumentation* ISystem::sm_pInstrumentation = NULL;
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // GetCPUUsage - Gets CPU Utilization
-// Default value is 0
+// Default value is what the instrumentation attributed to this system type, or 0 without one
 f32 
 ISystem::GetCPUUsage( 
     void 
     )
 {
+    if ( sm_pInstrumentation != NULL )
+    {
+        return sm_pInstrumentation->getJobCPUUsage( GetSystemType() );
+    }
     return 0;
 }
 
+
+///////////////////////////////////////////////////////////////////////////////
+// SetInstrumentation - Sets the instrumentation GetCPUUsage reads
+void
+ISystem::SetInstrumentation(
+    IService::IInstrumentation* pInstrumentation
+    )
+{
+    sm_pInstrumentation = pInstrumentation;
+}
+
 ISystemScene::ISystemScene(
     ISystem* pSystem
     )
-    : m_pSystem( pSystem )
-    , m_bInitialized( False )
+    : m_bInitialized( False )
+    , m_pSystem( pSystem )
 {
     ASSERT( m_pSystem != NULL );
 }
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ApplyChanges - Applies a property change set
+// Default falls back to SetProperties
+void
+ISystemObject::ApplyChanges(
+    const Properties::ChangeSet& Changes
+    )
+{
+    if ( !Changes.IsEmpty() )
+    {
+        SetProperties( Changes.GetProperties() );
+        MarkDirty( Changes.GetChanges() );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// MarkDirty - Accumulates changes to post
+void
+ISystemObject::MarkDirty(
+    System::Changes::BitMask Changes
+    )
+{
+    Changes &= GetPotentialSystemChanges();
+
+    if ( Changes != System::Changes::None )
+    {
+        m_DirtyChanges.fetch_or( Changes );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// PostDirtyChanges - Posts and clears the accumulated changes
+void
+ISystemObject::PostDirtyChanges(
+    void
+    )
+{
+    System::Changes::BitMask Changes = m_DirtyChanges.exchange( System::Changes::None );
+
+    if ( Changes != System::Changes::None )
+    {
+        PostChanges( Changes );
+    }
+}
@@ -14,6 +14,8 @@
 
 #pragma once
 
+#include <atomic>
+
 //
 // Forward declarations
 //
@@ -62,9 +64,9 @@ public:
     /// <summary>
     ///   One time initialization function for the system.
     /// </summary>
-    /// <param name="Properties">Property structure array to fill in.</param>
+    /// <param name="Properties">Property structure array to get values from.</param>
     /// <returns>An error code.</returns>
-    virtual Error Initialize( std::vector<Properties::Property> Properties ) = 0;
+    virtual Error Initialize( const Properties::Array& Properties ) = 0;
 
     /// <summary>
     ///   Gets the properties of this system.
@@ -73,13 +75,13 @@ public:
     ///   Implementation must work prior to initialization.
     /// </remarks>
     /// <param name="Properties">Property structure array to fill</param>
-    virtual void GetProperties( std::vector<Properties::Property>& Properties ) = 0;
+    virtual void GetProperties( Properties::Array& Properties ) = 0;
 
     /// <summary>
     ///   Sets the properties for this system.
     /// </summary>
     /// <param name="Properties">Property structure array to get values from.</param>
-    virtual void SetProperties( std::vector<Properties::Property> Properties ) = 0;
+    virtual void SetProperties( const Properties::Array& Properties ) = 0;
 
     /// <summary>
     ///   Creates a system scene for containing system objects.
@@ -98,13 +100,30 @@ public:
     /// <summary cref="ISystem::GetCPUUsage">
     ///   Returns the CPU Utilization of FMOD
     /// </summary>
+    /// <remarks>
+    ///   By default this is the share of all the CPUs the tasks of this system type used, as
+    ///    attributed by the instrumentation.
+    /// </remarks>
     /// <returns>CPU Utilization (0-100f)</returns>
 	virtual f32 GetCPUUsage( void );
 
+    /// <summary cref="ISystem::SetInstrumentation">
+    ///   Sets the instrumentation the default GetCPUUsage reads.
+    /// </summary>
+    /// <remarks>
+    ///   Whoever owns the instrumentation, such as the service manager, has to call this when
+    ///    the system libraries are initialized.  Nothing in this tree calls it yet, so the default
+    ///    GetCPUUsage returns 0.
+    /// </remarks>
+    /// <param name="pInstrumentation">The instrumentation, or NULL for none.</param>
+    static void SetInstrumentation( IService::IInstrumentation* pInstrumentation );
+
 
 protected:
 
     Bool                        m_bInitialized;
+
+    static IService::IInstrumentation*  sm_pInstrumentation;
 };
 
 
@@ -170,21 +189,21 @@ public:
     /// <summary>
     ///   One time initialization function for the scene.
     /// </summary>
-    /// <param name="Properties">Property structure array to fill in.</param>
+    /// <param name="Properties">Property structure array to get values from.</param>
     /// <returns>An error code.</returns>
-    virtual Error Initialize( std::vector<Properties::Property> Properties ) = 0;
+    virtual Error Initialize( const Properties::Array& Properties ) = 0;
 
     /// <summary>
     ///   Gets the properties of this scene.
     /// </summary>
     /// <param name="Properties">Property structure array to fill.</param>
-    virtual void GetProperties( std::vector<Properties::Property>& Properties ) = 0;
+    virtual void GetProperties( Properties::Array& Properties ) = 0;
 
     /// <summary>
     ///   Sets the properties for this scene.
     /// </summary>
     /// <param name="Properties">Property structure array to get values from.</param>
-    virtual void SetProperties( std::vector<Properties::Property> Properties ) = 0;
+    virtual void SetProperties( const Properties::Array& Properties ) = 0;
 
     /// <summary>
     ///   Get all the available object types as names.
@@ -267,6 +286,7 @@ public:
     ISystemObject( ISystemScene* pSystemScene, pcstr pszName )
         : m_bInitialized( False )
         , m_pSystemScene( pSystemScene )
+        , m_DirtyChanges( System::Changes::None )
     {
 		if( pszName )
 		{
@@ -332,21 +352,33 @@ public:
     /// <summary>
     ///   One time initialization function for the object.
     /// </summary>
-    /// <param name="Properties">Property structure array to fill in.</param>
+    /// <param name="Properties">Property structure array to get values from.</param>
     /// <returns>An error code.</returns>
-    virtual Error Initialize( std::vector<Properties::Property> Properties ) = 0;
+    virtual Error Initialize( const Properties::Array& Properties ) = 0;
 
     /// <summary>
     ///   Gets the properties of this object.
     /// </summary>
     /// <param name="Properties">The Property structure array to fill.</param>
-    virtual void GetProperties( std::vector<Properties::Property>& Properties ) = 0;
+    virtual void GetProperties( Properties::Array& Properties ) = 0;
 
     /// <summary>
     ///   Sets the properties for this object.
     /// </summary>
     /// <param name="Properties">Property structure array to get values from.</param>
-    virtual void SetProperties( std::vector<Properties::Property> Properties ) = 0;
+    virtual void SetProperties( const Properties::Array& Properties ) = 0;
+
+    /// <summary>
+    ///   Applies a set of property changes to this object.
+    /// </summary>
+    /// <remarks>
+    ///   The default implementation hands the changed properties to SetProperties and marks the
+    ///    change set's system changes dirty.  Objects receiving frequent deltas should override
+    ///    it, look up the properties they handle with ChangeSet::Find, and call MarkDirty with
+    ///    the changes they actually made.
+    /// </remarks>
+    /// <param name="Changes">The property changes to apply.</param>
+    virtual void ApplyChanges( const Properties::ChangeSet& Changes );
 
     /// <summary>
     ///   Returns a bit mask of System Changes that this system wants to receive changes for.  Used
@@ -356,6 +388,29 @@ public:
     /// <returns>A System::Changes::BitMask.</returns>
     virtual System::Changes::BitMask GetDesiredSystemChanges( void ) = 0;
 
+    /// <summary>
+    ///   Marks system changes as dirty.  Only the changes this object can post are kept.
+    /// </summary>
+    /// <remarks>Safe to call from multiple threads.</remarks>
+    /// <param name="Changes">The changes to mark.</param>
+    void MarkDirty( System::Changes::BitMask Changes );
+
+    /// <summary>
+    ///   Returns the changes marked dirty since they were last posted.
+    /// </summary>
+    /// <returns>A System::Changes::BitMask.</returns>
+    System::Changes::BitMask GetDirtyChanges( void ) const
+    {
+        return m_DirtyChanges.load();
+    }
+
+    /// <summary>
+    ///   Posts the dirty changes to the observers and clears them.  Clean objects post nothing,
+    ///    so the change control manager never visits objects whose property changes did not
+    ///    affect anything its observers are interested in.
+    /// </summary>
+    void PostDirtyChanges( void );
+
 
 protected:
 
@@ -365,6 +420,8 @@ protected:
 
     Handle                      m_hParentObject;
 
+    std::atomic<System::Changes::BitMask>   m_DirtyChanges;
+
 	std::string                 m_sName;
 };
 
@@ -411,6 +468,9 @@ public:
 	/// <summary cref="ISystemTask::Update">
     ///   Function informing the task to perform its updates.
     /// </summary>
+    /// <remarks>
+    ///   The task manager times each call with a profiler zone named after the system.
+    /// </remarks>
     /// <param name="DeltaTime">The time delta from the last call.</param>
     virtual void Update( f32 DeltaTime ) = 0;
 
@@ -69,16 +69,16 @@ namespace System
 		// the upper 16-bits, and can use the MakeCustom() function to make a custom
 		// type ID.
 		static const u32 Null                   = 0;
-		static const u32 Generic                = (1 << Generic);
-		static const u32 Geometry               = (1 << Geometry);
-		static const u32 Graphics               = (1 << Graphics);
-		static const u32 PhysicsCollision       = (1 << PhysicsCollision);
-		static const u32 Audio                  = (1 << Audio);
-		static const u32 Input                  = (1 << Input);
-		static const u32 AI                     = (1 << AI);
-		static const u32 Animation              = (1 << Animation);
-		static const u32 Scripting              = (1 << Scripting);
-		static const u32 Explosion		= (1 << Explosion);
+		static const u32 Generic                = (1 << System::Generic);
+		static const u32 Geometry               = (1 << System::Geometry);
+		static const u32 Graphics               = (1 << System::Graphics);
+		static const u32 PhysicsCollision       = (1 << System::PhysicsCollision);
+		static const u32 Audio                  = (1 << System::Audio);
+		static const u32 Input                  = (1 << System::Input);
+		static const u32 AI                     = (1 << System::AI);
+		static const u32 Animation              = (1 << System::Animation);
+		static const u32 Scripting              = (1 << System::Scripting);
+		static const u32 Explosion		= (1 << System::Explosion);
 		static const u32 Water                  = (1 << System::Water);
 		// If you extend this list to add a new system, also update the rest of the type-related
 		// lists in this file as well as the PerformanceHints list in the TaskManager.
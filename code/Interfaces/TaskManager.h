@@ -72,6 +72,11 @@ public:
 	/// <param name="uNumberOfThreads">the limit of the number of threads to use</param>
 	virtual void SetNumberOfThreads( u32 uNumberOfThreads )=0;
 
+    /// <summary cref="ITaskManager::ParallelFor">
+    /// This method splits the range [<paramref name="begin"/>, <paramref name="end"/>) into chunks of at
+    /// least <paramref name="minGrain"/> items and calls <paramref name="pfnJobFunction"/> on them in parallel.
+    /// </summary>
+    /// <remarks>Implementations time each chunk with PROFILE_ZONE_RANGE so captures show where it ran.</remarks>
     virtual void ParallelFor( ISystemTask* pSystemTask,
                               ParallelForFunction pfnJobFunction, void* pParam, u32 begin, u32 end, u32 minGrain = 1 ) = 0;
 };
@@ -20,31 +20,381 @@
 #include <cstdio>
 #include <iostream>
 #include <cstdlib>
+#include <unistd.h>
+#include <getopt.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
 using namespace std;
 
 
+//
+// Headless benchmark.
+//
+// --bench <scene> --frames N --threads T runs the frame loop of a built-in scene with no
+// rendering or input systems and prints the frame times, the time of each system and the
+// allocation counts as JSON on stdout.
+//
+namespace Bench
+{
+	// Systems of the benchmark scenes, in update order
+	enum SystemIndex
+	{
+		e_AI,
+		e_Physics,
+		e_Geometry,
+
+		e_SystemCount,
+		e_NoSystem = e_SystemCount
+	};
+
+	static pcstr s_apszSystemNames[ e_SystemCount ] = { "AI", "PhysicsCollision", "Geometry" };
+	static pcstr s_apszChunkNames[ e_SystemCount ] = { "AI::Chunk", "PhysicsCollision::Chunk", "Geometry::Chunk" };
+
+	struct Scene
+	{
+		pcstr pszName;
+		u32 ObjectCount;
+	};
+
+	static const Scene s_aScenes[] =
+	{
+		{ "Small",  1000 },
+		{ "Demo",   10000 },
+		{ "Large",  100000 },
+	};
+
+	static const u32 Grain = 256;
+	static const f32 DeltaTime = 1.0f / 60.0f;
+
+	// Allocations made while benchmarking, by the system that made them
+	static std::atomic<u32> s_bCounting( 0 );
+	static std::atomic<u64> s_aAllocations[ e_SystemCount + 1 ];
+	static thread_local u32 t_System = e_NoSystem;
+
+	// Attributes the allocations of the enclosing scope to a system
+	class SystemScope
+	{
+	public:
+		SystemScope( u32 System ) : m_Previous( t_System ) { t_System = System; }
+		~SystemScope( void ) { t_System = m_Previous; }
+
+	private:
+		u32 m_Previous;
+	};
+
+	struct Object
+	{
+		Math::Vector3 Position;
+		Math::Vector3 Velocity;
+		Math::Vector3 Target;
+		Math::Quaternion Orientation;
+		Math::Matrix4x4 World;
+	};
+
+	// Cheap deterministic target positions, so every run does the same work
+	static Math::Vector3 PickTarget( u32 Seed )
+	{
+		Seed = Seed * 1664525 + 1013904223;
+		f32 x = static_cast<f32>(Seed & 0xFFFF) / 655.36f - 50.0f;
+		Seed = Seed * 1664525 + 1013904223;
+		f32 z = static_cast<f32>(Seed & 0xFFFF) / 655.36f - 50.0f;
+		return Math::Vector3( x, 0.0f, z );
+	}
+
+	// AI - Steers towards a target, picking a new one on arrival
+	static void UpdateAI( std::vector<Object>& Objects, u32 Begin, u32 End, u32 Frame )
+	{
+		for( u32 i = Begin; i < End; i++ )
+		{
+			Object& o = Objects[ i ];
+			Math::Vector3 Direction = o.Target - o.Position;
+			Direction.y = 0.0f;
+			if( Direction.Magnitude() < 1.0f )
+			{
+				o.Target = PickTarget( i ^ (Frame << 16) );
+				continue;
+			}
+			Direction.Normalize();
+			o.Velocity += Direction * (4.0f * DeltaTime);
+			if( o.Velocity.Magnitude() > 8.0f )
+			{
+				o.Velocity.Normalize();
+				o.Velocity *= 8.0f;
+			}
+		}
+	}
+
+	// Physics - Integrates the motion and bounces off the ground
+	static void UpdatePhysics( std::vector<Object>& Objects, u32 Begin, u32 End )
+	{
+		for( u32 i = Begin; i < End; i++ )
+		{
+			Object& o = Objects[ i ];
+			o.Velocity.y -= 9.8f * DeltaTime;
+			o.Position += o.Velocity * DeltaTime;
+			if( o.Position.y < 0.0f )
+			{
+				o.Position.y = 0.0f;
+				o.Velocity.y *= -0.5f;
+			}
+		}
+	}
+
+	// Geometry - Builds the world transforms and collects the objects that moved
+	static void UpdateGeometry( std::vector<Object>& Objects, u32 Begin, u32 End,
+								std::vector<u32>& Moved, std::mutex& MovedMutex )
+	{
+		std::vector<u32> Changes;
+		for( u32 i = Begin; i < End; i++ )
+		{
+			Object& o = Objects[ i ];
+			Math::Vector3 Previous = o.World.GetTranslation();
+			o.Orientation.Set( Math::Vector3::UnitY, atan2f( o.Velocity.x, o.Velocity.z ) );
+			o.World.Transformation( o.Position, o.Orientation );
+			if( Previous != o.Position )
+			{
+				Changes.push_back( i );
+			}
+		}
+
+		std::lock_guard<std::mutex> Lock( MovedMutex );
+		Moved.insert( Moved.end(), Changes.begin(), Changes.end() );
+	}
+
+	// Nearest rank percentile of sorted values
+	static f64 Percentile( const std::vector<f64>& Sorted, f64 Fraction )
+	{
+		size_t Rank = static_cast<size_t>(ceil( Fraction * Sorted.size() ));
+		return Sorted[ (Rank > 0) ? std::min( Rank, Sorted.size() ) - 1 : 0 ];
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	// Run - Runs a scene and prints the results, returns the exit code
+	static int Run( pcstr pszScene, u32 Frames, u32 Threads )
+	{
+		const Scene* pScene = NULL;
+		for( u32 i = 0; i < sizeof( s_aScenes ) / sizeof( s_aScenes[ 0 ] ); i++ )
+		{
+			if( strcasecmp( pszScene, s_aScenes[ i ].pszName ) == 0 )
+			{
+				pScene = &s_aScenes[ i ];
+			}
+		}
+		if( pScene == NULL || Frames == 0 || Threads == 0 )
+		{
+			cerr << "usage: Smoke --bench <Small|Demo|Large> [--frames N] [--threads T]" << endl;
+			return 1;
+		}
+
+		std::vector<Object> Objects( pScene->ObjectCount );
+		for( u32 i = 0; i < Objects.size(); i++ )
+		{
+			Objects[ i ].Position = PickTarget( ~i );
+			Objects[ i ].Position.y = static_cast<f32>(i % 10);
+			Objects[ i ].Velocity = Math::Vector3::Zero;
+			Objects[ i ].Target = PickTarget( i );
+			Objects[ i ].Orientation = Math::Quaternion::Zero;
+			Objects[ i ].World = Math::Matrix4x4::Identity;
+		}
+
+		std::vector<u32> Moved;
+		std::mutex MovedMutex;
+		std::vector<f64> FrameMs;
+		f64 aWallMs[ e_SystemCount ] = { 0 };
+		f64 aCpuMs[ e_SystemCount ] = { 0 };
+		f64 aMaxMs[ e_SystemCount ] = { 0 };
+		u64 MovedTotal = 0;
+
+		Profiler::Startup();
+		for( u32 i = 0; i <= e_SystemCount; i++ )
+		{
+			s_aAllocations[ i ].store( 0 );
+		}
+		s_bCounting.store( True );
+
+		tbb::task_arena Arena( static_cast<int>(Threads) );
+		Arena.execute( [&]
+		{
+			for( u32 Frame = 0; Frame < Frames; Frame++ )
+			{
+				std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+				Profiler::BeginFrame();
+
+				for( u32 Index = 0; Index < e_SystemCount; Index++ )
+				{
+					PROFILE_ZONE( s_apszSystemNames[ Index ] );
+					SystemScope Scope( Index );
+
+					tbb::parallel_for( tbb::blocked_range<u32>( 0, pScene->ObjectCount, Grain ),
+						[&]( const tbb::blocked_range<u32>& Range )
+						{
+							SystemScope ChunkScope( Index );
+							PROFILE_ZONE_RANGE( s_apszChunkNames[ Index ], Range.begin(), Range.end() );
+
+							switch( Index )
+							{
+							case e_AI:
+								UpdateAI( Objects, Range.begin(), Range.end(), Frame );
+								break;
+
+							case e_Physics:
+								UpdatePhysics( Objects, Range.begin(), Range.end() );
+								break;
+
+							default:
+								UpdateGeometry( Objects, Range.begin(), Range.end(), Moved, MovedMutex );
+								break;
+							}
+						} );
+				}
+
+				// The changes are posted once the frame is done
+				MovedTotal += Moved.size();
+				Moved.clear();
+
+				Profiler::EndFrame();
+				FrameMs.push_back( std::chrono::duration<f64, std::milli>(
+					std::chrono::steady_clock::now() - Start ).count() );
+
+				Profiler::FrameStats Stats;
+				if( Profiler::GetFrameStats( Stats ) )
+				{
+					for( std::vector<Profiler::ZoneStats>::const_iterator it = Stats.Zones.begin();
+						 it != Stats.Zones.end(); it++ )
+					{
+						for( u32 Index = 0; Index < e_SystemCount; Index++ )
+						{
+							if( strcmp( it->pszName, s_apszSystemNames[ Index ] ) == 0 )
+							{
+								aWallMs[ Index ] += it->TotalMs;
+								aMaxMs[ Index ] = std::max<f64>( aMaxMs[ Index ], it->MaxMs );
+							}
+							else if( strcmp( it->pszName, s_apszChunkNames[ Index ] ) == 0 )
+							{
+								aCpuMs[ Index ] += it->TotalMs;
+							}
+						}
+					}
+				}
+			}
+		} );
+
+		s_bCounting.store( False );
+		Profiler::Shutdown();
+
+		//
+		// Report.
+		//
+		std::vector<f64> Sorted( FrameMs );
+		std::sort( Sorted.begin(), Sorted.end() );
+		f64 TotalMs = 0.0;
+		for( u32 i = 0; i < FrameMs.size(); i++ )
+		{
+			TotalMs += FrameMs[ i ];
+		}
+
+		u64 Allocations = 0;
+		for( u32 i = 0; i <= e_SystemCount; i++ )
+		{
+			Allocations += s_aAllocations[ i ].load();
+		}
+
+		printf( "{\n" );
+		printf( "  \"scene\": \"%s\",\n", pScene->pszName );
+		printf( "  \"objects\": %u,\n", pScene->ObjectCount );
+		printf( "  \"frames\": %u,\n", Frames );
+		printf( "  \"threads\": %u,\n", Threads );
+		printf( "  \"frame_ms\": { \"mean\": %.4f, \"p50\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+				TotalMs / Frames, Percentile( Sorted, 0.5 ), Percentile( Sorted, 0.99 ), Sorted.back() );
+		printf( "  \"allocations\": { \"total\": %llu, \"per_frame\": %.2f },\n",
+				static_cast<unsigned long long>(Allocations), static_cast<f64>(Allocations) / Frames );
+		printf( "  \"changes_per_frame\": %.2f,\n", static_cast<f64>(MovedTotal) / Frames );
+		printf( "  \"systems\": {\n" );
+		for( u32 Index = 0; Index < e_SystemCount; Index++ )
+		{
+			printf( "    \"%s\": { \"wall_ms\": %.4f, \"cpu_ms\": %.4f, \"max_ms\": %.4f, \"allocations_per_frame\": %.2f }%s\n",
+					s_apszSystemNames[ Index ], aWallMs[ Index ] / Frames, aCpuMs[ Index ] / Frames,
+					aMaxMs[ Index ], static_cast<f64>(s_aAllocations[ Index ].load()) / Frames,
+					(Index + 1 < e_SystemCount) ? "," : "" );
+		}
+		printf( "  }\n" );
+		printf( "}\n" );
+
+		return 0;
+	}
+}
+
+
+//
+// Count the allocations while benchmarking.
+//
+void* operator new( size_t Size )
+{
+	if( Bench::s_bCounting.load( std::memory_order_relaxed ) )
+	{
+		Bench::s_aAllocations[ Bench::t_System ].fetch_add( 1, std::memory_order_relaxed );
+	}
+
+	void* p = malloc( (Size > 0) ? Size : 1 );
+	if( p == NULL )
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete( void* p ) noexcept
+{
+	free( p );
+}
+
+
+
 //extern "C" int APIENTRY
 int main(int argc, char **argv)
 {
 
-	char c;
-	char *logfile = (char*)"logdefault.txt";
-	bool bLogging;
+	int c;
 	std::string sGdfPath = "Smoke.gdf";
+	const char* pszBenchScene = NULL;
+	u32 BenchFrames = 300;
+	u32 BenchThreads = tbb::this_task_arena::max_concurrency();
 //	USES_CONVERSION;
 	
 	//int					argc, iArg;
 
-	while ( ( c = getopt( argc, argv, "l::" ) ) != -1 )
+	static const struct option aLongOptions[] =
+	{
+		{ "bench",   required_argument, NULL, 'b' },
+		{ "frames",  required_argument, NULL, 'f' },
+		{ "threads", required_argument, NULL, 't' },
+		{ NULL,      0,                 NULL, 0   }
+	};
+
+	while ( ( c = getopt_long( argc, argv, "l::", aLongOptions, NULL ) ) != -1 )
 	{
 		switch(c)
 		{
+			case 'b':
+				pszBenchScene = optarg;
+				break;
+			case 'f':
+				BenchFrames = static_cast<u32>( strtoul( optarg, NULL, 10 ) );
+				break;
+			case 't':
+				BenchThreads = static_cast<u32>( strtoul( optarg, NULL, 10 ) );
+				break;
 			case 'l':
-				bLogging = true;
-				if( optarg != NULL )
-					logfile = optarg;
+				// Logging is not started here yet, see Debug::Startup below
 				#ifdef DEBUG
-					cout << "logging is set, logfile: " << logfile << endl;
+					cout << "logging is set, logfile: " << ( optarg != NULL ? optarg : "logdefault.txt" ) << endl;
 				#endif
 				break;
 			case '?':
@@ -58,6 +408,9 @@ int main(int argc, char **argv)
 		}	
 		
 	}
+	if( pszBenchScene != NULL )
+		return Bench::Run( pszBenchScene, BenchFrames, BenchThreads );
+
 	if( argv[optind] != NULL)
 		sGdfPath = argv[optind];
 	#ifdef DEBUG
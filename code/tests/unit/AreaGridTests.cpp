@@ -0,0 +1,191 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "TestHarness.h"
+#include "../../Interfaces/Services/AreaGrid.h"
+
+
+class TestArea : public Test::Subject, public IAreaObject
+{
+public:
+
+    TestArea( void )
+        : Min( Math::Vector3::Zero )
+        , Max( Math::Vector3::Zero )
+        , Type( e_Fire )
+        , bActive( True )
+    {
+    }
+
+    virtual void GetAreaBB( Math::Vector3& AreaMin, Math::Vector3& AreaMax )
+    {
+        AreaMin = Min;
+        AreaMax = Max;
+    }
+
+    virtual pcstr GetAreaName( void )       { return "Area"; }
+    virtual AreaType GetAreaType( void )    { return Type; }
+    virtual Bool IsAreaActive( void )       { return bActive; }
+
+    Math::Vector3           Min;
+    Math::Vector3           Max;
+    AreaType                Type;
+    Bool                    bActive;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// IsInside - Tests a point against the box of an area
+static Bool
+IsInside(
+    const TestArea& Area,
+    const Math::Vector3& Point
+    )
+{
+    return Point.x >= Area.Min.x && Point.x <= Area.Max.x &&
+           Point.y >= Area.Min.y && Point.y <= Area.Max.y &&
+           Point.z >= Area.Min.z && Point.z <= Area.Max.z;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// AreaGridMatchesAreaScan - The areas found at each point, and the points found in each area,
+//  are those a test of every point against every area finds, with inactive, removed, large and
+//  masked out areas
+TEST( AreaGridMatchesAreaScan )
+{
+    const u32 AreaCount = 300;
+    const u32 PointCount = 2000;
+    const f32 World = 1000.0f;
+
+    std::mt19937 Random( 3 );
+    std::uniform_real_distribution<f32> Unit( 0.0f, 1.0f );
+
+    // The grid is declared first so the areas, which tell it when destroyed, go before it
+    AreaGrid Grid( 16.0f );
+    std::vector<TestArea> aAreas( AreaCount );
+
+    for ( u32 a=0; a < AreaCount; a++ )
+    {
+        TestArea& Area = aAreas[ a ];
+        f32 x = Unit( Random ) * World;
+        f32 z = Unit( Random ) * World;
+        f32 Size = (Unit( Random ) < 0.02f) ? 600.0f : 5.0f + Unit( Random ) * 30.0f;
+        Area.Min = Math::Vector3( x, 0.0f, z );
+        Area.Max = Math::Vector3( x + Size, 50.0f, z + Size );
+        Area.Type = (Unit( Random ) < 0.7f) ? IAreaObject::e_Fire : IAreaObject::e_Zombie;
+        Area.bActive = Unit( Random ) < 0.8f;
+
+        Area.Attach( &Grid, System::Changes::POI::Area, 0 );
+        Area.PostChanges( System::Changes::POI::Area );
+    }
+    Grid.Update();
+
+    //
+    // Area 0 is removed, 1 turns inactive and 2 is set then removed before the same Update.
+    //
+    Grid.RemoveArea( &aAreas[ 0 ] );
+    aAreas[ 1 ].bActive = False;
+    aAreas[ 1 ].PostChanges( System::Changes::POI::Area );
+    Grid.SetArea( &aAreas[ 2 ] );
+    Grid.RemoveArea( &aAreas[ 2 ] );
+    Grid.Update();
+
+    std::vector<Math::Vector3> aPoints( PointCount );
+    for ( u32 p=0; p < PointCount; p++ )
+    {
+        aPoints[ p ] = Math::Vector3( Unit( Random ) * World, Unit( Random ) * 60.0f,
+                                      Unit( Random ) * World );
+    }
+
+    AreaGrid::Membership AreasAtPoints;
+    AreaGrid::Membership PointsInAreas;
+    Grid.Query( &aPoints[ 0 ], PointCount, &AreasAtPoints, &PointsInAreas,
+                1 << IAreaObject::e_Fire );
+
+    size_t Memberships = 0;
+
+    for ( u32 p=0; p < PointCount; p++ )
+    {
+        std::vector<IAreaObject*> aExpected;
+        for ( u32 a=3; a < AreaCount; a++ )
+        {
+            if ( aAreas[ a ].bActive && aAreas[ a ].Type == IAreaObject::e_Fire &&
+                 IsInside( aAreas[ a ], aPoints[ p ] ) )
+            {
+                aExpected.push_back( &aAreas[ a ] );
+            }
+        }
+
+        std::vector<IAreaObject*> aFound;
+        for ( u32 i=AreasAtPoints.aFirst[ p ]; i < AreasAtPoints.aFirst[ p + 1 ]; i++ )
+        {
+            u32 Index = AreasAtPoints.aMembers[ i ];
+            aFound.push_back( Grid.GetArea( Index ) );
+
+            CHECK( std::binary_search( PointsInAreas.aMembers.begin() + PointsInAreas.aFirst[ Index ],
+                                       PointsInAreas.aMembers.begin() + PointsInAreas.aFirst[ Index + 1 ],
+                                       p ) );
+        }
+
+        std::sort( aExpected.begin(), aExpected.end() );
+        std::sort( aFound.begin(), aFound.end() );
+        CHECK( aFound == aExpected );
+
+        Memberships += aExpected.size();
+    }
+
+    CHECK( PointsInAreas.aMembers.size() == Memberships );
+    CHECK( Memberships > 0 );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// AreaGridDropsDestroyedAreas - An area destroyed while observed is dropped by the next Update,
+//  even with a change of it still queued
+TEST( AreaGridDropsDestroyedAreas )
+{
+    AreaGrid Grid( 16.0f );
+
+    TestArea* pKept = new TestArea;
+    TestArea* pDestroyed = new TestArea;
+    TestArea* pChanged = new TestArea;
+    TestArea* apAreas[] = { pKept, pDestroyed, pChanged };
+
+    for ( u32 i=0; i < 3; i++ )
+    {
+        apAreas[ i ]->Max = Math::Vector3( 10.0f, 10.0f, 10.0f );
+        apAreas[ i ]->Attach( &Grid, System::Changes::POI::Area, 0 );
+        apAreas[ i ]->PostChanges( System::Changes::POI::Area );
+    }
+    Grid.Update();
+    CHECK( Grid.GetAreaCount() == 3 );
+
+    delete pDestroyed;
+    pChanged->PostChanges( System::Changes::POI::Area );
+    delete pChanged;
+    Grid.Update();
+
+    CHECK( Grid.GetAreaCount() == 1 );
+    CHECK( Grid.GetAreaCount() == 1 && Grid.GetArea( 0 ) == pKept );
+
+    delete pKept;
+    Grid.Update();
+    CHECK( Grid.GetAreaCount() == 0 );
+}
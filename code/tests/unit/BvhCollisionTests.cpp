@@ -0,0 +1,319 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "TestHarness.h"
+#include "../../Interfaces/Services/BvhCollision.h"
+
+
+struct TestBox
+{
+    std::string         sName;
+    Math::Vector3       Min;
+    Math::Vector3       Max;
+    Bool                bGround;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SegmentHitsBox - Slab test of the segment from Start along Delta, giving the entry fraction
+static Bool
+SegmentHitsBox(
+    const TestBox& Box,
+    const Math::Vector3& Start,
+    const Math::Vector3& Delta,
+    f32& t
+    )
+{
+    f32 aStart[ 3 ] = { Start.x, Start.y, Start.z };
+    f32 aDelta[ 3 ] = { Delta.x, Delta.y, Delta.z };
+    f32 aMin[ 3 ] = { Box.Min.x, Box.Min.y, Box.Min.z };
+    f32 aMax[ 3 ] = { Box.Max.x, Box.Max.y, Box.Max.z };
+    f32 Enter = 0.0f;
+    f32 Exit = 1.0f;
+
+    for ( u32 Axis=0; Axis < 3; Axis++ )
+    {
+        if ( fabsf( aDelta[ Axis ] ) < 1e-20f )
+        {
+            if ( aStart[ Axis ] < aMin[ Axis ] || aStart[ Axis ] > aMax[ Axis ] )
+            {
+                return False;
+            }
+            continue;
+        }
+
+        f32 t0 = (aMin[ Axis ] - aStart[ Axis ]) / aDelta[ Axis ];
+        f32 t1 = (aMax[ Axis ] - aStart[ Axis ]) / aDelta[ Axis ];
+        Enter = std::max( Enter, std::min( t0, t1 ) );
+        Exit = std::min( Exit, std::max( t0, t1 ) );
+        if ( Enter > Exit )
+        {
+            return False;
+        }
+    }
+
+    t = Enter;
+    return True;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// BvhCollisionMatchesBoxScan - Line tests, coherent packets and ground requests included, find
+//  the nearest box a scan of every box finds, as objects move and are removed
+TEST( BvhCollisionMatchesBoxScan )
+{
+    std::mt19937 Random( 7 );
+    std::uniform_real_distribution<f32> Position( -100.0f, 100.0f );
+    std::uniform_real_distribution<f32> Extent( 0.5f, 5.0f );
+
+    std::vector<TestBox> aBoxes( 1500 );
+    BvhCollision Collision;
+    Test::TaskManager TaskManager;
+
+    for ( size_t i=0; i < aBoxes.size(); i++ )
+    {
+        char szName[ 32 ];
+        sprintf( szName, "Box%u", static_cast<u32>(i) );
+        f32 Size = Extent( Random );
+        Math::Vector3 Center( Position( Random ), Position( Random ) * 0.2f, Position( Random ) );
+
+        aBoxes[ i ].sName = szName;
+        aBoxes[ i ].Min = Center - Math::Vector3( Size, Size, Size );
+        aBoxes[ i ].Max = Center + Math::Vector3( Size, Size, Size );
+        aBoxes[ i ].bGround = (i % 10 == 0);
+    }
+
+    for ( size_t i=0; i < aBoxes.size(); i++ )
+    {
+        Collision.SetObject( aBoxes[ i ].sName.c_str(), aBoxes[ i ].Min, aBoxes[ i ].Max,
+                             aBoxes[ i ].bGround );
+    }
+
+    u32 Hits = 0;
+
+    for ( u32 Frame=0; Frame < 6; Frame++ )
+    {
+        //
+        // Small moves refit the hierarchy, large ones rebuild it.
+        //
+        if ( Frame == 2 || Frame == 5 )
+        {
+            f32 Scale = (Frame == 2) ? 0.05f : 0.5f;
+            for ( size_t i=0; i < aBoxes.size(); i += 3 )
+            {
+                Math::Vector3 Move( Position( Random ) * Scale, 0.0f, Position( Random ) * Scale );
+                aBoxes[ i ].Min += Move;
+                aBoxes[ i ].Max += Move;
+                Collision.SetObject( aBoxes[ i ].sName.c_str(), aBoxes[ i ].Min, aBoxes[ i ].Max,
+                                     aBoxes[ i ].bGround );
+            }
+        }
+        else if ( Frame == 4 )
+        {
+            for ( u32 i=0; i < 100; i++ )
+            {
+                Collision.RemoveObject( aBoxes.back().sName.c_str() );
+                aBoxes.pop_back();
+            }
+        }
+
+        std::vector<Coll::Request> aRequests( 2000 );
+        std::vector<Coll::Handle> aHandles( aRequests.size() );
+        Math::Vector3 PacketStart = Math::Vector3::Zero;
+        Math::Vector3 PacketEnd = Math::Vector3::Zero;
+
+        for ( size_t i=0; i < aRequests.size(); i++ )
+        {
+            Coll::Request& Request = aRequests[ i ];
+            if ( i % 3 == 1 )
+            {
+                Request.SetFlags( Coll::e_Ground );
+            }
+            else if ( i % 3 == 2 )
+            {
+                Request.SetFlags( Coll::e_IgnoreGround );
+            }
+            if ( i % 7 == 0 )
+            {
+                Request.SetIgnore( aBoxes[ i % aBoxes.size() ].sName.c_str() );
+            }
+
+            Math::Vector3 Start( Position( Random ), Position( Random ) * 0.2f, Position( Random ) );
+            Math::Vector3 End( Position( Random ), Position( Random ) * 0.2f, Position( Random ) );
+            if ( i % 11 == 0 )
+            {
+                End = Start - Math::Vector3( 0.0f, 50.0f, 0.0f );
+            }
+
+            //
+            // Runs of 4 nearly parallel segments are traced as packets.
+            //
+            if ( (i / 4) % 2 == 0 )
+            {
+                if ( i % 4 == 0 )
+                {
+                    PacketStart = Start;
+                    PacketEnd = End;
+                }
+                else
+                {
+                    Math::Vector3 Offset( Position( Random ) * 0.01f, Position( Random ) * 0.01f,
+                                          Position( Random ) * 0.01f );
+                    Start = PacketStart + Offset;
+                    End = PacketEnd + Offset;
+                }
+            }
+
+            aHandles[ i ] = Collision.LineTest( Start, End, Request );
+        }
+
+        Coll::Result Result;
+        CHECK( !Collision.Finalize( aHandles[ 0 ], &Result ) );
+
+        Collision.Resolve( (Frame & 1) ? &TaskManager : NULL );
+
+        for ( size_t i=0; i < aRequests.size(); i++ )
+        {
+            const Coll::Request& Request = aRequests[ i ];
+            Bool bFinalized = Collision.Finalize( aHandles[ i ], &Result );
+            CHECK( bFinalized );
+            if ( !bFinalized )
+            {
+                continue;
+            }
+
+            Math::Vector3 Delta = Request.m_Position1 - Request.m_Position0;
+            const TestBox* pNearest = NULL;
+            f32 Nearest = 2.0f;
+
+            for ( size_t j=0; j < aBoxes.size(); j++ )
+            {
+                const TestBox& Box = aBoxes[ j ];
+                if ( ((Request.m_Flags & Coll::e_Ground) && !Box.bGround) ||
+                     ((Request.m_Flags & Coll::e_IgnoreGround) && Box.bGround) ||
+                     (Request.m_Ignore != NULL && Box.sName == Request.m_Ignore) )
+                {
+                    continue;
+                }
+
+                f32 t;
+                if ( SegmentHitsBox( Box, Request.m_Position0, Delta, t ) && t < Nearest )
+                {
+                    Nearest = t;
+                    pNearest = &Box;
+                }
+            }
+
+            CHECK( Result.m_Valid == (pNearest != NULL) );
+            if ( pNearest != NULL && Result.m_Valid )
+            {
+                Math::Vector3 Error = Request.m_Position0 + Delta * Nearest - Result.m_Position;
+                CHECK( fabsf( Error.x ) + fabsf( Error.y ) + fabsf( Error.z ) < 1e-3f );
+                Hits++;
+            }
+        }
+    }
+
+    //
+    // Enough segments hit something for the comparison to mean anything.
+    //
+    CHECK( Hits > 1000 );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// DepthProbe - Exposes the depth of the hierarchy
+class DepthProbe : public BvhCollision
+{
+public:
+
+    u32 GetDepth( u32 NodeIndex=0 ) const
+    {
+        const Node& Current = m_aNodes[ NodeIndex ];
+        u32 Depth = 0;
+        for ( u32 i=0; i < 4; i++ )
+        {
+            if ( Current.aChild[ i ] != sm_InvalidNode && Current.aCount[ i ] == 0 )
+            {
+                Depth = std::max( Depth, GetDepth( Current.aChild[ i ] ) );
+            }
+        }
+        return Depth + 1;
+    }
+
+    static u32 GetMaxDepth( void )
+    {
+        return sm_MaxDepth;
+    }
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// BvhCollisionBoundsDepth - Objects laid out so the surface area heuristic only splits off a few
+//  at a time give a deep hierarchy, which stays within the depth the traversal stacks are sized
+//  for and finds every object
+TEST( BvhCollisionBoundsDepth )
+{
+    std::vector<TestBox> aBoxes( 300 );
+    DepthProbe Collision;
+
+    //
+    // Each box an eighth closer to the origin and smaller than the last, so the largest few are
+    //  alone in the last bins and cheapest to split off.
+    //
+    f32 Center = 1.0f;
+    for ( size_t i=0; i < aBoxes.size(); i++, Center *= 0.875f )
+    {
+        char szName[ 32 ];
+        sprintf( szName, "Nested%u", static_cast<u32>(i) );
+
+        aBoxes[ i ].sName = szName;
+        aBoxes[ i ].Min = Math::Vector3( Center * 0.99f, -Center, -Center );
+        aBoxes[ i ].Max = Math::Vector3( Center * 1.01f, Center, Center );
+        aBoxes[ i ].bGround = False;
+
+        Collision.SetObject( aBoxes[ i ].sName.c_str(), aBoxes[ i ].Min, aBoxes[ i ].Max,
+                             aBoxes[ i ].bGround );
+    }
+
+    std::vector<Coll::Request> aRequests( aBoxes.size() );
+    std::vector<Coll::Handle> aHandles( aRequests.size() );
+    for ( size_t i=0; i < aRequests.size(); i++ )
+    {
+        Math::Vector3 Middle = (aBoxes[ i ].Min + aBoxes[ i ].Max) * 0.5f;
+        Math::Vector3 Above( 0.0f, aBoxes[ i ].Max.y * 2.0f, 0.0f );
+        aHandles[ i ] = Collision.LineTest( Middle + Above, Middle - Above, aRequests[ i ] );
+    }
+    Collision.Resolve();
+
+    // A balanced hierarchy over as many objects would be about 4 deep.
+    u32 Depth = Collision.GetDepth();
+    CHECK( Depth > 10 && Depth <= DepthProbe::GetMaxDepth() );
+
+    for ( size_t i=0; i < aRequests.size(); i++ )
+    {
+        Coll::Result Result;
+        CHECK( Collision.Finalize( aHandles[ i ], &Result ) );
+        CHECK( Result.m_Valid &&
+               fabsf( Result.m_Position.y - aBoxes[ i ].Max.y ) < aBoxes[ i ].Max.y * 1e-3f );
+    }
+}
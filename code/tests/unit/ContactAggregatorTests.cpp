@@ -0,0 +1,319 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+
+#include <math.h>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "TestHarness.h"
+#include "../../Interfaces/Services/ContactAggregator.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ClearContact - Zeroes a contact
+static void
+ClearContact(
+    IContactObject::Info& Contact
+    )
+{
+    Contact.m_VelocityObjectA = Math::Vector3::Zero;
+    Contact.m_VelocityObjectB = Math::Vector3::Zero;
+    Contact.m_Normal = Math::Vector3::Zero;
+    Contact.m_Position = Math::Vector3::Zero;
+    Contact.m_Impact = 0.0f;
+    Contact.m_Static = False;
+}
+
+
+class TestContact : public Test::Subject, public IContactObject
+{
+public:
+
+    TestContact( void )
+    {
+        ClearContact( Contact );
+    }
+
+    virtual const IContactObject::Info* GetContact( void )
+    {
+        return &Contact;
+    }
+
+    IContactObject::Info    Contact;
+};
+
+
+class ContactObserver : public IObserver
+{
+public:
+
+    ContactObserver( void )
+        : Count( 0 )
+    {
+    }
+
+    virtual Error ChangeOccurred( ISubject*, System::Changes::BitMask ChangeType )
+    {
+        if ( ChangeType & System::Changes::POI::Contact )
+        {
+            Count++;
+        }
+        return Errors::Success;
+    }
+
+    u32                     Count;
+};
+
+
+// A cluster of the reference, by the contacts' indices
+struct ModelEvent
+{
+    u32                     Strongest;
+    u32                     Count;
+    f32                     TotalImpact;
+    f32                     aSum[ 3 ];
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetCell - Gets the cluster cell of a position the way the aggregator orders them
+static u64
+GetCell(
+    const Math::Vector3& Position,
+    f32 InvClusterSize
+    )
+{
+    u64 x = static_cast<u64>(floorf( Position.x * InvClusterSize ) + 1024.0f);
+    u64 y = static_cast<u64>(floorf( Position.y * InvClusterSize ) + 1024.0f);
+    u64 z = static_cast<u64>(floorf( Position.z * InvClusterSize ) + 1024.0f);
+    return (x << 42) | (y << 21) | z;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ContactAggregatorClustersContacts - Resolve drops contacts under the threshold, reduces the
+//  rest to one event per cell with the cell's first strongest contact, count, total impact and
+//  impact weighted position, and orders the events strongest first, ties by cell
+TEST( ContactAggregatorClustersContacts )
+{
+    const f32 Threshold = 1.0f;
+    const f32 ClusterSize = 2.0f;
+
+    std::mt19937 Random( 42 );
+    std::uniform_real_distribution<f32> Coordinate( -9.0f, 9.0f );
+    std::uniform_int_distribution<u32> Quarters( 0, 8 );
+
+    ContactObserver Observer;
+    ContactAggregator Aggregator( Threshold, ClusterSize );
+    Aggregator.Attach( &Observer, System::Changes::POI::Contact, 0 );
+
+    for ( u32 Round=0; Round < 20; Round++ )
+    {
+        //
+        // Impacts in quarters up to 2, so many land on the threshold and many tie; the index of
+        //  each contact goes in a field the aggregator passes through.
+        //
+        u32 Count = 1 + (Round * 37) % 300;
+        std::vector<IContactObject::Info> aContacts( Count );
+        for ( u32 i=0; i < Count; i++ )
+        {
+            ClearContact( aContacts[ i ] );
+            aContacts[ i ].m_Position = Math::Vector3( Coordinate( Random ),
+                                                       Coordinate( Random ),
+                                                       Coordinate( Random ) );
+            aContacts[ i ].m_Impact = static_cast<f32>(Quarters( Random )) * 0.25f;
+            aContacts[ i ].m_VelocityObjectA.x = static_cast<f32>(i);
+            Aggregator.AddContact( aContacts[ i ] );
+        }
+
+        std::map<u64, ModelEvent> Model;
+        for ( u32 i=0; i < Count; i++ )
+        {
+            const IContactObject::Info& Contact = aContacts[ i ];
+            if ( Contact.m_Impact < Threshold )
+            {
+                continue;
+            }
+
+            u64 Cell = GetCell( Contact.m_Position, 1.0f / ClusterSize );
+            std::map<u64, ModelEvent>::iterator it = Model.find( Cell );
+            if ( it == Model.end() )
+            {
+                ModelEvent Empty = { i, 0, 0.0f, { 0.0f, 0.0f, 0.0f } };
+                it = Model.insert( std::make_pair( Cell, Empty ) ).first;
+            }
+            ModelEvent& Event = it->second;
+            Event.Count++;
+            Event.TotalImpact += Contact.m_Impact;
+            Event.aSum[ 0 ] += Contact.m_Position.x * Contact.m_Impact;
+            Event.aSum[ 1 ] += Contact.m_Position.y * Contact.m_Impact;
+            Event.aSum[ 2 ] += Contact.m_Position.z * Contact.m_Impact;
+            if ( Contact.m_Impact > aContacts[ Event.Strongest ].m_Impact )
+            {
+                Event.Strongest = i;
+            }
+        }
+
+        u32 Posted = Observer.Count;
+        Aggregator.Resolve();
+        const ContactAggregator::EventArray& aEvents = Aggregator.GetEvents();
+
+        CHECK( aEvents.size() == Model.size() );
+        CHECK( Observer.Count == Posted + (Model.empty() ? 0 : 1) );
+        CHECK( Aggregator.GetContact() ==
+               (aEvents.empty() ? NULL : &aEvents[ 0 ].Contact) );
+
+        for ( size_t e=0; e < aEvents.size(); e++ )
+        {
+            const ContactAggregator::Event& Event = aEvents[ e ];
+            u32 Strongest = static_cast<u32>(Event.Contact.m_VelocityObjectA.x);
+            CHECK( Strongest < Count );
+            if ( Strongest >= Count )
+            {
+                continue;
+            }
+
+            u64 Cell = GetCell( aContacts[ Strongest ].m_Position, 1.0f / ClusterSize );
+            std::map<u64, ModelEvent>::const_iterator it = Model.find( Cell );
+            CHECK( it != Model.end() );
+            if ( it == Model.end() )
+            {
+                continue;
+            }
+
+            const ModelEvent& Expected = it->second;
+            CHECK( Strongest == Expected.Strongest );
+            CHECK( Event.Count == Expected.Count );
+            CHECK( Event.Contact.m_Impact == aContacts[ Strongest ].m_Impact );
+            CHECK( fabsf( Event.TotalImpact - Expected.TotalImpact ) <=
+                   1e-5f * Expected.TotalImpact );
+            CHECK( fabsf( Event.Contact.m_Position.x * Expected.TotalImpact -
+                          Expected.aSum[ 0 ] ) <= 1e-3f * Expected.TotalImpact );
+            CHECK( fabsf( Event.Contact.m_Position.y * Expected.TotalImpact -
+                          Expected.aSum[ 1 ] ) <= 1e-3f * Expected.TotalImpact );
+            CHECK( fabsf( Event.Contact.m_Position.z * Expected.TotalImpact -
+                          Expected.aSum[ 2 ] ) <= 1e-3f * Expected.TotalImpact );
+            CHECK( Event.pSource == NULL && Event.pSubject == NULL );
+
+            if ( e > 0 )
+            {
+                const IContactObject::Info& Previous = aEvents[ e - 1 ].Contact;
+                CHECK( Previous.m_Impact >= Event.Contact.m_Impact );
+                if ( Previous.m_Impact == Event.Contact.m_Impact )
+                {
+                    u32 Index = static_cast<u32>(Previous.m_VelocityObjectA.x);
+                    CHECK( Index < Count &&
+                           GetCell( aContacts[ Index ].m_Position, 1.0f / ClusterSize ) < Cell );
+                }
+            }
+        }
+
+        //
+        // Capped, Resolve keeps the strongest events in the same order.
+        //
+        std::vector<ContactAggregator::Event> aAll( aEvents.begin(), aEvents.end() );
+        u32 MaxEvents = static_cast<u32>(aAll.size() / 2);
+        Aggregator.SetMaxEvents( MaxEvents );
+        for ( u32 i=0; i < Count; i++ )
+        {
+            Aggregator.AddContact( aContacts[ i ] );
+        }
+        Aggregator.Resolve();
+        CHECK( aEvents.size() == MaxEvents );
+        for ( size_t e=0; e < aEvents.size(); e++ )
+        {
+            CHECK( aEvents[ e ].Contact.m_VelocityObjectA.x ==
+                   aAll[ e ].Contact.m_VelocityObjectA.x );
+        }
+        Aggregator.SetMaxEvents( static_cast<u32>(-1) );
+
+        //
+        // The contacts are gone once resolved.
+        //
+        Posted = Observer.Count;
+        Aggregator.Resolve();
+        CHECK( aEvents.empty() && Aggregator.GetContact() == NULL );
+        CHECK( Observer.Count == Posted );
+    }
+
+    Aggregator.Detach( &Observer );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ContactAggregatorForgetsSources - Events keep the object that reported their strongest
+//  contact until it shuts down, whether it shuts down before or after the contacts are resolved
+TEST( ContactAggregatorForgetsSources )
+{
+    ContactAggregator Aggregator;
+
+    TestContact* pFirst = new TestContact;
+    TestContact* pSecond = new TestContact;
+    TestContact* pThird = new TestContact;
+    pFirst->Contact.m_Impact = 5.0f;
+    pSecond->Contact.m_Impact = 3.0f;
+    pSecond->Contact.m_Position = Math::Vector3( 10.0f, 0.0f, 0.0f );
+    pThird->Contact.m_Impact = 1.0f;
+    pThird->Contact.m_Position = Math::Vector3( 20.0f, 0.0f, 0.0f );
+
+    //
+    // Reported by posting a change, or added with a source that is also a subject.
+    //
+    pFirst->Attach( &Aggregator, System::Changes::POI::Contact, 0 );
+    pSecond->Attach( &Aggregator, System::Changes::POI::Contact, 0 );
+    pFirst->PostChanges( System::Changes::POI::Contact );
+    pSecond->PostChanges( System::Changes::POI::Contact );
+    Aggregator.AddContact( pThird->Contact, pThird );
+    pThird->Attach( &Aggregator, System::Changes::POI::Contact, 0 );
+
+    Aggregator.Resolve();
+    const ContactAggregator::EventArray& aEvents = Aggregator.GetEvents();
+    CHECK( aEvents.size() == 3 );
+    if ( aEvents.size() == 3 )
+    {
+        CHECK( aEvents[ 0 ].pSource == pFirst &&
+               aEvents[ 0 ].pSubject == static_cast<ISubject*>(pFirst) );
+        CHECK( aEvents[ 1 ].pSource == pSecond &&
+               aEvents[ 1 ].pSubject == static_cast<ISubject*>(pSecond) );
+        CHECK( aEvents[ 2 ].pSource == pThird &&
+               aEvents[ 2 ].pSubject == static_cast<ISubject*>(pThird) );
+
+        // Shutting down after Resolve clears the events of that object only
+        delete pFirst;
+        CHECK( aEvents[ 0 ].pSource == NULL && aEvents[ 0 ].pSubject == NULL );
+        CHECK( aEvents[ 1 ].pSource == pSecond );
+        CHECK( aEvents[ 2 ].pSource == pThird );
+    }
+
+    //
+    // Shutting down before Resolve clears the contacts collected from it.
+    //
+    pSecond->PostChanges( System::Changes::POI::Contact );
+    pThird->PostChanges( System::Changes::POI::Contact );
+    delete pSecond;
+    Aggregator.Resolve();
+    CHECK( aEvents.size() == 2 );
+    if ( aEvents.size() == 2 )
+    {
+        CHECK( aEvents[ 0 ].Contact.m_Impact == 3.0f );
+        CHECK( aEvents[ 0 ].pSource == NULL && aEvents[ 0 ].pSubject == NULL );
+        CHECK( aEvents[ 1 ].pSource == pThird );
+    }
+
+    delete pThird;
+    CHECK( aEvents.size() == 2 && aEvents[ 1 ].pSource == NULL );
+}
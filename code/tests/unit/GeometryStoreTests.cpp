@@ -0,0 +1,157 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+#include <random>
+#include <vector>
+
+#include "TestHarness.h"
+#include "../../Interfaces/Services/GeometryStore.h"
+
+
+struct TestGeometry
+{
+    Math::Vector3       Position;
+    Math::Quaternion    Orientation;
+    Math::Vector3       Scale;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SameGeometry - Compares an object in a buffer of the store with the expected values
+static Bool
+SameGeometry(
+    const GeometryStore& Store,
+    u32 Slot,
+    u32 Lag,
+    const TestGeometry& Expected
+    )
+{
+    const Math::Vector3& Position = *Store.GetPosition( Slot, Lag );
+    const Math::Quaternion& Orientation = *Store.GetOrientation( Slot, Lag );
+    const Math::Vector3& Scale = *Store.GetScale( Slot, Lag );
+
+    return Position.x == Expected.Position.x && Position.y == Expected.Position.y &&
+           Position.z == Expected.Position.z &&
+           Orientation.x == Expected.Orientation.x && Orientation.y == Expected.Orientation.y &&
+           Orientation.z == Expected.Orientation.z && Orientation.w == Expected.Orientation.w &&
+           Scale.x == Expected.Scale.x && Scale.y == Expected.Scale.y &&
+           Scale.z == Expected.Scale.z;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GeometryStoreFlipsWrites - Values written to the back buffer only show in front after a flip,
+//  and then stay there in the frames after, however many buffers back they were written, with
+//  the previous frame readable with 3 buffers
+TEST( GeometryStoreFlipsWrites )
+{
+    for ( u32 BufferCount=2; BufferCount <= GeometryStore::MaxBuffers; BufferCount++ )
+    {
+        std::mt19937 Random( BufferCount );
+        GeometryStore Store( BufferCount );
+
+        TestGeometry Default;
+        Default.Position = Math::Vector3::Zero;
+        Default.Orientation = Math::Quaternion::Zero;
+        Default.Scale = Math::Vector3::One;
+
+        std::vector<u32> aSlots;
+        std::vector<TestGeometry> aExpected( 300, Default );
+        for ( size_t i=0; i < aExpected.size(); i++ )
+        {
+            aSlots.push_back( Store.Add() );
+        }
+        std::vector<TestGeometry> aPrevious = aExpected;
+        std::vector<System::Changes::BitMask> aChanges( aExpected.size() );
+
+        for ( u32 Frame=1; Frame <= 100; Frame++ )
+        {
+            std::fill( aChanges.begin(), aChanges.end(), 0 );
+
+            for ( u32 Write=0; Write < 40; Write++ )
+            {
+                u32 i = Random() % aExpected.size();
+                f32 Value = static_cast<f32>(Random() % 1000);
+                TestGeometry& Expected = aExpected[ i ];
+
+                switch ( Random() % 4 )
+                {
+                case 0:
+                    Expected.Position = Math::Vector3( Value, Value + 1.0f, Value + 2.0f );
+                    Store.SetPosition( aSlots[ i ], Expected.Position );
+                    aChanges[ i ] |= System::Changes::Geometry::Position;
+                    break;
+
+                case 1:
+                    Expected.Orientation.x = Value;
+                    Expected.Orientation.y = 0.0f;
+                    Expected.Orientation.z = -Value;
+                    Expected.Orientation.w = 1.0f;
+                    Store.SetOrientation( aSlots[ i ], Expected.Orientation );
+                    aChanges[ i ] |= System::Changes::Geometry::Orientation;
+                    break;
+
+                case 2:
+                    Expected.Scale = Math::Vector3( Value, Value, Value );
+                    Store.SetScale( aSlots[ i ], Expected.Scale );
+                    aChanges[ i ] |= System::Changes::Geometry::Scale;
+                    break;
+
+                case 3:
+                    // Removing and adding an object puts it back to the defaults in every buffer.
+                    if ( Write == 0 )
+                    {
+                        Store.Remove( aSlots[ i ] );
+                        CHECK( Store.Add() == aSlots[ i ] );
+                        Expected = Default;
+                        aPrevious[ i ] = Default;
+                        aChanges[ i ] = 0;
+                    }
+                    break;
+                }
+            }
+
+            // Nothing written shows before the flip.
+            for ( size_t i=0; i < aExpected.size(); i++ )
+            {
+                CHECK( SameGeometry( Store, aSlots[ i ], 0, aPrevious[ i ] ) );
+            }
+
+            Store.Flip();
+            CHECK( Store.GetFrame() == Frame );
+
+            const GeometryStore::ChangeArray& aChanged = Store.GetChanges();
+            size_t Changed = 0;
+            for ( size_t i=0; i < aExpected.size(); i++ )
+            {
+                CHECK( SameGeometry( Store, aSlots[ i ], 0, aExpected[ i ] ) );
+                if ( BufferCount == 3 )
+                {
+                    CHECK( SameGeometry( Store, aSlots[ i ], 1, aPrevious[ i ] ) );
+                }
+
+                if ( aChanges[ i ] != 0 )
+                {
+                    CHECK( Changed < aChanged.size() && aChanged[ Changed ].Slot == aSlots[ i ] &&
+                           aChanged[ Changed ].Changes == aChanges[ i ] );
+                    Changed++;
+                }
+            }
+            CHECK( Changed == aChanged.size() );
+
+            aPrevious = aExpected;
+        }
+    }
+}
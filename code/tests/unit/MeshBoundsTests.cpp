@@ -0,0 +1,195 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+#include <float.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "TestHarness.h"
+#include "../../Interfaces/Services/MeshBounds.h"
+
+
+struct TestVertex
+{
+    f32                 aNormal[ 3 ];
+    f32                 aPosition[ 3 ];
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SameBox - Compares the published box of the bounds with an expected one
+static Bool
+SameBox(
+    const MeshBounds& Bounds,
+    const f32* pMin,
+    const f32* pMax
+    )
+{
+    Math::Vector3 Min;
+    Math::Vector3 Max;
+    Bounds.GetAABB( Min, Max );
+
+    return Min.x == pMin[ 0 ] && Min.y == pMin[ 1 ] && Min.z == pMin[ 2 ] &&
+           Max.x == pMax[ 0 ] && Max.y == pMax[ 1 ] && Max.z == pMax[ 2 ];
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// MeshBoundsKeepsEpsilon - The box is published the epsilon out from the vertices, and again
+//  only when a vertex moves out of it or the vertices shrink more than twice the epsilon away
+//  from a side, for meshes reduced on one thread or in parallel blocks
+TEST( MeshBoundsKeepsEpsilon )
+{
+    const f32 Epsilon = 0.25f;
+
+    //
+    // The cases the hysteresis is for, on a single axis.
+    //
+    {
+        f32 aPositions[ 2 ][ 3 ] = { { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f } };
+        MeshBounds Bounds( Epsilon );
+        f32 aMin[ 3 ] = { -Epsilon, -Epsilon, -Epsilon };
+        f32 aMax[ 3 ] = { 1.0f + Epsilon, 1.0f + Epsilon, 1.0f + Epsilon };
+
+        CHECK( Bounds.Update( aPositions, sizeof (aPositions[ 0 ]), 2 ) );
+        CHECK( SameBox( Bounds, aMin, aMax ) );
+
+        // Moving inside the box publishes nothing
+        aPositions[ 1 ][ 0 ] = 1.0f + Epsilon;
+        CHECK( !Bounds.Update( aPositions, sizeof (aPositions[ 0 ]), 2 ) );
+        aPositions[ 1 ][ 0 ] = 1.0f - Epsilon;
+        CHECK( !Bounds.Update( aPositions, sizeof (aPositions[ 0 ]), 2 ) );
+        CHECK( SameBox( Bounds, aMin, aMax ) );
+
+        // Growing out of it does
+        aPositions[ 1 ][ 0 ] = 1.5f;
+        CHECK( Bounds.Update( aPositions, sizeof (aPositions[ 0 ]), 2 ) );
+        aMax[ 0 ] = 1.5f + Epsilon;
+        CHECK( SameBox( Bounds, aMin, aMax ) );
+
+        // Shrinking up to twice the epsilon does not, past it does
+        aPositions[ 1 ][ 0 ] = 1.3f;
+        CHECK( !Bounds.Update( aPositions, sizeof (aPositions[ 0 ]), 2 ) );
+        aPositions[ 1 ][ 0 ] = 1.2f;
+        CHECK( Bounds.Update( aPositions, sizeof (aPositions[ 0 ]), 2 ) );
+        aMax[ 0 ] = 1.2f + Epsilon;
+        CHECK( SameBox( Bounds, aMin, aMax ) );
+    }
+
+    //
+    // Random moves against the rule, through the layout overload.
+    //
+    std::mt19937 Random( 9 );
+    std::uniform_real_distribution<f32> Position( -10.0f, 10.0f );
+    std::uniform_real_distribution<f32> Jitter( -0.3f, 0.3f );
+    Test::TaskManager TaskManager;
+
+    const VertexDecl::Element aDecl[] =
+    {
+        { VertexDecl::Type::Float3, VertexDecl::Usage::Normal,   0, 0 },
+        { VertexDecl::Type::Float3, VertexDecl::Usage::Position, 0, 0 },
+        { VertexDecl::Type::Float2, VertexDecl::Usage::Texture,  0, 1 },
+    };
+    VertexLayout Layout( aDecl, 3 );
+    CHECK( Layout.GetStride( 0 ) == sizeof (TestVertex) );
+
+    // Counts on either side of a parallel block
+    const u32 aCounts[] = { 1, 7, 16384, 16385, 40000 };
+
+    for ( u32 c=0; c < sizeof (aCounts) / sizeof (aCounts[ 0 ]); c++ )
+    {
+        std::vector<TestVertex> aVertices( aCounts[ c ] );
+        for ( size_t i=0; i < aVertices.size(); i++ )
+        {
+            for ( u32 Axis=0; Axis < 3; Axis++ )
+            {
+                aVertices[ i ].aNormal[ Axis ] = 100.0f;
+                aVertices[ i ].aPosition[ Axis ] = Position( Random );
+            }
+        }
+
+        IGraphicsObject::StreamView View;
+        View.pData = &aVertices[ 0 ];
+        View.Stride = sizeof (TestVertex);
+        View.Count = aCounts[ c ];
+
+        MeshBounds Bounds( Epsilon );
+        f32 aMin[ 3 ] = { 0.0f, 0.0f, 0.0f };
+        f32 aMax[ 3 ] = { 0.0f, 0.0f, 0.0f };
+        Bool bPublished = False;
+
+        CHECK( !Bounds.Update( 2, Layout, View, &TaskManager ) );
+
+        for ( u32 Step=0; Step < 40; Step++ )
+        {
+            //
+            // Jitter a few vertices, now and then throwing one far out or pulling the extremes in.
+            //
+            for ( u32 Move=0; Move < 10; Move++ )
+            {
+                TestVertex& Vertex = aVertices[ Random() % aVertices.size() ];
+                u32 Axis = Random() % 3;
+
+                switch ( Random() % 6 )
+                {
+                case 0:
+                    Vertex.aPosition[ Axis ] = Position( Random ) * 1.5f;
+                    break;
+
+                case 1:
+                    Vertex.aPosition[ Axis ] *= 0.9f;
+                    break;
+
+                default:
+                    Vertex.aPosition[ Axis ] += Jitter( Random );
+                    break;
+                }
+            }
+
+            f32 aLow[ 3 ] = { FLT_MAX, FLT_MAX, FLT_MAX };
+            f32 aHigh[ 3 ] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+            for ( size_t i=0; i < aVertices.size(); i++ )
+            {
+                for ( u32 Axis=0; Axis < 3; Axis++ )
+                {
+                    aLow[ Axis ] = std::min( aLow[ Axis ], aVertices[ i ].aPosition[ Axis ] );
+                    aHigh[ Axis ] = std::max( aHigh[ Axis ], aVertices[ i ].aPosition[ Axis ] );
+                }
+            }
+
+            Bool bExpected = !bPublished;
+            for ( u32 Axis=0; Axis < 3; Axis++ )
+            {
+                bExpected |= aLow[ Axis ] < aMin[ Axis ] || aHigh[ Axis ] > aMax[ Axis ] ||
+                             aLow[ Axis ] - aMin[ Axis ] > 2.0f * Epsilon ||
+                             aMax[ Axis ] - aHigh[ Axis ] > 2.0f * Epsilon;
+            }
+            if ( bExpected )
+            {
+                for ( u32 Axis=0; Axis < 3; Axis++ )
+                {
+                    aMin[ Axis ] = aLow[ Axis ] - Epsilon;
+                    aMax[ Axis ] = aHigh[ Axis ] + Epsilon;
+                }
+                bPublished = True;
+            }
+
+            CHECK( Bounds.Update( 1, Layout, View, (Step & 1) ? &TaskManager : NULL ) ==
+                   bExpected );
+            CHECK( SameBox( Bounds, aMin, aMax ) );
+        }
+    }
+}
@@ -0,0 +1,145 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+#include <algorithm>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "TestHarness.h"
+#include "../../Interfaces/Services/MeshStreams.h"
+
+
+struct TestView
+{
+    IGraphicsObject::StreamView View;
+    u32                         Value;      // Every element of the version mapped
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// MeshStreamsKeepMappedViews - A mapped view keeps its version however many are written after
+//  it, writes never go to a mapped buffer, and buffers are reused once their views are unmapped
+//  so no more are made than are ever live at once
+TEST( MeshStreamsKeepMappedViews )
+{
+    static const u32 StreamCount = 3;
+    static const u32 Count = 64;
+
+    std::mt19937 Random( 5 );
+    MeshStreams Streams;
+    std::vector<TestView> aViews;
+    u32 aVersions[ StreamCount ] = { 0 };
+    u32 aValues[ StreamCount ] = { 0 };
+    std::set<const void*> WriteBuffers;
+    size_t PeakLive = 0;
+
+    IGraphicsObject::StreamView Unwritten;
+    CHECK( !Streams.Map( 0, Unwritten ) );
+
+    for ( u32 Step=0; Step < 5000; Step++ )
+    {
+        u32 Stream = Random() % StreamCount;
+
+        switch ( Random() % 3 )
+        {
+        case 0:
+        {
+            //
+            // Write a new version, sometimes starting from the current one, into a buffer no view
+            //  or stream holds.
+            //
+            std::set<const void*> Live;
+            for ( size_t i=0; i < aViews.size(); i++ )
+            {
+                Live.insert( aViews[ i ].View.pData );
+            }
+            for ( u32 s=0; s < StreamCount; s++ )
+            {
+                IGraphicsObject::StreamView Current;
+                if ( Streams.Map( s, Current ) )
+                {
+                    Live.insert( Current.pData );
+                    Streams.Unmap( Current );
+                }
+            }
+
+            Bool bPreserve = (aVersions[ Stream ] > 0 && Random() % 2 == 0);
+            u32* pData = static_cast<u32*>(Streams.BeginWrite( Stream, sizeof (u32), Count,
+                                                               bPreserve ));
+            CHECK( Live.find( pData ) == Live.end() );
+            PeakLive = std::max( PeakLive, Live.size() + 1 );
+            WriteBuffers.insert( pData );
+
+            u32 Value = Step + 1;
+            for ( u32 i=0; i < Count; i++ )
+            {
+                CHECK( !bPreserve || pData[ i ] == aValues[ Stream ] );
+                pData[ i ] = Value;
+            }
+            Streams.EndWrite( Stream );
+
+            aVersions[ Stream ]++;
+            aValues[ Stream ] = Value;
+            break;
+        }
+
+        case 1:
+        {
+            TestView v;
+            if ( Streams.Map( Stream, v.View ) )
+            {
+                CHECK( aVersions[ Stream ] > 0 );
+                CHECK( v.View.Version == aVersions[ Stream ] && v.View.Count == Count &&
+                       v.View.Stride == sizeof (u32) );
+                v.Value = aValues[ Stream ];
+                aViews.push_back( v );
+            }
+            else
+            {
+                CHECK( aVersions[ Stream ] == 0 );
+            }
+            break;
+        }
+
+        case 2:
+            if ( !aViews.empty() )
+            {
+                size_t i = Random() % aViews.size();
+                Streams.Unmap( aViews[ i ].View );
+                aViews.erase( aViews.begin() + i );
+            }
+            break;
+        }
+
+        for ( size_t i=0; i < aViews.size(); i++ )
+        {
+            const u32* pData = static_cast<const u32*>(aViews[ i ].View.pData);
+            for ( u32 j=0; j < Count; j++ )
+            {
+                CHECK( pData[ j ] == aViews[ i ].Value );
+            }
+        }
+    }
+
+    CHECK( WriteBuffers.size() <= PeakLive );
+
+    for ( size_t i=0; i < aViews.size(); i++ )
+    {
+        Streams.Unmap( aViews[ i ].View );
+    }
+    CHECK( Streams.GetStreamsChanged() == (1 << StreamCount) - 1 );
+    CHECK( Streams.GetStreamsChanged() == 0 );
+}
@@ -0,0 +1,163 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "TestHarness.h"
+#include "../../Interfaces/Services/ParticleCulling.h"
+
+
+typedef IGraphicsParticleObject::ParticleData ParticleData;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ParticleCullingMatchesScalar - The particles kept are the ones a scalar test against the
+//  frustum and the minimum pixel size keeps, in order, culling on one thread or several, and
+//  groups behind the eye or hidden keep none
+TEST( ParticleCullingMatchesScalar )
+{
+    //
+    // A 90 degree perspective from an eye off the origin looking down z, mapping z to 0 to 1.
+    //
+    const f64 Near = 0.1;
+    const f64 Far = 100.0;
+    const f64 Focal = 1.0 / tan( 3.14159265358979 / 4.0 );
+    const f64 Q = Far / (Far - Near);
+    const Math::Vector3 Eye( 5.0f, 2.0f, -10.0f );
+    const f32 PixelScale = static_cast<f32>(720.0 / 2.0 * Focal);
+
+    Math::Matrix4x4 ViewProjection;
+    for ( u32 i=0; i < 16; i++ )
+    {
+        ViewProjection.m[ i ] = 0.0f;
+    }
+    ViewProjection.m[ 0 ] = static_cast<f32>(Focal);
+    ViewProjection.m[ 12 ] = static_cast<f32>(-Focal * Eye.x);
+    ViewProjection.m[ 5 ] = static_cast<f32>(Focal);
+    ViewProjection.m[ 13 ] = static_cast<f32>(-Focal * Eye.y);
+    ViewProjection.m[ 10 ] = static_cast<f32>(Q);
+    ViewProjection.m[ 14 ] = static_cast<f32>(-Q * (Eye.z + Near));
+    ViewProjection.m[ 11 ] = 1.0f;
+    ViewProjection.m[ 15 ] = -Eye.z;
+
+    //
+    // Group 0 spreads around and behind the eye with sizes across the pixel limit, group 1 is
+    //  all behind the eye, and group 2 is hidden.  The count is not a multiple of 4 or a chunk.
+    //
+    const u32 Count = 20003;
+
+    std::mt19937 Random( 21 );
+    std::uniform_real_distribution<f32> Across( -80.0f, 80.0f );
+    std::uniform_real_distribution<f32> Along( -30.0f, 110.0f );
+    std::uniform_real_distribution<f32> LogSize( -5.0f, 1.0f );
+
+    ParticleGroups Groups;
+    for ( u32 g=0; g < 3; g++ )
+    {
+        std::vector<ParticleData> aParticles( Count );
+        for ( u32 i=0; i < Count; i++ )
+        {
+            ParticleData& Particle = aParticles[ i ];
+            f32 z = (g == 1) ? Eye.z - 1.0f - fabsf( Along( Random ) ) : Along( Random );
+            Particle.Position = Math::Vector3( Across( Random ), Across( Random ), z );
+            Particle.Velocity = Math::Vector3::Zero;
+            Particle.Size = expf( LogSize( Random ) );
+            Particle.Time = 0.0f;
+            Particle.LifeTime = 100.0f;
+            Particle.Mass = 1.0f;
+            Particle.Color = 0;
+        }
+
+        Groups.AddGroup( ParticleStore::e_Euler, NULL, NULL, g + 1 );
+        Groups.GetStore( g ).Emit( &aParticles[ 0 ], Count );
+    }
+    Groups.SetVisible( 2, False );
+    Groups.Update( 1.0f / 60.0f );
+
+    ParticleCulling Culling;
+    Culling.SetView( ViewProjection, Eye, PixelScale );
+    Culling.SetMinPixelSize( 2.0f );
+
+    Test::TaskManager Tasks;
+    Culling.Cull( Groups, &Tasks );
+
+    IGraphicsParticleObject::ParticleColumns Columns;
+    Culling.GetColumns( Groups, 0, Columns );
+    CHECK( Columns.Count == Count && Columns.VisibleCount == Culling.GetVisibleCount( 0 ) );
+
+    std::vector<u32> aVisible( Columns.pVisible, Columns.pVisible + Columns.VisibleCount );
+    CHECK( std::adjacent_find( aVisible.begin(), aVisible.end(), std::greater_equal<u32>() ) ==
+           aVisible.end() );
+
+    //
+    // Test every particle in double precision, skipping the few close enough to a plane or the
+    //  pixel limit for the SSE rounding and reciprocal square root estimate to decide them.
+    //
+    u32 Kept = 0;
+    u32 Culled = 0;
+    for ( u32 i=0; i < Count; i++ )
+    {
+        f64 x = Columns.pPositionX[ i ] - Eye.x;
+        f64 y = Columns.pPositionY[ i ] - Eye.y;
+        f64 z = Columns.pPositionZ[ i ] - Eye.z;
+        f64 Radius = Columns.pSize[ i ] * 0.5;
+
+        f64 Side = sqrt( Focal * Focal + 1.0 );
+        f64 aDistances[ 6 ] =
+        {
+            (z + Focal * x) / Side, (z - Focal * x) / Side,
+            (z + Focal * y) / Side, (z - Focal * y) / Side,
+            z - Near, Far - z,
+        };
+
+        Bool bInside = True;
+        Bool bClose = False;
+        for ( u32 p=0; p < 6; p++ )
+        {
+            bInside &= aDistances[ p ] >= -Radius;
+            bClose |= fabs( aDistances[ p ] + Radius ) < 1e-3;
+        }
+
+        f64 Distance = std::max( sqrt( x * x + y * y + z * z ), 1e-3 );
+        f64 Pixels = Columns.pSize[ i ] * PixelScale / Distance;
+        bClose |= fabs( Pixels / 2.0 - 1.0 ) < 2e-3;
+
+        if ( bClose )
+        {
+            continue;
+        }
+
+        Bool bExpected = bInside && Pixels >= 2.0;
+        Bool bListed = std::binary_search( aVisible.begin(), aVisible.end(), i );
+        CHECK( bListed == bExpected );
+
+        Kept += bExpected;
+        Culled += !bExpected;
+    }
+
+    // Enough on each side for the comparison to mean anything.
+    CHECK( Kept > 1000 && Culled > 1000 );
+
+    CHECK( Culling.GetVisibleCount( 1 ) == 0 && Culling.GetTier( 1 ) == ParticleCulling::Hidden );
+    CHECK( Culling.GetVisibleCount( 2 ) == 0 && Culling.GetTier( 2 ) == ParticleCulling::Hidden );
+
+    Culling.Cull( Groups );
+    Culling.GetColumns( Groups, 0, Columns );
+    CHECK( Columns.VisibleCount == aVisible.size() &&
+           std::equal( aVisible.begin(), aVisible.end(), Columns.pVisible ) );
+}
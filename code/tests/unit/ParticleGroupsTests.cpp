@@ -0,0 +1,108 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "TestHarness.h"
+#include "../../Interfaces/Services/ParticleGroups.h"
+
+
+typedef IGraphicsParticleObject::ParticleData ParticleData;
+
+///////////////////////////////////////////////////////////////////////////////
+// ParticleGroupsThrottledMatchesUnthrottled - A group updated every few calls, with the time
+//  elapsed since its last update, has its particles where a group updated on every call has
+//  them, with either integrator and a time step that changes every call
+TEST( ParticleGroupsThrottledMatchesUnthrottled )
+{
+    const u32 Count = 3000;
+    const u32 Interval = 3;
+
+    std::mt19937 Random( 9 );
+    std::uniform_real_distribution<f32> Unit( -1.0f, 1.0f );
+
+    std::vector<ParticleData> aParticles( Count );
+    for ( u32 i=0; i < Count; i++ )
+    {
+        ParticleData& Particle = aParticles[ i ];
+        Particle.Position = Math::Vector3( Unit( Random ), Unit( Random ), Unit( Random ) );
+        Particle.Velocity = Math::Vector3( Unit( Random ), Unit( Random ), Unit( Random ) );
+        Particle.Size = 1.0f;
+        Particle.Time = 0.0f;
+        Particle.LifeTime = 100.0f;
+        Particle.Mass = 1.0f;
+        Particle.Color = 0;
+    }
+
+    //
+    // Groups 0 and 1 use Euler, 2 and 3 Verlet; the odd ones are throttled.
+    //
+    Test::TaskManager Tasks;
+    ParticleGroups Groups;
+
+    for ( u32 g=0; g < 4; g++ )
+    {
+        ParticleStore::Integrator Method = g < 2 ? ParticleStore::e_Euler : ParticleStore::e_Verlet;
+        Groups.AddGroup( Method, NULL, NULL, g + 1 );
+        Groups.GetStore( g ).Emit( &aParticles[ 0 ], Count );
+    }
+    Groups.SetUpdateInterval( 1, Interval );
+    Groups.SetUpdateInterval( 3, Interval );
+
+    std::vector<ParticleData> aFull( Count );
+    std::vector<ParticleData> aThrottled( Count );
+    u32 Compared = 0;
+
+    for ( u32 Call=0; Call < 30; Call++ )
+    {
+        Groups.Update( (1 + Call % 4) / 120.0f, &Tasks );
+
+        for ( u32 g=0; g < 4; g += 2 )
+        {
+            CHECK( Groups.GetStore( g ).GetCount() == Count &&
+                   Groups.GetStore( g + 1 ).GetCount() == Count );
+
+            Groups.GetStore( g ).CopyParticles( &aFull[ 0 ] );
+            Groups.GetStore( g + 1 ).CopyParticles( &aThrottled[ 0 ] );
+
+            //
+            // Compare on the calls the throttled group was updated on, when it has aged as much.
+            //
+            if ( fabsf( aFull[ 0 ].Time - aThrottled[ 0 ].Time ) > 1e-5f )
+            {
+                continue;
+            }
+            Compared++;
+
+            f32 MaxError = 0.0f;
+            for ( u32 i=0; i < Count; i++ )
+            {
+                const f32* pFull = &aFull[ i ].Position.x;
+                const f32* pThrottled = &aThrottled[ i ].Position.x;
+
+                for ( u32 Axis=0; Axis < 3; Axis++ )
+                {
+                    MaxError = std::max( MaxError, fabsf( pFull[ Axis ] - pThrottled[ Axis ] ) );
+                }
+            }
+            CHECK( MaxError < 1e-4f );
+        }
+    }
+
+    CHECK( Compared >= 2 * (30 / Interval) - 2 );
+}
@@ -0,0 +1,233 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+#include <math.h>
+#include <random>
+#include <vector>
+
+#include "TestHarness.h"
+#include "../../Interfaces/Services/ParticleStore.h"
+
+
+typedef IGraphicsParticleObject::ParticleData ParticleData;
+
+///////////////////////////////////////////////////////////////////////////////
+// RandomParticles - Makes particles around the origin living up to a second
+static void
+RandomParticles(
+    std::mt19937& Random,
+    u32 Count,
+    std::vector<ParticleData>& aParticles
+    )
+{
+    std::uniform_real_distribution<f32> Unit( 0.0f, 1.0f );
+
+    aParticles.resize( Count );
+    for ( u32 i=0; i < Count; i++ )
+    {
+        ParticleData& Particle = aParticles[ i ];
+        Particle.Position = Math::Vector3( Unit( Random ), Unit( Random ), Unit( Random ) );
+        Particle.Velocity = Math::Vector3( Unit( Random ) - 0.5f, Unit( Random ), Unit( Random ) - 0.5f );
+        Particle.Size = Unit( Random );
+        Particle.Time = 0.0f;
+        Particle.LifeTime = Unit( Random );
+        Particle.Mass = 1.0f;
+        Particle.Color = static_cast<u32>(Random());
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// UpdateChunkRange - Updates a range of chunks, called by ParallelFor
+static void
+UpdateChunkRange(
+    void* pParam,
+    u32 Begin,
+    u32 End
+    )
+{
+    ParticleStore* pStore = reinterpret_cast<ParticleStore*>(pParam);
+
+    for ( u32 Chunk=Begin; Chunk < End; Chunk++ )
+    {
+        pStore->UpdateChunk( Chunk );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// EmitIntoChunks - Writes particles into the emission chunks of a chunked update
+static void
+EmitIntoChunks(
+    ParticleStore& Store,
+    u32 Chunks,
+    const std::vector<ParticleData>& aParticles
+    )
+{
+    u32 Read = 0;
+
+    for ( u32 Chunk=Store.GetFirstEmitChunk(); Chunk < Chunks; Chunk++ )
+    {
+        u32 First;
+        u32 Count = Store.GetEmitRange( Chunk, First );
+
+        for ( u32 i=0; i < Count; i++, Read++ )
+        {
+            const ParticleData& Particle = aParticles[ Read ];
+            const f32* pPosition = &Particle.Position.x;
+            const f32* pVelocity = &Particle.Velocity.x;
+
+            for ( u32 Axis=0; Axis < 3; Axis++ )
+            {
+                Store.GetPositionColumn( Axis )[ First + i ] = pPosition[ Axis ];
+                Store.GetVelocityColumn( Axis )[ First + i ] = pVelocity[ Axis ];
+            }
+            Store.GetSizeColumn()[ First + i ] = Particle.Size;
+            Store.GetTimeColumn()[ First + i ] = Particle.Time;
+            Store.GetLifeTimeColumn()[ First + i ] = Particle.LifeTime;
+            Store.GetMassColumn()[ First + i ] = Particle.Mass;
+            Store.GetColorColumn()[ First + i ] = Particle.Color;
+        }
+
+        Store.SetEmitted( Chunk, Count );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ParticleStoreChunkedMatchesSerial - Updating a chunk at a time on several threads, emitting
+//  into the emission chunks, leaves the same particles as Update followed by Emit, with either
+//  integrator and a time step that changes every frame
+TEST( ParticleStoreChunkedMatchesSerial )
+{
+    const Math::Vector3 Gravity( 0.0f, -9.8f, 0.5f );
+    const f32 Drag = 0.3f;
+
+    Test::TaskManager Tasks;
+
+    for ( u32 Method=0; Method < 2; Method++ )
+    {
+        ParticleStore::Integrator Integrator =
+            Method == 0 ? ParticleStore::e_Euler : ParticleStore::e_Verlet;
+        ParticleStore Serial( Integrator );
+        ParticleStore Chunked( Integrator );
+
+        std::mt19937 Random( 5 );
+        std::vector<ParticleData> aEmitted;
+
+        RandomParticles( Random, 5000, aEmitted );
+        Serial.Emit( &aEmitted[ 0 ], 5000 );
+        Chunked.Emit( &aEmitted[ 0 ], 5000 );
+
+        for ( u32 Frame=0; Frame < 30; Frame++ )
+        {
+            f32 DeltaTime = (1 + Frame % 3) / 60.0f;
+            u32 EmitCount = static_cast<u32>(Random() % 2500);
+            RandomParticles( Random, EmitCount, aEmitted );
+
+            Serial.Update( DeltaTime, Gravity, Drag );
+            if ( EmitCount > 0 )
+            {
+                Serial.Emit( &aEmitted[ 0 ], EmitCount );
+            }
+
+            u32 Chunks = Chunked.BeginUpdate( DeltaTime, Gravity, Drag, EmitCount );
+            Tasks.ParallelFor( NULL, UpdateChunkRange, &Chunked, 0, Chunked.GetFirstEmitChunk() );
+            EmitIntoChunks( Chunked, Chunks, aEmitted );
+            CHECK( Chunked.EndUpdate() == EmitCount );
+
+            CHECK( Chunked.GetCount() == Serial.GetCount() );
+            if ( Chunked.GetCount() != Serial.GetCount() )
+            {
+                break;
+            }
+
+            std::vector<ParticleData> aSerial( Serial.GetCount() + 1 );
+            std::vector<ParticleData> aChunked( Chunked.GetCount() + 1 );
+            Serial.CopyParticles( &aSerial[ 0 ] );
+            Chunked.CopyParticles( &aChunked[ 0 ] );
+
+            u32 Mismatches = 0;
+            for ( u32 i=0; i < Serial.GetCount(); i++ )
+            {
+                const ParticleData& a = aSerial[ i ];
+                const ParticleData& b = aChunked[ i ];
+
+                if ( a.Position.x != b.Position.x || a.Position.y != b.Position.y ||
+                     a.Position.z != b.Position.z || a.Velocity.x != b.Velocity.x ||
+                     a.Velocity.y != b.Velocity.y || a.Velocity.z != b.Velocity.z ||
+                     a.Size != b.Size || a.Time != b.Time || a.LifeTime != b.LifeTime ||
+                     a.Mass != b.Mass || a.Color != b.Color )
+                {
+                    Mismatches++;
+                }
+            }
+            CHECK( Mismatches == 0 );
+
+            Math::Vector3 SerialMin, SerialMax, ChunkedMin, ChunkedMax;
+            f32 SerialSize, ChunkedSize;
+            Serial.GetBounds( SerialMin, SerialMax, SerialSize );
+            Chunked.GetBounds( ChunkedMin, ChunkedMax, ChunkedSize );
+            CHECK( SerialMin == ChunkedMin && SerialMax == ChunkedMax && SerialSize == ChunkedSize );
+        }
+
+        CHECK( Serial.GetCount() > ParticleStore::ChunkSize );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ParticleStoreVerletKeepsSpeed - A particle moving at a steady speed keeps it, and is where that
+//  speed takes it, when the time step changes between updates
+TEST( ParticleStoreVerletKeepsSpeed )
+{
+    const f32 aDeltaTimes[] = { 0.01f, 0.08f, 0.02f, 0.05f };
+
+    for ( u32 Chunked=0; Chunked < 2; Chunked++ )
+    {
+        ParticleStore Store( ParticleStore::e_Verlet );
+
+        ParticleData Emitted;
+        Emitted.Position = Math::Vector3::Zero;
+        Emitted.Velocity = Math::Vector3( 1.0f, 0.0f, 0.0f );
+        Emitted.Size = 1.0f;
+        Emitted.Time = 0.0f;
+        Emitted.LifeTime = 100.0f;
+        Emitted.Mass = 1.0f;
+        Emitted.Color = 0;
+        Store.Emit( &Emitted, 1 );
+
+        f32 Elapsed = 0.0f;
+        for ( u32 i=0; i < 4; i++ )
+        {
+            if ( Chunked )
+            {
+                Store.BeginUpdate( aDeltaTimes[ i ], Math::Vector3::Zero, 0.0f, 0 );
+                Store.UpdateChunk( 0 );
+                Store.EndUpdate();
+            }
+            else
+            {
+                Store.Update( aDeltaTimes[ i ], Math::Vector3::Zero );
+            }
+            Elapsed += aDeltaTimes[ i ];
+
+            ParticleData Particle;
+            Store.CopyParticles( &Particle );
+            CHECK( fabsf( Particle.Velocity.x - 1.0f ) < 1e-4f );
+            CHECK( fabsf( Particle.Position.x - Elapsed ) < 1e-5f );
+        }
+    }
+}
@@ -0,0 +1,286 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+#include <stddef.h>
+#include <string.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "TestHarness.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SameProperty - Compares the name, type, flags and values of two properties
+static Bool
+SameProperty(
+    const Properties::Property& a,
+    const Properties::Property& b
+    )
+{
+    if ( a.GetId() != b.GetId() || strcmp( a.GetName(), b.GetName() ) != 0 ||
+         a.GetType() != b.GetType() || a.GetFlags() != b.GetFlags() )
+    {
+        return False;
+    }
+
+    for ( i32 i=0; i < static_cast<i32>(Properties::Values::Count); i++ )
+    {
+        switch ( a.GetValueType( i ) )
+        {
+        case Properties::Values::None:
+            break;
+
+        case Properties::Values::Boolean:
+            if ( a.GetBool( i ) != b.GetBool( i ) ) { return False; }
+            break;
+
+        case Properties::Values::Enum:
+        case Properties::Values::Int32:
+            if ( a.GetInt32( i ) != b.GetInt32( i ) ) { return False; }
+            break;
+
+        case Properties::Values::String:
+        case Properties::Values::Path:
+            if ( strcmp( a.GetStringPtr( i ), b.GetStringPtr( i ) ) != 0 ) { return False; }
+            break;
+
+        default:
+            if ( a.GetFloat32( i ) != b.GetFloat32( i ) ) { return False; }
+            break;
+        }
+    }
+
+    return True;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// MakeProperties - Makes one property of each kind of value, the first twice
+static Properties::Array
+MakeProperties(
+    void
+    )
+{
+    Properties::Array Properties;
+
+    Properties::Property Counts( "BinaryCounts", Properties::MakeId( "BinaryCounts" ),
+                                 VALUE2( Properties::Values::Int32, Properties::Values::Enum ),
+                                 Properties::Flags::Valid );
+    Counts.SetValue( 0, -7 );
+    Counts.SetValue( 1, 3 );
+    Properties.push_back( Counts );
+
+    Properties::Property Position( "BinaryPosition", Properties::MakeId( "BinaryPosition" ),
+                                   Properties::Values::Vector3,
+                                   Properties::Flags::Valid | Properties::Flags::InitOnly );
+    Position.SetValue( 0, 1.5f );
+    Position.SetValue( 1, -2.25f );
+    Position.SetValue( 2, 1e20f );
+    Properties.push_back( Position );
+
+    Properties::Property Labels( "BinaryLabels", Properties::MakeId( "BinaryLabels" ),
+                                 VALUE4( Properties::Values::String, Properties::Values::Boolean,
+                                         Properties::Values::Path, Properties::Values::String ),
+                                 Properties::Flags::Valid );
+    Labels.SetValue( 0, "label" );
+    Labels.SetValue( 1, True );
+    Labels.SetValue( 2, "some/path/to/a/file.xml" );
+    Labels.SetValue( 3, "" );
+    Properties.push_back( Labels );
+
+    // The same name again shares its name table entry.
+    Counts.SetValue( 0, 42 );
+    Properties.push_back( Counts );
+
+    return Properties;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// PropertyBinaryRoundTrips - Properties written and attached read back the same through views
+//  and Read, and writing them again gives the same bytes
+TEST( PropertyBinaryRoundTrips )
+{
+    Properties::Array Properties = MakeProperties();
+
+    Properties::Binary::Writer Writer;
+    std::vector<u8> Buffer;
+    CHECK( Writer.Write( Properties, Buffer ) == Errors::Success );
+
+    const Properties::Binary::Header* pHeader =
+        reinterpret_cast<const Properties::Binary::Header*>(&Buffer[ 0 ]);
+    CHECK( pHeader->NameCount == 3 && pHeader->RecordCount == 4 );
+    CHECK( pHeader->TotalSize == Buffer.size() && Buffer.size() % 4 == 0 );
+
+    Properties::Binary::Reader Reader;
+    CHECK( Reader.Attach( &Buffer[ 0 ], static_cast<u32>(Buffer.size()) ) == Errors::Success );
+    CHECK( Reader.GetCount() == Properties.size() );
+
+    for ( u32 i=0; i < Reader.GetCount(); i++ )
+    {
+        Properties::Binary::Reader::View v = Reader.Get( i );
+        CHECK( v.GetId() == Properties[ i ].GetId() );
+        CHECK( strcmp( v.GetName(), Properties[ i ].GetName() ) == 0 );
+        CHECK( v.GetType() == Properties[ i ].GetType() );
+        CHECK( v.GetFlags() == Properties[ i ].GetFlags() );
+    }
+    CHECK( Reader.Get( 2 ).GetBool( 1 ) );
+    CHECK( std::string( Reader.Get( 2 ).GetStringPtr( 2 ) ) == "some/path/to/a/file.xml" );
+    CHECK( Reader.Get( 3 ).GetInt32( 0 ) == 42 );
+
+    Properties::Array Read;
+    Reader.Read( Read );
+    CHECK( Read.size() == Properties.size() );
+    for ( u32 i=0; i < Read.size() && i < Properties.size(); i++ )
+    {
+        CHECK( SameProperty( Read[ i ], Properties[ i ] ) );
+    }
+
+    // Attaching interned the names.
+    pcstr pszName = Properties::Names::GetName( Properties::MakeId( "BinaryLabels" ) );
+    CHECK( pszName != NULL && std::string( pszName ) == "BinaryLabels" );
+
+    std::vector<u8> Again;
+    CHECK( Writer.Write( Read, Again ) == Errors::Success );
+    CHECK( Again == Buffer );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// PropertyBinaryRejectsCorruptInput - Attach refuses a buffer with a bad header, a short size,
+//  or an offset, index or name id that does not hold up, and anything it accepts after random
+//  corruption reads back without leaving the buffer
+TEST( PropertyBinaryRejectsCorruptInput )
+{
+    Properties::Binary::Writer Writer;
+    std::vector<u8> Buffer;
+    Writer.Write( MakeProperties(), Buffer );
+
+    // A copy of the buffer to corrupt, read and written a 32 bit word at a byte offset at a time.
+    struct Corrupt
+    {
+        std::vector<u8> Bytes;
+
+        u32& operator[]( size_t Offset )
+        {
+            return *reinterpret_cast<u32*>(&Bytes[ Offset ]);
+        }
+
+        Bool Attaches( u32 Size )
+        {
+            Properties::Binary::Reader Reader;
+            return Reader.Attach( &Bytes[ 0 ], Size ) == Errors::Success;
+        }
+
+        Bool Attaches( void )
+        {
+            return Attaches( static_cast<u32>(Bytes.size()) );
+        }
+    };
+
+    const size_t NamesOffset = sizeof (Properties::Binary::Header);
+    const size_t RecordsOffset = NamesOffset + 3 * sizeof (Properties::Binary::NameEntry);
+    const size_t StringsOffset = RecordsOffset + 4 * sizeof (Properties::Binary::Record);
+    const u32 StringSize = reinterpret_cast<Properties::Binary::Header*>(&Buffer[ 0 ])->StringSize;
+
+    Corrupt c;
+    c.Bytes = Buffer;
+    CHECK( c.Attaches() );
+
+    Properties::Binary::Reader Reader;
+    CHECK( Reader.Attach( NULL, 0 ) != Errors::Success );
+    CHECK( !c.Attaches( sizeof (Properties::Binary::Header) - 1 ) );
+    CHECK( !c.Attaches( static_cast<u32>(Buffer.size()) - 1 ) );
+
+    c.Bytes = Buffer; c[ offsetof( Properties::Binary::Header, Magic ) ] ^= 1;
+    CHECK( !c.Attaches() );
+
+    c.Bytes = Buffer; c[ offsetof( Properties::Binary::Header, Version ) ] += 1;
+    CHECK( !c.Attaches() );
+
+    c.Bytes = Buffer; c[ offsetof( Properties::Binary::Header, NameCount ) ] += 1;
+    CHECK( !c.Attaches() );
+
+    c.Bytes = Buffer; c[ offsetof( Properties::Binary::Header, RecordCount ) ] = 0x40000000;
+    CHECK( !c.Attaches() );
+
+    c.Bytes = Buffer; c[ offsetof( Properties::Binary::Header, TotalSize ) ] -= 4;
+    CHECK( !c.Attaches() );
+
+    // Unterminated string data
+    c.Bytes = Buffer; c.Bytes.back() = 'x';
+    CHECK( !c.Attaches() );
+
+    // A name offset past the string data
+    c.Bytes = Buffer;
+    c[ NamesOffset + offsetof( Properties::Binary::NameEntry, NameOffset ) ] = StringSize;
+    CHECK( !c.Attaches() );
+
+    // A name id that is not that of the name
+    c.Bytes = Buffer;
+    c[ NamesOffset + offsetof( Properties::Binary::NameEntry, NameId ) ] += 1;
+    CHECK( !c.Attaches() );
+
+    // A name that was changed under its id
+    c.Bytes = Buffer; c.Bytes[ StringsOffset ] ^= 0x20;
+    CHECK( !c.Attaches() );
+
+    // A record naming a name past the table
+    c.Bytes = Buffer;
+    c[ RecordsOffset + offsetof( Properties::Binary::Record, NameIndex ) ] = 3;
+    CHECK( !c.Attaches() );
+
+    // A string value offset past the string data (the third record holds strings)
+    c.Bytes = Buffer;
+    c[ RecordsOffset + 2 * sizeof (Properties::Binary::Record) +
+       offsetof( Properties::Binary::Record, aValues ) ] = StringSize;
+    CHECK( !c.Attaches() );
+
+    // Retyping an int to a string leaves its value an offset that must be checked.
+    c.Bytes = Buffer;
+    c[ RecordsOffset + offsetof( Properties::Binary::Record, Type ) ] =
+        VALUE2( Properties::Values::String, Properties::Values::Enum );
+    CHECK( !c.Attaches() );
+
+    std::mt19937 Random( 17 );
+    for ( u32 Trial=0; Trial < 2000; Trial++ )
+    {
+        c.Bytes = Buffer;
+        for ( u32 Flips = Random() % 4 + 1; Flips > 0; Flips-- )
+        {
+            c.Bytes[ Random() % c.Bytes.size() ] ^= static_cast<u8>(1 << (Random() % 8));
+        }
+
+        if ( Reader.Attach( &c.Bytes[ 0 ], static_cast<u32>(c.Bytes.size()) ) == Errors::Success )
+        {
+            Properties::Array Read;
+            Reader.Read( Read );
+            CHECK( Read.size() == Reader.GetCount() );
+
+            for ( u32 i=0; i < Read.size(); i++ )
+            {
+                for ( i32 v=0; v < static_cast<i32>(Properties::Values::Count); v++ )
+                {
+                    u32 Type = Read[ i ].GetValueType( v );
+                    if ( Type == Properties::Values::String || Type == Properties::Values::Path )
+                    {
+                        CHECK( strlen( Read[ i ].GetStringPtr( v ) ) < StringSize );
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,316 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+#include <stdio.h>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "TestHarness.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+// RandomString - Makes a string of letters, now and then one far longer than any property
+//  stores inline
+static std::string
+RandomString(
+    std::mt19937& Random
+    )
+{
+    u32 Length = (Random() % 16 == 0) ? 70000 + Random() % 100 : Random() % 30;
+
+    std::string s( Length, ' ' );
+    for ( u32 i=0; i < Length; i++ )
+    {
+        s[ i ] = static_cast<char>('a' + Random() % 26);
+    }
+    return s;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// StringStoreKeepsStrings - Strings appended to a store read back the same as it grows onto the
+//  heap, is copied, moved, swapped and cleared
+TEST( StringStoreKeepsStrings )
+{
+    std::mt19937 Random( 7 );
+
+    Properties::StringStore Store;
+    std::vector<std::string> aStrings;
+    std::vector<u32> aOffsets;
+
+    CHECK( !Store.IsHeap() && Store.GetCapacity() == Properties::StringStore::InlineCapacity );
+
+    for ( u32 i=0; i < 40; i++ )
+    {
+        aStrings.push_back( RandomString( Random ) );
+        aOffsets.push_back( Store.Append( aStrings.back().c_str(),
+                                          static_cast<u32>(aStrings.back().length()) ) );
+    }
+    CHECK( Store.IsHeap() );
+
+    Properties::StringStore Copy( Store );
+    Properties::StringStore Moved( std::move( Copy ) );
+    Properties::StringStore Inline;
+    Inline.Append( "short", 5 );
+    Inline.Swap( Moved );
+
+    CHECK( Inline.IsHeap() && !Moved.IsHeap() );
+    CHECK( Copy.GetSize() == 0 );
+    CHECK( Inline.GetSize() == Store.GetSize() );
+
+    size_t Total = 0;
+    for ( u32 i=0; i < aStrings.size(); i++ )
+    {
+        CHECK( aStrings[ i ] == Store.Get( aOffsets[ i ] ) );
+        CHECK( aStrings[ i ] == Inline.Get( aOffsets[ i ] ) );
+        Total += aStrings[ i ].length() + 1;
+    }
+    CHECK( Store.GetSize() == Total );
+    CHECK( std::string( Moved.Get( 0 ) ) == "short" );
+
+    //
+    // Copies only take the used characters, so a cleared heap store copies back inline.
+    //
+    Store.Clear();
+    u32 Offset = Store.Append( "abc", 3 );
+    Properties::StringStore Small( Store );
+    CHECK( !Small.IsHeap() && std::string( Small.Get( Offset ) ) == "abc" );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// PropertyStringsMatchStdString - The string values of a property, set from std::strings, C
+//  strings and its own values, long and short, read back as a std::string per value would, in
+//  the property and in copies of it
+TEST( PropertyStringsMatchStdString )
+{
+    std::mt19937 Random( 11 );
+
+    Properties::Property Strings( "Strings", Properties::MakeId( "Strings" ),
+                                  VALUE1x4( Properties::Values::String ),
+                                  Properties::Flags::Valid );
+    std::string asExpected[ Properties::Values::Count ];
+
+    for ( u32 Step=0; Step < 2000; Step++ )
+    {
+        i32 Index = static_cast<i32>(Random() % Properties::Values::Count);
+
+        switch ( Random() % 3 )
+        {
+        case 0:
+            asExpected[ Index ] = RandomString( Random );
+            Strings.SetValue( Index, asExpected[ Index ] );
+            break;
+
+        case 1:
+            asExpected[ Index ] = RandomString( Random );
+            Strings.SetValue( Index, asExpected[ Index ].c_str() );
+            break;
+
+        case 2:
+        {
+            // A value pointing into the property's own strings
+            i32 Other = static_cast<i32>(Random() % Properties::Values::Count);
+            asExpected[ Index ] = asExpected[ Other ];
+            Strings.SetValue( Index, Strings.GetStringPtr( Other ) );
+            break;
+        }
+        }
+
+        Properties::Property Copy( Strings );
+        Properties::Property Assigned;
+        Assigned = Copy;
+
+        for ( i32 i=0; i < static_cast<i32>(Properties::Values::Count); i++ )
+        {
+            CHECK( Strings.GetString( i ) == asExpected[ i ] );
+            CHECK( Copy.GetString( i ) == asExpected[ i ] );
+            CHECK( Assigned.GetString( i ) == asExpected[ i ] );
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// MapFindsInsertedIds - A map finds every id inserted into it, including ids that probe past
+//  each other, and no others as it grows, is updated, rebuilt and cleared
+TEST( MapFindsInsertedIds )
+{
+    std::mt19937 Random( 13 );
+
+    Properties::Map Map;
+    std::map<Properties::Id, u32> Expected;
+
+    CHECK( Map.Find( 1 ) == Properties::Map::InvalidIndex );
+
+    for ( u32 i=0; i < 1000; i++ )
+    {
+        // Ids sharing their low bits land in the same slot until the map is large.
+        Properties::Id PropertyId = (Random() % 4 == 0) ? (Random() % 64 + 1) << 12 :
+                                                         Random() % 4096 + 1;
+        Expected[ PropertyId ] = i;
+        Map.Insert( PropertyId, i );
+    }
+    CHECK( Map.Size() == Expected.size() );
+
+    for ( Properties::Id PropertyId=1; PropertyId <= (64 << 12); PropertyId++ )
+    {
+        std::map<Properties::Id, u32>::const_iterator it = Expected.find( PropertyId );
+        CHECK( Map.Find( PropertyId ) ==
+               ((it != Expected.end()) ? it->second : Properties::Map::InvalidIndex) );
+    }
+
+    Map.Clear();
+    CHECK( Map.Size() == 0 );
+    CHECK( Map.Find( Expected.begin()->first ) == Properties::Map::InvalidIndex );
+
+    Properties::Array Properties;
+    for ( u32 i=0; i < 40; i++ )
+    {
+        char szName[ 32 ];
+        sprintf( szName, "MapProperty%u", i );
+        Properties.push_back( Properties::Property( NULL, Properties::MakeId( szName ),
+                                                    VALUE1( Properties::Values::Int32 ),
+                                                    Properties::Flags::Valid ) );
+    }
+    Map.Build( Properties );
+
+    CHECK( Map.Size() == Properties.size() );
+    for ( u32 i=0; i < Properties.size(); i++ )
+    {
+        CHECK( Map.Find( Properties[ i ].GetId() ) == i );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// PropertyNamesAreInterned - Naming a property interns its name, so change sets built by id
+//  get the name
+TEST( PropertyNamesAreInterned )
+{
+    Properties::Property Named( "InternedByConstructor", VALUE1( Properties::Values::Int32 ),
+                                Properties::Flags::Valid, NULL, NULL, NULL, NULL, 5 );
+
+    CHECK( Named.GetId() == Properties::MakeId( "InternedByConstructor" ) );
+    pcstr pszName = Properties::Names::GetName( Named.GetId() );
+    CHECK( pszName != NULL && std::string( pszName ) == "InternedByConstructor" );
+    CHECK( Named.GetInt32( 0 ) == 5 );
+
+    Properties::ChangeSet Changes;
+    Properties::Property& Added = Changes.Add( Named.GetId(), VALUE1( Properties::Values::Int32 ) );
+    CHECK( Added.GetName() != NULL && std::string( Added.GetName() ) == "InternedByConstructor" );
+
+    CHECK( Properties::Names::GetName( Properties::MakeId( "NeverInterned" ) ) == NULL );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ChangeSetCoalescesChanges - A property changed several times is held once, in the order it
+//  first changed, with its last values, and the change set's system changes are the union of
+//  all of them until it is cleared
+TEST( ChangeSetCoalescesChanges )
+{
+    const u32 NameCount = 24;
+
+    std::mt19937 Random( 13 );
+
+    std::vector<Properties::Id> aIds;
+    for ( u32 i=0; i < NameCount; i++ )
+    {
+        char szName[ 32 ];
+        sprintf( szName, "ChangeSetProperty%u", i );
+        aIds.push_back( Properties::Names::Intern( szName ) );
+    }
+
+    Properties::ChangeSet Changes;
+    CHECK( Changes.IsEmpty() && Changes.GetChanges() == System::Changes::None );
+
+    for ( u32 Round=0; Round < 50; Round++ )
+    {
+        std::vector<Properties::Id> aOrder;
+        std::map<Properties::Id, i32> Values;
+        System::Changes::BitMask Union = System::Changes::None;
+
+        u32 Count = Random() % 100;
+        for ( u32 k=0; k < Count; k++ )
+        {
+            Properties::Id PropertyId = aIds[ Random() % NameCount ];
+            i32 Value = static_cast<i32>(Random() % 1000);
+            System::Changes::BitMask Bits = 1u << (Random() % 32);
+            if ( Random() % 8 == 0 )
+            {
+                Bits = System::Changes::None;
+            }
+
+            //
+            // Changed in place through the entry, or replaced by a copy.
+            //
+            if ( Random() % 2 == 0 )
+            {
+                Properties::Property& Entry =
+                    Changes.Add( PropertyId, VALUE1( Properties::Values::Int32 ), Bits );
+                CHECK( Entry.GetId() == PropertyId );
+                Entry.SetValue( 0, Value );
+            }
+            else
+            {
+                Properties::Property Source( Properties::Names::GetName( PropertyId ), PropertyId,
+                                             VALUE1( Properties::Values::Int32 ),
+                                             Properties::Flags::Valid );
+                Source.SetValue( 0, Value );
+                Changes.Add( Source, Bits );
+            }
+
+            if ( Values.find( PropertyId ) == Values.end() )
+            {
+                aOrder.push_back( PropertyId );
+            }
+            Values[ PropertyId ] = Value;
+            Union |= Bits;
+        }
+
+        CHECK( Changes.GetCount() == aOrder.size() );
+        CHECK( Changes.IsEmpty() == aOrder.empty() );
+        CHECK( Changes.GetChanges() == Union );
+
+        const Properties::Array& Properties = Changes.GetProperties();
+        CHECK( Properties.size() == aOrder.size() );
+        for ( size_t i=0; i < aOrder.size() && i < Properties.size(); i++ )
+        {
+            CHECK( Properties[ i ].GetId() == aOrder[ i ] );
+            CHECK( Properties[ i ].GetInt32( 0 ) == Values[ aOrder[ i ] ] );
+        }
+
+        for ( u32 i=0; i < NameCount; i++ )
+        {
+            const Properties::Property* pFound = Changes.Find( aIds[ i ] );
+            std::map<Properties::Id, i32>::const_iterator it = Values.find( aIds[ i ] );
+            CHECK( (pFound != NULL) == (it != Values.end()) );
+            if ( pFound != NULL && it != Values.end() )
+            {
+                CHECK( pFound->GetInt32( 0 ) == it->second );
+                CHECK( std::string( pFound->GetName() ) ==
+                       Properties::Names::GetName( aIds[ i ] ) );
+            }
+        }
+
+        Changes.Clear();
+        CHECK( Changes.IsEmpty() && Changes.GetCount() == 0 );
+        CHECK( Changes.GetChanges() == System::Changes::None );
+        CHECK( Changes.Find( aIds[ 0 ] ) == NULL );
+    }
+}
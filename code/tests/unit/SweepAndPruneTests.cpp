@@ -0,0 +1,151 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+#include <random>
+#include <set>
+#include <vector>
+
+#include "TestHarness.h"
+#include "../../Interfaces/Services/SweepAndPrune.h"
+
+
+typedef std::set< std::pair<u32, u32> > PairSet;
+
+///////////////////////////////////////////////////////////////////////////////
+// RandomBox - Places a box in a wide flat world, now and then a very large one spanning many
+//  cells
+static IIntersectionObject::Info
+RandomBox(
+    std::mt19937& Random
+    )
+{
+    std::uniform_real_distribution<f32> Unit( 0.0f, 1.0f );
+    const f32 World = 100.0f;
+
+    IIntersectionObject::Info Info = IIntersectionObject::Info();
+    Info.pszName = "Box";
+
+    Math::Vector3 Min( Unit( Random ) * World, Unit( Random ) * World * 0.1f, Unit( Random ) * World );
+    f32 Size = (Unit( Random ) < 0.01f) ? World * 0.7f : 0.5f + Unit( Random );
+    Info.AABBMin = Min;
+    Info.AABBMax = Min + Math::Vector3( Size, Size, Size );
+
+    return Info;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SweepAndPruneMatchesAllPairs - The pairs kept up to date as boxes move, are removed and are
+//  added again are the pairs a test of every box against every other finds
+TEST( SweepAndPruneMatchesAllPairs )
+{
+    const u32 Count = 800;
+
+    std::mt19937 Random( 5 );
+    std::uniform_real_distribution<f32> Unit( 0.0f, 1.0f );
+
+    SweepAndPrune Broadphase( 16.0f );
+    std::vector<IIntersectionObject::Info> aInfos( Count );
+    std::vector<SweepAndPrune::Handle> aHandles( Count );
+    std::vector<Bool> abLive( Count, True );
+
+    for ( u32 i=0; i < Count; i++ )
+    {
+        aInfos[ i ] = RandomBox( Random );
+        aHandles[ i ] = Broadphase.Add( aInfos[ i ] );
+    }
+
+    size_t Overlaps = 0;
+
+    for ( u32 Frame=0; Frame < 20; Frame++ )
+    {
+        for ( u32 i=0; i < Count; i++ )
+        {
+            if ( abLive[ i ] )
+            {
+                Math::Vector3 Move( (Unit( Random ) - 0.5f) * 0.2f, (Unit( Random ) - 0.5f) * 0.1f,
+                                    (Unit( Random ) - 0.5f) * 0.2f );
+                aInfos[ i ].AABBMin += Move;
+                aInfos[ i ].AABBMax += Move;
+                Broadphase.Set( aHandles[ i ], aInfos[ i ] );
+            }
+        }
+
+        for ( u32 k=0; k < 20; k++ )
+        {
+            u32 i = Random() % Count;
+            if ( abLive[ i ] )
+            {
+                Broadphase.Remove( aHandles[ i ] );
+                abLive[ i ] = False;
+            }
+            else
+            {
+                aInfos[ i ] = RandomBox( Random );
+                aHandles[ i ] = Broadphase.Add( aInfos[ i ] );
+                abLive[ i ] = True;
+            }
+        }
+
+        Broadphase.Update();
+
+        PairSet Expected;
+        for ( u32 i=0; i < Count; i++ )
+        {
+            for ( u32 j=i + 1; j < Count; j++ )
+            {
+                const IIntersectionObject::Info& a = aInfos[ i ];
+                const IIntersectionObject::Info& b = aInfos[ j ];
+                if ( abLive[ i ] && abLive[ j ] &&
+                     a.AABBMin.x <= b.AABBMax.x && b.AABBMin.x <= a.AABBMax.x &&
+                     a.AABBMin.y <= b.AABBMax.y && b.AABBMin.y <= a.AABBMax.y &&
+                     a.AABBMin.z <= b.AABBMax.z && b.AABBMin.z <= a.AABBMax.z )
+                {
+                    Expected.insert( std::make_pair( std::min( aHandles[ i ], aHandles[ j ] ),
+                                                     std::max( aHandles[ i ], aHandles[ j ] ) ) );
+                }
+            }
+        }
+
+        const SweepAndPrune::PairArray& aPairs = Broadphase.GetPairs();
+        PairSet Found;
+        for ( size_t p=0; p < aPairs.size(); p++ )
+        {
+            CHECK( aPairs[ p ].First < aPairs[ p ].Second );
+            if ( p > 0 )
+            {
+                CHECK( aPairs[ p - 1 ].First < aPairs[ p ].First ||
+                       (aPairs[ p - 1 ].First == aPairs[ p ].First &&
+                        aPairs[ p - 1 ].Second < aPairs[ p ].Second) );
+            }
+            Found.insert( std::make_pair( aPairs[ p ].First, aPairs[ p ].Second ) );
+        }
+        CHECK( Found == Expected );
+
+        size_t Intersections = 0;
+        for ( u32 i=0; i < Count; i++ )
+        {
+            if ( abLive[ i ] )
+            {
+                Intersections += Broadphase.GetIntersections( aHandles[ i ] ).size();
+            }
+        }
+        CHECK( Intersections == 2 * Expected.size() );
+
+        Overlaps += Expected.size();
+    }
+
+    CHECK( Overlaps > 0 );
+}
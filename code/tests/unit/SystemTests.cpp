@@ -0,0 +1,192 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "TestHarness.h"
+
+
+class TestSystemObject : public ISystemObject
+{
+public:
+
+    TestSystemObject( System::Changes::BitMask PotentialChanges )
+        : ISystemObject( NULL, "TestSystemObject" )
+        , PotentialChanges( PotentialChanges )
+        , SetCount( 0 )
+    {
+    }
+
+    virtual System::Type GetSystemType( void )                      { return System::Types::Null; }
+    virtual Error Initialize( const Properties::Array& )            { return Errors::Success; }
+    virtual void GetProperties( Properties::Array& )                {}
+    virtual System::Changes::BitMask GetDesiredSystemChanges( void ) { return 0; }
+    virtual Error ChangeOccurred( ISubject*, System::Changes::BitMask ) { return Errors::Success; }
+
+    virtual void SetProperties( const Properties::Array& Properties )
+    {
+        SetCount += static_cast<u32>(Properties.size());
+    }
+
+    virtual System::Changes::BitMask GetPotentialSystemChanges( void )
+    {
+        return PotentialChanges;
+    }
+
+    System::Changes::BitMask    PotentialChanges;
+    u32                         SetCount;
+};
+
+
+class ChangeRecorder : public IObserver
+{
+public:
+
+    ChangeRecorder( void )
+        : Posts( 0 )
+        , Union( System::Changes::None )
+        , Last( System::Changes::None )
+    {
+    }
+
+    virtual Error ChangeOccurred( ISubject*, System::Changes::BitMask ChangeType )
+    {
+        if ( ChangeType != 0 )
+        {
+            Posts++;
+            Union |= ChangeType;
+            Last = ChangeType;
+        }
+        return Errors::Success;
+    }
+
+    u32                         Posts;
+    System::Changes::BitMask    Union;
+    System::Changes::BitMask    Last;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SystemObjectPostsDirtyChanges - Marked changes the object can post accumulate until posted
+//  once together, property change sets mark their changes, and clean objects post nothing
+TEST( SystemObjectPostsDirtyChanges )
+{
+    const System::Changes::BitMask Potential = System::Changes::Geometry::All;
+    const System::Changes::BitMask Foreign = System::Changes::Graphics::IndexDecl;
+
+    ChangeRecorder Recorder;
+    TestSystemObject Object( Potential );
+    Object.Attach( &Recorder, System::Changes::All, 0 );
+
+    CHECK( Object.GetDirtyChanges() == System::Changes::None );
+    Object.PostDirtyChanges();
+    CHECK( Recorder.Posts == 0 );
+
+    //
+    // Changes the object cannot post are dropped; the rest accumulate.
+    //
+    Object.MarkDirty( System::Changes::Geometry::Position | Foreign );
+    CHECK( Object.GetDirtyChanges() == System::Changes::Geometry::Position );
+    Object.MarkDirty( System::Changes::Geometry::Position );
+    Object.MarkDirty( System::Changes::Geometry::Orientation );
+    Object.MarkDirty( Foreign );
+    CHECK( Object.GetDirtyChanges() ==
+           (System::Changes::Geometry::Position | System::Changes::Geometry::Orientation) );
+
+    Object.PostDirtyChanges();
+    CHECK( Recorder.Posts == 1 );
+    CHECK( Recorder.Last ==
+           (System::Changes::Geometry::Position | System::Changes::Geometry::Orientation) );
+    CHECK( Object.GetDirtyChanges() == System::Changes::None );
+
+    Object.PostDirtyChanges();
+    Object.MarkDirty( Foreign );
+    Object.PostDirtyChanges();
+    CHECK( Recorder.Posts == 1 );
+
+    //
+    // A change set hands its properties over and marks its changes.
+    //
+    Properties::ChangeSet Changes;
+    Object.ApplyChanges( Changes );
+    CHECK( Object.SetCount == 0 && Object.GetDirtyChanges() == System::Changes::None );
+
+    Changes.Add( Properties::Names::Intern( "DirtyPosition" ),
+                 VALUE1x3( Properties::Values::Float32 ), System::Changes::Geometry::Position );
+    Changes.Add( Properties::Names::Intern( "DirtyScale" ),
+                 VALUE1x3( Properties::Values::Float32 ),
+                 System::Changes::Geometry::Scale | Foreign );
+    Object.ApplyChanges( Changes );
+    CHECK( Object.SetCount == 2 );
+    CHECK( Object.GetDirtyChanges() ==
+           (System::Changes::Geometry::Position | System::Changes::Geometry::Scale) );
+
+    Object.PostDirtyChanges();
+    CHECK( Recorder.Posts == 2 );
+    CHECK( Recorder.Last ==
+           (System::Changes::Geometry::Position | System::Changes::Geometry::Scale) );
+
+    Object.Detach( &Recorder );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SystemObjectKeepsConcurrentMarks - Changes marked from several threads while another thread
+//  posts are all posted, and leave the object clean
+TEST( SystemObjectKeepsConcurrentMarks )
+{
+    const u32 ThreadCount = 4;
+    const u32 MarkCount = 20000;
+
+    ChangeRecorder Recorder;
+    TestSystemObject Object( System::Changes::All );
+    Object.Attach( &Recorder, System::Changes::All, 0 );
+
+    std::atomic<u32> Running( ThreadCount );
+    std::vector<std::thread> aThreads;
+    for ( u32 t=0; t < ThreadCount; t++ )
+    {
+        aThreads.push_back( std::thread( [ &Object, &Running, t ]()
+        {
+            for ( u32 i=0; i < MarkCount; i++ )
+            {
+                Object.MarkDirty( 1u << (t * 4 + i % 4) );
+            }
+            Running--;
+        } ) );
+    }
+
+    while ( Running.load() != 0 )
+    {
+        Object.PostDirtyChanges();
+    }
+    for ( u32 t=0; t < ThreadCount; t++ )
+    {
+        aThreads[ t ].join();
+    }
+    Object.PostDirtyChanges();
+
+    CHECK( Recorder.Union == (1u << (ThreadCount * 4)) - 1 );
+    CHECK( Object.GetDirtyChanges() == System::Changes::None );
+
+    u32 Posts = Recorder.Posts;
+    Object.PostDirtyChanges();
+    CHECK( Recorder.Posts == Posts );
+
+    Object.Detach( &Recorder );
+}
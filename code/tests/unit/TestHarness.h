@@ -0,0 +1,113 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#pragma once
+
+//
+// core includes
+//
+#include "../../BaseTypes/BaseTypes.h"
+#include "../../Interfaces/Interface.h"
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// <summary>
+///   A minimal harness for the unit tests of the services: TEST defines a test and registers it,
+///    CHECK records a failed condition and carries on.
+/// </summary>
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace Test
+{
+    typedef void (*TestFunction)( void );
+
+    /// <summary>
+    ///   Registers a test when constructed, used by TEST.
+    /// </summary>
+    class Registrar
+    {
+    public:
+
+        Registrar( const char* pszName, TestFunction pfnTest );
+    };
+
+    /// <summary>
+    ///   Records a failed check, used by CHECK.
+    /// </summary>
+    void Fail( const char* pszCondition, const char* pszFile, u32 Line );
+
+    /// <summary>
+    ///   Runs the tests whose names contain a filter.
+    /// </summary>
+    /// <param name="pszFilter">The filter, or NULL to run every test.</param>
+    /// <returns>The number of failed checks.</returns>
+    u32 Run( const char* pszFilter );
+
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// <summary>
+    ///   A task manager running ParallelFor on TBB, so tests cover the parallel paths.
+    /// </summary>
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class TaskManager : public ITaskManager
+    {
+    public:
+
+        virtual void NonStandardPerThreadCallback( JobFunction pfnCallback, void* pData );
+        virtual u32 GetRecommendedJobCount( JobCountInstructionHints Hints=None );
+        virtual void SetNumberOfThreads( u32 uNumberOfThreads );
+        virtual void ParallelFor( ISystemTask* pSystemTask, ParallelForFunction pfnJobFunction,
+                                  void* pParam, u32 begin, u32 end, u32 minGrain=1 );
+    };
+
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// <summary>
+    ///   A subject with a single observer which, like CSubject, tells the observer it is going
+    ///    away from its own destructor, after the classes derived from it are destroyed.
+    /// </summary>
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class Subject : public ISubject
+    {
+    public:
+
+        Subject( void );
+        virtual ~Subject( void );
+
+        virtual Error Attach( IObserver* pInObserver, u32 uInIntrestBits, u32 uID, u32 shiftBits=0 );
+        virtual Error Detach( IObserver* pInObserver );
+        virtual Error UpdateInterestBits( IObserver* pInObserver, u32 uInIntrestBits );
+        virtual u32 GetID( IObserver* pObserver ) const;
+        virtual void PostChanges( System::Changes::BitMask uInChangedBits );
+        virtual System::Changes::BitMask GetPotentialSystemChanges( void );
+        virtual void PreDestruct( void );
+
+
+    protected:
+
+        IObserver*                  m_pObserver;
+        u32                         m_InterestBits;
+    };
+}
+
+
+#define TEST( Name )                                                            \
+    static void Name( void );                                                   \
+    static Test::Registrar s_Register##Name( #Name, Name );                     \
+    static void Name( void )
+
+#define CHECK( Condition )                                                      \
+    do { if ( !(Condition) ) { Test::Fail( #Condition, __FILE__, __LINE__ ); } } while ( 0 )
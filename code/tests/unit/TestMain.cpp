@@ -0,0 +1,288 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/task_arena.h>
+
+#include "TestHarness.h"
+
+
+struct TestEntry
+{
+    const char*         pszName;
+    Test::TestFunction  pfnTest;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// GetTests - The registered tests, built on first use since registration runs during static
+//  initialization
+static std::vector<TestEntry>&
+GetTests(
+    void
+    )
+{
+    static std::vector<TestEntry> s_aTests;
+    return s_aTests;
+}
+
+static u32 s_Failures = 0;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Registrar - Adds a test to the list
+Test::Registrar::Registrar(
+    const char* pszName,
+    TestFunction pfnTest
+    )
+{
+    TestEntry Entry = { pszName, pfnTest };
+    GetTests().push_back( Entry );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Fail - Reports a failed check
+void
+Test::Fail(
+    const char* pszCondition,
+    const char* pszFile,
+    u32 Line
+    )
+{
+    printf( "  %s(%u): CHECK( %s ) failed\n", pszFile, Line, pszCondition );
+    s_Failures++;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Run - Runs the matching tests, reporting each
+u32
+Test::Run(
+    const char* pszFilter
+    )
+{
+    u32 Failures = 0;
+
+    for ( size_t i=0; i < GetTests().size(); i++ )
+    {
+        const TestEntry& Entry = GetTests()[ i ];
+        if ( pszFilter != NULL && strstr( Entry.pszName, pszFilter ) == NULL )
+        {
+            continue;
+        }
+
+        s_Failures = 0;
+        Entry.pfnTest();
+        printf( "%s %s\n", s_Failures == 0 ? "passed" : "FAILED", Entry.pszName );
+        Failures += s_Failures;
+    }
+
+    return Failures;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// NonStandardPerThreadCallback - Calls the callback on the calling thread only
+void
+Test::TaskManager::NonStandardPerThreadCallback(
+    JobFunction pfnCallback,
+    void* pData
+    )
+{
+    pfnCallback( pData );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetRecommendedJobCount - One job per TBB thread
+u32
+Test::TaskManager::GetRecommendedJobCount(
+    JobCountInstructionHints
+    )
+{
+    return static_cast<u32>(tbb::this_task_arena::max_concurrency());
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SetNumberOfThreads - TBB picks the threads
+void
+Test::TaskManager::SetNumberOfThreads(
+    u32
+    )
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ParallelFor - Splits the range with tbb::parallel_for
+struct ParallelForBody
+{
+    ITaskManager::ParallelForFunction   pfnJobFunction;
+    void*                               pParam;
+
+    void operator()( const tbb::blocked_range<u32>& Range ) const
+    {
+        pfnJobFunction( pParam, Range.begin(), Range.end() );
+    }
+};
+
+void
+Test::TaskManager::ParallelFor(
+    ISystemTask*,
+    ParallelForFunction pfnJobFunction,
+    void* pParam,
+    u32 begin,
+    u32 end,
+    u32 minGrain
+    )
+{
+    ParallelForBody Body = { pfnJobFunction, pParam };
+    tbb::parallel_for( tbb::blocked_range<u32>( begin, end, minGrain ), Body );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Subject - Starts with no observer
+Test::Subject::Subject(
+    void
+    )
+    : m_pObserver( NULL )
+    , m_InterestBits( 0 )
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ~Subject - Tells the observer the subject is going away
+Test::Subject::~Subject(
+    void
+    )
+{
+    PreDestruct();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Attach - Sets the observer
+Error
+Test::Subject::Attach(
+    IObserver* pInObserver,
+    u32 uInIntrestBits,
+    u32,
+    u32
+    )
+{
+    m_pObserver = pInObserver;
+    m_InterestBits = uInIntrestBits;
+    return Errors::Success;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Detach - Clears the observer
+Error
+Test::Subject::Detach(
+    IObserver* pInObserver
+    )
+{
+    if ( m_pObserver == pInObserver )
+    {
+        m_pObserver = NULL;
+    }
+    return Errors::Success;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// UpdateInterestBits - Changes what the observer hears about
+Error
+Test::Subject::UpdateInterestBits(
+    IObserver*,
+    u32 uInIntrestBits
+    )
+{
+    m_InterestBits = uInIntrestBits;
+    return Errors::Success;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetID - Subjects here have no ids
+u32
+Test::Subject::GetID(
+    IObserver*
+    ) const
+{
+    return 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// PostChanges - Calls the observer if it is interested
+void
+Test::Subject::PostChanges(
+    System::Changes::BitMask uInChangedBits
+    )
+{
+    if ( m_pObserver != NULL && (uInChangedBits & m_InterestBits) != 0 )
+    {
+        m_pObserver->ChangeOccurred( this, uInChangedBits & m_InterestBits );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetPotentialSystemChanges - Any change
+System::Changes::BitMask
+Test::Subject::GetPotentialSystemChanges(
+    void
+    )
+{
+    return System::Changes::All;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// PreDestruct - Tells the observer, as CSubject does, with a change of 0
+void
+Test::Subject::PreDestruct(
+    void
+    )
+{
+    if ( m_pObserver != NULL )
+    {
+        m_pObserver->ChangeOccurred( this, 0 );
+        m_pObserver = NULL;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// main - Runs the tests named on the command line, or all of them
+int
+main(
+    int argc,
+    char** argv
+    )
+{
+    u32 Failures = Test::Run( argc > 1 ? argv[ 1 ] : NULL );
+
+    printf( "%u failed checks\n", Failures );
+    return Failures == 0 ? 0 : 1;
+}
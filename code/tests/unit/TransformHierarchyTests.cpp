@@ -0,0 +1,395 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "TestHarness.h"
+#include "../../Interfaces/Services/TransformHierarchy.h"
+
+
+class TestObject : public Test::Subject, public IGeometryObject
+{
+public:
+
+    TestObject( void )
+        : Position( Math::Vector3::Zero )
+        , Scale( Math::Vector3::One )
+        , pParent( NULL )
+        , bRemoved( False )
+    {
+        Orientation.x = 0.0f;
+        Orientation.y = 0.0f;
+        Orientation.z = 0.0f;
+        Orientation.w = 1.0f;
+    }
+
+    virtual const Math::Vector3* GetPosition( void )        { return &Position; }
+    virtual const Math::Quaternion* GetOrientation( void )  { return &Orientation; }
+    virtual const Math::Vector3* GetScale( void )           { return &Scale; }
+
+    Math::Vector3           Position;
+    Math::Quaternion        Orientation;
+    Math::Vector3           Scale;
+
+    // The links the hierarchy is expected to have
+    TestObject*             pParent;
+    Bool                    bRemoved;
+};
+
+
+class GeometryObserver : public IObserver
+{
+public:
+
+    GeometryObserver( void )
+        : Count( 0 )
+    {
+    }
+
+    virtual Error ChangeOccurred( ISubject*, System::Changes::BitMask ChangeType )
+    {
+        if ( ChangeType & System::Changes::Geometry::Position )
+        {
+            Count++;
+        }
+        return Errors::Success;
+    }
+
+    u32                     Count;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Randomize - Gives an object a random local transform
+static void
+Randomize(
+    TestObject& Object,
+    std::mt19937& Random
+    )
+{
+    std::uniform_real_distribution<f32> Unit( -1.0f, 1.0f );
+
+    Object.Position = Math::Vector3( Unit( Random ) * 5.0f, Unit( Random ) * 5.0f,
+                                     Unit( Random ) * 5.0f );
+    Object.Scale = Math::Vector3( 1.0f + Unit( Random ) * 0.3f, 1.0f + Unit( Random ) * 0.3f,
+                                  1.0f + Unit( Random ) * 0.3f );
+
+    f32 x = Unit( Random );
+    f32 y = Unit( Random );
+    f32 z = Unit( Random );
+    f32 w = Unit( Random );
+    f32 InvLength = 1.0f / sqrtf( x * x + y * y + z * z + w * w + 1e-6f );
+    Object.Orientation.x = x * InvLength;
+    Object.Orientation.y = y * InvLength;
+    Object.Orientation.z = z * InvLength;
+    Object.Orientation.w = w * InvLength;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetWorld - Computes an object's world transform as its parent's world times its scaled,
+//  rotated then translated local transform
+static Math::Matrix4x4
+GetWorld(
+    TestObject* pObject
+    )
+{
+    Math::Matrix4x4 Local;
+    Local.Transformation( pObject->Position, pObject->Orientation );
+    for ( u32 i=0; i < 3; i++ )
+    {
+        Local.m[ i ] *= pObject->Scale.x;
+        Local.m[ 4 + i ] *= pObject->Scale.y;
+        Local.m[ 8 + i ] *= pObject->Scale.z;
+    }
+
+    return (pObject->pParent != NULL) ? GetWorld( pObject->pParent ) * Local : Local;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// IsWorldRight - Compares the hierarchy's world transform of an object with the reference
+static Bool
+IsWorldRight(
+    const TransformHierarchy& Hierarchy,
+    TestObject* pObject
+    )
+{
+    const Math::Matrix4x4* pWorld = Hierarchy.GetWorldTransform( pObject );
+    if ( pWorld == NULL )
+    {
+        return False;
+    }
+
+    Math::Matrix4x4 Expected = GetWorld( pObject );
+    for ( u32 i=0; i < 16; i++ )
+    {
+        if ( fabsf( pWorld->m[ i ] - Expected.m[ i ] ) > 1e-3f * (1.0f + fabsf( Expected.m[ i ] )) )
+        {
+            return False;
+        }
+    }
+    return True;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// IsBelow - Checks whether an object or one of its ancestors is in a set
+static Bool
+IsBelow(
+    TestObject* pObject,
+    const std::set<TestObject*>& Touched
+    )
+{
+    for ( ; pObject != NULL; pObject = pObject->pParent )
+    {
+        if ( Touched.count( pObject ) != 0 )
+        {
+            return True;
+        }
+    }
+    return False;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// TransformHierarchyMatchesParentTimesLocal - After each Update every world transform is the
+//  parent's world times the local transform, and the changed objects are exactly those at or
+//  below an object whose local transform or link changed, parents first
+TEST( TransformHierarchyMatchesParentTimesLocal )
+{
+    const u32 ObjectCount = 1500;
+
+    std::mt19937 Random( 11 );
+    std::uniform_real_distribution<f32> Unit( 0.0f, 1.0f );
+    Test::TaskManager TaskManager;
+
+    // The hierarchy is declared first so the objects, which tell it when destroyed, go before it
+    GeometryObserver Observer;
+    TransformHierarchy Hierarchy;
+    Hierarchy.Attach( &Observer, System::Changes::Geometry::Position, 0 );
+
+    //
+    // Random trees a few levels deep, some levels wide enough to be split across jobs.
+    //
+    std::vector<TestObject> aObjects( ObjectCount );
+    std::set<TestObject*> Touched;
+    for ( u32 i=0; i < ObjectCount; i++ )
+    {
+        TestObject& Object = aObjects[ i ];
+        Randomize( Object, Random );
+        Object.Attach( &Hierarchy, System::Changes::Geometry::All, 0 );
+        if ( i > 0 && Unit( Random ) > 0.05f )
+        {
+            Object.pParent = &aObjects[ Random() % i ];
+        }
+        Hierarchy.SetParent( &Object, Object.pParent );
+        Touched.insert( &Object );
+    }
+
+    for ( u32 Frame=0; Frame < 12; Frame++ )
+    {
+        if ( Frame > 0 )
+        {
+            Touched.clear();
+
+            // New local transforms, posted as changes
+            for ( u32 k=0; k < 10; k++ )
+            {
+                TestObject& Object = aObjects[ Random() % ObjectCount ];
+                if ( !Object.bRemoved )
+                {
+                    Randomize( Object, Random );
+                    Object.PostChanges( System::Changes::Geometry::Position );
+                    Touched.insert( &Object );
+                }
+            }
+
+            // New links, to earlier objects so no cycles form
+            for ( u32 k=0; k < (Frame % 3) * 4; k++ )
+            {
+                u32 Child = 1 + Random() % (ObjectCount - 1);
+                TestObject* pParent = &aObjects[ Random() % Child ];
+                if ( aObjects[ Child ].bRemoved || pParent->bRemoved )
+                {
+                    continue;
+                }
+                if ( Unit( Random ) < 0.25f )
+                {
+                    pParent = NULL;
+                }
+                if ( aObjects[ Child ].pParent != pParent )
+                {
+                    aObjects[ Child ].pParent = pParent;
+                    Touched.insert( &aObjects[ Child ] );
+                }
+                Hierarchy.SetParent( &aObjects[ Child ], pParent );
+            }
+
+            // A removal, whose children become roots
+            if ( Frame % 4 == 3 )
+            {
+                TestObject* pRemoved = &aObjects[ Random() % ObjectCount ];
+                if ( !pRemoved->bRemoved )
+                {
+                    pRemoved->bRemoved = True;
+                    Hierarchy.RemoveObject( pRemoved );
+                    for ( u32 i=0; i < ObjectCount; i++ )
+                    {
+                        if ( aObjects[ i ].pParent == pRemoved )
+                        {
+                            aObjects[ i ].pParent = NULL;
+                            Touched.insert( &aObjects[ i ] );
+                        }
+                    }
+                    Touched.erase( pRemoved );
+                }
+            }
+        }
+
+        u32 Posted = Observer.Count;
+        Hierarchy.Update( (Frame & 1) ? &TaskManager : NULL );
+
+        //
+        // The changed objects are the touched subtrees, each once, parents first.
+        //
+        const TransformHierarchy::ObjectArray& apChanged = Hierarchy.GetChangedObjects();
+        std::set<IGeometryObject*> Changed;
+        for ( size_t i=0; i < apChanged.size(); i++ )
+        {
+            TestObject* pObject = static_cast<TestObject*>(apChanged[ i ]);
+            CHECK( Changed.insert( pObject ).second );
+            CHECK( pObject->pParent == NULL || !IsBelow( pObject->pParent, Touched ) ||
+                   Changed.count( pObject->pParent ) != 0 );
+        }
+
+        u32 Expected = 0;
+        for ( u32 i=0; i < ObjectCount; i++ )
+        {
+            TestObject* pObject = &aObjects[ i ];
+            if ( pObject->bRemoved )
+            {
+                CHECK( Hierarchy.GetWorldTransform( pObject ) == NULL );
+                CHECK( Changed.count( pObject ) == 0 );
+                continue;
+            }
+
+            Bool bExpected = IsBelow( pObject, Touched );
+            Expected += bExpected ? 1 : 0;
+            CHECK( (Changed.count( pObject ) != 0) == bExpected );
+            CHECK( Hierarchy.GetParent( pObject ) == pObject->pParent );
+            CHECK( IsWorldRight( Hierarchy, pObject ) );
+        }
+        CHECK( apChanged.size() == Expected );
+        CHECK( Observer.Count == Posted + (Expected > 0 ? 1 : 0) );
+    }
+
+    //
+    // With nothing queued nothing changes.
+    //
+    u32 Posted = Observer.Count;
+    Hierarchy.Update( &TaskManager );
+    CHECK( Hierarchy.GetChangedObjects().empty() );
+    CHECK( Observer.Count == Posted );
+
+    Hierarchy.Detach( &Observer );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// TransformHierarchyBreaksCycles - A cycle of links is broken by making one of its objects a
+//  root, leaving the links into and out of the cycle as they were
+TEST( TransformHierarchyBreaksCycles )
+{
+    std::mt19937 Random( 5 );
+
+    TransformHierarchy Hierarchy;
+
+    TestObject aObjects[ 8 ];
+    for ( u32 i=0; i < 8; i++ )
+    {
+        Randomize( aObjects[ i ], Random );
+        aObjects[ i ].Attach( &Hierarchy, System::Changes::Geometry::All, 0 );
+    }
+
+    //
+    // Two objects linked to each other, with one hanging off the cycle, next to a tree.
+    //
+    TestObject* pA = &aObjects[ 0 ];
+    TestObject* pB = &aObjects[ 1 ];
+    TestObject* pHanging = &aObjects[ 2 ];
+    TestObject* pRoot = &aObjects[ 3 ];
+    TestObject* pLeaf = &aObjects[ 4 ];
+    Hierarchy.SetParent( pHanging, pB );
+    Hierarchy.SetParent( pA, pB );
+    Hierarchy.SetParent( pB, pA );
+    Hierarchy.SetParent( pLeaf, pRoot );
+    Hierarchy.Update();
+
+    CHECK( (Hierarchy.GetParent( pA ) == NULL) != (Hierarchy.GetParent( pB ) == NULL) );
+    CHECK( Hierarchy.GetParent( pA ) == pB || Hierarchy.GetParent( pB ) == pA );
+    CHECK( Hierarchy.GetParent( pHanging ) == pB );
+    CHECK( Hierarchy.GetParent( pRoot ) == NULL );
+    CHECK( Hierarchy.GetParent( pLeaf ) == pRoot );
+
+    pA->pParent = static_cast<TestObject*>(Hierarchy.GetParent( pA ));
+    pB->pParent = static_cast<TestObject*>(Hierarchy.GetParent( pB ));
+    pHanging->pParent = pB;
+    pLeaf->pParent = pRoot;
+    for ( u32 i=0; i < 5; i++ )
+    {
+        CHECK( IsWorldRight( Hierarchy, &aObjects[ i ] ) );
+    }
+
+    //
+    // A chain closed into a cycle of three below a root the cycle no longer reaches.
+    //
+    TestObject* pTop = &aObjects[ 5 ];
+    TestObject* pX = &aObjects[ 6 ];
+    TestObject* pY = &aObjects[ 7 ];
+    Hierarchy.SetParent( pX, pTop );
+    Hierarchy.SetParent( pY, pX );
+    Hierarchy.SetParent( pTop, NULL );
+    Hierarchy.Update();
+    Hierarchy.SetParent( pX, pLeaf );
+    Hierarchy.SetParent( pLeaf, pY );
+    Hierarchy.Update();
+
+    TestObject* apCycle[ 3 ] = { pX, pY, pLeaf };
+    TestObject* apLinked[ 3 ] = { pLeaf, pX, pY };
+    u32 Roots = 0;
+    for ( u32 i=0; i < 3; i++ )
+    {
+        IGeometryObject* pParent = Hierarchy.GetParent( apCycle[ i ] );
+        CHECK( pParent == NULL || pParent == apLinked[ i ] );
+        Roots += (pParent == NULL) ? 1 : 0;
+        apCycle[ i ]->pParent = static_cast<TestObject*>(pParent);
+    }
+    CHECK( Roots == 1 );
+    CHECK( Hierarchy.GetParent( pRoot ) == NULL && Hierarchy.GetParent( pTop ) == NULL );
+
+    const TransformHierarchy::ObjectArray& apChanged = Hierarchy.GetChangedObjects();
+    CHECK( std::find( apChanged.begin(), apChanged.end(), pRoot ) == apChanged.end() );
+    CHECK( std::find( apChanged.begin(), apChanged.end(), pTop ) == apChanged.end() );
+    for ( u32 i=0; i < 8; i++ )
+    {
+        CHECK( IsWorldRight( Hierarchy, &aObjects[ i ] ) );
+    }
+}
@@ -0,0 +1,125 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+#include <math.h>
+#include <random>
+#include <vector>
+
+#include "TestHarness.h"
+#include "../../Interfaces/Services/VertexLayout.h"
+
+
+using namespace VertexDecl;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// VertexConverterRoundTrip - Floats packed to UByte4 and Color elements match the byte each
+//  should round to, copied and widened elements match exactly, missing elements are zero, and
+//  unpacking the result gets back the floats within half a step of the packing
+TEST( VertexConverterRoundTrip )
+{
+    // A count that is neither a multiple of the 4 vertices packed at once nor of a batch
+    const u32 Count = 1003;
+
+    const Element aSource[] =
+    {
+        { Type::Float3, Usage::Position, 0, 0 },
+        { Type::Float3, Usage::Normal,   0, 0 },
+        { Type::Float2, Usage::Texture,  0, 0 },
+        { Type::Float4, Usage::Diffuse,  0, 0 },
+    };
+    const Element aDest[] =
+    {
+        { Type::Float3, Usage::Position, 0, 0 },
+        { Type::UByte4, Usage::Normal,   0, 0 },
+        { Type::Color,  Usage::Diffuse,  0, 0 },
+        { Type::Float3, Usage::Texture,  0, 0 },
+        { Type::Float3, Usage::Tangent,  0, 0 },
+    };
+
+    VertexLayout Source( aSource, 4 );
+    VertexLayout Dest( aDest, 5 );
+    VertexConverter Pack( Dest, 0, Source, 0 );
+    VertexConverter Unpack( Source, 0, Dest, 0 );
+
+    CHECK( VertexConverter( Source, 0, Source, 0 ).IsCopy() );
+    CHECK( !Pack.IsCopy() );
+    CHECK( Source.GetStride() == 48 && Dest.GetStride() == 44 );
+
+    //
+    // Normals are in -1 to 1, the diffuse colors in 0 to 1.
+    //
+    std::mt19937 Random( 3 );
+    std::uniform_real_distribution<f32> Unit( -1.0f, 1.0f );
+
+    std::vector<f32> aVertices( Count * 12 );
+    for ( u32 i=0; i < Count * 12; i++ )
+    {
+        aVertices[ i ] = ((i % 12) >= 8) ? fabsf( Unit( Random ) ) : Unit( Random );
+    }
+
+    std::vector<u8> aPacked( Count * Dest.GetStride() );
+    Pack.Convert( &aPacked[ 0 ], &aVertices[ 0 ], Count );
+
+    for ( u32 i=0; i < Count; i++ )
+    {
+        const f32* pSource = &aVertices[ i * 12 ];
+        const u8* pDest = &aPacked[ i * Dest.GetStride() ];
+        const f32* pPosition = reinterpret_cast<const f32*>(pDest);
+        const f32* pTexture = reinterpret_cast<const f32*>(pDest + 20);
+        const f32* pTangent = reinterpret_cast<const f32*>(pDest + 32);
+
+        CHECK( pPosition[ 0 ] == pSource[ 0 ] && pPosition[ 1 ] == pSource[ 1 ] &&
+               pPosition[ 2 ] == pSource[ 2 ] );
+
+        for ( u32 c=0; c < 3; c++ )
+        {
+            CHECK( pDest[ 12 + c ] == lrintf( pSource[ 3 + c ] * 127.5f + 127.5f ) );
+        }
+        CHECK( pDest[ 15 ] == 255 );
+
+        // Colors are stored blue, green, red, alpha
+        CHECK( pDest[ 16 ] == lrintf( pSource[ 10 ] * 255.0f ) );
+        CHECK( pDest[ 17 ] == lrintf( pSource[ 9 ] * 255.0f ) );
+        CHECK( pDest[ 18 ] == lrintf( pSource[ 8 ] * 255.0f ) );
+        CHECK( pDest[ 19 ] == lrintf( pSource[ 11 ] * 255.0f ) );
+
+        CHECK( pTexture[ 0 ] == pSource[ 6 ] && pTexture[ 1 ] == pSource[ 7 ] &&
+               pTexture[ 2 ] == 0.0f );
+        CHECK( pTangent[ 0 ] == 0.0f && pTangent[ 1 ] == 0.0f && pTangent[ 2 ] == 0.0f );
+    }
+
+    std::vector<f32> aUnpacked( Count * 12 );
+    Unpack.Convert( &aUnpacked[ 0 ], &aPacked[ 0 ], Count );
+
+    for ( u32 i=0; i < Count * 12; i++ )
+    {
+        u32 Component = i % 12;
+        f32 Error = fabsf( aUnpacked[ i ] - aVertices[ i ] );
+
+        if ( Component >= 3 && Component < 6 )
+        {
+            CHECK( Error <= 0.5f / 127.5f + 1e-6f );
+        }
+        else if ( Component >= 8 )
+        {
+            CHECK( Error <= 0.5f / 255.0f + 1e-6f );
+        }
+        else
+        {
+            CHECK( Error == 0.0f );
+        }
+    }
+}
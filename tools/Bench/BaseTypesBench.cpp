@@ -0,0 +1,547 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+//
+// BaseTypesBench - Microbenchmarks of the BaseTypes allocator, containers and math against the
+//  standard library and the SSE math.
+//
+// Usage: BaseTypesBench [-s Suite] [-r Repeats] [-t MaxThreads]
+//   -s Suite       Only run one suite: alloc, arraylist, list, tree, vector or matrix
+//   -r Repeats     Runs of each case; the fastest one is reported (default 5)
+//   -t MaxThreads  Largest thread count of the sweep (default the hardware threads)
+//
+// Every case runs at 16, 256, 4K and 64K elements on 1, 2, 4, ... threads.  Each thread works on
+// its own instance, so the thread sweep shows how an implementation holds up when several systems
+// use it at once: malloc and the std containers share the process heap while the BaseTypes
+// containers only touch their own UnitAllocator.  The BaseTypes containers are sized up front, as
+// the engine sizes them.
+//
+// One JSON object is printed per case, one per line:
+//   {"suite":"list","impl":"TList","size":4096,"threads":4,"ns_per_op":3.10,"mops":1290.32}
+// ns_per_op is the time of an operation on one thread and mops the millions of operations per
+// second summed over the threads.  An operation is one element of the case's work:
+//   alloc      Allocate and free a 32 byte block
+//   arraylist  Append an element, then read it back in a second pass
+//   list       Append an element, visit it and free it with Clear
+//   tree       Insert a key, then find it
+//   vector     Cross, normalize and dot a pair of vectors
+//   matrix     Multiply two 4x4 matrices
+//
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include "../../code/BaseTypes/Defines.h"
+#include "../../code/BaseTypes/DataTypes.h"
+#include "../../code/BaseTypes/Errors.h"
+#include "../../code/BaseTypes/Assert.h"
+#include "../../code/BaseTypes/UnitAllocator.h"
+#include "../../code/BaseTypes/ArrayList.h"
+#include "../../code/BaseTypes/List.h"
+#include "../../code/BaseTypes/RedBlackTree.h"
+#include "../../code/BaseTypes/Math.h"
+#include "../../code/BaseTypes/MathX.h"
+
+using namespace Math;
+
+
+// Elements each thread processes per run, whatever the size
+static const u32 s_OpsPerRun = 1 << 20;
+
+static const u32 s_aSizes[] = { 16, 256, 4 * 1024, 64 * 1024 };
+
+static const u32 s_AllocSize = 32;
+
+// Keeps the results of the runs alive so the work is not optimized away
+static std::atomic<u64> s_Sink( 0 );
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Key - Spreads the indices over u32 without repeating a key
+static inline u32 Key( u32 Index )
+{
+    return Index * 2654435761u;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Allocator cases
+static u64 AllocUnitAllocator( u32 Size, u32 Iterations )
+{
+    UnitAllocator Allocator;
+    Allocator.Initialize( s_AllocSize, Size, Size );
+
+    std::vector<u8*> aBlocks( Size );
+    u64 Sum = 0;
+
+    for( u32 Iteration = 0; Iteration < Iterations; Iteration++ )
+    {
+        for( u32 i = 0; i < Size; i++ )
+        {
+            aBlocks[ i ] = Allocator.Allocate();
+            aBlocks[ i ][ s_AllocSize - 1 ] = static_cast<u8>(i);
+        }
+        for( u32 i = 0; i < Size; i++ )
+        {
+            Sum += aBlocks[ i ][ s_AllocSize - 1 ];
+            Allocator.Deallocate( aBlocks[ i ] );
+        }
+    }
+
+    return Sum;
+}
+
+static u64 AllocMalloc( u32 Size, u32 Iterations )
+{
+    std::vector<u8*> aBlocks( Size );
+    u64 Sum = 0;
+
+    for( u32 Iteration = 0; Iteration < Iterations; Iteration++ )
+    {
+        for( u32 i = 0; i < Size; i++ )
+        {
+            aBlocks[ i ] = static_cast<u8*>(malloc( s_AllocSize ));
+            aBlocks[ i ][ s_AllocSize - 1 ] = static_cast<u8>(i);
+        }
+        for( u32 i = 0; i < Size; i++ )
+        {
+            Sum += aBlocks[ i ][ s_AllocSize - 1 ];
+            free( aBlocks[ i ] );
+        }
+    }
+
+    return Sum;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Array cases
+static u64 ArrayListTArrayList( u32 Size, u32 Iterations )
+{
+    u64 Sum = 0;
+
+    for( u32 Iteration = 0; Iteration < Iterations; Iteration++ )
+    {
+        TArrayList<u32> Array( Size );
+        for( u32 i = 0; i < Size; i++ )
+        {
+            Array.PushBack( i );
+        }
+        for( u32 i = 0; i < Array.Size(); i++ )
+        {
+            Sum += Array.GetAt( i );
+        }
+    }
+
+    return Sum;
+}
+
+static u64 ArrayListVector( u32 Size, u32 Iterations )
+{
+    u64 Sum = 0;
+
+    for( u32 Iteration = 0; Iteration < Iterations; Iteration++ )
+    {
+        // Sized up front like the TArrayList, so only the container overhead is compared
+        std::vector<u32> Array;
+        Array.reserve( Size );
+        for( u32 i = 0; i < Size; i++ )
+        {
+            Array.push_back( i );
+        }
+        for( u32 i = 0; i < Array.size(); i++ )
+        {
+            Sum += Array[ i ];
+        }
+    }
+
+    return Sum;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// List cases
+static u64 ListTList( u32 Size, u32 Iterations )
+{
+    TList<u32> List( Size, Size );
+    u64 Sum = 0;
+
+    for( u32 Iteration = 0; Iteration < Iterations; Iteration++ )
+    {
+        for( u32 i = 0; i < Size; i++ )
+        {
+            List.PushBack( i );
+        }
+        for( TList<u32>::Iterator It = List.Begin(); It != List.End(); ++It )
+        {
+            Sum += *It;
+        }
+        List.Clear();
+    }
+
+    return Sum;
+}
+
+static u64 ListStdList( u32 Size, u32 Iterations )
+{
+    std::list<u32> List;
+    u64 Sum = 0;
+
+    for( u32 Iteration = 0; Iteration < Iterations; Iteration++ )
+    {
+        for( u32 i = 0; i < Size; i++ )
+        {
+            List.push_back( i );
+        }
+        for( std::list<u32>::const_iterator It = List.begin(); It != List.end(); ++It )
+        {
+            Sum += *It;
+        }
+        List.clear();
+    }
+
+    return Sum;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Tree cases
+struct TreeItem
+{
+    TreeItem( u32 InKey = 0, u32 InValue = 0 )
+        : Key( InKey )
+        , Value( InValue )
+    {
+    }
+
+    u32 Key;
+    u32 Value;
+};
+
+struct TreeCompare
+{
+    i16 operator()( const TreeItem& a, const TreeItem& b ) const
+    {
+        return (a.Key < b.Key) ? -1 : (a.Key > b.Key) ? 1 : 0;
+    }
+
+    i16 operator()( const TreeItem& a, u32 b ) const
+    {
+        return (a.Key < b) ? -1 : (a.Key > b) ? 1 : 0;
+    }
+};
+
+static u64 TreeTRedBlackTree( u32 Size, u32 Iterations )
+{
+    u64 Sum = 0;
+
+    for( u32 Iteration = 0; Iteration < Iterations; Iteration++ )
+    {
+        // One more unit for the sentinel
+        TRedBlackTree<TreeItem, u32, TreeCompare> Tree( Size + 1, Size );
+        for( u32 i = 0; i < Size; i++ )
+        {
+            Tree.insert( TreeItem( Key( i ), i ) );
+        }
+        for( u32 i = 0; i < Size; i++ )
+        {
+            u32 Find = Key( i );
+            Sum += Tree.find( Find ) ? 1 : 0;
+        }
+    }
+
+    return Sum;
+}
+
+static u64 TreeStdMap( u32 Size, u32 Iterations )
+{
+    u64 Sum = 0;
+
+    for( u32 Iteration = 0; Iteration < Iterations; Iteration++ )
+    {
+        std::map<u32, u32> Tree;
+        for( u32 i = 0; i < Size; i++ )
+        {
+            Tree.insert( std::make_pair( Key( i ), i ) );
+        }
+        for( u32 i = 0; i < Size; i++ )
+        {
+            Sum += (Tree.find( Key( i ) ) != Tree.end()) ? 1 : 0;
+        }
+    }
+
+    return Sum;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Math cases
+static f32 Coordinate( u32 Index, u32 Axis )
+{
+    return static_cast<f32>((Key( Index * 3 + Axis ) >> 8) & 0xFFFF) / 65536.0f + 0.5f;
+}
+
+static u64 VectorMath( u32 Size, u32 Iterations )
+{
+    std::vector<Vector3> a, b;
+    for( u32 i = 0; i < Size; i++ )
+    {
+        a.push_back( Vector3( Coordinate( i, 0 ), Coordinate( i, 1 ), Coordinate( i, 2 ) ) );
+        b.push_back( Vector3( Coordinate( i, 2 ), Coordinate( i, 0 ), Coordinate( i, 1 ) ) );
+    }
+
+    f32 Sum = 0.0f;
+    for( u32 Iteration = 0; Iteration < Iterations; Iteration++ )
+    {
+        for( u32 i = 0; i < Size; i++ )
+        {
+            Vector3 r = a[ i ].Cross( b[ i ] );
+            r.Normalize();
+            Sum += r.Dot( a[ i ] );
+        }
+    }
+
+    return static_cast<u64>(Sum);
+}
+
+static u64 VectorMathX( u32 Size, u32 Iterations )
+{
+    std::vector<XVector3> a, b;
+    for( u32 i = 0; i < Size; i++ )
+    {
+        a.push_back( XVector3( Coordinate( i, 0 ), Coordinate( i, 1 ), Coordinate( i, 2 ) ) );
+        b.push_back( XVector3( Coordinate( i, 2 ), Coordinate( i, 0 ), Coordinate( i, 1 ) ) );
+    }
+
+    f32 Sum = 0.0f;
+    for( u32 Iteration = 0; Iteration < Iterations; Iteration++ )
+    {
+        for( u32 i = 0; i < Size; i++ )
+        {
+            XVector3 r = a[ i ].Cross( b[ i ] );
+            r.Normalize();
+            Sum += r.Dot( a[ i ] );
+        }
+    }
+
+    return static_cast<u64>(Sum);
+}
+
+static u64 MatrixMath( u32 Size, u32 Iterations )
+{
+    std::vector<Matrix4x4> a( Size, Matrix4x4::Identity );
+    std::vector<Matrix4x4> r( Size );
+    Matrix4x4 b = Matrix4x4::Identity;
+    b.SetTranslation( Vector3( 1.0f, 2.0f, 3.0f ) );
+    for( u32 i = 0; i < Size; i++ )
+    {
+        a[ i ].SetTranslation( Vector3( Coordinate( i, 0 ), Coordinate( i, 1 ), Coordinate( i, 2 ) ) );
+    }
+
+    f32 Sum = 0.0f;
+    for( u32 Iteration = 0; Iteration < Iterations; Iteration++ )
+    {
+        for( u32 i = 0; i < Size; i++ )
+        {
+            r[ i ] = a[ i ] * b;
+        }
+        Sum += r[ Iteration % Size ].GetTranslation().x;
+    }
+
+    return static_cast<u64>(Sum);
+}
+
+static u64 MatrixMathX( u32 Size, u32 Iterations )
+{
+    std::vector<XMatrix4x4> a( Size, XMatrix4x4::Identity );
+    std::vector<XMatrix4x4> r( Size );
+    XMatrix4x4 b = XMatrix4x4::Identity;
+    b.SetTranslation( XVector3( 1.0f, 2.0f, 3.0f ) );
+    for( u32 i = 0; i < Size; i++ )
+    {
+        a[ i ].SetTranslation( XVector3( Coordinate( i, 0 ), Coordinate( i, 1 ), Coordinate( i, 2 ) ) );
+    }
+
+    f32 Sum = 0.0f;
+    for( u32 Iteration = 0; Iteration < Iterations; Iteration++ )
+    {
+        for( u32 i = 0; i < Size; i++ )
+        {
+            r[ i ] = a[ i ] * b;
+        }
+        XVector3 Translation;
+        Sum += r[ Iteration % Size ].GetTranslation( Translation ).GetX();
+    }
+
+    return static_cast<u64>(Sum);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// The cases, BaseTypes first in each suite
+typedef u64 (*BenchFn)( u32 Size, u32 Iterations );
+
+struct Case
+{
+    pcstr pszSuite;
+    pcstr pszImpl;
+    BenchFn pfnRun;
+};
+
+static const Case s_aCases[] =
+{
+    { "alloc",      "UnitAllocator",    AllocUnitAllocator },
+    { "alloc",      "malloc",           AllocMalloc },
+    { "arraylist",  "TArrayList",       ArrayListTArrayList },
+    { "arraylist",  "std::vector",      ArrayListVector },
+    { "list",       "TList",            ListTList },
+    { "list",       "std::list",        ListStdList },
+    { "tree",       "TRedBlackTree",    TreeTRedBlackTree },
+    { "tree",       "std::map",         TreeStdMap },
+    { "vector",     "Math",             VectorMath },
+    { "vector",     "MathX",            VectorMathX },
+    { "matrix",     "Math",             MatrixMath },
+    { "matrix",     "MathX",            MatrixMathX },
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// RunCase - Times one run of a case on Threads threads, returning the wall time in seconds
+static f64 RunCase( const Case& Bench, u32 Size, u32 Iterations, u32 Threads )
+{
+    std::atomic<u32> Ready( 0 );
+    std::atomic<u32> bGo( 0 );
+    std::vector<std::thread> aThreads;
+
+    for( u32 i = 0; i < Threads; i++ )
+    {
+        aThreads.push_back( std::thread( [&]()
+        {
+            Ready++;
+            while( bGo.load() == 0 )
+            {
+            }
+            s_Sink += Bench.pfnRun( Size, Iterations );
+        } ) );
+    }
+
+    // Start every thread at once so thread creation is not timed
+    while( Ready.load() != Threads )
+    {
+    }
+    std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+    bGo = 1;
+
+    for( u32 i = 0; i < Threads; i++ )
+    {
+        aThreads[ i ].join();
+    }
+
+    return std::chrono::duration<f64>( std::chrono::steady_clock::now() - Start ).count();
+}
+
+
+int main( int argc, char** argv )
+{
+    const char* pszSuite = NULL;
+    u32 Repeats = 5;
+    u32 MaxThreads = std::thread::hardware_concurrency();
+    int Option;
+
+    while( (Option = getopt( argc, argv, "s:r:t:" )) != -1 )
+    {
+        switch( Option )
+        {
+        case 's':
+            pszSuite = optarg;
+            break;
+
+        case 'r':
+            Repeats = static_cast<u32>(atoi( optarg ));
+            break;
+
+        case 't':
+            MaxThreads = static_cast<u32>(atoi( optarg ));
+            break;
+
+        default:
+            fprintf( stderr, "Usage: %s [-s Suite] [-r Repeats] [-t MaxThreads]\n", argv[ 0 ] );
+            return 1;
+        }
+    }
+
+    Repeats = (Repeats > 0) ? Repeats : 1;
+    MaxThreads = (MaxThreads > 0) ? MaxThreads : 1;
+
+    // 1, 2, 4, ... and then the largest count
+    std::vector<u32> aThreadCounts;
+    for( u32 Threads = 1; Threads < MaxThreads; Threads *= 2 )
+    {
+        aThreadCounts.push_back( Threads );
+    }
+    aThreadCounts.push_back( MaxThreads );
+
+    Bool bFound = False;
+    for( u32 c = 0; c < sizeof( s_aCases ) / sizeof( s_aCases[ 0 ] ); c++ )
+    {
+        const Case& Bench = s_aCases[ c ];
+        if( pszSuite != NULL && strcmp( pszSuite, Bench.pszSuite ) != 0 )
+        {
+            continue;
+        }
+        bFound = True;
+
+        for( u32 s = 0; s < sizeof( s_aSizes ) / sizeof( s_aSizes[ 0 ] ); s++ )
+        {
+            u32 Size = s_aSizes[ s ];
+            u32 Iterations = (s_OpsPerRun > Size) ? s_OpsPerRun / Size : 1;
+
+            for( size_t t = 0; t < aThreadCounts.size(); t++ )
+            {
+                u32 Threads = aThreadCounts[ t ];
+
+                f64 Best = RunCase( Bench, Size, Iterations, Threads );
+                for( u32 r = 1; r < Repeats; r++ )
+                {
+                    f64 Seconds = RunCase( Bench, Size, Iterations, Threads );
+                    Best = (Seconds < Best) ? Seconds : Best;
+                }
+
+                f64 Ops = static_cast<f64>(Size) * Iterations;
+                printf( "{\"suite\":\"%s\",\"impl\":\"%s\",\"size\":%u,\"threads\":%u,"
+                        "\"ns_per_op\":%.2f,\"mops\":%.2f}\n",
+                        Bench.pszSuite, Bench.pszImpl, Size, Threads,
+                        Best * 1e9 / Ops, Ops * Threads / Best * 1e-6 );
+                fflush( stdout );
+            }
+        }
+    }
+
+    if( !bFound )
+    {
+        fprintf( stderr, "Unknown suite %s\n", pszSuite );
+        return 1;
+    }
+
+    return 0;
+}
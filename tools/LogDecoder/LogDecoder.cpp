@@ -0,0 +1,381 @@
+// Copyright  2008-2009 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+//
+// LogDecoder - Turns a binary log (Debug.bin) back into text.
+//
+// Usage: LogDecoder [-t] [-s System] Debug.bin
+//   -t         Prefix every message with its time in seconds and its thread index
+//   -s System  Only decode one system's messages, as they would appear in Debug_<System>.log
+//
+// Without -s the output matches Debug.log: messages from systems are prefixed with [System].
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../../code/BaseTypes/Defines.h"
+#include "../../code/BaseTypes/DataTypes.h"
+#include "../../code/BaseTypes/LogFormat.h"
+
+using namespace Debug::LogFormat;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ArgReader - Reads the raw arguments of a message with bounds checks
+class ArgReader
+{
+public:
+
+    ArgReader( const u8* pData, const u8* pEnd )
+        : m_pData( pData )
+        , m_pEnd( pEnd )
+    {
+    }
+
+    template <typename T>
+    Bool Read( T& Value )
+    {
+        if( m_pData + sizeof( T ) > m_pEnd )
+        {
+            return False;
+        }
+        memcpy( &Value, m_pData, sizeof( T ) );
+        m_pData += sizeof( T );
+        return True;
+    }
+
+    Bool ReadString( std::string& Value )
+    {
+        u16 Length;
+        if( !Read( Length ) || m_pData + Length > m_pEnd )
+        {
+            return False;
+        }
+        Value.assign( reinterpret_cast<const char*>(m_pData), Length );
+        m_pData += Length;
+        return True;
+    }
+
+protected:
+
+    const u8* m_pData;
+    const u8* m_pEnd;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// FormatOne - Formats a single conversion with its '*' arguments
+template <typename T>
+static void FormatOne( std::string& Text, const std::string& Spec, const i32* pStars, u32 StarCount, T Value )
+{
+    char Buffer[ 4096 ];
+    int Length;
+
+    switch( StarCount )
+    {
+    case 0:
+        Length = snprintf( Buffer, sizeof( Buffer ), Spec.c_str(), Value );
+        break;
+
+    case 1:
+        Length = snprintf( Buffer, sizeof( Buffer ), Spec.c_str(), pStars[ 0 ], Value );
+        break;
+
+    default:
+        Length = snprintf( Buffer, sizeof( Buffer ), Spec.c_str(), pStars[ 0 ], pStars[ 1 ], Value );
+        break;
+    }
+
+    if( Length > 0 )
+    {
+        Text.append( Buffer, (Length < static_cast<int>(sizeof( Buffer ))) ? Length : sizeof( Buffer ) - 1 );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Decode - Rebuilds the text of a message from its format and arguments
+static Bool Decode( std::string& Text, const std::string& Format, ArgReader& Args )
+{
+    Conversion Spec;
+    const char* pCursor = Format.c_str();
+    const char* pLiteral = pCursor;
+
+    while( NextConversion( pCursor, Spec ) )
+    {
+        Text.append( pLiteral, Spec.pStart );
+        pLiteral = pCursor;
+
+        if( Spec.Arg == ArgKind::e_None )
+        {
+            Text += '%';
+            continue;
+        }
+
+        i32 aStars[ 2 ] = { 0, 0 };
+        for( u32 Star = 0; Star < Spec.StarCount; Star++ )
+        {
+            if( !Args.Read( aStars[ Star ] ) )
+            {
+                return False;
+            }
+        }
+
+        // Rebuild the conversion with a length modifier matching the stored size
+        std::string Conversion( Spec.pStart, Spec.pModifier );
+        if( Spec.Arg == ArgKind::e_Int64 )
+        {
+            Conversion += "ll";
+        }
+        else if( Spec.Arg == ArgKind::e_Int32 && *Spec.pModifier == 'h' )
+        {
+            Conversion.append( Spec.pModifier, Spec.pType );
+        }
+        Conversion += *Spec.pType;
+
+        switch( Spec.Arg )
+        {
+        case ArgKind::e_Int32:
+        {
+            i32 Value;
+            if( !Args.Read( Value ) )
+            {
+                return False;
+            }
+            FormatOne( Text, Conversion, aStars, Spec.StarCount, Value );
+            break;
+        }
+
+        case ArgKind::e_Int64:
+        {
+            i64 Value;
+            if( !Args.Read( Value ) )
+            {
+                return False;
+            }
+            FormatOne( Text, Conversion, aStars, Spec.StarCount, Value );
+            break;
+        }
+
+        case ArgKind::e_Double:
+        {
+            f64 Value;
+            if( !Args.Read( Value ) )
+            {
+                return False;
+            }
+            FormatOne( Text, Conversion, aStars, Spec.StarCount, Value );
+            break;
+        }
+
+        case ArgKind::e_Pointer:
+        {
+            u64 Value;
+            if( !Args.Read( Value ) )
+            {
+                return False;
+            }
+            FormatOne( Text, Conversion, aStars, Spec.StarCount, reinterpret_cast<void*>(static_cast<size_t>(Value)) );
+            break;
+        }
+
+        case ArgKind::e_String:
+        {
+            std::string Value;
+            if( !Args.ReadString( Value ) )
+            {
+                return False;
+            }
+            FormatOne( Text, Conversion, aStars, Spec.StarCount, Value.c_str() );
+            break;
+        }
+
+        default:
+            // The logger never defers these, so the format is not one it wrote
+            return False;
+        }
+    }
+
+    Text.append( pLiteral, pCursor );
+    return True;
+}
+
+
+int main( int argc, char** argv )
+{
+    Bool bTimes = False;
+    const char* pszSystem = NULL;
+    int Option;
+
+    while( (Option = getopt( argc, argv, "ts:" )) != -1 )
+    {
+        switch( Option )
+        {
+        case 't':
+            bTimes = True;
+            break;
+
+        case 's':
+            pszSystem = optarg;
+            break;
+
+        default:
+            fprintf( stderr, "Usage: %s [-t] [-s System] Debug.bin\n", argv[ 0 ] );
+            return 1;
+        }
+    }
+
+    if( optind >= argc )
+    {
+        fprintf( stderr, "Usage: %s [-t] [-s System] Debug.bin\n", argv[ 0 ] );
+        return 1;
+    }
+
+    //
+    // Read the whole log.
+    //
+    FILE* pFile = fopen( argv[ optind ], "rb" );
+    if( pFile == NULL )
+    {
+        fprintf( stderr, "Unable to open %s\n", argv[ optind ] );
+        return 1;
+    }
+
+    std::vector<u8> Data;
+    u8 Chunk[ 64 * 1024 ];
+    size_t Read;
+    while( (Read = fread( Chunk, 1, sizeof( Chunk ), pFile )) > 0 )
+    {
+        Data.insert( Data.end(), Chunk, Chunk + Read );
+    }
+    fclose( pFile );
+
+    FileHeader Header;
+    if( Data.size() < sizeof( Header ) ||
+        (memcpy( &Header, &Data[ 0 ], sizeof( Header ) ), Header.Magic != Magic) ||
+        Header.Version != Version )
+    {
+        fprintf( stderr, "%s is not a binary log\n", argv[ optind ] );
+        return 1;
+    }
+
+    //
+    // Decode the records in order; formats and names always precede their use.
+    //
+    std::map<u32, std::string> Formats;
+    std::map<u32, std::string> Names;
+    Bool bFirst = True;
+    u64 StartTime = 0;
+    size_t Offset = sizeof( Header );
+
+    while( Offset + sizeof( RecordHeader ) <= Data.size() )
+    {
+        RecordHeader Record;
+        memcpy( &Record, &Data[ Offset ], sizeof( Record ) );
+
+        if( Record.Size < sizeof( Record ) || Record.Size > Data.size() - Offset ||
+            Record.Length > Record.Size - sizeof( Record ) )
+        {
+            fprintf( stderr, "Corrupt record at offset %lu\n", static_cast<unsigned long>(Offset) );
+            return 1;
+        }
+
+        const u8* pPayload = &Data[ Offset + sizeof( Record ) ];
+        const u8* pEnd = pPayload + Record.Length;
+        Offset += Record.Size;
+
+        switch( Record.Kind )
+        {
+        case RecordKind::e_TypeName:
+            Names[ Record.Type ].assign( reinterpret_cast<const char*>(pPayload),
+                                         strnlen( reinterpret_cast<const char*>(pPayload), Record.Length ) );
+            break;
+
+        case RecordKind::e_Format:
+        {
+            FormatHeader Format;
+            if( Record.Length >= sizeof( Format ) )
+            {
+                memcpy( &Format, pPayload, sizeof( Format ) );
+                const char* pszFormat = reinterpret_cast<const char*>(pPayload + sizeof( Format ));
+                Formats[ Format.FormatId ].assign( pszFormat, strnlen( pszFormat, pEnd - reinterpret_cast<const u8*>(pszFormat) ) );
+            }
+            break;
+        }
+
+        case RecordKind::e_Binary:
+        {
+            const std::string& Name = Names[ Record.Type ];
+            if( pszSystem != NULL && Name != pszSystem )
+            {
+                break;
+            }
+
+            MessageHeader Message;
+            if( Record.Length < sizeof( Message ) )
+            {
+                break;
+            }
+            memcpy( &Message, pPayload, sizeof( Message ) );
+
+            std::map<u32, std::string>::const_iterator it = Formats.find( Message.FormatId );
+            if( it == Formats.end() )
+            {
+                fprintf( stderr, "Message uses unknown format %u\n", Message.FormatId );
+                break;
+            }
+
+            std::string Text;
+            if( bTimes )
+            {
+                u64 Time = (static_cast<u64>(Message.TimeHigh) << 32) | Message.TimeLow;
+                if( bFirst )
+                {
+                    StartTime = Time;
+                    bFirst = False;
+                }
+
+                // Thread buffers are drained in turn, so messages can be earlier than the first
+                char Prefix[ 64 ];
+                snprintf( Prefix, sizeof( Prefix ), "%12.6f T%-3u ",
+                          static_cast<i64>(Time - StartTime) * 1e-9, Message.ThreadIndex );
+                Text = Prefix;
+            }
+            if( pszSystem == NULL && !Name.empty() )
+            {
+                Text += "[" + Name + "] ";
+            }
+
+            ArgReader Args( pPayload + sizeof( Message ), pEnd );
+            if( !Decode( Text, it->second, Args ) )
+            {
+                Text += "<truncated arguments>\n";
+            }
+            fwrite( Text.data(), 1, Text.size(), stdout );
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+
+    return 0;
+}